@@ -30,6 +30,14 @@
 
 #include <hpd-0.6/hpd_types.h>
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 extern hpd_module_def_t hpd_log;
 
+#ifdef __cplusplus
+}
+#endif
+
 #endif //HPD_LOG_H
@@ -30,6 +30,10 @@
 #include <hpd-0.6/modules/hpd_log.h>
 #include <hpd-0.6/hpd_application_api.h>
 #include <hpd-0.6/common/hpd_common.h>
+#include "hpd_log_binary.h"
+
+#define LOG_BINARY_SIZE_DEFAULT (4 << 20)
+#define LOG_BINARY_SIZE_MIN (64 << 10)
 
 static hpd_error_t log_on_create(void **data, const hpd_module_t *context);
 static hpd_error_t log_on_destroy(void *data);
@@ -51,6 +55,9 @@ struct log {
     const hpd_module_t *context;
     char *fn;
     FILE *file;
+    hpd_bool_t binary;
+    size_t size;
+    log_binary_t bin;
     hpd_listener_t *listener;
 };
 
@@ -67,6 +74,12 @@ static void log_on_log(void *data, const char *msg)
     }
 }
 
+static void log_on_log_record(void *data, const hpd_log_record_t *record)
+{
+    log_t *log = data;
+    log_binary_write(&log->bin, record);
+}
+
 static hpd_error_t log_on_create(void **data, const hpd_module_t *context)
 {
     hpd_error_t rc;
@@ -75,10 +88,15 @@ static hpd_error_t log_on_create(void **data, const hpd_module_t *context)
 
     if ((rc = hpd_module_add_option(context, "file", "file", 0, "Append all log messages to file")))
         return rc;
+    if ((rc = hpd_module_add_option(context, "binary", NULL, 0, "Write file in binary form, rotated when full, read it with hpd-log-decode")))
+        return rc;
+    if ((rc = hpd_module_add_option(context, "size", "bytes", 0, "Size of a binary file before it is rotated (default: 4194304)")))
+        return rc;
 
     log_t *log;
     HPD_CALLOC(log, 1, log_t);
     log->context = context;
+    log->size = LOG_BINARY_SIZE_DEFAULT;
 
     (*data) = log;
     return HPD_E_SUCCESS;
@@ -100,7 +118,18 @@ static hpd_error_t log_on_start(void *data)
     hpd_error_t rc, rc2;
     log_t *log = data;
 
-    if (log->fn) {
+    if (log->binary && !log->fn) HPD_LOG_RETURN(log->context, HPD_E_ARGUMENT, "Binary mode requires a file");
+
+    if (log->fn && log->binary) {
+        if ((rc = log_binary_open(&log->bin, log->context, log->fn, log->size))) return rc;
+
+        if ((rc = hpd_listener_alloc(&log->listener, log->context))) goto error_binary_close;
+        if ((rc = hpd_listener_set_log_record_callback(log->listener, log_on_log_record))) goto error_binary_free;
+        if ((rc = hpd_listener_set_data(log->listener, log, NULL))) goto error_binary_free;
+        if ((rc = hpd_subscribe(log->listener))) goto error_binary_free;
+
+        HPD_LOG_INFO(log->context, "Logging to binary file '%s'...", log->fn);
+    } else if (log->fn) {
         log->file = fopen(log->fn, "a");
         if (!log->file) HPD_LOG_RETURN(log->context, HPD_E_UNKNOWN, "Failed to open file '%s' for writing", log->fn);
 
@@ -119,6 +148,16 @@ static hpd_error_t log_on_start(void *data)
 
     error_close:
     fclose(log->file);
+    log->file = NULL;
+    log->listener = NULL;
+    return rc;
+
+    error_binary_free:
+    if ((rc2 = hpd_listener_free(log->listener))) HPD_LOG_ERROR(log->context, "Free failed [code: %d]", rc2);
+
+    error_binary_close:
+    log_binary_close(&log->bin);
+    log->listener = NULL;
     return rc;
 }
 
@@ -128,8 +167,15 @@ static hpd_error_t log_on_stop(void *data)
     log_t *log = data;
 
     if (log->file) {
-        if (!fclose(log->file)) HPD_LOG_RETURN(log->context, HPD_E_UNKNOWN, "Failed to close file '%s'", log->fn);
+        // Unsubscribe first, the listener is called from the log writer thread until then
+        if ((rc = hpd_listener_free(log->listener))) return rc;
+        log->listener = NULL;
+        if (fclose(log->file)) HPD_LOG_RETURN(log->context, HPD_E_UNKNOWN, "Failed to close file '%s'", log->fn);
+        log->file = NULL;
+    } else if (log->listener) {
         if ((rc = hpd_listener_free(log->listener))) return rc;
+        log->listener = NULL;
+        log_binary_close(&log->bin);
     }
 
     return HPD_E_SUCCESS;
@@ -142,6 +188,14 @@ static hpd_error_t log_on_parse_opt(void *data, const char *name, const char *ar
     if (strcmp(name, "file") == 0) {
         HPD_STR_CPY(log->fn, arg);
         return HPD_E_SUCCESS;
+    } else if (strcmp(name, "binary") == 0) {
+        log->binary = HPD_TRUE;
+        return HPD_E_SUCCESS;
+    } else if (strcmp(name, "size") == 0) {
+        long size = atol(arg);
+        if (size < LOG_BINARY_SIZE_MIN) return HPD_E_ARGUMENT;
+        log->size = (size_t) size;
+        return HPD_E_SUCCESS;
     }
 
     return HPD_E_ARGUMENT;
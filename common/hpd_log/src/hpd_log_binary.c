@@ -0,0 +1,277 @@
+/*
+ * Copyright 2011 Aalborg University. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are
+ * permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of
+ * conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list
+ * of conditions and the following disclaimer in the documentation and/or other materials
+ * provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY Aalborg University ''AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL Aalborg University OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are those of the
+ * authors and should not be interpreted as representing official policies, either expressed
+ */
+
+#include "hpd_log_binary.h"
+#include <hpd-0.6/hpd_shared_api.h>
+#include <hpd-0.6/common/hpd_common.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define LOG_BINARY_TABLE_MIN 64
+#define LOG_BINARY_ID_MAX UINT16_MAX
+
+static size_t log_binary_hash_str(const char *str)
+{
+    uint32_t hash = 2166136261u;
+    for (; *str; str++) {
+        hash ^= (unsigned char) *str;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static size_t log_binary_hash_site(const char *file, int line)
+{
+    return (((uintptr_t) file >> 3) * 2654435761u) ^ (size_t) line;
+}
+
+static void *log_binary_reserve(log_binary_t *bin, size_t size)
+{
+    size = LOG_BINARY_ALIGN(size);
+    if (bin->pos + size > bin->size) return NULL;
+    void *entry = &bin->map[bin->pos];
+    bin->pos += size;
+    return entry;
+}
+
+static void log_binary_tables_clear(log_binary_t *bin)
+{
+    for (size_t i = 0; i <= bin->strings_mask; i++) free(bin->strings[i].str);
+    memset(bin->strings, 0, (bin->strings_mask+1) * sizeof(log_binary_string_slot_t));
+    memset(bin->sites, 0, (bin->sites_mask+1) * sizeof(log_binary_site_slot_t));
+    bin->strings_count = 0;
+    bin->sites_count = 0;
+}
+
+static hpd_error_t log_binary_strings_grow(log_binary_t *bin)
+{
+    size_t mask = bin->strings_mask * 2 + 1;
+    log_binary_string_slot_t *strings = calloc(mask+1, sizeof(log_binary_string_slot_t));
+    if (!strings) return HPD_E_ALLOC;
+    for (size_t i = 0; i <= bin->strings_mask; i++) {
+        if (!bin->strings[i].str) continue;
+        size_t j = log_binary_hash_str(bin->strings[i].str) & mask;
+        while (strings[j].str) j = (j+1) & mask;
+        strings[j] = bin->strings[i];
+    }
+    free(bin->strings);
+    bin->strings = strings;
+    bin->strings_mask = mask;
+    return HPD_E_SUCCESS;
+}
+
+static hpd_error_t log_binary_sites_grow(log_binary_t *bin)
+{
+    size_t mask = bin->sites_mask * 2 + 1;
+    log_binary_site_slot_t *sites = calloc(mask+1, sizeof(log_binary_site_slot_t));
+    if (!sites) return HPD_E_ALLOC;
+    for (size_t i = 0; i <= bin->sites_mask; i++) {
+        if (!bin->sites[i].file) continue;
+        size_t j = log_binary_hash_site(bin->sites[i].file, bin->sites[i].line) & mask;
+        while (sites[j].file) j = (j+1) & mask;
+        sites[j] = bin->sites[i];
+    }
+    free(bin->sites);
+    bin->sites = sites;
+    bin->sites_mask = mask;
+    return HPD_E_SUCCESS;
+}
+
+/**
+ * Id of str in the current file, writing a string entry the first time it is seen. Returns -1 if the file is full.
+ */
+static int log_binary_string(log_binary_t *bin, const char *str)
+{
+    size_t i = log_binary_hash_str(str) & bin->strings_mask;
+    for (; bin->strings[i].str; i = (i+1) & bin->strings_mask)
+        if (strcmp(bin->strings[i].str, str) == 0) return bin->strings[i].id;
+
+    if (bin->strings_count >= LOG_BINARY_ID_MAX) return -1;
+    size_t len = strlen(str);
+    if (len > UINT16_MAX) len = UINT16_MAX;
+    char *copy = strdup(str);
+    if (!copy) return -1;
+    log_binary_string_t *entry = log_binary_reserve(bin, sizeof(log_binary_string_t) + len);
+    if (!entry) {
+        free(copy);
+        return -1;
+    }
+
+    uint16_t id = (uint16_t) bin->strings_count++;
+    entry->id = id;
+    entry->len = (uint16_t) len;
+    memcpy(&entry[1], str, len);
+    entry->type = LOG_BINARY_STRING;
+
+    bin->strings[i].str = copy;
+    bin->strings[i].id = id;
+    if (bin->strings_count * 2 > bin->strings_mask && log_binary_strings_grow(bin))
+        return -1;
+    return id;
+}
+
+/**
+ * Id of the file/line pair in the current file, writing a site entry the first time it is seen. Files are keyed on
+ * their pointer, as they are string literals from __FILE__. Returns -1 if the file is full.
+ */
+static int log_binary_site(log_binary_t *bin, const char *file, int line)
+{
+    size_t i = log_binary_hash_site(file, line) & bin->sites_mask;
+    for (; bin->sites[i].file; i = (i+1) & bin->sites_mask)
+        if (bin->sites[i].file == file && bin->sites[i].line == line) return bin->sites[i].id;
+
+    if (bin->sites_count >= LOG_BINARY_ID_MAX) return -1;
+    int file_id = log_binary_string(bin, file);
+    if (file_id < 0) return -1;
+    log_binary_site_t *entry = log_binary_reserve(bin, sizeof(log_binary_site_t));
+    if (!entry) return -1;
+
+    uint16_t id = (uint16_t) bin->sites_count++;
+    entry->id = id;
+    entry->file = (uint16_t) file_id;
+    entry->line = (uint32_t) line;
+    entry->type = LOG_BINARY_SITE;
+
+    bin->sites[i].file = file;
+    bin->sites[i].line = line;
+    bin->sites[i].id = id;
+    if (bin->sites_count * 2 > bin->sites_mask && log_binary_sites_grow(bin))
+        return -1;
+    return id;
+}
+
+static hpd_error_t log_binary_map(log_binary_t *bin)
+{
+    // Keep the previous file around, replacing the one before it
+    if (access(bin->fn, F_OK) == 0) {
+        size_t len = strlen(bin->fn) + 3;
+        char old[len];
+        snprintf(old, len, "%s.1", bin->fn);
+        if (rename(bin->fn, old))
+            HPD_LOG_RETURN(bin->context, HPD_E_UNKNOWN, "Failed to rotate '%s' to '%s'", bin->fn, old);
+    }
+
+    bin->fd = open(bin->fn, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (bin->fd < 0) HPD_LOG_RETURN(bin->context, HPD_E_UNKNOWN, "Failed to open file '%s' for writing", bin->fn);
+    if (ftruncate(bin->fd, (off_t) bin->size)) goto error;
+    bin->map = mmap(NULL, bin->size, PROT_READ | PROT_WRITE, MAP_SHARED, bin->fd, 0);
+    if (bin->map == MAP_FAILED) goto error;
+
+    log_binary_header_t *header = (log_binary_header_t *) bin->map;
+    memcpy(header->magic, LOG_BINARY_MAGIC, sizeof(header->magic));
+    header->byte_order = LOG_BINARY_BYTE_ORDER;
+    bin->pos = LOG_BINARY_ALIGN(sizeof(log_binary_header_t));
+    log_binary_tables_clear(bin);
+    return HPD_E_SUCCESS;
+
+    error:
+    bin->map = NULL;
+    close(bin->fd);
+    bin->fd = -1;
+    HPD_LOG_RETURN(bin->context, HPD_E_UNKNOWN, "Failed to map file '%s'", bin->fn);
+}
+
+static void log_binary_unmap(log_binary_t *bin)
+{
+    if (!bin->map) return;
+    munmap(bin->map, bin->size);
+    bin->map = NULL;
+    // Drop the unused, zeroed tail
+    if (ftruncate(bin->fd, (off_t) bin->pos))
+        HPD_LOG_WARN(bin->context, "Failed to truncate file '%s'", bin->fn);
+    close(bin->fd);
+    bin->fd = -1;
+}
+
+hpd_error_t log_binary_open(log_binary_t *bin, const hpd_module_t *context, const char *fn, size_t size)
+{
+    hpd_error_t rc;
+
+    memset(bin, 0, sizeof(log_binary_t));
+    bin->context = context;
+    bin->fd = -1;
+    bin->size = size;
+    bin->strings_mask = LOG_BINARY_TABLE_MIN-1;
+    bin->sites_mask = LOG_BINARY_TABLE_MIN-1;
+    HPD_STR_CPY(bin->fn, fn);
+    HPD_CALLOC(bin->strings, LOG_BINARY_TABLE_MIN, log_binary_string_slot_t);
+    HPD_CALLOC(bin->sites, LOG_BINARY_TABLE_MIN, log_binary_site_slot_t);
+
+    if ((rc = log_binary_map(bin))) goto error;
+    return HPD_E_SUCCESS;
+
+    alloc_error:
+    rc = HPD_E_ALLOC;
+    error:
+    free(bin->strings);
+    free(bin->sites);
+    free(bin->fn);
+    return rc;
+}
+
+hpd_error_t log_binary_close(log_binary_t *bin)
+{
+    log_binary_unmap(bin);
+    log_binary_tables_clear(bin);
+    free(bin->strings);
+    free(bin->sites);
+    free(bin->fn);
+    return HPD_E_SUCCESS;
+}
+
+void log_binary_write(log_binary_t *bin, const hpd_log_record_t *record)
+{
+    size_t len = record->len > UINT16_MAX ? UINT16_MAX : record->len;
+    const char *file = record->file ? record->file : "";
+
+    // A message that does not fit in the current file is written to a new one, along with the strings it refers to
+    for (int rotated = 0; bin->map; rotated = 1) {
+        int module = log_binary_string(bin, record->module);
+        int site = module < 0 ? -1 : log_binary_site(bin, file, record->line);
+        log_binary_message_t *entry = site < 0 ? NULL : log_binary_reserve(bin, sizeof(log_binary_message_t) + len);
+        if (entry) {
+            entry->level = (uint8_t) record->level;
+            entry->module = (uint16_t) module;
+            entry->site = (uint16_t) site;
+            entry->len = (uint16_t) len;
+            entry->time = record->time;
+            memcpy(&entry[1], record->msg, len);
+            // Type last, a reader never sees a half written entry as valid
+            __atomic_store_n(&entry->type, LOG_BINARY_MESSAGE, __ATOMIC_RELEASE);
+            return;
+        }
+        if (rotated) return;
+
+        log_binary_unmap(bin);
+        if (log_binary_map(bin)) return;
+    }
+}
@@ -0,0 +1,166 @@
+/*
+ * Copyright 2011 Aalborg University. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are
+ * permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of
+ * conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list
+ * of conditions and the following disclaimer in the documentation and/or other materials
+ * provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY Aalborg University ''AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL Aalborg University OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are those of the
+ * authors and should not be interpreted as representing official policies, either expressed
+ */
+
+#ifndef HPD_LOG_BINARY_H
+#define HPD_LOG_BINARY_H
+
+#include <hpd-0.6/hpd_types.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Binary log files start with a header, followed by entries that are each aligned to 8 bytes. Module names and file
+ * names are written once per file as string entries, and file/line pairs once as site entries, so that messages only
+ * carry their ids. Every file is self-contained: ids start over after rotation. Numbers are in host byte order, which
+ * the decoder checks against byte_order. A zero type marks the end of the entries.
+ */
+
+#define LOG_BINARY_MAGIC "HPDLOGB1"
+#define LOG_BINARY_BYTE_ORDER 0x01020304
+#define LOG_BINARY_ALIGN(SIZE) (((SIZE) + 7) & ~(size_t) 7)
+
+enum log_binary_type {
+    LOG_BINARY_END = 0,
+    LOG_BINARY_STRING,
+    LOG_BINARY_SITE,
+    LOG_BINARY_MESSAGE,
+};
+
+typedef struct log_binary_header log_binary_header_t;
+typedef struct log_binary_string log_binary_string_t;
+typedef struct log_binary_site log_binary_site_t;
+typedef struct log_binary_message log_binary_message_t;
+typedef struct log_binary_string_slot log_binary_string_slot_t;
+typedef struct log_binary_site_slot log_binary_site_slot_t;
+typedef struct log_binary log_binary_t;
+
+struct log_binary_header {
+    char magic[8];
+    uint32_t byte_order;
+    uint32_t reserved;
+};
+
+struct log_binary_string {
+    uint8_t type;
+    uint8_t reserved;
+    uint16_t id;
+    uint16_t len;       ///< Followed by len bytes, not null terminated
+    uint16_t reserved2;
+};
+
+struct log_binary_site {
+    uint8_t type;
+    uint8_t reserved;
+    uint16_t id;
+    uint16_t file;      ///< String id
+    uint16_t reserved2;
+    uint32_t line;
+    uint32_t reserved3;
+};
+
+struct log_binary_message {
+    uint8_t type;
+    uint8_t level;
+    uint16_t module;    ///< String id
+    uint16_t site;
+    uint16_t len;       ///< Followed by len bytes, not null terminated
+    uint64_t time;      ///< Microseconds since the epoch
+};
+
+struct log_binary_string_slot {
+    char *str;
+    uint16_t id;
+};
+
+struct log_binary_site_slot {
+    const char *file;
+    int line;
+    uint16_t id;
+};
+
+/**
+ * Writer for one binary log file, mapped into memory. Only used from the log writer thread of hpd, so it needs no
+ * locking.
+ */
+struct log_binary {
+    const hpd_module_t *context;
+    char *fn;
+    size_t size;        ///< Size of each file, it is rotated when full
+    int fd;
+    char *map;
+    size_t pos;
+    log_binary_string_slot_t *strings;  ///< Module and file names written to this file, hashed on their content
+    size_t strings_mask;
+    size_t strings_count;
+    log_binary_site_slot_t *sites;      ///< File/line pairs written to this file, hashed on file pointer and line
+    size_t sites_mask;
+    size_t sites_count;
+};
+
+/**
+ * A message read back from a binary log file. Strings point into the file and are not null terminated, module and
+ * file are NULL if their ids are unknown.
+ */
+typedef struct log_binary_record {
+    uint8_t level;
+    uint64_t time;      ///< Microseconds since the epoch
+    const char *module;
+    size_t module_len;
+    const char *file;
+    size_t file_len;
+    uint32_t line;
+    const char *msg;
+    size_t len;
+} log_binary_record_t;
+
+typedef void (*log_binary_read_f)(void *data, const log_binary_record_t *record);
+
+typedef enum log_binary_read_status {
+    LOG_BINARY_READ_OK = 0,
+    LOG_BINARY_READ_NOT_LOG,    ///< No binary log header
+    LOG_BINARY_READ_BYTE_ORDER, ///< Written with a different byte order
+    LOG_BINARY_READ_TRUNCATED,  ///< The entry at pos does not fit in the file
+    LOG_BINARY_READ_UNKNOWN,    ///< The entry at pos has an unknown type
+    LOG_BINARY_READ_ALLOC,
+} log_binary_read_status_t;
+
+hpd_error_t log_binary_open(log_binary_t *bin, const hpd_module_t *context, const char *fn, size_t size);
+hpd_error_t log_binary_close(log_binary_t *bin);
+void log_binary_write(log_binary_t *bin, const hpd_log_record_t *record);
+
+log_binary_read_status_t log_binary_read(const char *map, size_t size, log_binary_read_f on_message, void *data,
+                                         size_t *pos);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //HPD_LOG_BINARY_H
@@ -0,0 +1,125 @@
+/*
+ * Copyright 2011 Aalborg University. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are
+ * permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of
+ * conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list
+ * of conditions and the following disclaimer in the documentation and/or other materials
+ * provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY Aalborg University ''AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL Aalborg University OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are those of the
+ * authors and should not be interpreted as representing official policies, either expressed
+ */
+
+#include "hpd_log_binary.h"
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Read the messages of a binary log file, in the order they were written.
+ *
+ *  Reading stops at the end marker or the end of the file. On errors before
+ *  that, the messages up to the offending entry have been passed on, and
+ *  pos is set to its offset.
+ *
+ *  \param  map         The file contents
+ *  \param  size        Size of the file
+ *  \param  on_message  Called with each message, the record is only valid during the call
+ *  \param  data        Data for on_message
+ *  \param  pos         Will be set to the offset of the offending entry, may be NULL
+ */
+log_binary_read_status_t log_binary_read(const char *map, size_t size, log_binary_read_f on_message, void *data,
+                                         size_t *pos)
+{
+    log_binary_read_status_t stat = LOG_BINARY_READ_OK;
+    const log_binary_header_t *header = (const log_binary_header_t *) map;
+    const log_binary_string_t **strings;
+    const log_binary_site_t **sites;
+    size_t p;
+
+    if (pos) (*pos) = 0;
+    if (size < sizeof(log_binary_header_t) || memcmp(header->magic, LOG_BINARY_MAGIC, sizeof(header->magic)))
+        return LOG_BINARY_READ_NOT_LOG;
+    if (header->byte_order != LOG_BINARY_BYTE_ORDER) return LOG_BINARY_READ_BYTE_ORDER;
+
+    // Ids are per file, indexed by id
+    strings = calloc(UINT16_MAX+1, sizeof(*strings));
+    sites = calloc(UINT16_MAX+1, sizeof(*sites));
+    if (!strings || !sites) {
+        stat = LOG_BINARY_READ_ALLOC;
+        goto done;
+    }
+
+    p = LOG_BINARY_ALIGN(sizeof(log_binary_header_t));
+    while (p + sizeof(uint8_t) <= size) {
+        const char *entry = &map[p];
+        switch ((uint8_t) *entry) {
+            case LOG_BINARY_END:
+                goto done;
+            case LOG_BINARY_STRING: {
+                const log_binary_string_t *string = (const log_binary_string_t *) entry;
+                if (p + sizeof(*string) > size || p + sizeof(*string) + string->len > size) goto truncated;
+                strings[string->id] = string;
+                p += LOG_BINARY_ALIGN(sizeof(*string) + string->len);
+                break;
+            }
+            case LOG_BINARY_SITE: {
+                const log_binary_site_t *site = (const log_binary_site_t *) entry;
+                if (p + sizeof(*site) > size) goto truncated;
+                sites[site->id] = site;
+                p += LOG_BINARY_ALIGN(sizeof(*site));
+                break;
+            }
+            case LOG_BINARY_MESSAGE: {
+                const log_binary_message_t *message = (const log_binary_message_t *) entry;
+                if (p + sizeof(*message) > size || p + sizeof(*message) + message->len > size) goto truncated;
+                const log_binary_string_t *module = strings[message->module];
+                const log_binary_site_t *site = sites[message->site];
+                const log_binary_string_t *file = site ? strings[site->file] : NULL;
+
+                log_binary_record_t record = {
+                        .level = message->level,
+                        .time = message->time,
+                        .module = module ? (const char *) &module[1] : NULL,
+                        .module_len = module ? module->len : 0,
+                        .file = file ? (const char *) &file[1] : NULL,
+                        .file_len = file ? file->len : 0,
+                        .line = site ? site->line : 0,
+                        .msg = (const char *) &message[1],
+                        .len = message->len,
+                };
+                on_message(data, &record);
+                p += LOG_BINARY_ALIGN(sizeof(*message) + message->len);
+                break;
+            }
+            default:
+                stat = LOG_BINARY_READ_UNKNOWN;
+                if (pos) (*pos) = p;
+                goto done;
+        }
+    }
+    goto done;
+
+    truncated:
+    stat = LOG_BINARY_READ_TRUNCATED;
+    if (pos) (*pos) = p;
+
+    done:
+    free(strings);
+    free(sites);
+    return stat;
+}
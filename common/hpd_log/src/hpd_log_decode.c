@@ -0,0 +1,149 @@
+/*
+ * Copyright 2011 Aalborg University. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are
+ * permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of
+ * conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list
+ * of conditions and the following disclaimer in the documentation and/or other materials
+ * provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY Aalborg University ''AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL Aalborg University OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are those of the
+ * authors and should not be interpreted as representing official policies, either expressed
+ */
+
+#include "hpd_log_binary.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+/**
+ * Renders binary log files written by hpd_log as text, in the same form as the text log.
+ */
+
+static const char *decode_type(uint8_t level)
+{
+    switch (level) {
+        case HPD_L_ERROR: return "ERROR";
+        case HPD_L_WARN: return "WARNING";
+        case HPD_L_INFO: return "INFO";
+        case HPD_L_DEBUG: return "DEBUG";
+        case HPD_L_VERBOSE: return "VERBOSE";
+        default: return "UNKNOWN";
+    }
+}
+
+/// Print a message as the text log would, one line per line of the message
+static void decode_on_message(void *data, const log_binary_record_t *record)
+{
+    char time_buffer[26];
+    struct tm tm_info;
+    time_t sec = (time_t) (record->time / 1000000);
+    localtime_r(&sec, &tm_info);
+    strftime(time_buffer, sizeof(time_buffer), "%Y/%m/%d %H:%M:%S", &tm_info);
+
+    const char *mod = record->module ? record->module : "?";
+    int mod_len = record->module ? (int) record->module_len : 1;
+    const char *fn_str = record->file ? record->file : "?";
+    int fn_len = record->file ? (int) record->file_len : 1;
+    for (int i = fn_len; i > 0; i--) {
+        if (fn_str[i-1] == '/') {
+            fn_str = &fn_str[i];
+            fn_len -= i;
+            break;
+        }
+    }
+
+    const char *msg = record->msg;
+    const char *msg_end = msg + record->len;
+    while (msg < msg_end) {
+        const char *nl = memchr(msg, '\n', (size_t) (msg_end - msg));
+        const char *line_end = nl ? nl : msg_end;
+        if (line_end != msg)
+            printf("%s.%06u [%.*s]%*s %8s: %.*s  %.*s:%u\n",
+                   time_buffer, (unsigned) (record->time % 1000000),
+                   mod_len, mod, mod_len < 12 ? 12 - mod_len : 0, "", decode_type(record->level),
+                   (int) (line_end - msg), msg, fn_len, fn_str, record->line);
+        msg = nl ? nl + 1 : msg_end;
+    }
+}
+
+static int decode(const char *fn, const char *map, size_t size)
+{
+    size_t pos;
+
+    switch (log_binary_read(map, size, decode_on_message, NULL, &pos)) {
+        case LOG_BINARY_READ_OK:
+            return 0;
+        case LOG_BINARY_READ_NOT_LOG:
+            fprintf(stderr, "%s: not a binary log file\n", fn);
+            return 1;
+        case LOG_BINARY_READ_BYTE_ORDER:
+            fprintf(stderr, "%s: written with a different byte order\n", fn);
+            return 1;
+        case LOG_BINARY_READ_TRUNCATED:
+            fprintf(stderr, "%s: truncated entry at offset %zu\n", fn, pos);
+            return 1;
+        case LOG_BINARY_READ_UNKNOWN:
+            fprintf(stderr, "%s: unknown entry at offset %zu\n", fn, pos);
+            return 1;
+        case LOG_BINARY_READ_ALLOC:
+        default:
+            fprintf(stderr, "%s: out of memory\n", fn);
+            return 1;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    int rc = 0;
+
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s FILE...\n", argv[0]);
+        return 2;
+    }
+
+    // Oldest first, so pass rotated files before the current one
+    for (int i = 1; i < argc; i++) {
+        struct stat st;
+        int fd = open(argv[i], O_RDONLY);
+        if (fd < 0 || fstat(fd, &st)) {
+            perror(argv[i]);
+            if (fd >= 0) close(fd);
+            rc = 1;
+            continue;
+        }
+        if (st.st_size == 0) {
+            close(fd);
+            continue;
+        }
+        const char *map = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (map == MAP_FAILED) {
+            perror(argv[i]);
+            rc = 1;
+            continue;
+        }
+        if (decode(argv[i], map, (size_t) st.st_size)) rc = 1;
+        munmap((void *) map, (size_t) st.st_size);
+    }
+
+    return rc;
+}
@@ -0,0 +1,234 @@
+/*
+ * Copyright 2011 Aalborg University. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are
+ * permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of
+ * conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list
+ * of conditions and the following disclaimer in the documentation and/or other materials
+ * provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY Aalborg University ''AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL Aalborg University OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are those of the
+ * authors and should not be interpreted as representing official policies, either expressed
+ */
+
+/*
+ * Writes messages through the binary mode of the log module, which receives them with a log record listener, into
+ * files small enough to be rotated, and reads them back as hpd-log-decode does.
+ */
+
+#include <gtest/gtest.h>
+#include "hpd-0.6/hpd_api.h"
+#include "hpd-0.6/modules/hpd_log.h"
+#include "hpd_log_binary.h"
+#include <ev.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+
+#define CASE hpd_log_binary
+
+/// Smallest file size the module accepts
+#define FILE_SIZE "65536"
+
+/// Enough messages of MSG_LEN bytes to fill the first file, but not the second
+#define MESSAGES 450
+#define MSG_LEN 200
+
+/// Messages logged per iteration, so the ring of the log writer is not overrun
+#define BATCH 10
+
+typedef struct {
+    uint8_t level;
+    std::string module;
+    std::string file;
+    uint32_t line;
+    std::string msg;
+} message_t;
+
+static hpd_t *hpd;
+static const hpd_module_t *test_context;
+static ev_timer timer;
+static int logged;
+static int info_line, warn_line;
+
+static std::string message(int i)
+{
+    char buf[16];
+    snprintf(buf, sizeof(buf), "message %04d ", i);
+    return std::string(buf) + std::string(MSG_LEN - strlen(buf), 'x');
+}
+
+static void on_timeout(hpd_ev_loop_t *loop, ev_timer *w, int revents)
+{
+    for (int i = 0; i < BATCH && logged < MESSAGES; i++, logged++) {
+        std::string msg = message(logged);
+        if (logged % 2 == 0) {
+            info_line = __LINE__ + 1;
+            HPD_LOG_INFO(test_context, "%s", msg.c_str());
+        } else {
+            warn_line = __LINE__ + 1;
+            HPD_LOG_WARN(test_context, "%s", msg.c_str());
+        }
+    }
+    if (logged < MESSAGES) return;
+
+    ev_timer_stop(loop, w);
+    hpd_stop(hpd);
+}
+
+static hpd_error_t on_create(void **data, const hpd_module_t *context)
+{
+    test_context = context;
+    *data = &timer;
+    return HPD_E_SUCCESS;
+}
+
+static hpd_error_t on_destroy(void *data)
+{
+    return HPD_E_SUCCESS;
+}
+
+static hpd_error_t on_start(void *data)
+{
+    hpd_error_t rc;
+    hpd_ev_loop_t *loop;
+
+    if ((rc = hpd_get_loop(test_context, &loop))) return rc;
+    ev_timer_init(&timer, on_timeout, 0, 0.01);
+    ev_timer_start(loop, &timer);
+    return HPD_E_SUCCESS;
+}
+
+static hpd_error_t on_stop(void *data)
+{
+    return HPD_E_SUCCESS;
+}
+
+static hpd_error_t on_parse_opt(void *data, const char *name, const char *arg)
+{
+    return HPD_E_ARGUMENT;
+}
+
+static hpd_module_def_t module_def = { on_create, on_destroy, on_start, on_stop, on_parse_opt };
+
+static void on_message(void *data, const log_binary_record_t *record)
+{
+    std::vector<message_t> *messages = (std::vector<message_t> *) data;
+    message_t message = {
+            record->level,
+            record->module ? std::string(record->module, record->module_len) : "",
+            record->file ? std::string(record->file, record->file_len) : "",
+            record->line,
+            std::string(record->msg, record->len),
+    };
+    messages->push_back(message);
+}
+
+static std::string read_file(const std::string &fn)
+{
+    std::string content;
+    char buf[4096];
+    ssize_t len;
+    int fd = open(fn.c_str(), O_RDONLY);
+
+    EXPECT_GE(fd, 0);
+    if (fd < 0) return content;
+    while ((len = read(fd, buf, sizeof(buf))) > 0) content.append(buf, (size_t) len);
+    close(fd);
+    return content;
+}
+
+static log_binary_read_status_t decode(const std::string &content, std::vector<message_t> &messages,
+                                       size_t *pos = nullptr)
+{
+    return log_binary_read(content.data(), content.size(), on_message, &messages, pos);
+}
+
+TEST(CASE, rotate_and_decode) {
+    char dir[] = "/tmp/hpd_log_testXXXXXX";
+    ASSERT_NE(mkdtemp(dir), nullptr);
+    std::string fn = std::string(dir) + "/log.bin", rotated = fn + ".1", file_opt = "--log-file=" + fn;
+    char *argv[] = {
+            (char *) "test",
+            (char *) file_opt.c_str(),
+            (char *) "--log-binary",
+            (char *) "--log-size=" FILE_SIZE,
+    };
+
+    logged = 0;
+    ASSERT_EQ(hpd_alloc(&hpd), HPD_E_SUCCESS);
+    ASSERT_EQ(hpd_module(hpd, "log", &hpd_log), HPD_E_SUCCESS);
+    ASSERT_EQ(hpd_module(hpd, "test", &module_def), HPD_E_SUCCESS);
+    ASSERT_EQ(hpd_start(hpd, 4, argv), HPD_E_SUCCESS);
+    ASSERT_EQ(hpd_free(hpd), HPD_E_SUCCESS);
+
+    // Oldest first, the rotated file ends with its last entry, the current one was truncated when closed
+    std::string first = read_file(rotated), second = read_file(fn);
+    std::vector<message_t> first_messages, messages;
+    ASSERT_LE(first.size(), (size_t) atoi(FILE_SIZE));
+    ASSERT_EQ(decode(first, first_messages), LOG_BINARY_READ_OK);
+    ASSERT_EQ(decode(second, messages), LOG_BINARY_READ_OK);
+    messages.insert(messages.begin(), first_messages.begin(), first_messages.end());
+
+    // Both files hold messages of the test module, and each file has its own string and site entries
+    int i = 0;
+    size_t in_first = 0;
+    for (size_t j = 0; j < messages.size(); j++) {
+        const message_t &message = messages[j];
+        if (message.module != "test") continue;
+        ASSERT_EQ(message.msg, ::message(i));
+        ASSERT_EQ(message.file, __FILE__);
+        if (i % 2 == 0) {
+            ASSERT_EQ(message.level, HPD_L_INFO);
+            ASSERT_EQ(message.line, (uint32_t) info_line);
+        } else {
+            ASSERT_EQ(message.level, HPD_L_WARN);
+            ASSERT_EQ(message.line, (uint32_t) warn_line);
+        }
+        if (j < first_messages.size()) in_first++;
+        i++;
+    }
+    ASSERT_EQ(i, MESSAGES);
+    ASSERT_GT(in_first, 0u);
+    ASSERT_LT(in_first, (size_t) MESSAGES);
+
+    // An entry cut off at the end of the file is reported, after the messages before it
+    std::vector<message_t> truncated;
+    size_t pos, last = second.rfind(::message(MESSAGES - 1));
+    ASSERT_NE(last, std::string::npos);
+    std::string cut = second.substr(0, last + MSG_LEN / 2);
+    ASSERT_EQ(decode(cut, truncated, &pos), LOG_BINARY_READ_TRUNCATED);
+    ASSERT_EQ(pos, last - sizeof(log_binary_message_t));
+    ASSERT_FALSE(truncated.empty());
+    ASSERT_EQ(truncated.back().msg, ::message(MESSAGES - 2));
+
+    // A file written with the other byte order is refused
+    std::vector<message_t> swapped;
+    std::string other = second;
+    log_binary_header_t *header = (log_binary_header_t *) &other[0];
+    header->byte_order = __builtin_bswap32(header->byte_order);
+    ASSERT_EQ(decode(other, swapped), LOG_BINARY_READ_BYTE_ORDER);
+    ASSERT_TRUE(swapped.empty());
+
+    unlink(rotated.c_str());
+    unlink(fn.c_str());
+    rmdir(dir);
+}
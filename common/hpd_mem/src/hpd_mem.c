@@ -148,7 +148,7 @@ static hpd_status_t mem_on_get(void *data, hpd_request_t *req)
     if (!msrv->value) return HPD_S_200;
 
     hpd_value_t *value;
-    hpd_value_copy(msrv->mem->context, &value, msrv->value);
+    hpd_value_ref(msrv->value, &value);
 
     hpd_response_t *res;
     hpd_response_alloc(&res, req, HPD_S_200);
@@ -166,18 +166,19 @@ static hpd_status_t mem_on_put(void *data, hpd_request_t *req)
     hpd_request_get_value(req, &value);
 
     { // Save value for later
-        hpd_value_copy(msrv->mem->context, &msrv->value, value);
+        if (msrv->value) hpd_value_unref(msrv->value);
+        hpd_value_ref(value, &msrv->value);
     }
 
     { // Report as changed
         hpd_value_t *val;
-        hpd_value_copy(msrv->mem->context, &val, value);
+        hpd_value_ref(value, &val);
         hpd_changed(msrv->service, val);
     }
 
     { // Respond with value
         hpd_value_t *val;
-        hpd_value_copy(msrv->mem->context, &val, value);
+        hpd_value_ref(value, &val);
         hpd_response_t *res;
         hpd_response_alloc(&res, req, HPD_S_200);
         hpd_response_set_value(res, val);
@@ -247,6 +248,13 @@ static hpd_error_t mem_on_stop(void *data)
 {
     mem_t *mem = data;
     hpd_adapter_detach(mem->adapter);
+
+    mem_srv_t *msrv;
+    TAILQ_FOREACH(msrv, &mem->msrvs, HPD_TAILQ_FIELD) {
+        if (msrv->value) hpd_value_unref(msrv->value);
+        msrv->value = NULL;
+    }
+
     return HPD_E_SUCCESS;
 }
 
@@ -34,6 +34,10 @@
 #include "rest_xml.h"
 #include <mxml.h>
 #include <hpd-0.6/common/hpd_serialize_shared.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <limits.h>
 
 static hpd_error_t rest_on_create(void **data, const hpd_module_t *context);
 static hpd_error_t rest_on_destroy(void *data);
@@ -49,12 +53,39 @@ typedef enum rest_content_type {
     CONTENT_XML,
     CONTENT_JSON,
     CONTENT_WILDCARD,
+    CONTENT_OCTET_STREAM, ///< The raw body of the value, which may be binary
 } rest_content_type_t;
 
+/// Size of an entity tag, a quoted 64 bit hash in hex
+#define REST_ETAG_SIZE (1+16+1+1)
+
+/// Representations of the configuration, which are cached
+typedef enum rest_cache_type {
+    REST_CACHE_XML,
+    REST_CACHE_JSON,
+    REST_CACHE_COUNT
+} rest_cache_type_t;
+
+/**
+ * A cached representation of the configuration.
+ *
+ *  Shared by the cache and the responses sending it, the last one to let go
+ *  of it frees it. Responses may be sent by the worker threads of httpd.
+ *  The representation is kept in the chunks it was written in, and each
+ *  chunk is sent as a segment of its own, holding a reference.
+ */
+typedef struct rest_cache {
+    int refs;                   ///< References
+    char etag[REST_ETAG_SIZE];  ///< Entity tag, a hash of the chunks
+    rest_chunk_t *chunks;       ///< The representation, the owner of each chunk is the cache
+} rest_cache_t;
+
 struct hpd_rest {
     hpd_httpd_t *ws;
     hpd_httpd_settings_t ws_set;
     const hpd_module_t *context;
+    hpd_listener_t *listener;              ///< Invalidates the cache on changes to the configuration
+    rest_cache_t *cache[REST_CACHE_COUNT]; ///< Cached representations, NULL if not cached
 };
 
 typedef struct hpd_rest_req {
@@ -64,7 +95,6 @@ typedef struct hpd_rest_req {
     hpd_httpd_request_t *http_req;
     hpd_httpd_method_t http_method;
     const char *url;
-    hpd_map_t *headers;
     char *body;
     size_t len;
 
@@ -91,6 +121,10 @@ static rest_content_type_t rest_media_type_to_enum(const char *haystack)
             strncmp(haystack, "application/json;", 17) == 0 ||
             ((str = strstr(haystack, ",application/json")) && (str[17] == ';' || str[17] == '\0')))
         return CONTENT_JSON;
+    if (    strcmp(haystack, "application/octet-stream") == 0 ||
+            strncmp(haystack, "application/octet-stream;", 25) == 0 ||
+            ((str = strstr(haystack, ",application/octet-stream")) && (str[25] == ';' || str[25] == '\0')))
+        return CONTENT_OCTET_STREAM;
     if (strcmp(haystack, "*/*") == 0)
         return CONTENT_WILDCARD;
     return CONTENT_UNKNOWN;
@@ -205,6 +239,125 @@ static hpd_error_t rest_reply_method_not_allowed(hpd_httpd_request_t *req, hpd_r
     return rest_reply(req, HPD_S_405, rest_req, context);
 }
 
+static void rest_cache_unref(rest_cache_t *cache)
+{
+    if (__atomic_sub_fetch(&cache->refs, 1, __ATOMIC_ACQ_REL) > 0) return;
+    rest_chunks_free(cache->chunks);
+    free(cache);
+}
+
+/// Free function for a chunk of a cached representation, called once it has been sent
+static void rest_cache_on_sent(void *buf)
+{
+    rest_chunk_t *chunk = (rest_chunk_t *) ((char *) buf - offsetof(rest_chunk_t, buf));
+    rest_cache_unref(chunk->owner);
+}
+
+static void rest_cache_clear(hpd_rest_t *rest)
+{
+    for (int i = 0; i < REST_CACHE_COUNT; i++) {
+        if (rest->cache[i]) rest_cache_unref(rest->cache[i]);
+        rest->cache[i] = NULL;
+    }
+}
+
+static void rest_on_adp_change(void *data, const hpd_adapter_id_t *adapter)
+{
+    rest_cache_clear(data);
+}
+
+static void rest_on_dev_change(void *data, const hpd_device_id_t *device)
+{
+    rest_cache_clear(data);
+}
+
+static void rest_on_srv_change(void *data, const hpd_service_id_t *service)
+{
+    rest_cache_clear(data);
+}
+
+/**
+ * Get the configuration in a representation, from the cache if possible.
+ *
+ *  The cache is cleared whenever an adapter, device or service is
+ *  attached, detached or changed.
+ *
+ *  \param  rest   The rest module
+ *  \param  type   The representation
+ *  \param  cache  Will be set to the cached representation, owned by the cache
+ */
+static hpd_error_t rest_cache_get(hpd_rest_t *rest, rest_cache_type_t type, rest_cache_t **cache)
+{
+    hpd_error_t rc;
+    const hpd_module_t *context = rest->context;
+    rest_chunk_t *chunks;
+
+    if (rest->cache[type]) {
+        (*cache) = rest->cache[type];
+        return HPD_E_SUCCESS;
+    }
+
+    switch (type) {
+        case REST_CACHE_XML:
+            if ((rc = hpd_rest_xml_get_configuration(context, rest, &chunks))) return rc;
+            break;
+        case REST_CACHE_JSON:
+            if ((rc = hpd_rest_json_get_configuration(context, rest, &chunks))) return rc;
+            break;
+        default:
+            HPD_LOG_RETURN(context, HPD_E_ARGUMENT, "Unknown representation.");
+    }
+
+    // The chunks are taken over as they are
+    rest_cache_t *c = malloc(sizeof(rest_cache_t));
+    if (!c) {
+        rest_chunks_free(chunks);
+        HPD_LOG_RETURN_E_ALLOC(context);
+    }
+    c->refs = 1;
+    c->chunks = chunks;
+
+    // FNV-1a
+    uint64_t hash = 14695981039346656037u;
+    for (rest_chunk_t *chunk = chunks; chunk; chunk = chunk->next) {
+        chunk->owner = c;
+        for (size_t i = 0; i < chunk->len; i++) {
+            hash ^= (unsigned char) chunk->buf[i];
+            hash *= 1099511628211u;
+        }
+    }
+    snprintf(c->etag, sizeof(c->etag), "\"%016" PRIx64 "\"", hash);
+
+    rest->cache[type] = c;
+    (*cache) = c;
+    return HPD_E_SUCCESS;
+}
+
+/**
+ * Whether an If-None-Match header matches an entity tag.
+ *
+ *  The header is "*" or a comma-separated list of entity tags. Uses the weak comparison, as required for
+ *  If-None-Match, so a W/ prefix is ignored, but otherwise each tag must equal ours exactly.
+ */
+static hpd_bool_t rest_etag_matches(const char *if_none_match, const char *etag)
+{
+    size_t etag_len = strlen(etag);
+    const char *tag = if_none_match, *end, *last;
+
+    while (*tag) {
+        if (!(end = strchr(tag, ','))) end = &tag[strlen(tag)];
+        last = end;
+        while (tag < last && (*tag == ' ' || *tag == '\t')) tag++;
+        while (last > tag && (last[-1] == ' ' || last[-1] == '\t')) last--;
+        if (last - tag == 1 && *tag == '*') return HPD_TRUE;
+        if (last - tag >= 2 && strncmp(tag, "W/", 2) == 0) tag += 2;
+        if ((size_t) (last - tag) == etag_len && strncmp(tag, etag, etag_len) == 0) return HPD_TRUE;
+        tag = *end ? &end[1] : end;
+    }
+
+    return HPD_FALSE;
+}
+
 static hpd_error_t rest_reply_devices(hpd_rest_req_t *rest_req)
 {
     hpd_error_t rc, rc2;
@@ -214,60 +367,82 @@ static hpd_error_t rest_reply_devices(hpd_rest_req_t *rest_req)
 
     if (rest_req->http_res) HPD_LOG_RETURN(context, HPD_E_STATE, "Response already sent.");
 
-    // Get Accept header
-    const char *accept;
-    switch ((rc = hpd_map_get(rest_req->headers, "accept", &accept))) {
+    // Get Accept and If-None-Match headers
+    const char *accept, *if_none_match;
+    switch ((rc = hpd_httpd_request_get_header_by_id(http_req, HPD_HTTPD_H_ACCEPT, &accept))) {
         case HPD_E_SUCCESS:
             break;
         case HPD_E_NOT_FOUND:
             accept = NULL;
             break;
         default:
-            if ((rc2 = rest_reply_internal_server_error(http_req, rest_req, context))) {
-                HPD_LOG_ERROR(context, "Failed to send internal server error response (code: %d).", rc2);
-            }
-            return rc;
+            goto header_error;
+    }
+    switch ((rc = hpd_httpd_request_get_header_by_id(http_req, HPD_HTTPD_H_IF_NONE_MATCH, &if_none_match))) {
+        case HPD_E_SUCCESS:
+            break;
+        case HPD_E_NOT_FOUND:
+            if_none_match = NULL;
+            break;
+        default:
+            goto header_error;
     }
 
-    // Create body
-    char *body;
-    const char *content_type = NULL;
+    // Get body
+    rest_cache_type_t type;
+    const char *content_type;
     switch (rest_media_type_to_enum(accept)) {
         case CONTENT_NONE:
         case CONTENT_XML:
         case CONTENT_WILDCARD:
-            if ((rc = hpd_rest_xml_get_configuration(context, rest, &body))) return rc;
+            type = REST_CACHE_XML;
             content_type = "application/xml";
             break;
         case CONTENT_JSON:
-
-            if ((rc = hpd_rest_json_get_configuration(rest->context, rest, &body))) return rc;
+            type = REST_CACHE_JSON;
             content_type = "application/json";
             break;
+        case CONTENT_OCTET_STREAM:
         case CONTENT_UNKNOWN:
+        default:
             if ((rc = rest_reply_unsupported_media_type(http_req, rest_req, context))) {
                 HPD_LOG_ERROR(context, "Failed to send unsupported media type response (code: %d).", rc);
             }
             return HPD_E_SUCCESS;
     }
+    rest_cache_t *cache;
+    if ((rc = rest_cache_get(rest, type, &cache))) return rc;
+
+    // Send response, the client may already have the body
+    if (if_none_match && rest_etag_matches(if_none_match, cache->etag)) {
+        if ((rc = hpd_httpd_response_create(&rest_req->http_res, http_req, HPD_S_304))) return rc;
+        if ((rc = hpd_httpd_response_add_header(rest_req->http_res, "ETag", cache->etag))) goto response_error;
+        if ((rc = hpd_httpd_response_sendf(rest_req->http_res, NULL))) goto response_error;
+        return hpd_httpd_response_destroy(rest_req->http_res);
+    }
 
-    // Send response
-    if ((rc = hpd_httpd_response_create(&rest_req->http_res, http_req, HPD_S_200))) goto create_error;
-    if (content_type && (rc = hpd_httpd_response_add_header(rest_req->http_res, "Content-Type", content_type))) goto response_error;
-    if ((rc = hpd_httpd_response_sendf(rest_req->http_res, "%s", body))) goto response_error;
-    if ((rc = hpd_httpd_response_destroy(rest_req->http_res))) goto create_error;
-
-    free(body);
-
-    return rc;
+    // The chunks are shared with the cache, each sent chunk holds a reference until it has been sent
+    if ((rc = hpd_httpd_response_create(&rest_req->http_res, http_req, HPD_S_200))) return rc;
+    if ((rc = hpd_httpd_response_add_header(rest_req->http_res, "Content-Type", content_type))) goto response_error;
+    if ((rc = hpd_httpd_response_add_header(rest_req->http_res, "ETag", cache->etag))) goto response_error;
+    for (rest_chunk_t *chunk = cache->chunks; chunk; chunk = chunk->next) {
+        __atomic_add_fetch(&cache->refs, 1, __ATOMIC_RELAXED);
+        if ((rc = hpd_httpd_response_send_chunk(rest_req->http_res, chunk->buf, chunk->len, rest_cache_on_sent)))
+            goto response_error;
+    }
+    return hpd_httpd_response_destroy(rest_req->http_res);
 
     response_error:
         if ((rc2 = hpd_httpd_response_destroy(rest_req->http_res)))
             HPD_LOG_ERROR(context, "Failed to destroy response (code: %d).", rc2);
         rest_req->http_res = NULL;
-    create_error:
-        free(body);
-    return rc;
+        return rc;
+
+    header_error:
+        if ((rc2 = rest_reply_internal_server_error(http_req, rest_req, context))) {
+            HPD_LOG_ERROR(context, "Failed to send internal server error response (code: %d).", rc2);
+        }
+        return rc;
 }
 
 #ifdef HPD_REST_ORIGIN
@@ -430,7 +605,7 @@ static void rest_on_response(void *data, const hpd_response_t *res)
     // Get data from httpd
     const char *accept;
     rest_content_type_t accept_type;
-    switch ((rc = hpd_map_get(rest_req->headers, "accept", &accept))) {
+    switch ((rc = hpd_httpd_request_get_header_by_id(http_req, HPD_HTTPD_H_ACCEPT, &accept))) {
         case HPD_E_SUCCESS:
             break;
         case HPD_E_NOT_FOUND:
@@ -448,6 +623,7 @@ static void rest_on_response(void *data, const hpd_response_t *res)
         case CONTENT_XML:
         case CONTENT_JSON:
         case CONTENT_WILDCARD:
+        case CONTENT_OCTET_STREAM:
             break;
         case CONTENT_UNKNOWN:
             if ((rc2 = rest_reply_unsupported_media_type(http_req, rest_req, context))) {
@@ -456,26 +632,13 @@ static void rest_on_response(void *data, const hpd_response_t *res)
             return;
     }
 
-    // Null terminate val
-    char *body = NULL;
-    body = malloc((len+1) * sizeof(char));
-    if (!body) {
-        if ((rc2 = rest_reply_internal_server_error(http_req, rest_req, context))) {
-            HPD_LOG_ERROR(context, "Failed to send internal server error response (code: %d).", rc2);
-        }
-        HPD_LOG_ERROR(context, "Failed to allocate memory.");
-        return;
-    }
-    strncpy(body, val, len);
-    body[len] = '\0';
-
     if (rest_req->http_res) {
         HPD_LOG_ERROR(context, "Response already sent.");
         rc = HPD_E_STATE;
-        goto error_free_body;
+        goto error_return;
     }
     
-    // Create response
+    // Create response (val is always followed by a '\0', so it can be used as a string for xml and json)
     if ((rc = hpd_httpd_response_create(&rest_req->http_res, http_req, status))) goto error_send_res;
     hpd_httpd_response_t *http_res = rest_req->http_res;
     char *state = NULL;
@@ -483,7 +646,7 @@ static void rest_on_response(void *data, const hpd_response_t *res)
         case CONTENT_NONE:
         case CONTENT_XML:
         case CONTENT_WILDCARD:
-            if ((rc = hpd_rest_xml_get_value(body, context, &state))) goto error_free_res;
+            if ((rc = hpd_rest_xml_get_value(val, context, &state))) goto error_free_res;
             if ((rc = hpd_httpd_response_add_header(http_res, "Content-Type", "application/xml"))) goto error_free_state;
             break;
         case CONTENT_JSON:
@@ -492,6 +655,9 @@ static void rest_on_response(void *data, const hpd_response_t *res)
             }
             if ((rc = hpd_httpd_response_add_header(http_res, "Content-Type", "application/json"))) goto error_free_state;
             break;
+        case CONTENT_OCTET_STREAM:
+            if ((rc = hpd_httpd_response_add_header(http_res, "Content-Type", "application/octet-stream"))) goto error_free_res;
+            break;
         case CONTENT_UNKNOWN:
             HPD_LOG_ERROR(context, "Should definitely not be here.");
             goto error_free_res;
@@ -499,16 +665,17 @@ static void rest_on_response(void *data, const hpd_response_t *res)
 #ifdef HPD_REST_ORIGIN
     if ((rc = hpd_httpd_response_add_header(http_res, "Access-Control-Allow-Origin", "*"))) goto error_free_state;
 #endif
-    if (state) {
-        if ((rc = hpd_httpd_response_sendf(http_res, "%s", state))) goto error_free_state;
+    if (accept_type == CONTENT_OCTET_STREAM) {
+        if ((rc = hpd_httpd_response_send(http_res, val, len))) goto error_free_state;
+    } else if (state) {
+        if ((rc = hpd_httpd_response_send(http_res, state, strlen(state)))) goto error_free_state;
     } else {
-        if ((rc = hpd_httpd_response_sendf(http_res, ""))) goto error_free_state;
+        if ((rc = hpd_httpd_response_send(http_res, "", 0))) goto error_free_state;
     }
     rc = hpd_httpd_response_destroy(http_res);
 
     // Clean up
     free(state);
-    free(body);
 
     if (rc) HPD_LOG_ERROR(context, "Failed to destroy httpd response [code: %i].", rc);
 
@@ -525,8 +692,7 @@ static void rest_on_response(void *data, const hpd_response_t *res)
         if ((rc2 = rest_reply_internal_server_error(http_req, rest_req, context))) {
             HPD_LOG_ERROR(context, "Failed to send internal server error response (code: %d).", rc2);
         }
-    error_free_body:
-        free(body);
+    error_return:
         HPD_LOG_ERROR(context, "on_response failed (code: %i).", rc);
         return;
 }
@@ -665,15 +831,6 @@ static hpd_httpd_return_t rest_on_req_hdr_cmpl(hpd_httpd_t *ins, hpd_httpd_reque
     struct hpd_rest *rest = httpd_ctx;
     const hpd_module_t *context = rest->context;
 
-    // Get headers for later
-    if ((rc = hpd_httpd_request_get_headers(req, &rest_req->headers))) {
-        HPD_LOG_ERROR(context, "Failed to get headers (code: %d).", rc);
-        if ((rc2 = rest_reply_internal_server_error(req, rest_req, context))) {
-            HPD_LOG_ERROR(context, "Failed to send internal server error response (code: %d).", rc2);
-        }
-        return HPD_HTTPD_R_STOP;
-    }
-
     // Get method
     if ((rc = hpd_httpd_request_get_method(req, &rest_req->http_method))) {
         HPD_LOG_ERROR(context, "Failed to get method (code: %d).", rc);
@@ -748,7 +905,7 @@ static hpd_httpd_return_t rest_on_req_body(hpd_httpd_t *ins, hpd_httpd_request_t
     const hpd_module_t *context = rest_req->rest->context;
 
     HPD_REALLOC(rest_req->body, rest_req->len + len + 1, char);
-    strncpy(&rest_req->body[rest_req->len], chunk, len);
+    memcpy(&rest_req->body[rest_req->len], chunk, len);
     rest_req->len += len;
     rest_req->body[rest_req->len] = '\0';
     return HPD_HTTPD_R_CONTINUE;
@@ -773,7 +930,7 @@ static hpd_httpd_return_t rest_on_req_cmpl(hpd_httpd_t *ins, hpd_httpd_request_t
     if (rest_req->body) {
         // Get content type
         const char *content_type;
-        switch ((rc = hpd_map_get(rest_req->headers, "content-type", &content_type))) {
+        switch ((rc = hpd_httpd_request_get_header_by_id(req, HPD_HTTPD_H_CONTENT_TYPE, &content_type))) {
             case HPD_E_SUCCESS:
                 break;
             case HPD_E_NOT_FOUND:
@@ -836,6 +993,21 @@ static hpd_httpd_return_t rest_on_req_cmpl(hpd_httpd_t *ins, hpd_httpd_request_t
                         return HPD_HTTPD_R_STOP;
                 }
                 break;
+            case CONTENT_OCTET_STREAM:
+                if (rest_req->len > INT_MAX) {
+                    if ((rc2 = rest_reply_bad_request(req, rest_req, context))) {
+                        HPD_LOG_ERROR(context, "Failed to send bad request response (code: %d).", rc2);
+                    }
+                    return HPD_HTTPD_R_STOP;
+                }
+                if ((rc = hpd_value_alloc(&value, context, rest_req->body, (int) rest_req->len))) {
+                    HPD_LOG_ERROR(context, "Unable to allocate value (code: %d).", rc);
+                    if ((rc2 = rest_reply_internal_server_error(req, rest_req, context))) {
+                        HPD_LOG_ERROR(context, "Failed to send internal server error response (code: %d).", rc2);
+                    }
+                    return HPD_HTTPD_R_STOP;
+                }
+                break;
             case CONTENT_UNKNOWN:
             case CONTENT_NONE:
             case CONTENT_WILDCARD:
@@ -898,6 +1070,7 @@ static hpd_error_t rest_on_create(void **data, const hpd_module_t *context)
     hpd_error_t rc;
 
     if ((rc = hpd_module_add_option(context, "port", "port", 0, "Listener port for rest server."))) return rc;
+    if ((rc = hpd_module_add_option(context, "workers", "count", 0, "Number of threads parsing requests, each with its own listener (default: 0)."))) return rc;
 
     hpd_httpd_settings_t ws_set = HPD_HTTPD_SETTINGS_DEFAULT;
     ws_set.on_req_begin = rest_on_req_begin;
@@ -949,15 +1122,32 @@ static hpd_error_t rest_on_start(void *data)
     hpd_ev_loop_t *loop;
     if ((rc = hpd_get_loop(context, &loop))) return rc;
 
-    if ((rc = hpd_httpd_create(&rest->ws, &rest->ws_set, context, loop))) return rc;
+    if ((rc = hpd_listener_alloc(&rest->listener, context))) return rc;
+    if ((rc = hpd_listener_set_data(rest->listener, rest, NULL))) goto listener_error;
+    if ((rc = hpd_listener_set_adapter_callback(rest->listener, rest_on_adp_change, rest_on_adp_change,
+                                                rest_on_adp_change))) goto listener_error;
+    if ((rc = hpd_listener_set_device_callback(rest->listener, rest_on_dev_change, rest_on_dev_change,
+                                               rest_on_dev_change))) goto listener_error;
+    if ((rc = hpd_listener_set_service_callback(rest->listener, rest_on_srv_change, rest_on_srv_change,
+                                                rest_on_srv_change))) goto listener_error;
+    if ((rc = hpd_subscribe(rest->listener))) goto listener_error;
+
+    if ((rc = hpd_httpd_create(&rest->ws, &rest->ws_set, context, loop))) goto listener_error;
     if ((rc = hpd_httpd_start(rest->ws))) {
         if ((rc2 = hpd_httpd_destroy(rest->ws))) {
             HPD_LOG_ERROR(context, "Failed to destroy httpd (code: %d).", rc2);
         }
-        return rc;
+        goto listener_error;
     }
 
     return HPD_E_SUCCESS;
+
+    listener_error:
+        if ((rc2 = hpd_listener_free(rest->listener))) {
+            HPD_LOG_ERROR(context, "Failed to free listener (code: %d).", rc2);
+        }
+        rest->listener = NULL;
+        return rc;
 }
 
 static hpd_error_t rest_on_stop(void *data)
@@ -976,6 +1166,13 @@ static hpd_error_t rest_on_stop(void *data)
     
     rest->ws = NULL;
 
+    if ((rc2 = hpd_listener_free(rest->listener))) {
+        if (rc) HPD_LOG_ERROR(context, "Failed to free listener (code: %d).", rc2);
+        else rc = rc2;
+    }
+    rest->listener = NULL;
+    rest_cache_clear(rest);
+
     return rc;
 }
 
@@ -988,6 +1185,11 @@ static hpd_error_t rest_on_parse_opt(void *data, const char *name, const char *a
         if (port <= HPD_TCPD_P_SYSTEM_PORTS_START || port > HPD_TCPD_P_DYNAMIC_PORTS_END) return HPD_E_ARGUMENT;
         rest->ws_set.port = port;
         return HPD_E_SUCCESS;
+    } else if (strcmp(name, "workers") == 0) {
+        int workers = atoi(arg);
+        if (workers < 0) return HPD_E_ARGUMENT;
+        rest->ws_set.workers = workers;
+        return HPD_E_SUCCESS;
     } else {
         return HPD_E_ARGUMENT;
     }
@@ -0,0 +1,81 @@
+/*
+ * Copyright 2011 Aalborg University. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are
+ * permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of
+ * conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list
+ * of conditions and the following disclaimer in the documentation and/or other materials
+ * provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY Aalborg University ''AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL Aalborg University OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are those of the
+ * authors and should not be interpreted as representing official policies, either expressed
+ */
+
+#include "rest_chunk.h"
+#include "hpd-0.6/hpd_shared_api.h"
+#include <string.h>
+#include <stdlib.h>
+
+/**
+ * Append data to a list of chunks.
+ *
+ *  The last chunk is filled up before a new one is added.
+ *
+ *  \param  chunks  The list, empty when zero initialised (apart from the context)
+ *  \param  buf     The data
+ *  \param  len     Length of the data
+ */
+hpd_error_t rest_chunks_put(rest_chunks_t *chunks, const char *buf, size_t len)
+{
+    while (len > 0) {
+        rest_chunk_t *last = chunks->last;
+
+        if (!last || last->len == REST_CHUNK_SIZE) {
+            // Not zeroed, only the used part of buf is ever read
+            if (!(last = malloc(sizeof(rest_chunk_t)))) HPD_LOG_RETURN_E_ALLOC(chunks->context);
+            last->next = NULL;
+            last->owner = NULL;
+            last->len = 0;
+            if (chunks->last) chunks->last->next = last;
+            else chunks->first = last;
+            chunks->last = last;
+        }
+
+        size_t n = REST_CHUNK_SIZE - last->len;
+        if (n > len) n = len;
+        memcpy(&last->buf[last->len], buf, n);
+        last->len += n;
+        buf += n;
+        len -= n;
+    }
+
+    return HPD_E_SUCCESS;
+}
+
+/**
+ * Free a list of chunks.
+ *
+ *  \param  first  The first chunk, may be NULL
+ */
+void rest_chunks_free(rest_chunk_t *first)
+{
+    while (first) {
+        rest_chunk_t *next = first->next;
+        free(first);
+        first = next;
+    }
+}
@@ -0,0 +1,70 @@
+/*
+ * Copyright 2011 Aalborg University. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are
+ * permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of
+ * conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list
+ * of conditions and the following disclaimer in the documentation and/or other materials
+ * provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY Aalborg University ''AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL Aalborg University OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are those of the
+ * authors and should not be interpreted as representing official policies, either expressed
+ */
+
+#ifndef HOMEPORT_REST_CHUNK_H
+#define HOMEPORT_REST_CHUNK_H
+
+#include "../../../hpd/include/hpd-0.6/hpd_types.h"
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// Size of the chunks a representation is written in, and sent as
+#define REST_CHUNK_SIZE (16*1024)
+
+typedef struct rest_chunk rest_chunk_t;
+
+/**
+ * A chunk of a representation.
+ *
+ *  Representations of the configuration are written straight into a list
+ *  of chunks, which can be sent as is, one segment per chunk.
+ */
+struct rest_chunk {
+    rest_chunk_t *next;
+    void *owner;               ///< Not used by the writers, lets the holder of the list be found from buf
+    size_t len;                ///< Length of the data in buf
+    char buf[REST_CHUNK_SIZE];
+};
+
+/// A list of chunks being written
+typedef struct rest_chunks {
+    const hpd_module_t *context;
+    rest_chunk_t *first;
+    rest_chunk_t *last;
+} rest_chunks_t;
+
+hpd_error_t rest_chunks_put(rest_chunks_t *chunks, const char *buf, size_t len);
+void rest_chunks_free(rest_chunk_t *first);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
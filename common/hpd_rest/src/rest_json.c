@@ -28,31 +28,56 @@
 #include "rest_json.h"
 #include "hpd-0.6/common/hpd_jansson.h"
 #include "hpd-0.6/hpd_application_api.h"
+#include "hpd-0.6/common/hpd_common.h"
 #include <string.h>
+#include <stdlib.h>
 #include <hpd-0.6/common/hpd_serialize_shared.h>
 #include <hpd-0.6/common/hpd_json.h>
 
 #define REST_JSON_RETURN_JSON_ERROR(CONTEXT) HPD_LOG_RETURN(context, HPD_E_UNKNOWN, "Json error")
 
-hpd_error_t hpd_rest_json_get_configuration(const hpd_module_t *context, hpd_rest_t *rest, char **out)
+/// Appends each buffer of the writer to the chunks of the configuration
+static hpd_error_t rest_json_on_write(void *data, char *buf, size_t len)
 {
-    hpd_error_t rc;
-
-    json_t *json;
-    if (!(json = json_object())) REST_JSON_RETURN_JSON_ERROR(context);
-
-    json_t *child;
-    if ((rc = hpd_json_configuration_to_json(context, &child))) return rc;
-    if (json_object_set_new(json, HPD_SERIALIZE_KEY_CONFIGURATION, child)) goto json_error;
-
-    if (!((*out) = json_dumps(json, 0))) goto json_error;
-
-    json_decref(json);
-    return HPD_E_SUCCESS;
+    hpd_error_t rc = rest_chunks_put(data, buf, len);
+    free(buf);
+    return rc;
+}
 
-    json_error:
-    json_decref(json);
-    REST_JSON_RETURN_JSON_ERROR(context);
+/**
+ * Get the configuration as json.
+ *
+ *  The json is written while walking the model, without building a json
+ *  tree first. The writer uses buffers of the same size as the chunks, so
+ *  each buffer fills up one chunk.
+ *
+ *  \param  context  The module
+ *  \param  rest     The rest module
+ *  \param  out      Will be set to the first chunk of the json, free with rest_chunks_free()
+ */
+hpd_error_t hpd_rest_json_get_configuration(const hpd_module_t *context, hpd_rest_t *rest, rest_chunk_t **out)
+{
+    hpd_error_t rc, rc2;
+    hpd_json_writer_t *writer;
+    rest_chunks_t chunks = { context, NULL, NULL };
+
+    if ((rc = hpd_json_writer_alloc(&writer, context, REST_CHUNK_SIZE, rest_json_on_write, &chunks))) return rc;
+
+    if ((rc = hpd_json_writer_begin_object(writer)) ||
+        (rc = hpd_json_writer_key(writer, HPD_SERIALIZE_KEY_CONFIGURATION)) ||
+        (rc = hpd_json_configuration_write(context, writer)) ||
+        (rc = hpd_json_writer_end_object(writer)) ||
+        (rc = hpd_json_writer_flush(writer)))
+        goto error;
+
+    (*out) = chunks.first;
+    return hpd_json_writer_free(writer);
+
+    error:
+        if ((rc2 = hpd_json_writer_free(writer)))
+            HPD_LOG_ERROR(context, "Failed to free json writer (code: %d).", rc2);
+        rest_chunks_free(chunks.first);
+        return rc;
 }
 
 hpd_error_t hpd_rest_json_get_value(const hpd_value_t *value, const hpd_module_t *context, char **out)
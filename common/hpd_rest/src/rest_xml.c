@@ -27,6 +27,8 @@
 
 #include "rest_xml.h"
 #include <time.h>
+#include <string.h>
+#include <stdlib.h>
 #include <mxml.h>
 #include <hpd-0.6/common/hpd_common.h>
 #include <hpd-0.6/common/hpd_serialize_shared.h>
@@ -34,6 +36,9 @@
 
 static const char * const REST_XML_VERSION = "1.0";
 
+/// The element mxmlNewXML() creates for REST_XML_VERSION
+static const char * const REST_XML_DECLARATION = "?xml version=\"1.0\" encoding=\"utf-8\"?";
+
 // TODO Fix ugly hack to get context through mxml ?
 static const hpd_module_t *rest_xml_global_context = NULL;
 
@@ -54,14 +59,181 @@ static void rest_xml_on_mxml_error(const char *msg)
 
 #define REST_XML_RETURN_XML_ERROR(CONTEXT) HPD_LOG_RETURN(context, HPD_E_UNKNOWN, "Xml error")
 
-static hpd_error_t rest_xml_add(mxml_node_t *parent, const char *key, const char *val, const hpd_module_t *context)
+/// Mxml moves an attribute to a new line, if it would end past this column (mxml's default wrap margin)
+#define REST_XML_WRAP 72
+
+/// Maximum depth of nested elements
+#define REST_XML_DEPTH 8
+
+typedef struct rest_xml_attr {
+    const char *key;
+    const char *val;
+} rest_xml_attr_t;
+
+/**
+ * Forward-only xml writer.
+ *
+ *  Produces the same bytes as building the tree with mxml and saving it with
+ *  mxmlSaveAllocString(xml, MXML_NO_CALLBACK), but writes straight into a
+ *  list of chunks, without a terminating null character. The start tag of
+ *  an element is held back until its first child or its end, as mxml writes
+ *  an element without children as "<name ... />". Until then, attributes
+ *  are only referenced, not copied, so nothing is allocated per element.
+ */
+typedef struct rest_xml_writer {
+    const hpd_module_t *context;
+    rest_chunks_t chunks;                   ///< The output
+    int col;                                ///< Column, counted the way mxml does (unescaped attribute values)
+    const char *names[REST_XML_DEPTH];      ///< Names of the open elements
+    int depth;
+    hpd_bool_t pending;                     ///< Whether the start tag of the innermost element is not written yet
+    rest_xml_attr_t *attrs;                 ///< Attributes of the pending element
+    size_t attrs_len;
+    size_t attrs_size;
+} rest_xml_writer_t;
+
+static hpd_error_t rest_xml_put(rest_xml_writer_t *writer, const char *str, size_t len)
 {
-    mxmlElementSetAttr(parent, key, val);
-    if (!mxmlElementGetAttr(parent, key)) REST_XML_RETURN_XML_ERROR(context);
+    return rest_chunks_put(&writer->chunks, str, len);
+}
+
+static hpd_error_t rest_xml_put_c(rest_xml_writer_t *writer, char c)
+{
+    return rest_xml_put(writer, &c, 1);
+}
+
+/// Same as mxml_write_string(): only &, <, > and " are replaced by entities
+static hpd_error_t rest_xml_put_escaped(rest_xml_writer_t *writer, const char *str)
+{
+    hpd_error_t rc;
+
+    while (*str) {
+        size_t len = strcspn(str, "&<>\"");
+        if ((rc = rest_xml_put(writer, str, len))) return rc;
+        str += len;
+
+        const char *entity;
+        switch (*str) {
+            case '&': entity = "&amp;"; break;
+            case '<': entity = "&lt;"; break;
+            case '>': entity = "&gt;"; break;
+            case '"': entity = "&quot;"; break;
+            default: return HPD_E_SUCCESS;
+        }
+        if ((rc = rest_xml_put(writer, entity, strlen(entity)))) return rc;
+        str++;
+    }
+
     return HPD_E_SUCCESS;
 }
 
-static hpd_error_t rest_xml_add_attr(mxml_node_t *parent, const hpd_pair_t *pair, const hpd_module_t *context)
+/// Same as mxml_write_name(): names are written as is, unless quoted
+static hpd_error_t rest_xml_put_name(rest_xml_writer_t *writer, const char *name)
+{
+    hpd_error_t rc;
+
+    if (*name != '"' && *name != '\'') return rest_xml_put(writer, name, strlen(name));
+
+    char quote = *name++;
+    if ((rc = rest_xml_put_c(writer, quote))) return rc;
+    for (; *name && *name != quote; name++) {
+        char c[2] = { *name, '\0' };
+        if ((rc = rest_xml_put_escaped(writer, c))) return rc;
+    }
+    return rest_xml_put_c(writer, quote);
+}
+
+static hpd_error_t rest_xml_write_start(rest_xml_writer_t *writer, hpd_bool_t empty)
+{
+    hpd_error_t rc;
+    const char *name = writer->names[writer->depth - 1];
+
+    writer->pending = HPD_FALSE;
+
+    if ((rc = rest_xml_put_c(writer, '<'))) return rc;
+    if (name[0] == '?') rc = rest_xml_put(writer, name, strlen(name));
+    else rc = rest_xml_put_name(writer, name);
+    if (rc) return rc;
+    writer->col += strlen(name) + 1;
+
+    for (size_t i = 0; i < writer->attrs_len; i++) {
+        rest_xml_attr_t *attr = &writer->attrs[i];
+        int width = (int) (strlen(attr->key) + strlen(attr->val) + 3);
+        if (writer->col + width > REST_XML_WRAP) {
+            if ((rc = rest_xml_put_c(writer, '\n'))) return rc;
+            writer->col = 0;
+        } else {
+            if ((rc = rest_xml_put_c(writer, ' '))) return rc;
+            writer->col++;
+        }
+        if ((rc = rest_xml_put_name(writer, attr->key))) return rc;
+        if ((rc = rest_xml_put(writer, "=\"", 2))) return rc;
+        if ((rc = rest_xml_put_escaped(writer, attr->val))) return rc;
+        if ((rc = rest_xml_put_c(writer, '"'))) return rc;
+        writer->col += width;
+    }
+
+    if (!empty || name[0] == '?' || name[0] == '!') {
+        if ((rc = rest_xml_put_c(writer, '>'))) return rc;
+        writer->col++;
+    } else {
+        if ((rc = rest_xml_put(writer, " />", 3))) return rc;
+        writer->col += 3;
+    }
+
+    return HPD_E_SUCCESS;
+}
+
+static hpd_error_t rest_xml_begin(rest_xml_writer_t *writer, const char *name)
+{
+    hpd_error_t rc;
+
+    if (writer->pending && (rc = rest_xml_write_start(writer, HPD_FALSE))) return rc;
+    if (writer->depth == REST_XML_DEPTH)
+        HPD_LOG_RETURN(writer->context, HPD_E_STATE, "Xml elements nested too deep.");
+
+    writer->names[writer->depth++] = name;
+    writer->pending = HPD_TRUE;
+    writer->attrs_len = 0;
+    return HPD_E_SUCCESS;
+}
+
+/**
+ * Add an attribute to the element just begun.
+ *
+ *  Like mxmlElementSetAttr(), setting an attribute twice replaces the value,
+ *  but keeps its position. Key and value must stay valid until the element
+ *  gets its first child, or is ended.
+ */
+static hpd_error_t rest_xml_attr(rest_xml_writer_t *writer, const char *key, const char *val)
+{
+    const hpd_module_t *context = writer->context;
+
+    if (!writer->pending)
+        HPD_LOG_RETURN(context, HPD_E_STATE, "Attributes must be added before any child elements.");
+
+    for (size_t i = 0; i < writer->attrs_len; i++) {
+        if (strcmp(writer->attrs[i].key, key) == 0) {
+            writer->attrs[i].val = val;
+            return HPD_E_SUCCESS;
+        }
+    }
+
+    if (writer->attrs_len == writer->attrs_size) {
+        size_t size = writer->attrs_size ? writer->attrs_size * 2 : 8;
+        HPD_REALLOC(writer->attrs, size, rest_xml_attr_t);
+        writer->attrs_size = size;
+    }
+    writer->attrs[writer->attrs_len].key = key;
+    writer->attrs[writer->attrs_len].val = val;
+    writer->attrs_len++;
+    return HPD_E_SUCCESS;
+
+    alloc_error:
+        HPD_LOG_RETURN_E_ALLOC(context);
+}
+
+static hpd_error_t rest_xml_add_attr(rest_xml_writer_t *writer, const hpd_pair_t *pair)
 {
     hpd_error_t rc;
 
@@ -69,206 +241,243 @@ static hpd_error_t rest_xml_add_attr(mxml_node_t *parent, const hpd_pair_t *pair
     const char *key, *val;
     if ((rc = hpd_pair_get(pair, &key, &val))) return rc;
 
-    return rest_xml_add(parent, key, val, context);
+    return rest_xml_attr(writer, key, val);
 }
 
-static hpd_error_t rest_xml_add_parameter(mxml_node_t *parent, hpd_parameter_id_t *parameter, const hpd_module_t *context)
+static hpd_error_t rest_xml_end(rest_xml_writer_t *writer)
 {
     hpd_error_t rc;
 
-    // Create node
-    mxml_node_t *xml;
-    if (!(xml = mxmlNewElement(parent, HPD_SERIALIZE_KEY_PARAMETER))) REST_XML_RETURN_XML_ERROR(context);
+    if (writer->depth == 0)
+        HPD_LOG_RETURN(writer->context, HPD_E_STATE, "No xml element to end.");
+
+    if (writer->pending) {
+        if ((rc = rest_xml_write_start(writer, HPD_TRUE))) return rc;
+    } else {
+        // Processing instructions and comments have no end tag
+        const char *name = writer->names[writer->depth - 1];
+        if (name[0] != '?' && name[0] != '!') {
+            if ((rc = rest_xml_put(writer, "</", 2))) return rc;
+            if ((rc = rest_xml_put_escaped(writer, name))) return rc;
+            if ((rc = rest_xml_put_c(writer, '>'))) return rc;
+            writer->col += strlen(name) + 3;
+        }
+    }
+
+    writer->depth--;
+    return HPD_E_SUCCESS;
+}
+
+static hpd_error_t rest_xml_add_parameter(rest_xml_writer_t *writer, hpd_parameter_id_t *parameter)
+{
+    hpd_error_t rc;
+
+    // Begin element
+    if ((rc = rest_xml_begin(writer, HPD_SERIALIZE_KEY_PARAMETER))) return rc;
 
     // Add id
     const char *id;
     if ((rc = hpd_parameter_id_get_parameter_id_str(parameter, &id))) return rc;
-    if ((rc = rest_xml_add(xml, HPD_SERIALIZE_KEY_ID, id, context))) return rc;
+    if ((rc = rest_xml_attr(writer, HPD_SERIALIZE_KEY_ID, id))) return rc;
 
     // Add attributes
     const hpd_pair_t *pair;
     HPD_PARAMETER_ID_FOREACH_ATTR(rc, pair, parameter)
-        if ((rc = rest_xml_add_attr(xml, pair, context))) return rc;
+        if ((rc = rest_xml_add_attr(writer, pair))) return rc;
     if (rc) return rc;
 
-    return HPD_E_SUCCESS;
+    return rest_xml_end(writer);
 }
 
-static hpd_error_t rest_xml_add_service(mxml_node_t *parent, hpd_service_id_t *service, hpd_rest_t *rest, const hpd_module_t *context)
+static hpd_error_t rest_xml_add_service(rest_xml_writer_t *writer, hpd_service_id_t *service, hpd_rest_t *rest)
 {
     hpd_error_t rc;
+    const hpd_module_t *context = writer->context;
 
-    // Create node
-    mxml_node_t *xml;
-    if (!(xml = mxmlNewElement(parent, HPD_SERIALIZE_KEY_SERVICE))) REST_XML_RETURN_XML_ERROR(context);
+    // Begin element
+    if ((rc = rest_xml_begin(writer, HPD_SERIALIZE_KEY_SERVICE))) return rc;
 
     // Add id
     const char *id;
     if ((rc = hpd_service_id_get_service_id_str(service, &id))) return rc;
-    if ((rc = rest_xml_add(xml, HPD_SERIALIZE_KEY_ID, id, context))) return rc;
+    if ((rc = rest_xml_attr(writer, HPD_SERIALIZE_KEY_ID, id))) return rc;
 
-    // Add url
+    // Add url (referenced until the start tag is written, so freed at the end)
     char *url;
     if ((rc = hpd_serialize_url_create(context, service, &url))) return rc;
-    if ((rc = rest_xml_add(xml, HPD_SERIALIZE_KEY_URI, url, context))) {
-        free(url);
-        return rc;
-    }
-    free(url);
+    if ((rc = rest_xml_attr(writer, HPD_SERIALIZE_KEY_URI, url))) goto error;
 
     // Add actions
     const hpd_action_t *action;
     HPD_SERVICE_ID_FOREACH_ACTION(rc, action, service) {
         hpd_method_t method;
-        if ((rc = hpd_action_get_method(action, &method))) return rc;
+        if ((rc = hpd_action_get_method(action, &method))) goto error;
         switch (method) {
             case HPD_M_NONE:break;
             case HPD_M_GET:
-                if ((rc = rest_xml_add(xml, HPD_SERIALIZE_KEY_GET, HPD_SERIALIZE_VAL_TRUE, context))) return rc;
+                if ((rc = rest_xml_attr(writer, HPD_SERIALIZE_KEY_GET, HPD_SERIALIZE_VAL_TRUE))) goto error;
                 break;
             case HPD_M_PUT:
-                if ((rc = rest_xml_add(xml, HPD_SERIALIZE_KEY_PUT, HPD_SERIALIZE_VAL_TRUE, context))) return rc;
+                if ((rc = rest_xml_attr(writer, HPD_SERIALIZE_KEY_PUT, HPD_SERIALIZE_VAL_TRUE))) goto error;
                 break;
             case HPD_M_COUNT:break;
         }
     }
-    if (rc) return rc;
+    if (rc) goto error;
 
     // Add attributes
     const hpd_pair_t *pair;
     HPD_SERVICE_ID_FOREACH_ATTR(rc, pair, service)
-        if ((rc = rest_xml_add_attr(xml, pair, context))) return rc;
-    if (rc) return rc;
+        if ((rc = rest_xml_add_attr(writer, pair))) goto error;
+    if (rc) goto error;
 
     // Add parameters
     hpd_parameter_id_t *parameter;
     HPD_SERVICE_ID_FOREACH_PARAMETER_ID(rc, parameter, service) {
-        if ((rc = rest_xml_add_parameter(xml, parameter, context))) return rc;
+        if ((rc = rest_xml_add_parameter(writer, parameter))) {
+            hpd_parameter_id_free(parameter);
+            goto error;
+        }
     }
-    if (rc) return rc;
+    if (rc) goto error;
 
-    return HPD_E_SUCCESS;
+    rc = rest_xml_end(writer);
+
+    error:
+        free(url);
+        return rc;
 }
 
-static hpd_error_t rest_xml_add_device(mxml_node_t *parent, hpd_device_id_t *device, hpd_rest_t *rest, const hpd_module_t *context)
+static hpd_error_t rest_xml_add_device(rest_xml_writer_t *writer, hpd_device_id_t *device, hpd_rest_t *rest)
 {
     hpd_error_t rc;
 
-    // Create object
-    mxml_node_t *xml;
-    if (!(xml = mxmlNewElement(parent, HPD_SERIALIZE_KEY_DEVICE))) REST_XML_RETURN_XML_ERROR(context);
+    // Begin element
+    if ((rc = rest_xml_begin(writer, HPD_SERIALIZE_KEY_DEVICE))) return rc;
 
     // Add id
     const char *id;
     if ((rc = hpd_device_id_get_device_id_str(device, &id))) return rc;
-    if ((rc = rest_xml_add(xml, HPD_SERIALIZE_KEY_ID, id, context))) return rc;
+    if ((rc = rest_xml_attr(writer, HPD_SERIALIZE_KEY_ID, id))) return rc;
 
     // Add attributes
     const hpd_pair_t *pair;
     HPD_DEVICE_ID_FOREACH_ATTR(rc, pair, device)
-        if ((rc = rest_xml_add_attr(xml, pair, context))) return rc;
+        if ((rc = rest_xml_add_attr(writer, pair))) return rc;
     if (rc) return rc;
 
     // Add services
     hpd_service_id_t *service;
     HPD_DEVICE_ID_FOREACH_SERVICE_ID(rc, service, device) {
-        if ((rc = rest_xml_add_service(xml, service, rest, context))) return rc;
+        if ((rc = rest_xml_add_service(writer, service, rest))) {
+            hpd_service_id_free(service);
+            return rc;
+        }
     }
     if (rc) return rc;
 
-    return HPD_E_SUCCESS;
+    return rest_xml_end(writer);
 }
 
-static hpd_error_t rest_xml_add_adapter(mxml_node_t *parent, hpd_adapter_id_t *adapter, hpd_rest_t *rest, const hpd_module_t *context)
+static hpd_error_t rest_xml_add_adapter(rest_xml_writer_t *writer, hpd_adapter_id_t *adapter, hpd_rest_t *rest)
 {
     hpd_error_t rc;
 
-    // Create object
-    mxml_node_t *json;
-    if (!(json = mxmlNewElement(parent, HPD_SERIALIZE_KEY_ADAPTER))) REST_XML_RETURN_XML_ERROR(context);
+    // Begin element
+    if ((rc = rest_xml_begin(writer, HPD_SERIALIZE_KEY_ADAPTER))) return rc;
 
     // Add id
     const char *id;
     if ((rc = hpd_adapter_id_get_adapter_id_str(adapter, &id))) return rc;
-    if ((rc = rest_xml_add(json, HPD_SERIALIZE_KEY_ID, id, context))) return rc;
+    if ((rc = rest_xml_attr(writer, HPD_SERIALIZE_KEY_ID, id))) return rc;
 
     // Add attributes
     const hpd_pair_t *pair;
     HPD_ADAPTER_ID_FOREACH_ATTR(rc, pair, adapter) {
-        if ((rc = rest_xml_add_attr(json, pair, context))) return rc;
+        if ((rc = rest_xml_add_attr(writer, pair))) return rc;
     }
     if (rc) return rc;
 
     // Add devices
     hpd_device_id_t *device;
     HPD_ADAPTER_ID_FOREACH_DEVICE_ID(rc, device, adapter) {
-        if ((rc = rest_xml_add_device(json, device, rest, context))) return rc;
+        if ((rc = rest_xml_add_device(writer, device, rest))) {
+            hpd_device_id_free(device);
+            return rc;
+        }
     }
     if (rc) return rc;
 
-    return HPD_E_SUCCESS;
+    return rest_xml_end(writer);
 }
 
-static hpd_error_t rest_xml_add_configuration(mxml_node_t *parent, hpd_rest_t *rest, const hpd_module_t *context)
+static hpd_error_t rest_xml_add_configuration(rest_xml_writer_t *writer, hpd_rest_t *rest)
 {
     hpd_error_t rc;
+    const hpd_module_t *context = writer->context;
 
-    // Create object
-    mxml_node_t *xml;
-    if (!(xml = mxmlNewElement(parent, HPD_SERIALIZE_KEY_CONFIGURATION))) REST_XML_RETURN_XML_ERROR(context);
+    // Begin element
+    if ((rc = rest_xml_begin(writer, HPD_SERIALIZE_KEY_CONFIGURATION))) return rc;
 
     // Add encoded charset
 #ifdef CURL_ICONV_CODESET_OF_HOST
     curl_version_info_data *curl_ver = curl_version_info(CURLVERSION_NOW);
     if (curl_ver->features & CURL_VERSION_CONV && curl_ver->iconv_ver_num != 0)
-        if ((rc = rest_xml_add(xml, HPD_SERIALIZE_KEY_URL_ENCODED_CHARSET, CURL_ICONV_CODESET_OF_HOST, context))) return rc;
+        if ((rc = rest_xml_attr(writer, HPD_SERIALIZE_KEY_URL_ENCODED_CHARSET, CURL_ICONV_CODESET_OF_HOST))) return rc;
     else
-        if ((rc = rest_xml_add(xml, HPD_SERIALIZE_KEY_URL_ENCODED_CHARSET, HPD_SERIALIZE_VAL_ASCII, context))) return rc;
+        if ((rc = rest_xml_attr(writer, HPD_SERIALIZE_KEY_URL_ENCODED_CHARSET, HPD_SERIALIZE_VAL_ASCII))) return rc;
 #else
-    if ((rc = rest_xml_add(xml, HPD_SERIALIZE_KEY_URL_ENCODED_CHARSET, HPD_SERIALIZE_VAL_ASCII, context))) return rc;
+    if ((rc = rest_xml_attr(writer, HPD_SERIALIZE_KEY_URL_ENCODED_CHARSET, HPD_SERIALIZE_VAL_ASCII))) return rc;
 #endif
 
     // Add adapters
     hpd_adapter_id_t *adapter;
     HPD_FOREACH_ADAPTER_ID(rc, adapter, context) {
-        if ((rc = rest_xml_add_adapter(xml, adapter, rest, context))) return rc;
+        if ((rc = rest_xml_add_adapter(writer, adapter, rest))) {
+            hpd_adapter_id_free(adapter);
+            return rc;
+        }
     }
     if (rc) return rc;
 
-    return HPD_E_SUCCESS;
+    return rest_xml_end(writer);
 }
 
-hpd_error_t hpd_rest_xml_get_configuration(const hpd_module_t *context, hpd_rest_t *rest, char **out)
+/**
+ * Get the configuration as xml.
+ *
+ *  The xml is written while walking the model, without building an mxml tree
+ *  first. The output is identical to what mxmlSaveAllocString() gives for the
+ *  same tree.
+ *
+ *  \param  context  The module
+ *  \param  rest     The rest module
+ *  \param  out      Will be set to the first chunk of the xml, free with rest_chunks_free()
+ */
+hpd_error_t hpd_rest_xml_get_configuration(const hpd_module_t *context, hpd_rest_t *rest, rest_chunk_t **out)
 {
-    REST_XML_BEGIN(context);
-
     hpd_error_t rc;
+    rest_xml_writer_t writer = { .context = context, .chunks = { .context = context } };
 
-    mxml_node_t *xml;
-    if (!(xml = mxmlNewXML(REST_XML_VERSION))) {
-        REST_XML_END();
-        REST_XML_RETURN_XML_ERROR(context);
-    }
-
-    if ((rc = rest_xml_add_configuration(xml, rest, context))) goto error;
+    if ((rc = rest_xml_begin(&writer, REST_XML_DECLARATION)) ||
+        (rc = rest_xml_add_configuration(&writer, rest)) ||
+        (rc = rest_xml_end(&writer)))
+        goto error;
 
-    if (!((*out) = mxmlSaveAllocString(xml, MXML_NO_CALLBACK))) {
-        mxmlDelete(xml);
-        REST_XML_END();
-        REST_XML_RETURN_XML_ERROR(context);
-    }
+    // Like mxmlSaveString(), end with a newline, unless already at the start of a line
+    if (writer.col > 0 && (rc = rest_xml_put_c(&writer, '\n'))) goto error;
 
-    mxmlDelete(xml);
-    REST_XML_END();
+    free(writer.attrs);
+    (*out) = writer.chunks.first;
     return HPD_E_SUCCESS;
 
     error:
-    mxmlDelete(xml);
-    REST_XML_END();
-    return rc;
+        free(writer.attrs);
+        rest_chunks_free(writer.chunks.first);
+        return rc;
 }
 
-static hpd_error_t rest_xml_add_value(mxml_node_t *parent, char *value, const hpd_module_t *context)
+static hpd_error_t rest_xml_add_value(mxml_node_t *parent, const char *value, const hpd_module_t *context)
 {
     mxml_node_t *xml;
     if (!(xml = mxmlNewElement(parent, HPD_SERIALIZE_KEY_VALUE))) REST_XML_RETURN_XML_ERROR(context);
@@ -278,7 +487,7 @@ static hpd_error_t rest_xml_add_value(mxml_node_t *parent, char *value, const hp
     return HPD_E_SUCCESS;
 }
 
-hpd_error_t hpd_rest_xml_get_value(char *value, const hpd_module_t *context, char **out)
+hpd_error_t hpd_rest_xml_get_value(const char *value, const hpd_module_t *context, char **out)
 {
     REST_XML_BEGIN(context);
 
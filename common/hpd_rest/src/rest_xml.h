@@ -29,11 +29,20 @@
 #define HOMEPORT_REST_XML_H
 
 #include "../../../hpd/include/hpd-0.6/hpd_types.h"
+#include "rest_chunk.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
 
 typedef struct hpd_rest hpd_rest_t;
 
-hpd_error_t hpd_rest_xml_get_configuration(const hpd_module_t *context, hpd_rest_t *rest, char **out);
-hpd_error_t hpd_rest_xml_get_value(char *value, const hpd_module_t *context, char **out);
+hpd_error_t hpd_rest_xml_get_configuration(const hpd_module_t *context, hpd_rest_t *rest, rest_chunk_t **out);
+hpd_error_t hpd_rest_xml_get_value(const char *value, const hpd_module_t *context, char **out);
 hpd_error_t hpd_rest_xml_parse_value(const char *in, const hpd_module_t *context, char **out);
 
+#ifdef __cplusplus
+}
+#endif
+
 #endif
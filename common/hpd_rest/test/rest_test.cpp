@@ -0,0 +1,342 @@
+/*
+ * Copyright 2011 Aalborg University. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are
+ * permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of
+ * conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list
+ * of conditions and the following disclaimer in the documentation and/or other materials
+ * provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY Aalborg University ''AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL Aalborg University OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are those of the
+ * authors and should not be interpreted as representing official policies, either expressed
+ */
+
+/*
+ * Runs the rest module on the loopback interface and fetches the device list from a client thread, to check the
+ * entity tag of the cached body, the 304 response to If-None-Match, and that changes to the configuration, made on
+ * the loop on behalf of the client, replace the entity tag.
+ */
+
+#include <gtest/gtest.h>
+#include "hpd-0.6/hpd_api.h"
+#include "hpd-0.6/modules/hpd_rest.h"
+#include <ev.h>
+#include <errno.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <string>
+
+#define CASE hpd_rest
+
+#define PORT 18090
+
+typedef void (*client_f)();
+typedef void (*mutation_f)();
+
+static hpd_t *hpd;
+static const hpd_module_t *test_context;
+static client_f client;
+static pthread_t client_thread;
+static ev_timer timer;
+static volatile bool client_done;
+static mutation_f mutation;
+static sem_t mutated;
+
+static hpd_adapter_t *adapter;
+static hpd_device_t *device;
+static hpd_service_t *service;
+
+static void *on_client(void *data)
+{
+    client();
+    client_done = true;
+    return nullptr;
+}
+
+static void on_timeout(hpd_ev_loop_t *loop, ev_timer *w, int revents)
+{
+    mutation_f f = __atomic_exchange_n(&mutation, nullptr, __ATOMIC_SEQ_CST);
+    if (f) {
+        f();
+        sem_post(&mutated);
+    }
+
+    if (!client_done) return;
+    ev_timer_stop(loop, w);
+    hpd_stop(hpd);
+}
+
+static hpd_error_t on_create(void **data, const hpd_module_t *context)
+{
+    test_context = context;
+    *data = &timer;
+    return HPD_E_SUCCESS;
+}
+
+static hpd_error_t on_destroy(void *data)
+{
+    return HPD_E_SUCCESS;
+}
+
+static hpd_error_t on_start(void *data)
+{
+    hpd_error_t rc;
+    hpd_ev_loop_t *loop;
+
+    if ((rc = hpd_get_loop(test_context, &loop))) return rc;
+    if (pthread_create(&client_thread, nullptr, on_client, nullptr)) return HPD_E_UNKNOWN;
+    ev_timer_init(&timer, on_timeout, 0.01, 0.01);
+    ev_timer_start(loop, &timer);
+    return HPD_E_SUCCESS;
+}
+
+static hpd_error_t on_stop(void *data)
+{
+    hpd_error_t rc;
+
+    pthread_join(client_thread, nullptr);
+    if (adapter && (rc = hpd_adapter_free(adapter))) return rc;
+    adapter = nullptr;
+    return HPD_E_SUCCESS;
+}
+
+static hpd_error_t on_parse_opt(void *data, const char *name, const char *arg)
+{
+    return HPD_E_ARGUMENT;
+}
+
+static hpd_module_def_t module_def = { on_create, on_destroy, on_start, on_stop, on_parse_opt };
+
+static void run(client_f f)
+{
+    char *argv[] = { (char *) "test", (char *) "--rest-port=18090" };
+
+    client = f;
+    client_done = false;
+    ASSERT_EQ(sem_init(&mutated, 0, 0), 0);
+    ASSERT_EQ(hpd_alloc(&hpd), HPD_E_SUCCESS);
+    ASSERT_EQ(hpd_module(hpd, "rest", &hpd_rest), HPD_E_SUCCESS);
+    ASSERT_EQ(hpd_module(hpd, "test", &module_def), HPD_E_SUCCESS);
+    ASSERT_EQ(hpd_start(hpd, 2, argv), HPD_E_SUCCESS);
+    ASSERT_EQ(hpd_free(hpd), HPD_E_SUCCESS);
+    sem_destroy(&mutated);
+}
+
+/** Let the loop run f, as the configuration may only be changed there, and wait for it to finish. */
+static void mutate(mutation_f f)
+{
+    __atomic_store_n(&mutation, f, __ATOMIC_SEQ_CST);
+    while (sem_wait(&mutated) && errno == EINTR);
+}
+
+/** Whether a response has been read in full, the device list is sent in chunks, and a 304 response has no body. */
+static bool complete(const std::string &res)
+{
+    size_t end = res.find("\r\n\r\n");
+    if (end == std::string::npos) return false;
+    if (res.compare(0, 12, "HTTP/1.1 304") == 0) return true;
+    return res.size() >= 5 && res.compare(res.size() - 5, 5, "0\r\n\r\n") == 0;
+}
+
+/** Send a GET request for the device list, and read the response. */
+static std::string get(const std::string &headers)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr = {};
+    struct timeval timeout = { 0, 500000 };
+    std::string msg = "GET /devices HTTP/1.1\r\nHost: a\r\n" + headers + "\r\n", res;
+    char buf[1024];
+    ssize_t len;
+
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(PORT);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    EXPECT_GE(fd, 0);
+    EXPECT_EQ(setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)), 0);
+    EXPECT_EQ(connect(fd, (struct sockaddr *) &addr, sizeof(addr)), 0);
+    EXPECT_EQ(write(fd, msg.data(), msg.size()), (ssize_t) msg.size());
+    while (!complete(res) && (len = read(fd, buf, sizeof(buf))) > 0) res.append(buf, (size_t) len);
+    EXPECT_TRUE(complete(res));
+    close(fd);
+    return res;
+}
+
+static std::string status(const std::string &res)
+{
+    return res.substr(0, res.find("\r\n"));
+}
+
+static std::string header(const std::string &res, const std::string &name)
+{
+    size_t begin = res.find("\r\n" + name + ": "), end;
+    if (begin == std::string::npos || begin > res.find("\r\n\r\n")) return "";
+    begin += name.size() + 4;
+    end = res.find("\r\n", begin);
+    return res.substr(begin, end - begin);
+}
+
+static std::string body(const std::string &res)
+{
+    size_t begin = res.find("\r\n\r\n");
+    return begin == std::string::npos ? "" : res.substr(begin + 4);
+}
+
+static std::string etag, json_etag, if_none_match[9];
+static std::string res_200, res_json, res_304[6], res_mismatch[3];
+
+static void on_etag()
+{
+    res_200 = get("");
+    etag = header(res_200, "ETag");
+    res_json = get("Accept: application/json\r\n");
+    json_etag = header(res_json, "ETag");
+
+    // Each of these lists our tag, in the forms If-None-Match allows
+    if_none_match[0] = etag;
+    if_none_match[1] = "W/" + etag;
+    if_none_match[2] = "\"other\", " + etag;
+    if_none_match[3] = "\"other\" ,\t" + etag + " , W/\"more\"";
+    if_none_match[4] = "*";
+    if_none_match[5] = " * ";
+    for (int i = 0; i < 6; i++) res_304[i] = get("If-None-Match: " + if_none_match[i] + "\r\n");
+
+    // And these hold it only as a part of another tag
+    if_none_match[6] = "\"x" + etag.substr(1);
+    if_none_match[7] = etag.substr(0, etag.size() - 1) + "x\"";
+    if_none_match[8] = "\"other\", W/\"" + etag + "\"";
+    for (int i = 0; i < 3; i++) res_mismatch[i] = get("If-None-Match: " + if_none_match[6 + i] + "\r\n");
+}
+
+TEST(CASE, etag) {
+    run(on_etag);
+
+    ASSERT_EQ(status(res_200), "HTTP/1.1 200 OK");
+    ASSERT_EQ(etag.size(), 18u);
+    ASSERT_EQ(etag.front(), '"');
+    ASSERT_EQ(etag.back(), '"');
+    ASSERT_FALSE(body(res_200).empty());
+
+    // Each representation has its own tag
+    ASSERT_EQ(status(res_json), "HTTP/1.1 200 OK");
+    ASSERT_EQ(json_etag.size(), 18u);
+    ASSERT_NE(json_etag, etag);
+
+    for (int i = 0; i < 6; i++) {
+        SCOPED_TRACE(if_none_match[i]);
+        ASSERT_EQ(status(res_304[i]), "HTTP/1.1 304 Not Modified");
+        ASSERT_EQ(header(res_304[i], "ETag"), etag);
+        ASSERT_EQ(body(res_304[i]), "");
+    }
+    for (int i = 0; i < 3; i++) {
+        SCOPED_TRACE(if_none_match[6 + i]);
+        ASSERT_EQ(status(res_mismatch[i]), "HTTP/1.1 200 OK");
+        ASSERT_EQ(body(res_mismatch[i]), body(res_200));
+    }
+}
+
+static void attach_adapter()
+{
+    EXPECT_EQ(hpd_adapter_alloc(&adapter, test_context, "a0"), HPD_E_SUCCESS);
+    EXPECT_EQ(hpd_adapter_attach(adapter), HPD_E_SUCCESS);
+}
+
+static void attach_device()
+{
+    EXPECT_EQ(hpd_device_alloc(&device, test_context, "d0"), HPD_E_SUCCESS);
+    EXPECT_EQ(hpd_device_attach(adapter, device), HPD_E_SUCCESS);
+}
+
+static void attach_service()
+{
+    EXPECT_EQ(hpd_service_alloc(&service, test_context, "s0"), HPD_E_SUCCESS);
+    EXPECT_EQ(hpd_service_attach(device, service), HPD_E_SUCCESS);
+}
+
+static void change_adapter()
+{
+    EXPECT_EQ(hpd_adapter_set_attr(adapter, "name", "Adapter"), HPD_E_SUCCESS);
+}
+
+static void change_device()
+{
+    EXPECT_EQ(hpd_device_set_attr(device, "name", "Device"), HPD_E_SUCCESS);
+}
+
+static void change_service()
+{
+    EXPECT_EQ(hpd_service_set_attr(service, "name", "Service"), HPD_E_SUCCESS);
+}
+
+static void detach_service()
+{
+    EXPECT_EQ(hpd_service_detach(service), HPD_E_SUCCESS);
+    EXPECT_EQ(hpd_service_free(service), HPD_E_SUCCESS);
+    service = nullptr;
+}
+
+static void detach_device()
+{
+    EXPECT_EQ(hpd_device_detach(device), HPD_E_SUCCESS);
+    EXPECT_EQ(hpd_device_free(device), HPD_E_SUCCESS);
+    device = nullptr;
+}
+
+static void detach_adapter()
+{
+    EXPECT_EQ(hpd_adapter_detach(adapter), HPD_E_SUCCESS);
+    EXPECT_EQ(hpd_adapter_free(adapter), HPD_E_SUCCESS);
+    adapter = nullptr;
+}
+
+#define MUTATIONS 9
+
+static const mutation_f mutations[MUTATIONS] = {
+        attach_adapter, attach_device, attach_service,
+        change_adapter, change_device, change_service,
+        detach_service, detach_device, detach_adapter,
+};
+static std::string etags[MUTATIONS + 1], res_cached[MUTATIONS + 1];
+
+static void on_mutations()
+{
+    etags[0] = header(get(""), "ETag");
+    for (int i = 0; i < MUTATIONS; i++) {
+        mutate(mutations[i]);
+        etags[i + 1] = header(get(""), "ETag");
+        // The new tag is the one the cache now holds
+        res_cached[i + 1] = get("If-None-Match: " + etags[i + 1] + "\r\n");
+    }
+}
+
+TEST(CASE, etag_changes) {
+    run(on_mutations);
+
+    ASSERT_FALSE(etags[0].empty());
+    for (int i = 1; i <= MUTATIONS; i++) {
+        SCOPED_TRACE(i);
+        ASSERT_FALSE(etags[i].empty());
+        ASSERT_NE(etags[i], etags[i - 1]);
+        ASSERT_EQ(status(res_cached[i]), "HTTP/1.1 304 Not Modified");
+    }
+
+    // The body is a function of the configuration only
+    ASSERT_EQ(etags[MUTATIONS], etags[0]);
+}
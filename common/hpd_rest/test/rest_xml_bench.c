@@ -0,0 +1,303 @@
+/*
+ * Copyright 2011 Aalborg University. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are
+ * permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of
+ * conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list
+ * of conditions and the following disclaimer in the documentation and/or other materials
+ * provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY Aalborg University ''AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL Aalborg University OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are those of the
+ * authors and should not be interpreted as representing official policies, either expressed
+ */
+
+
+/*
+ * Xml configuration benchmark.
+ *
+ * Compares hpd_rest_xml_get_configuration(), which writes the xml while walking the model, against building an mxml
+ * tree and saving it with mxmlSaveAllocString(), as it was done before (see rest_xml_mxml.c). For each model size, both
+ * are run until roughly BENCH_SERVICES services have been serialised, and the outputs are checked to be identical.
+ * Prints microseconds per configuration for both.
+ *
+ * Usage: bench_rest_xml
+ */
+
+#include "../src/rest_xml.h"
+#include "rest_xml_mxml.h"
+#include "hpd-0.6/hpd_api.h"
+#include <ev.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_SERVICES 200000
+#define BENCH_DEVICES 4
+#define BENCH_SERVICES_PER_DEVICE 4
+
+static const int sizes[] = { 1, 10, 100, 0 };
+
+typedef struct {
+    const hpd_module_t *context;
+    hpd_adapter_t **adapters;
+    int adapters_len;
+    ev_timer timer;
+} bench_t;
+
+static hpd_t *hpd;
+
+static hpd_error_t bench_on_create(void **data, const hpd_module_t *context);
+static hpd_error_t bench_on_destroy(void *data);
+static hpd_error_t bench_on_start(void *data);
+static hpd_error_t bench_on_stop(void *data);
+static hpd_error_t bench_on_parse_opt(void *data, const char *name, const char *arg);
+
+static hpd_module_def_t bench_def = {
+        bench_on_create,
+        bench_on_destroy,
+        bench_on_start,
+        bench_on_stop,
+        bench_on_parse_opt,
+};
+
+static double bench_elapsed(const struct timespec *start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double) (now.tv_sec - start->tv_sec) + (double) (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static hpd_status_t bench_on_get(void *data, hpd_request_t *req)
+{
+    return HPD_S_200;
+}
+
+static hpd_error_t bench_add_adapter(bench_t *bench)
+{
+    hpd_error_t rc;
+    char id[32];
+    hpd_adapter_t *adapter;
+
+    snprintf(id, sizeof(id), "adapter%i", bench->adapters_len);
+    if ((rc = hpd_adapter_alloc(&adapter, bench->context, id))) return rc;
+    if ((rc = hpd_adapter_set_attr(adapter, "name", "Bench & <adapter>"))) goto error_free;
+    if ((rc = hpd_adapter_attach(adapter))) goto error_free;
+    bench->adapters[bench->adapters_len++] = adapter;
+
+    for (int d = 0; d < BENCH_DEVICES; d++) {
+        hpd_device_t *device;
+        snprintf(id, sizeof(id), "device%i", d);
+        if ((rc = hpd_device_alloc(&device, bench->context, id))) return rc;
+        if ((rc = hpd_device_set_attr(device, "description", "A device with a \"quoted\" description, long enough to wrap"))) {
+            hpd_device_free(device);
+            return rc;
+        }
+        if ((rc = hpd_device_attach(adapter, device))) {
+            hpd_device_free(device);
+            return rc;
+        }
+
+        for (int s = 0; s < BENCH_SERVICES_PER_DEVICE; s++) {
+            hpd_service_t *service;
+            hpd_parameter_t *parameter;
+            snprintf(id, sizeof(id), "service%i", s);
+            if ((rc = hpd_service_alloc(&service, bench->context, id))) return rc;
+            if ((rc = hpd_service_set_action(service, HPD_M_GET, bench_on_get)) ||
+                (rc = hpd_service_set_attr(service, "unit", "W")) ||
+                (rc = hpd_parameter_alloc(&parameter, bench->context, "p0"))) {
+                hpd_service_free(service);
+                return rc;
+            }
+            if ((rc = hpd_parameter_set_attr(parameter, "max", "100")) ||
+                (rc = hpd_parameter_attach(service, parameter))) {
+                hpd_parameter_free(parameter);
+                hpd_service_free(service);
+                return rc;
+            }
+            if ((rc = hpd_service_attach(device, service))) {
+                hpd_service_free(service);
+                return rc;
+            }
+        }
+    }
+
+    return HPD_E_SUCCESS;
+
+    error_free:
+        hpd_adapter_free(adapter);
+        return rc;
+}
+
+/// Join the chunks written by hpd_rest_xml_get_configuration() into a string, for comparison
+static char *bench_join(rest_chunk_t *chunks)
+{
+    size_t len = 0;
+    for (rest_chunk_t *chunk = chunks; chunk; chunk = chunk->next) len += chunk->len;
+
+    char *str = malloc(len + 1);
+    if (!str) return NULL;
+    len = 0;
+    for (rest_chunk_t *chunk = chunks; chunk; chunk = chunk->next) {
+        memcpy(&str[len], chunk->buf, chunk->len);
+        len += chunk->len;
+    }
+    str[len] = '\0';
+    return str;
+}
+
+static hpd_error_t bench_run(bench_t *bench, int size)
+{
+    hpd_error_t rc;
+    struct timespec start;
+    char *expected, *actual;
+    rest_chunk_t *chunks;
+    int runs = BENCH_SERVICES / (size * BENCH_DEVICES * BENCH_SERVICES_PER_DEVICE);
+    if (runs < 1) runs = 1;
+
+    // Check that the output is the same
+    if ((rc = rest_xml_mxml_get_configuration(bench->context, &expected))) return rc;
+    if ((rc = hpd_rest_xml_get_configuration(bench->context, NULL, &chunks))) {
+        free(expected);
+        return rc;
+    }
+    actual = bench_join(chunks);
+    rest_chunks_free(chunks);
+    if (!actual) {
+        free(expected);
+        return HPD_E_ALLOC;
+    }
+    if (strcmp(expected, actual) != 0) {
+        fprintf(stderr, "Output differs for %i adapters.\n--- mxml:\n%s\n--- writer:\n%s\n", size, expected, actual);
+        free(expected);
+        free(actual);
+        return HPD_E_UNKNOWN;
+    }
+    size_t len = strlen(actual);
+    free(expected);
+    free(actual);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < runs; i++) {
+        if ((rc = rest_xml_mxml_get_configuration(bench->context, &expected))) return rc;
+        free(expected);
+    }
+    double mxml_secs = bench_elapsed(&start);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < runs; i++) {
+        if ((rc = hpd_rest_xml_get_configuration(bench->context, NULL, &chunks))) return rc;
+        rest_chunks_free(chunks);
+    }
+    double writer_secs = bench_elapsed(&start);
+
+    printf("adapters %4i (%8zu bytes): mxml %10.1f us, writer %10.1f us, speedup %5.1fx\n",
+           size, len, mxml_secs * 1e6 / runs, writer_secs * 1e6 / runs, mxml_secs / writer_secs);
+    fflush(stdout);
+    return HPD_E_SUCCESS;
+}
+
+static hpd_error_t bench_on_create(void **data, const hpd_module_t *context)
+{
+    int max = 0;
+    for (const int *size = sizes; *size; size++) if (*size > max) max = *size;
+
+    bench_t *bench = calloc(1, sizeof(bench_t));
+    if (!bench) return HPD_E_ALLOC;
+    if (!(bench->adapters = calloc((size_t) max, sizeof(hpd_adapter_t *)))) {
+        free(bench);
+        return HPD_E_ALLOC;
+    }
+    bench->context = context;
+    *data = bench;
+    return HPD_E_SUCCESS;
+}
+
+static hpd_error_t bench_on_destroy(void *data)
+{
+    bench_t *bench = data;
+    free(bench->adapters);
+    free(bench);
+    return HPD_E_SUCCESS;
+}
+
+static void bench_on_timeout(hpd_ev_loop_t *loop, ev_timer *timer, int revents)
+{
+    hpd_error_t rc;
+    bench_t *bench = timer->data;
+
+    for (const int *size = sizes; *size; size++) {
+        while (bench->adapters_len < *size)
+            if ((rc = bench_add_adapter(bench))) goto error;
+        if ((rc = bench_run(bench, *size))) goto error;
+    }
+
+    hpd_stop(hpd);
+    return;
+
+    error:
+        HPD_LOG_ERROR(bench->context, "Benchmark failed [code: %i].", rc);
+        hpd_stop(hpd);
+}
+
+static hpd_error_t bench_on_start(void *data)
+{
+    hpd_error_t rc;
+    bench_t *bench = data;
+    hpd_ev_loop_t *loop;
+
+    // Run from within the loop, as hpd_stop() has no effect before it runs
+    if ((rc = hpd_get_loop(bench->context, &loop))) return rc;
+    ev_timer_init(&bench->timer, bench_on_timeout, 0, 0);
+    bench->timer.data = bench;
+    ev_timer_start(loop, &bench->timer);
+    return HPD_E_SUCCESS;
+}
+
+static hpd_error_t bench_on_stop(void *data)
+{
+    hpd_error_t rc;
+    bench_t *bench = data;
+    hpd_ev_loop_t *loop;
+
+    if ((rc = hpd_get_loop(bench->context, &loop))) return rc;
+    ev_timer_stop(loop, &bench->timer);
+
+    while (bench->adapters_len > 0) {
+        if ((rc = hpd_adapter_free(bench->adapters[--bench->adapters_len]))) return rc;
+    }
+    return HPD_E_SUCCESS;
+}
+
+static hpd_error_t bench_on_parse_opt(void *data, const char *name, const char *arg)
+{
+    return HPD_E_ARGUMENT;
+}
+
+int main(int argc, char *argv[])
+{
+    hpd_error_t rc;
+
+    if ((rc = hpd_alloc(&hpd))) return rc;
+    if ((rc = hpd_module(hpd, "bench", &bench_def))) goto error_free;
+    if ((rc = hpd_start(hpd, argc, argv))) goto error_free;
+    return hpd_free(hpd);
+
+    error_free:
+    hpd_free(hpd);
+    return rc;
+}
@@ -0,0 +1,137 @@
+/*
+ * Copyright 2011 Aalborg University. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are
+ * permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of
+ * conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list
+ * of conditions and the following disclaimer in the documentation and/or other materials
+ * provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY Aalborg University ''AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL Aalborg University OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are those of the
+ * authors and should not be interpreted as representing official policies, either expressed
+ */
+
+
+#include "rest_xml_mxml.h"
+#include "hpd-0.6/hpd_api.h"
+#include "hpd-0.6/common/hpd_serialize_shared.h"
+#include <mxml.h>
+#include <stdlib.h>
+
+static hpd_error_t mxml_add_attr(mxml_node_t *xml, const hpd_pair_t *pair)
+{
+    hpd_error_t rc;
+    const char *key, *val;
+    if ((rc = hpd_pair_get(pair, &key, &val))) return rc;
+    mxmlElementSetAttr(xml, key, val);
+    return HPD_E_SUCCESS;
+}
+
+static hpd_error_t mxml_add_parameter(mxml_node_t *parent, hpd_parameter_id_t *parameter)
+{
+    hpd_error_t rc;
+    const char *id;
+    const hpd_pair_t *pair;
+
+    mxml_node_t *xml = mxmlNewElement(parent, HPD_SERIALIZE_KEY_PARAMETER);
+    if ((rc = hpd_parameter_id_get_parameter_id_str(parameter, &id))) return rc;
+    mxmlElementSetAttr(xml, HPD_SERIALIZE_KEY_ID, id);
+    HPD_PARAMETER_ID_FOREACH_ATTR(rc, pair, parameter)
+        if ((rc = mxml_add_attr(xml, pair))) return rc;
+    return rc;
+}
+
+static hpd_error_t mxml_add_service(mxml_node_t *parent, hpd_service_id_t *service, const hpd_module_t *context)
+{
+    hpd_error_t rc;
+    const char *id;
+    char *url;
+    const hpd_action_t *action;
+    const hpd_pair_t *pair;
+    hpd_parameter_id_t *parameter;
+
+    mxml_node_t *xml = mxmlNewElement(parent, HPD_SERIALIZE_KEY_SERVICE);
+    if ((rc = hpd_service_id_get_service_id_str(service, &id))) return rc;
+    mxmlElementSetAttr(xml, HPD_SERIALIZE_KEY_ID, id);
+    if ((rc = hpd_serialize_url_create(context, service, &url))) return rc;
+    mxmlElementSetAttr(xml, HPD_SERIALIZE_KEY_URI, url);
+    free(url);
+    HPD_SERVICE_ID_FOREACH_ACTION(rc, action, service) {
+        hpd_method_t method;
+        if ((rc = hpd_action_get_method(action, &method))) return rc;
+        if (method == HPD_M_GET) mxmlElementSetAttr(xml, HPD_SERIALIZE_KEY_GET, HPD_SERIALIZE_VAL_TRUE);
+        if (method == HPD_M_PUT) mxmlElementSetAttr(xml, HPD_SERIALIZE_KEY_PUT, HPD_SERIALIZE_VAL_TRUE);
+    }
+    if (rc) return rc;
+    HPD_SERVICE_ID_FOREACH_ATTR(rc, pair, service)
+        if ((rc = mxml_add_attr(xml, pair))) return rc;
+    if (rc) return rc;
+    HPD_SERVICE_ID_FOREACH_PARAMETER_ID(rc, parameter, service)
+        if ((rc = mxml_add_parameter(xml, parameter))) return rc;
+    return rc;
+}
+
+static hpd_error_t mxml_add_device(mxml_node_t *parent, hpd_device_id_t *device, const hpd_module_t *context)
+{
+    hpd_error_t rc;
+    const char *id;
+    const hpd_pair_t *pair;
+    hpd_service_id_t *service;
+
+    mxml_node_t *xml = mxmlNewElement(parent, HPD_SERIALIZE_KEY_DEVICE);
+    if ((rc = hpd_device_id_get_device_id_str(device, &id))) return rc;
+    mxmlElementSetAttr(xml, HPD_SERIALIZE_KEY_ID, id);
+    HPD_DEVICE_ID_FOREACH_ATTR(rc, pair, device)
+        if ((rc = mxml_add_attr(xml, pair))) return rc;
+    if (rc) return rc;
+    HPD_DEVICE_ID_FOREACH_SERVICE_ID(rc, service, device)
+        if ((rc = mxml_add_service(xml, service, context))) return rc;
+    return rc;
+}
+
+static hpd_error_t mxml_add_adapter(mxml_node_t *parent, hpd_adapter_id_t *adapter, const hpd_module_t *context)
+{
+    hpd_error_t rc;
+    const char *id;
+    const hpd_pair_t *pair;
+    hpd_device_id_t *device;
+
+    mxml_node_t *xml = mxmlNewElement(parent, HPD_SERIALIZE_KEY_ADAPTER);
+    if ((rc = hpd_adapter_id_get_adapter_id_str(adapter, &id))) return rc;
+    mxmlElementSetAttr(xml, HPD_SERIALIZE_KEY_ID, id);
+    HPD_ADAPTER_ID_FOREACH_ATTR(rc, pair, adapter)
+        if ((rc = mxml_add_attr(xml, pair))) return rc;
+    if (rc) return rc;
+    HPD_ADAPTER_ID_FOREACH_DEVICE_ID(rc, device, adapter)
+        if ((rc = mxml_add_device(xml, device, context))) return rc;
+    return rc;
+}
+
+hpd_error_t rest_xml_mxml_get_configuration(const hpd_module_t *context, char **out)
+{
+    hpd_error_t rc;
+    hpd_adapter_id_t *adapter;
+
+    mxml_node_t *xml = mxmlNewXML("1.0");
+    mxml_node_t *configuration = mxmlNewElement(xml, HPD_SERIALIZE_KEY_CONFIGURATION);
+    mxmlElementSetAttr(configuration, HPD_SERIALIZE_KEY_URL_ENCODED_CHARSET, HPD_SERIALIZE_VAL_ASCII);
+    HPD_FOREACH_ADAPTER_ID(rc, adapter, context)
+        if ((rc = mxml_add_adapter(configuration, adapter, context))) break;
+    if (!rc && !((*out) = mxmlSaveAllocString(xml, MXML_NO_CALLBACK))) rc = HPD_E_ALLOC;
+    mxmlDelete(xml);
+    return rc;
+}
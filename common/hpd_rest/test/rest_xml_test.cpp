@@ -0,0 +1,205 @@
+/*
+ * Copyright 2011 Aalborg University. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are
+ * permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of
+ * conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list
+ * of conditions and the following disclaimer in the documentation and/or other materials
+ * provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY Aalborg University ''AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL Aalborg University OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are those of the
+ * authors and should not be interpreted as representing official policies, either expressed
+ */
+
+/*
+ * Checks that the xml configuration written by the rest module is byte for byte what building an mxml tree and saving
+ * it gave (see rest_xml_mxml.c), for entities, empty elements, and attributes wrapped at column 72.
+ */
+
+#include <gtest/gtest.h>
+#include "../src/rest_xml.h"
+#include "rest_xml_mxml.h"
+#include "hpd-0.6/hpd_api.h"
+#include <ev.h>
+#include <string>
+
+#define CASE hpd_rest_xml
+
+/// Attribute values of each length in this range are written, so the wrap margin is met at every column
+#define WRAP_MIN 1
+#define WRAP_MAX 80
+
+enum { EMPTY, ATTACHED, CONFIGURATIONS };
+
+static hpd_t *hpd;
+static const hpd_module_t *test_context;
+static ev_timer timer;
+static hpd_adapter_t *adapters[2];
+static std::string expected[CONFIGURATIONS], actual[CONFIGURATIONS];
+
+static hpd_status_t on_action(void *data, hpd_request_t *req)
+{
+    return HPD_S_200;
+}
+
+static hpd_error_t attach()
+{
+    hpd_error_t rc;
+    hpd_device_t *device;
+    hpd_service_t *service;
+    hpd_parameter_t *parameter;
+
+    // Entities in ids and attributes, the apostrophe and UTF-8 are written as they are
+    if ((rc = hpd_adapter_alloc(&adapters[0], test_context, "a&b<c>d\"e'f"))) return rc;
+    if ((rc = hpd_adapter_set_attrs(adapters[0],
+                                    "name", "Tom & Jerry's <\"adapter\">",
+                                    "utf-8", "K\xc3\xb8kken \xe2\x80\x93 \xe6\xb8\xa9\xe5\xba\xa6",
+                                    "empty", "",
+                                    NULL))) return rc;
+    if ((rc = hpd_adapter_attach(adapters[0]))) return rc;
+
+    // Attributes of each length, and entities that make a value longer than mxml counts it when wrapping
+    if ((rc = hpd_device_alloc(&device, test_context, "wrap"))) return rc;
+    for (int len = WRAP_MIN; len <= WRAP_MAX; len++) {
+        char key[16];
+        std::string val(len, 'v');
+        snprintf(key, sizeof(key), "k%02d", len);
+        if ((rc = hpd_device_set_attr(device, key, val.c_str()))) return rc;
+    }
+    if ((rc = hpd_device_set_attr(device, "entities", "&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&"))) return rc;
+    if ((rc = hpd_device_set_attr(device, "long", std::string(200, 'l').c_str()))) return rc;
+    if ((rc = hpd_device_attach(adapters[0], device))) return rc;
+
+    for (int len = WRAP_MIN; len <= WRAP_MAX; len += 7) {
+        char id[16];
+        snprintf(id, sizeof(id), "s%02d", len);
+        if ((rc = hpd_service_alloc(&service, test_context, id))) return rc;
+        if ((rc = hpd_service_set_attr(service, "v", std::string(len, '<').c_str()))) return rc;
+        if (len % 2 && (rc = hpd_service_set_action(service, HPD_M_GET, on_action))) return rc;
+        if ((rc = hpd_service_attach(device, service))) return rc;
+
+        if ((rc = hpd_parameter_alloc(&parameter, test_context, "p0"))) return rc;
+        if ((rc = hpd_parameter_set_attr(parameter, "max", std::string(len, '9').c_str()))) return rc;
+        if ((rc = hpd_parameter_attach(service, parameter))) return rc;
+    }
+
+    // Empty elements at each level
+    if ((rc = hpd_device_alloc(&device, test_context, "no services"))) return rc;
+    if ((rc = hpd_device_attach(adapters[0], device))) return rc;
+    if ((rc = hpd_device_alloc(&device, test_context, "empty service"))) return rc;
+    if ((rc = hpd_device_attach(adapters[0], device))) return rc;
+    if ((rc = hpd_service_alloc(&service, test_context, "s"))) return rc;
+    if ((rc = hpd_service_attach(device, service))) return rc;
+    if ((rc = hpd_adapter_alloc(&adapters[1], test_context, "no devices"))) return rc;
+    return hpd_adapter_attach(adapters[1]);
+}
+
+static hpd_error_t serialise(int i)
+{
+    hpd_error_t rc;
+    char *str;
+    rest_chunk_t *chunks;
+
+    if ((rc = rest_xml_mxml_get_configuration(test_context, &str))) return rc;
+    expected[i] = str;
+    free(str);
+
+    if ((rc = hpd_rest_xml_get_configuration(test_context, NULL, &chunks))) return rc;
+    actual[i].clear();
+    for (rest_chunk_t *chunk = chunks; chunk; chunk = chunk->next) actual[i].append(chunk->buf, chunk->len);
+    rest_chunks_free(chunks);
+    return HPD_E_SUCCESS;
+}
+
+static void on_timeout(hpd_ev_loop_t *loop, ev_timer *w, int revents)
+{
+    ev_timer_stop(loop, w);
+    hpd_stop(hpd);
+}
+
+static hpd_error_t on_create(void **data, const hpd_module_t *context)
+{
+    test_context = context;
+    *data = &timer;
+    return HPD_E_SUCCESS;
+}
+
+static hpd_error_t on_destroy(void *data)
+{
+    return HPD_E_SUCCESS;
+}
+
+static hpd_error_t on_start(void *data)
+{
+    hpd_error_t rc;
+    hpd_ev_loop_t *loop;
+
+    if ((rc = serialise(EMPTY))) return rc;
+    if ((rc = attach())) return rc;
+    if ((rc = serialise(ATTACHED))) return rc;
+
+    if ((rc = hpd_get_loop(test_context, &loop))) return rc;
+    ev_timer_init(&timer, on_timeout, 0, 0);
+    ev_timer_start(loop, &timer);
+    return HPD_E_SUCCESS;
+}
+
+static hpd_error_t on_stop(void *data)
+{
+    hpd_error_t rc;
+
+    for (int i = 0; i < 2; i++) {
+        if (adapters[i] && (rc = hpd_adapter_free(adapters[i]))) return rc;
+        adapters[i] = NULL;
+    }
+    return HPD_E_SUCCESS;
+}
+
+static hpd_error_t on_parse_opt(void *data, const char *name, const char *arg)
+{
+    return HPD_E_ARGUMENT;
+}
+
+static hpd_module_def_t module_def = { on_create, on_destroy, on_start, on_stop, on_parse_opt };
+
+TEST(CASE, configuration_as_mxml) {
+    char *argv[] = { (char *) "test" };
+
+    ASSERT_EQ(hpd_alloc(&hpd), HPD_E_SUCCESS);
+    ASSERT_EQ(hpd_module(hpd, "test", &module_def), HPD_E_SUCCESS);
+    ASSERT_EQ(hpd_start(hpd, 1, argv), HPD_E_SUCCESS);
+    ASSERT_EQ(hpd_free(hpd), HPD_E_SUCCESS);
+
+    // Without adapters, the configuration is an empty element
+    ASSERT_NE(expected[EMPTY].find("_urlEncodedCharset=\"ASCII\" />"), std::string::npos);
+    ASSERT_EQ(actual[EMPTY], expected[EMPTY]);
+
+    // The cases are in the output
+    const std::string &xml = expected[ATTACHED];
+    ASSERT_NE(xml.find("\"a&amp;b&lt;c&gt;d&quot;e'f\""), std::string::npos);
+    ASSERT_NE(xml.find("\"Tom &amp; Jerry's &lt;&quot;adapter&quot;&gt;\""), std::string::npos);
+    ASSERT_NE(xml.find("\"K\xc3\xb8kken \xe2\x80\x93 \xe6\xb8\xa9\xe5\xba\xa6\""), std::string::npos);
+    ASSERT_NE(xml.find("empty=\"\""), std::string::npos);
+    ASSERT_NE(xml.find("id=\"no devices\" />"), std::string::npos);
+    ASSERT_NE(xml.find("id=\"no services\" />"), std::string::npos);
+    ASSERT_NE(xml.find("\nk"), std::string::npos);
+    ASSERT_NE(xml.find("\nlong="), std::string::npos);
+
+    size_t pos = 0;
+    while (pos < actual[ATTACHED].size() && actual[ATTACHED][pos] == xml[pos]) pos++;
+    ASSERT_EQ(actual[ATTACHED], xml) << "First difference at byte " << pos;
+}
@@ -31,6 +31,21 @@
 #include <hpd-0.6/hpd_types.h>
 #include <hpd-0.6/common/hpd_jansson.h>
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct hpd_json_writer hpd_json_writer_t;
+
+/**
+ * Called with each buffer of a streaming json writer.
+ *
+ *  \param  data  Data given to hpd_json_writer_alloc()
+ *  \param  buf   The buffer, allocated with malloc(), ownership is passed on, also on errors
+ *  \param  len   Length of the data in buf
+ */
+typedef hpd_error_t (*hpd_json_write_f)(void *data, char *buf, size_t len);
+
 hpd_error_t hpd_json_adapter_id_to_json(const hpd_module_t *context, const hpd_adapter_id_t *adapter, json_t **out);
 hpd_error_t hpd_json_adapter_to_json(const hpd_module_t *context, const hpd_adapter_id_t *adapter, json_t **out);
 hpd_error_t hpd_json_adapter_to_json_shallow(const hpd_module_t *context, const hpd_adapter_id_t *adapter, json_t **out);
@@ -50,7 +65,23 @@ hpd_error_t hpd_json_value_to_json(const hpd_module_t *context, const hpd_value_
 hpd_error_t hpd_json_response_to_json(const hpd_module_t *context, const hpd_response_t *response, json_t **out);
 hpd_error_t hpd_json_request_to_json(const hpd_module_t *context, const hpd_request_t *request, json_t **out);
 
+hpd_error_t hpd_json_writer_alloc(hpd_json_writer_t **writer, const hpd_module_t *context, size_t chunk_size,
+                                  hpd_json_write_f on_write, void *data);
+hpd_error_t hpd_json_writer_free(hpd_json_writer_t *writer);
+hpd_error_t hpd_json_writer_flush(hpd_json_writer_t *writer);
+hpd_error_t hpd_json_writer_begin_object(hpd_json_writer_t *writer);
+hpd_error_t hpd_json_writer_end_object(hpd_json_writer_t *writer);
+hpd_error_t hpd_json_writer_begin_array(hpd_json_writer_t *writer);
+hpd_error_t hpd_json_writer_end_array(hpd_json_writer_t *writer);
+hpd_error_t hpd_json_writer_key(hpd_json_writer_t *writer, const char *key);
+hpd_error_t hpd_json_writer_string(hpd_json_writer_t *writer, const char *val);
+hpd_error_t hpd_json_configuration_write(const hpd_module_t *context, hpd_json_writer_t *writer);
+
 hpd_error_t hpd_json_value_parse(const hpd_module_t *context, json_t *json, hpd_value_t **out);
 hpd_error_t hpd_json_request_parse(const hpd_module_t *context, json_t *json, hpd_response_f on_response, hpd_request_t **out);
 
+#ifdef __cplusplus
+}
+#endif
+
 #endif //HOMEPORT_HPD_JSON_H
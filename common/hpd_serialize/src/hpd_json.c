@@ -496,12 +496,9 @@ hpd_error_t hpd_json_value_to_json(const hpd_module_t *context, const hpd_value_
 {
     hpd_error_t rc;
 
+    // The body is always followed by a '\0'
     const char *body;
-    size_t len;
-    if ((rc = hpd_value_get_body(value, &body, &len))) return rc;
-
-    char *null_term = NULL;
-    HPD_STR_N_CPY(null_term, body, len);
+    if ((rc = hpd_value_get_body(value, &body, NULL))) return rc;
 
     json_t *json;
     if (!(json = json_object())) goto json_error;
@@ -529,20 +526,14 @@ hpd_error_t hpd_json_value_to_json(const hpd_module_t *context, const hpd_value_
     }
 
     (*out) = json;
-    free(null_term);
     return HPD_E_SUCCESS;
 
     error:
     json_decref(json);
-    free(null_term);
     return rc;
 
-    alloc_error:
-    HPD_LOG_RETURN_E_ALLOC(context);
-
     json_error:
     if (json) json_decref(json);
-    free(null_term);
     HPD_JSON_RETURN_JSON_ERROR(context);
 }
 
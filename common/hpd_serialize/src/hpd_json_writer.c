@@ -0,0 +1,515 @@
+/*
+ * Copyright 2011 Aalborg University. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are
+ * permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of
+ * conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list
+ * of conditions and the following disclaimer in the documentation and/or other materials
+ * provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY Aalborg University ''AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL Aalborg University OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are those of the
+ * authors and should not be interpreted as representing official policies, either expressed
+ */
+
+
+#include <hpd-0.6/common/hpd_json.h>
+#include <hpd-0.6/common/hpd_serialize_shared.h>
+
+#pragma clang diagnostic push
+#pragma ide diagnostic ignored "UnusedImportStatement"
+#include <curl/curl.h>
+#pragma clang diagnostic pop
+
+#include <hpd-0.6/hpd_shared_api.h>
+#include <hpd-0.6/common/hpd_common.h>
+#include <hpd-0.6/hpd_api.h>
+#include <string.h>
+#include <stdio.h>
+
+/// Maximum nesting of objects and arrays
+#define HPD_JSON_WRITER_DEPTH_MAX 32
+
+/**
+ * A streaming json writer.
+ *
+ *  Json is written directly into a buffer of a fixed size, which is
+ *  handed on to the write callback each time it fills up, and when the
+ *  writer is flushed. Output is formatted as json_dumps() without flags,
+ *  but members are written in the order they are given, and strings are
+ *  not validated as UTF-8.
+ */
+struct hpd_json_writer {
+    const hpd_module_t *context;
+    hpd_json_write_f on_write; ///< Called with each full buffer
+    void *data;                ///< Data for on_write
+    char *buf;                 ///< Current buffer, NULL until written to
+    size_t len;                ///< Length of data in buf
+    size_t size;               ///< Size of buffers
+    int depth;                 ///< Current nesting of objects and arrays
+    hpd_bool_t first[HPD_JSON_WRITER_DEPTH_MAX]; ///< Whether the next element is the first, for each level
+    hpd_bool_t key;            ///< A key has been written, and its value is next
+};
+
+static hpd_error_t json_writer_put(hpd_json_writer_t *writer, const char *str, size_t len)
+{
+    hpd_error_t rc;
+
+    while (len > 0) {
+        if (!writer->buf && !(writer->buf = malloc(writer->size))) HPD_LOG_RETURN_E_ALLOC(writer->context);
+
+        size_t n = writer->size - writer->len;
+        if (n > len) n = len;
+        memcpy(&writer->buf[writer->len], str, n);
+        writer->len += n;
+        str += n;
+        len -= n;
+
+        if (writer->len == writer->size && (rc = hpd_json_writer_flush(writer))) return rc;
+    }
+
+    return HPD_E_SUCCESS;
+}
+
+static hpd_error_t json_writer_puts(hpd_json_writer_t *writer, const char *str)
+{
+    return json_writer_put(writer, str, strlen(str));
+}
+
+static hpd_error_t json_writer_put_string(hpd_json_writer_t *writer, const char *str)
+{
+    hpd_error_t rc;
+    char esc[7];
+    const char *run = str;
+
+    if ((rc = json_writer_put(writer, "\"", 1))) return rc;
+
+    for (; *str; str++) {
+        unsigned char c = (unsigned char) *str;
+        if (c >= 0x20 && c != '"' && c != '\\') continue;
+
+        // Write the run of characters not needing escape
+        if ((rc = json_writer_put(writer, run, str - run))) return rc;
+        run = str + 1;
+
+        switch (c) {
+            case '"':  strcpy(esc, "\\\""); break;
+            case '\\': strcpy(esc, "\\\\"); break;
+            case '\b': strcpy(esc, "\\b"); break;
+            case '\f': strcpy(esc, "\\f"); break;
+            case '\n': strcpy(esc, "\\n"); break;
+            case '\r': strcpy(esc, "\\r"); break;
+            case '\t': strcpy(esc, "\\t"); break;
+            default:   snprintf(esc, sizeof(esc), "\\u%04X", c); break;
+        }
+        if ((rc = json_writer_puts(writer, esc))) return rc;
+    }
+
+    if ((rc = json_writer_put(writer, run, str - run))) return rc;
+    return json_writer_put(writer, "\"", 1);
+}
+
+/**
+ * Write the separator before the next element, if any.
+ */
+static hpd_error_t json_writer_next(hpd_json_writer_t *writer)
+{
+    if (writer->key) {
+        writer->key = HPD_FALSE;
+        return HPD_E_SUCCESS;
+    }
+    if (writer->depth == 0) return HPD_E_SUCCESS;
+    if (writer->first[writer->depth-1]) {
+        writer->first[writer->depth-1] = HPD_FALSE;
+        return HPD_E_SUCCESS;
+    }
+    return json_writer_put(writer, ", ", 2);
+}
+
+static hpd_error_t json_writer_begin(hpd_json_writer_t *writer, const char *open)
+{
+    hpd_error_t rc;
+
+    if (writer->depth == HPD_JSON_WRITER_DEPTH_MAX)
+        HPD_LOG_RETURN(writer->context, HPD_E_STATE, "Json nested too deeply.");
+    if ((rc = json_writer_next(writer))) return rc;
+    writer->first[writer->depth++] = HPD_TRUE;
+    return json_writer_puts(writer, open);
+}
+
+static hpd_error_t json_writer_end(hpd_json_writer_t *writer, const char *close)
+{
+    if (writer->depth == 0 || writer->key)
+        HPD_LOG_RETURN(writer->context, HPD_E_STATE, "Json not open.");
+    writer->depth--;
+    return json_writer_puts(writer, close);
+}
+
+/**
+ * Allocate a streaming json writer.
+ *
+ *  Json is written into buffers of chunk_size bytes, which are handed on
+ *  to on_write as they fill up. The last buffer is handed on by
+ *  hpd_json_writer_flush().
+ *
+ *  \param  writer      Will be set to the writer
+ *  \param  context     The module
+ *  \param  chunk_size  Size of each buffer
+ *  \param  on_write    Called with each buffer, takes ownership of it
+ *  \param  data        Data for on_write
+ */
+hpd_error_t hpd_json_writer_alloc(hpd_json_writer_t **writer, const hpd_module_t *context, size_t chunk_size,
+                                  hpd_json_write_f on_write, void *data)
+{
+    if (!context) return HPD_E_NULL;
+    if (!writer || !on_write) HPD_LOG_RETURN_E_NULL(context);
+    if (chunk_size == 0) HPD_LOG_RETURN(context, HPD_E_ARGUMENT, "Chunk size must be positive.");
+
+    HPD_CALLOC(*writer, 1, hpd_json_writer_t);
+    (*writer)->context = context;
+    (*writer)->on_write = on_write;
+    (*writer)->data = data;
+    (*writer)->size = chunk_size;
+    return HPD_E_SUCCESS;
+
+    alloc_error:
+        HPD_LOG_RETURN_E_ALLOC(context);
+}
+
+/**
+ * Free a streaming json writer, dropping any data not yet flushed.
+ *
+ *  \param  writer  The writer
+ */
+hpd_error_t hpd_json_writer_free(hpd_json_writer_t *writer)
+{
+    if (!writer) return HPD_E_NULL;
+    free(writer->buf);
+    free(writer);
+    return HPD_E_SUCCESS;
+}
+
+/**
+ * Hand on the data written so far to the write callback.
+ *
+ *  \param  writer  The writer
+ */
+hpd_error_t hpd_json_writer_flush(hpd_json_writer_t *writer)
+{
+    if (!writer) return HPD_E_NULL;
+    if (!writer->len) return HPD_E_SUCCESS;
+
+    char *buf = writer->buf;
+    size_t len = writer->len;
+    writer->buf = NULL;
+    writer->len = 0;
+    return writer->on_write(writer->data, buf, len);
+}
+
+hpd_error_t hpd_json_writer_begin_object(hpd_json_writer_t *writer)
+{
+    if (!writer) return HPD_E_NULL;
+    return json_writer_begin(writer, "{");
+}
+
+hpd_error_t hpd_json_writer_end_object(hpd_json_writer_t *writer)
+{
+    if (!writer) return HPD_E_NULL;
+    return json_writer_end(writer, "}");
+}
+
+hpd_error_t hpd_json_writer_begin_array(hpd_json_writer_t *writer)
+{
+    if (!writer) return HPD_E_NULL;
+    return json_writer_begin(writer, "[");
+}
+
+hpd_error_t hpd_json_writer_end_array(hpd_json_writer_t *writer)
+{
+    if (!writer) return HPD_E_NULL;
+    return json_writer_end(writer, "]");
+}
+
+/**
+ * Write the key of the next member of an object, the value is written next.
+ *
+ *  \param  writer  The writer
+ *  \param  key     The key
+ */
+hpd_error_t hpd_json_writer_key(hpd_json_writer_t *writer, const char *key)
+{
+    hpd_error_t rc;
+
+    if (!writer) return HPD_E_NULL;
+    if (!key) HPD_LOG_RETURN_E_NULL(writer->context);
+    if (writer->key) HPD_LOG_RETURN(writer->context, HPD_E_STATE, "Json key already written.");
+
+    if ((rc = json_writer_next(writer))) return rc;
+    if ((rc = json_writer_put_string(writer, key))) return rc;
+    if ((rc = json_writer_put(writer, ": ", 2))) return rc;
+    writer->key = HPD_TRUE;
+    return HPD_E_SUCCESS;
+}
+
+hpd_error_t hpd_json_writer_string(hpd_json_writer_t *writer, const char *val)
+{
+    hpd_error_t rc;
+
+    if (!writer) return HPD_E_NULL;
+    if (!val) HPD_LOG_RETURN_E_NULL(writer->context);
+
+    if ((rc = json_writer_next(writer))) return rc;
+    return json_writer_put_string(writer, val);
+}
+
+static hpd_error_t json_writer_member_str(hpd_json_writer_t *writer, const char *key, const char *val)
+{
+    hpd_error_t rc;
+    if ((rc = hpd_json_writer_key(writer, key))) return rc;
+    return hpd_json_writer_string(writer, val);
+}
+
+static hpd_error_t json_writer_pair(hpd_json_writer_t *writer, const hpd_pair_t *pair)
+{
+    hpd_error_t rc;
+
+    // Get key and value
+    const char *key, *val;
+    if ((rc = hpd_pair_get(pair, &key, &val))) return rc;
+
+    return json_writer_member_str(writer, key, val);
+}
+
+static hpd_error_t json_write_parameter(const hpd_module_t *context, hpd_json_writer_t *writer,
+                                        const hpd_parameter_id_t *parameter)
+{
+    hpd_error_t rc;
+
+    if ((rc = hpd_json_writer_begin_object(writer))) return rc;
+
+    // Add id
+    const char *id;
+    if ((rc = hpd_parameter_id_get_parameter_id_str(parameter, &id))) return rc;
+    if ((rc = json_writer_member_str(writer, HPD_SERIALIZE_KEY_ID, id))) return rc;
+
+    // Add attributes
+    const hpd_pair_t *pair;
+    if ((rc = hpd_json_writer_key(writer, HPD_SERIALIZE_KEY_ATTRS))) return rc;
+    if ((rc = hpd_json_writer_begin_object(writer))) return rc;
+    HPD_PARAMETER_ID_FOREACH_ATTR(rc, pair, parameter)
+        if ((rc = json_writer_pair(writer, pair))) return rc;
+    if (rc) return rc;
+    if ((rc = hpd_json_writer_end_object(writer))) return rc;
+
+    return hpd_json_writer_end_object(writer);
+}
+
+static hpd_error_t json_write_service(const hpd_module_t *context, hpd_json_writer_t *writer,
+                                      const hpd_service_id_t *service)
+{
+    hpd_error_t rc;
+
+    if ((rc = hpd_json_writer_begin_object(writer))) return rc;
+
+    // Add id
+    const char *aid, *did, *sid;
+    if ((rc = hpd_service_id_get_adapter_id_str(service, &aid))) return rc;
+    if ((rc = hpd_service_id_get_device_id_str(service, &did))) return rc;
+    if ((rc = hpd_service_id_get_service_id_str(service, &sid))) return rc;
+    if ((rc = hpd_json_writer_key(writer, HPD_SERIALIZE_KEY_ID)) ||
+        (rc = hpd_json_writer_begin_object(writer)) ||
+        (rc = json_writer_member_str(writer, HPD_SERIALIZE_KEY_ADAPTER, aid)) ||
+        (rc = json_writer_member_str(writer, HPD_SERIALIZE_KEY_DEVICE, did)) ||
+        (rc = json_writer_member_str(writer, HPD_SERIALIZE_KEY_SERVICE, sid)) ||
+        (rc = hpd_json_writer_end_object(writer)))
+        return rc;
+
+    // Add url
+    char *url;
+    if ((rc = hpd_serialize_url_create(context, service, &url))) return rc;
+    rc = json_writer_member_str(writer, HPD_SERIALIZE_KEY_URI, url);
+    free(url);
+    if (rc) return rc;
+
+    // Add actions
+    const hpd_action_t *action;
+    HPD_SERVICE_ID_FOREACH_ACTION(rc, action, service) {
+        hpd_method_t method;
+        if ((rc = hpd_action_get_method(action, &method))) return rc;
+        switch (method) {
+            case HPD_M_NONE:break;
+            case HPD_M_GET:
+                if ((rc = json_writer_member_str(writer, HPD_SERIALIZE_KEY_GET, HPD_SERIALIZE_VAL_TRUE))) return rc;
+                break;
+            case HPD_M_PUT:
+                if ((rc = json_writer_member_str(writer, HPD_SERIALIZE_KEY_PUT, HPD_SERIALIZE_VAL_TRUE))) return rc;
+                break;
+            case HPD_M_COUNT:break;
+        }
+    }
+    if (rc) return rc;
+
+    // Add attributes
+    const hpd_pair_t *pair;
+    if ((rc = hpd_json_writer_key(writer, HPD_SERIALIZE_KEY_ATTRS))) return rc;
+    if ((rc = hpd_json_writer_begin_object(writer))) return rc;
+    HPD_SERVICE_ID_FOREACH_ATTR(rc, pair, service)
+        if ((rc = json_writer_pair(writer, pair))) return rc;
+    if (rc) return rc;
+    if ((rc = hpd_json_writer_end_object(writer))) return rc;
+
+    // Add parameters
+    hpd_parameter_id_t *parameter;
+    if ((rc = hpd_json_writer_key(writer, HPD_SERIALIZE_KEY_PARAMETERS))) return rc;
+    if ((rc = hpd_json_writer_begin_array(writer))) return rc;
+    HPD_SERVICE_ID_FOREACH_PARAMETER_ID(rc, parameter, service) {
+        if ((rc = json_write_parameter(context, writer, parameter))) {
+            hpd_parameter_id_free(parameter);
+            return rc;
+        }
+    }
+    if (rc) return rc;
+    if ((rc = hpd_json_writer_end_array(writer))) return rc;
+
+    return hpd_json_writer_end_object(writer);
+}
+
+static hpd_error_t json_write_device(const hpd_module_t *context, hpd_json_writer_t *writer,
+                                     const hpd_device_id_t *device)
+{
+    hpd_error_t rc;
+
+    if ((rc = hpd_json_writer_begin_object(writer))) return rc;
+
+    // Add id
+    const char *aid, *did;
+    if ((rc = hpd_device_id_get_adapter_id_str(device, &aid))) return rc;
+    if ((rc = hpd_device_id_get_device_id_str(device, &did))) return rc;
+    if ((rc = hpd_json_writer_key(writer, HPD_SERIALIZE_KEY_ID)) ||
+        (rc = hpd_json_writer_begin_object(writer)) ||
+        (rc = json_writer_member_str(writer, HPD_SERIALIZE_KEY_ADAPTER, aid)) ||
+        (rc = json_writer_member_str(writer, HPD_SERIALIZE_KEY_DEVICE, did)) ||
+        (rc = hpd_json_writer_end_object(writer)))
+        return rc;
+
+    // Add attributes
+    const hpd_pair_t *pair;
+    if ((rc = hpd_json_writer_key(writer, HPD_SERIALIZE_KEY_ATTRS))) return rc;
+    if ((rc = hpd_json_writer_begin_object(writer))) return rc;
+    HPD_DEVICE_ID_FOREACH_ATTR(rc, pair, device)
+        if ((rc = json_writer_pair(writer, pair))) return rc;
+    if (rc) return rc;
+    if ((rc = hpd_json_writer_end_object(writer))) return rc;
+
+    // Add services
+    hpd_service_id_t *service;
+    if ((rc = hpd_json_writer_key(writer, HPD_SERIALIZE_KEY_SERVICES))) return rc;
+    if ((rc = hpd_json_writer_begin_array(writer))) return rc;
+    HPD_DEVICE_ID_FOREACH_SERVICE_ID(rc, service, device) {
+        if ((rc = json_write_service(context, writer, service))) {
+            hpd_service_id_free(service);
+            return rc;
+        }
+    }
+    if (rc) return rc;
+    if ((rc = hpd_json_writer_end_array(writer))) return rc;
+
+    return hpd_json_writer_end_object(writer);
+}
+
+static hpd_error_t json_write_adapter(const hpd_module_t *context, hpd_json_writer_t *writer,
+                                      const hpd_adapter_id_t *adapter)
+{
+    hpd_error_t rc;
+
+    if ((rc = hpd_json_writer_begin_object(writer))) return rc;
+
+    // Add id
+    const char *aid;
+    if ((rc = hpd_adapter_id_get_adapter_id_str(adapter, &aid))) return rc;
+    if ((rc = hpd_json_writer_key(writer, HPD_SERIALIZE_KEY_ID)) ||
+        (rc = hpd_json_writer_begin_object(writer)) ||
+        (rc = json_writer_member_str(writer, HPD_SERIALIZE_KEY_ADAPTER, aid)) ||
+        (rc = hpd_json_writer_end_object(writer)))
+        return rc;
+
+    // Add attributes
+    const hpd_pair_t *pair;
+    if ((rc = hpd_json_writer_key(writer, HPD_SERIALIZE_KEY_ATTRS))) return rc;
+    if ((rc = hpd_json_writer_begin_object(writer))) return rc;
+    HPD_ADAPTER_ID_FOREACH_ATTR(rc, pair, adapter)
+        if ((rc = json_writer_pair(writer, pair))) return rc;
+    if (rc) return rc;
+    if ((rc = hpd_json_writer_end_object(writer))) return rc;
+
+    // Add devices
+    hpd_device_id_t *device;
+    if ((rc = hpd_json_writer_key(writer, HPD_SERIALIZE_KEY_DEVICES))) return rc;
+    if ((rc = hpd_json_writer_begin_array(writer))) return rc;
+    HPD_ADAPTER_ID_FOREACH_DEVICE_ID(rc, device, adapter) {
+        if ((rc = json_write_device(context, writer, device))) {
+            hpd_device_id_free(device);
+            return rc;
+        }
+    }
+    if (rc) return rc;
+    if ((rc = hpd_json_writer_end_array(writer))) return rc;
+
+    return hpd_json_writer_end_object(writer);
+}
+
+/**
+ * Write the configuration, as hpd_json_configuration_to_json() would produce it.
+ *
+ *  The model is walked once, without building a json tree, and written
+ *  into the buffers of the writer as it goes. The writer is not flushed.
+ *
+ *  \param  context  The module
+ *  \param  writer   The writer
+ */
+hpd_error_t hpd_json_configuration_write(const hpd_module_t *context, hpd_json_writer_t *writer)
+{
+    hpd_error_t rc;
+
+    if (!context) return HPD_E_NULL;
+    if (!writer) HPD_LOG_RETURN_E_NULL(context);
+
+    if ((rc = hpd_json_writer_begin_object(writer))) return rc;
+
+    // Add encoded charset
+    const char *charset = HPD_SERIALIZE_VAL_ASCII;
+#ifdef CURL_ICONV_CODESET_OF_HOST
+    curl_version_info_data *curl_ver = curl_version_info(CURLVERSION_NOW);
+    if (curl_ver->features & CURL_VERSION_CONV && curl_ver->iconv_ver_num != 0)
+        charset = CURL_ICONV_CODESET_OF_HOST;
+#endif
+    if ((rc = json_writer_member_str(writer, HPD_SERIALIZE_KEY_URL_ENCODED_CHARSET, charset))) return rc;
+
+    // Add adapters
+    hpd_adapter_id_t *adapter;
+    if ((rc = hpd_json_writer_key(writer, HPD_SERIALIZE_KEY_ADAPTERS))) return rc;
+    if ((rc = hpd_json_writer_begin_array(writer))) return rc;
+    HPD_FOREACH_ADAPTER_ID(rc, adapter, context) {
+        if ((rc = json_write_adapter(context, writer, adapter))) {
+            hpd_adapter_id_free(adapter);
+            return rc;
+        }
+    }
+    if (rc) return rc;
+    if ((rc = hpd_json_writer_end_array(writer))) return rc;
+
+    return hpd_json_writer_end_object(writer);
+}
@@ -0,0 +1,206 @@
+/*
+ * Copyright 2011 Aalborg University. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are
+ * permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of
+ * conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list
+ * of conditions and the following disclaimer in the documentation and/or other materials
+ * provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY Aalborg University ''AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL Aalborg University OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are those of the
+ * authors and should not be interpreted as representing official policies, either expressed
+ */
+
+/*
+ * Attaches a configuration with strings that need escaping, and checks that the streaming json writer gives the same
+ * bytes as json_dumps() of the tree from hpd_json_configuration_to_json(), whatever the size of its buffers.
+ */
+
+#include <gtest/gtest.h>
+#include "hpd-0.6/hpd_api.h"
+#include "hpd-0.6/common/hpd_json.h"
+#include <ev.h>
+#include <string>
+
+#define CASE hpd_json_writer
+
+/// Buffer sizes to write with, the smallest splits every escape sequence
+static const size_t chunk_sizes[] = { 1, 2, 7, 64, 4096 };
+#define CHUNK_SIZES (sizeof(chunk_sizes) / sizeof(chunk_sizes[0]))
+
+static hpd_t *hpd;
+static const hpd_module_t *test_context;
+static ev_timer timer;
+static hpd_adapter_t *adapters[2];
+static std::string dumped, written[CHUNK_SIZES];
+static size_t max_len[CHUNK_SIZES];
+
+static hpd_status_t on_action(void *data, hpd_request_t *req)
+{
+    return HPD_S_200;
+}
+
+static hpd_error_t on_write(void *data, char *buf, size_t len)
+{
+    size_t i = (size_t) data;
+
+    written[i].append(buf, len);
+    if (len > max_len[i]) max_len[i] = len;
+    free(buf);
+    return HPD_E_SUCCESS;
+}
+
+static hpd_error_t attach()
+{
+    hpd_error_t rc;
+    hpd_device_t *device;
+    hpd_service_t *service;
+    hpd_parameter_t *parameter;
+
+    // Control characters, quotes, backslashes, slashes and non-ASCII UTF-8 in ids, keys and values
+    if ((rc = hpd_adapter_alloc(&adapters[0], test_context, "adapter/0"))) return rc;
+    if ((rc = hpd_adapter_set_attrs(adapters[0],
+                                    "name", "Quote \" backslash \\ slash /",
+                                    "control", "\x01\x02\b\f\n\r\t\x1f\x7f",
+                                    "utf-8", "K\xc3\xb8kken \xe2\x80\x93 \xe6\xb8\xa9\xe5\xba\xa6 \xf0\x9f\x98\x80",
+                                    "k\\e\"y\n", "",
+                                    NULL))) return rc;
+    if ((rc = hpd_adapter_attach(adapters[0]))) return rc;
+
+    if ((rc = hpd_device_alloc(&device, test_context, "device \"0\""))) return rc;
+    if ((rc = hpd_device_set_attrs(device, "name", "\\\\server\\share", "type", "</script>", NULL))) return rc;
+    if ((rc = hpd_device_attach(adapters[0], device))) return rc;
+
+    if ((rc = hpd_service_alloc(&service, test_context, "service\\0"))) return rc;
+    if ((rc = hpd_service_set_attrs(service, "type", "\xc2\xb0" "C", "unit", "\t", NULL))) return rc;
+    if ((rc = hpd_service_set_actions(service, HPD_M_GET, on_action, HPD_M_PUT, on_action, HPD_M_NONE))) return rc;
+    if ((rc = hpd_service_attach(device, service))) return rc;
+
+    if ((rc = hpd_parameter_alloc(&parameter, test_context, "p\x7f\n"))) return rc;
+    if ((rc = hpd_parameter_set_attrs(parameter, "min", "-1", "max", "\"1\"", NULL))) return rc;
+    if ((rc = hpd_parameter_attach(service, parameter))) return rc;
+
+    if ((rc = hpd_service_alloc(&service, test_context, "service 1"))) return rc;
+    if ((rc = hpd_service_attach(device, service))) return rc;
+
+    // Empty objects and arrays
+    if ((rc = hpd_device_alloc(&device, test_context, "empty"))) return rc;
+    if ((rc = hpd_device_attach(adapters[0], device))) return rc;
+    if ((rc = hpd_adapter_alloc(&adapters[1], test_context, "\xe2\x82\xac"))) return rc;
+    return hpd_adapter_attach(adapters[1]);
+}
+
+static hpd_error_t dump()
+{
+    hpd_error_t rc;
+    json_t *json;
+    char *str;
+
+    if ((rc = hpd_json_configuration_to_json(test_context, &json))) return rc;
+    str = json_dumps(json, 0);
+    json_decref(json);
+    if (!str) return HPD_E_UNKNOWN;
+    dumped = str;
+    free(str);
+    return HPD_E_SUCCESS;
+}
+
+static hpd_error_t write_configuration(size_t i)
+{
+    hpd_error_t rc;
+    hpd_json_writer_t *writer;
+
+    if ((rc = hpd_json_writer_alloc(&writer, test_context, chunk_sizes[i], on_write, (void *) i))) return rc;
+    if ((rc = hpd_json_configuration_write(test_context, writer)) || (rc = hpd_json_writer_flush(writer))) {
+        hpd_json_writer_free(writer);
+        return rc;
+    }
+    return hpd_json_writer_free(writer);
+}
+
+static void on_timeout(hpd_ev_loop_t *loop, ev_timer *w, int revents)
+{
+    ev_timer_stop(loop, w);
+    hpd_stop(hpd);
+}
+
+static hpd_error_t on_create(void **data, const hpd_module_t *context)
+{
+    test_context = context;
+    *data = &timer;
+    return HPD_E_SUCCESS;
+}
+
+static hpd_error_t on_destroy(void *data)
+{
+    return HPD_E_SUCCESS;
+}
+
+static hpd_error_t on_start(void *data)
+{
+    hpd_error_t rc;
+    hpd_ev_loop_t *loop;
+
+    if ((rc = attach())) return rc;
+    if ((rc = dump())) return rc;
+    for (size_t i = 0; i < CHUNK_SIZES; i++)
+        if ((rc = write_configuration(i))) return rc;
+
+    if ((rc = hpd_get_loop(test_context, &loop))) return rc;
+    ev_timer_init(&timer, on_timeout, 0, 0);
+    ev_timer_start(loop, &timer);
+    return HPD_E_SUCCESS;
+}
+
+static hpd_error_t on_stop(void *data)
+{
+    hpd_error_t rc;
+
+    for (int i = 0; i < 2; i++) {
+        if (adapters[i] && (rc = hpd_adapter_free(adapters[i]))) return rc;
+        adapters[i] = NULL;
+    }
+    return HPD_E_SUCCESS;
+}
+
+static hpd_error_t on_parse_opt(void *data, const char *name, const char *arg)
+{
+    return HPD_E_ARGUMENT;
+}
+
+static hpd_module_def_t module_def = { on_create, on_destroy, on_start, on_stop, on_parse_opt };
+
+TEST(CASE, configuration_as_json_dumps) {
+    char *argv[] = { (char *) "test" };
+
+    ASSERT_EQ(hpd_alloc(&hpd), HPD_E_SUCCESS);
+    ASSERT_EQ(hpd_module(hpd, "test", &module_def), HPD_E_SUCCESS);
+    ASSERT_EQ(hpd_start(hpd, 1, argv), HPD_E_SUCCESS);
+    ASSERT_EQ(hpd_free(hpd), HPD_E_SUCCESS);
+
+    // The escapes json_dumps() makes without flags, slashes and UTF-8 are left as they are
+    ASSERT_NE(dumped.find("\"Quote \\\" backslash \\\\ slash /\""), std::string::npos);
+    ASSERT_NE(dumped.find("\"\\u0001\\u0002\\b\\f\\n\\r\\t\\u001F\x7f\""), std::string::npos);
+    ASSERT_NE(dumped.find("\"K\xc3\xb8kken \xe2\x80\x93 \xe6\xb8\xa9\xe5\xba\xa6 \xf0\x9f\x98\x80\""), std::string::npos);
+    ASSERT_NE(dumped.find("\"k\\\\e\\\"y\\n\": \"\""), std::string::npos);
+
+    for (size_t i = 0; i < CHUNK_SIZES; i++) {
+        SCOPED_TRACE(chunk_sizes[i]);
+        ASSERT_EQ(written[i], dumped);
+        ASSERT_LE(max_len[i], chunk_sizes[i]);
+    }
+}
@@ -34,13 +34,53 @@
 extern "C" {
 #endif
 
+/**
+ * Pause the loop; needed to touch the model, which includes hpd_changed() as it reads the service. Requests, responses
+ * and changes by id, with hpd_id_changed(), can be pushed from any thread without it.
+ */
 hpd_error_t hpd_thread_lock(const hpd_module_t *context);
 hpd_error_t hpd_thread_unlock(const hpd_module_t *context);
 
+/**
+ * Send a request from a foreign thread and wait for its response, without pausing the loop. req_value is handed over,
+ * also if an error is returned.
+ */
 hpd_error_t hpd_thread_request_sync_safe(const hpd_module_t *context, const hpd_service_id_t *srv,
                                          hpd_method_t method, hpd_value_t *req_value, hpd_status_t *status,
                                          hpd_value_t **res_value);
 
+typedef struct hpd_thread_future hpd_thread_future_t;
+typedef struct hpd_thread_request hpd_thread_request_t;
+
+struct hpd_thread_request {
+    const hpd_service_id_t *srv;
+    hpd_method_t method;
+    hpd_value_t *value;         ///< Handed over, also on errors, may be NULL
+};
+
+/**
+ * Send a request from a foreign thread without waiting. The future must be freed with hpd_thread_future_free(), which
+ * may be done before the request is done. req_value is handed over, also if an error is returned.
+ */
+hpd_error_t hpd_thread_request_async(const hpd_module_t *context, const hpd_service_id_t *srv,
+                                     hpd_method_t method, hpd_value_t *req_value, hpd_thread_future_t **future);
+/**
+ * Send n requests, which the loop picks up on a single wakeup. futures must have room for n futures. The values of the
+ * requests are handed over on every path: if an error is returned, e.g. because hpd has stopped, none of the requests
+ * are sent, their values are freed, and no futures are returned.
+ */
+hpd_error_t hpd_thread_request_batch(const hpd_module_t *context, const hpd_thread_request_t *requests, size_t n,
+                                     hpd_thread_future_t **futures);
+
+/** Wait at most timeout seconds for the response, or without limit if timeout is negative. */
+hpd_error_t hpd_thread_future_wait(hpd_thread_future_t *future, double timeout, hpd_bool_t *done);
+hpd_error_t hpd_thread_future_poll(hpd_thread_future_t *future, hpd_bool_t *done);
+/** Eventfd that becomes readable when the future is done. Owned by the future, do not close it. */
+hpd_error_t hpd_thread_future_get_fd(hpd_thread_future_t *future, int *fd);
+/** Status and value of a done request, the value is handed over to the caller. */
+hpd_error_t hpd_thread_future_get_response(hpd_thread_future_t *future, hpd_status_t *status, hpd_value_t **value);
+hpd_error_t hpd_thread_future_free(hpd_thread_future_t *future);
+
 #ifdef __cplusplus
 }
 #endif
@@ -31,6 +31,10 @@
 #include <pthread.h>
 #include <hpd-0.6/common/hpd_common.h>
 #include <semaphore.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
 #include <hpd-0.6/hpd_api.h>
 
 #define HPD_LOG_RETURN_PTHREAD_CODE(CONTEXT, RC) HPD_LOG_RETURN((CONTEXT), HPD_E_UNKNOWN, "pthread failed [code: %i].", (RC))
@@ -43,7 +47,6 @@
 } while(0)
 
 typedef struct thread thread_t;
-typedef struct req_data req_data_t;
 
 struct thread {
     const hpd_module_t *context;
@@ -54,11 +57,20 @@ struct thread {
     sem_t sem_cont_loop;
 };
 
-struct req_data {
+/**
+ * Completion of a request sent from another thread. The response callback fills it in on the loop thread, and it is
+ * marked done when the request is freed, so a request that is dropped without a response still completes. It is
+ * shared by the request and the caller, and freed by whichever lets go of it last.
+ */
+struct hpd_thread_future {
+    const hpd_module_t *context;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    int refs;                   ///< Accessed atomically
+    hpd_bool_t done;            ///< Set when the request is freed, guarded by mutex
+    hpd_status_t status;        ///< HPD_S_NONE until a response arrives
     hpd_value_t *val;
-    hpd_status_t status;
-    sem_t sem;
-    hpd_bool_t get_val;
+    int fd;                     ///< Eventfd, -1 until asked for, guarded by mutex
 };
 
 static hpd_error_t thread_on_create(void **data, const hpd_module_t *context);
@@ -112,6 +124,8 @@ static hpd_error_t thread_on_create(void **data, const hpd_module_t *context)
     if ((stat = sem_init(&thread->sem_cont_loop, 0, 0)))
         HPD_LOG_RETURN_PTHREAD_CODE(thread->context, stat);
 
+    // hpd only destroys modules with data
+    (*data) = thread;
     return HPD_E_SUCCESS;
 
     alloc_error:
@@ -194,98 +208,284 @@ hpd_error_t hpd_thread_unlock(const hpd_module_t *context)
     return HPD_E_SUCCESS;
 }
 
-static void on_hpd_response(void *in, const hpd_response_t *res)
+static hpd_error_t thread_future_alloc(hpd_thread_future_t **future, const hpd_module_t *context)
 {
     int stat;
+    pthread_condattr_t attr;
+
+    HPD_CALLOC(*future, 1, hpd_thread_future_t);
+    (*future)->context = context;
+    (*future)->refs = 2;
+    (*future)->status = HPD_S_NONE;
+    (*future)->fd = -1;
+
+    if ((stat = pthread_mutex_init(&(*future)->mutex, NULL))) goto pthread_error;
+    // Timed waits are measured on the monotonic clock, so changes to the wall clock do not affect them
+    if ((stat = pthread_condattr_init(&attr))) goto pthread_error_mutex;
+    if (!(stat = pthread_condattr_setclock(&attr, CLOCK_MONOTONIC)))
+        stat = pthread_cond_init(&(*future)->cond, &attr);
+    pthread_condattr_destroy(&attr);
+    if (stat) goto pthread_error_mutex;
+
+    return HPD_E_SUCCESS;
+
+    pthread_error_mutex:
+    pthread_mutex_destroy(&(*future)->mutex);
+    pthread_error:
+    free(*future);
+    (*future) = NULL;
+    HPD_LOG_RETURN_PTHREAD_CODE(context, stat);
+
+    alloc_error:
+    HPD_LOG_RETURN_E_ALLOC(context);
+}
+
+static void thread_future_destroy(hpd_thread_future_t *future)
+{
     hpd_error_t rc;
 
-    req_data_t *data = in;
+    if (future->val && (rc = hpd_value_free(future->val)))
+        HPD_LOG_ERROR(future->context, "hpd free (code: %i)", rc);
+    if (future->fd >= 0) close(future->fd);
+    pthread_cond_destroy(&future->cond);
+    pthread_mutex_destroy(&future->mutex);
+    free(future);
+}
 
-    const hpd_service_id_t *srv;
-    if ((rc = hpd_response_get_request_service(res, &srv))) {
-        HPD_LOG_ERROR(thread->context, "hpd failed (code: %i)", rc);
-        goto done;
-    }
+static void thread_future_unref(hpd_thread_future_t *future)
+{
+    if (!__atomic_sub_fetch(&future->refs, 1, __ATOMIC_ACQ_REL)) thread_future_destroy(future);
+}
+
+static void on_hpd_response(void *in, const hpd_response_t *res)
+{
+    hpd_error_t rc;
+    hpd_thread_future_t *future = in;
+    const hpd_value_t *val;
 
-    const char *sid;
-    if ((rc = hpd_service_id_get_service_id_str(srv, &sid))) {
-        HPD_LOG_ERROR(thread->context, "hpd failed (code: %i)", rc);
-        goto done;
+    if ((rc = hpd_response_get_status(res, &future->status))) {
+        HPD_LOG_ERROR(future->context, "hpd failed (code: %i)", rc);
+        return;
     }
 
-    if ((rc = hpd_response_get_status(res, &data->status))) {
-        HPD_LOG_ERROR(thread->context, "hpd failed (code: %i)", rc);
-        goto done;
+    // A reference, not a copy, is handed to the waiting thread
+    if ((rc = hpd_response_get_value(res, &val))) {
+        HPD_LOG_ERROR(future->context, "hpd failed (code: %i)", rc);
+        return;
     }
+    if (val && (rc = hpd_value_ref(val, &future->val)))
+        HPD_LOG_ERROR(future->context, "hpd failed (code: %i)", rc);
+}
 
-    if (data->get_val) {
-        const hpd_value_t *val;
-        if ((rc = hpd_response_get_value(res, &val))) {
-            HPD_LOG_ERROR(thread->context, "hpd failed (code: %i)", rc);
-            goto done;
+static void on_hpd_request_free(void *in)
+{
+    int stat;
+    hpd_thread_future_t *future = in;
+    const uint64_t one = 1;
+
+    if ((stat = pthread_mutex_lock(&future->mutex))) HPD_LOG_RETURN_PTHREAD(future->context, stat);
+    future->done = HPD_TRUE;
+    if ((stat = pthread_cond_broadcast(&future->cond)))
+        HPD_LOG_ERROR(future->context, "pthread failed [code: %i].", stat);
+    if (future->fd >= 0 && write(future->fd, &one, sizeof(one)) < 0)
+        HPD_LOG_ERROR(future->context, "write failed [code: %i].", errno);
+    if ((stat = pthread_mutex_unlock(&future->mutex))) HPD_LOG_RETURN_PTHREAD(future->context, stat);
+
+    thread_future_unref(future);
+}
+
+static void thread_request_discard(const hpd_module_t *context, hpd_request_t *req, hpd_thread_future_t *future)
+{
+    hpd_error_t rc;
+
+    // Frees the request without on_hpd_request_free() touching the future, which is not shared yet
+    if ((rc = hpd_request_set_data(req, NULL, NULL)))
+        HPD_LOG_ERROR(context, "hpd failed (code: %i)", rc);
+    if ((rc = hpd_request_free(req)))
+        HPD_LOG_ERROR(context, "hpd free (code: %i)", rc);
+    thread_future_destroy(future);
+}
+
+hpd_error_t hpd_thread_request_async(const hpd_module_t *context, const hpd_service_id_t *srv,
+                                     hpd_method_t method, hpd_value_t *req_value, hpd_thread_future_t **future)
+{
+    hpd_thread_request_t request = { srv, method, req_value };
+    return hpd_thread_request_batch(context, &request, 1, future);
+}
+
+/**
+ * Frees the values of requests from index first, which are not attached to a request. Context may be NULL.
+ */
+static void thread_values_free(const hpd_module_t *context, const hpd_thread_request_t *requests, size_t first,
+                               size_t n)
+{
+    hpd_error_t rc;
+
+    for (size_t i = first; i < n; i++)
+        if (requests[i].value && (rc = hpd_value_free(requests[i].value)) && context)
+            HPD_LOG_ERROR(context, "hpd free (code: %i)", rc);
+}
+
+hpd_error_t hpd_thread_request_batch(const hpd_module_t *context, const hpd_thread_request_t *requests, size_t n,
+                                     hpd_thread_future_t **futures)
+{
+    if (!requests) return HPD_E_NULL;
+
+    hpd_error_t rc;
+    size_t i, allocated = 0, attached = 0;
+    hpd_request_t **reqs = NULL;
+
+    // The values are handed over on every path, if anything fails they are freed, together with the requests
+    if (!context || !thread || !futures) {
+        thread_values_free(context, requests, 0, n);
+        if (!context) return HPD_E_NULL;
+        MODULE_CHECK(context);
+        HPD_LOG_RETURN_E_NULL(context);
+    }
+    if (n == 0) return HPD_E_SUCCESS;
+
+    HPD_CALLOC(reqs, n, hpd_request_t *);
+    for (allocated = 0; allocated < n; allocated++) {
+        if ((rc = hpd_request_alloc(&reqs[allocated], requests[allocated].srv, requests[allocated].method,
+                                    on_hpd_response)))
+            goto error_free_requests;
+        if ((rc = thread_future_alloc(&futures[allocated], context))) {
+            hpd_request_free(reqs[allocated]);
+            goto error_free_requests;
+        }
+    }
+    for (attached = 0; attached < n; attached++) {
+        if (requests[attached].value && (rc = hpd_request_set_value(reqs[attached], requests[attached].value)))
+            goto error_free_requests;
+        if ((rc = hpd_request_set_data(reqs[attached], futures[attached], on_hpd_request_free))) {
+            attached++;
+            goto error_free_requests;
         }
+    }
+
+    // All requests are pushed onto the queue of the loop at once, and dispatched on a single wakeup
+    if ((rc = hpd_requests(reqs, n))) goto error_free_requests;
+
+    free(reqs);
+    return HPD_E_SUCCESS;
+
+    error_free_requests:
+    // Frees the values that were attached, along with the requests
+    for (i = 0; i < allocated; i++) {
+        thread_request_discard(context, reqs[i], futures[i]);
+        futures[i] = NULL;
+    }
+    thread_values_free(context, requests, attached, n);
+    free(reqs);
+    return rc;
 
-        if (val && (rc = hpd_value_copy(thread->context, &data->val, val))) {
-            HPD_LOG_ERROR(thread->context, "hpd failed (code: %i)", rc);
-            goto done;
+    alloc_error:
+    thread_values_free(context, requests, 0, n);
+    HPD_LOG_RETURN_E_ALLOC(context);
+}
+
+hpd_error_t hpd_thread_future_wait(hpd_thread_future_t *future, double timeout, hpd_bool_t *done)
+{
+    if (!future) return HPD_E_NULL;
+
+    int stat;
+    const hpd_module_t *context = future->context;
+    struct timespec deadline;
+
+    if (timeout >= 0) {
+        if (clock_gettime(CLOCK_MONOTONIC, &deadline))
+            HPD_LOG_RETURN(context, HPD_E_UNKNOWN, "clock_gettime failed [code: %i].", errno);
+        deadline.tv_sec += (time_t) timeout;
+        deadline.tv_nsec += (long) ((timeout - (time_t) timeout) * 1e9);
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
         }
     }
 
-    done:
-    if ((stat = sem_post(&data->sem)))
-        HPD_LOG_ERROR(thread->context, "pthread failed [code: %i].", stat);
+    if ((stat = pthread_mutex_lock(&future->mutex))) HPD_LOG_RETURN_PTHREAD_CODE(context, stat);
+    while (!future->done && !stat) {
+        if (timeout < 0) stat = pthread_cond_wait(&future->cond, &future->mutex);
+        else stat = pthread_cond_timedwait(&future->cond, &future->mutex, &deadline);
+    }
+    if (done) (*done) = future->done;
+    pthread_mutex_unlock(&future->mutex);
+    if (stat && stat != ETIMEDOUT) HPD_LOG_RETURN_PTHREAD_CODE(context, stat);
+
+    return HPD_E_SUCCESS;
 }
 
-hpd_error_t hpd_thread_request_sync_safe(const hpd_module_t *context, const hpd_service_id_t *srv,
-                                         hpd_method_t method, hpd_value_t *req_value, hpd_status_t *status,
-                                         hpd_value_t **res_value)
+hpd_error_t hpd_thread_future_poll(hpd_thread_future_t *future, hpd_bool_t *done)
 {
-    if (!context) return HPD_E_NULL;
-    MODULE_CHECK(context);
+    if (!future) return HPD_E_NULL;
+    if (!done) HPD_LOG_RETURN_E_NULL(future->context);
 
-    int stat, stat2;
-    hpd_error_t rc, rc2;
-    req_data_t data;
-    data.val = NULL;
-    data.get_val = (res_value != NULL);
+    int stat;
+
+    if ((stat = pthread_mutex_lock(&future->mutex))) HPD_LOG_RETURN_PTHREAD_CODE(future->context, stat);
+    (*done) = future->done;
+    if ((stat = pthread_mutex_unlock(&future->mutex))) HPD_LOG_RETURN_PTHREAD_CODE(future->context, stat);
 
-    if ((stat = sem_init(&data.sem, 0, 0))) goto error_pthread_return;
+    return HPD_E_SUCCESS;
+}
 
-    if ((rc = hpd_thread_lock(context))) goto error_hpd_free_data;
-    hpd_request_t *req;
-    if ((rc = hpd_request_alloc(&req, srv, method, on_hpd_response))) goto error_hpd_unlock;
-    if (req_value && (rc = hpd_request_set_value(req, req_value))) goto error_hpd_free_request;
-    if ((rc = hpd_request_set_data(req, &data, NULL))) goto error_hpd_free_request;
-    if ((rc = hpd_request(req))) goto error_hpd_free_request;
-    if ((rc = hpd_thread_unlock(context))) goto error_hpd_free_data;
+hpd_error_t hpd_thread_future_get_fd(hpd_thread_future_t *future, int *fd)
+{
+    if (!future) return HPD_E_NULL;
+    if (!fd) HPD_LOG_RETURN_E_NULL(future->context);
 
-    if ((stat = sem_wait(&data.sem))) goto error_pthread_free;
-    if ((stat = sem_destroy(&data.sem))) goto error_pthread_free_data;
+    int stat, err = 0;
 
-    if (status) (*status) = data.status;
-    if (res_value) (*res_value) = data.val;
+    // Created on first use, and already readable if the request is done
+    if ((stat = pthread_mutex_lock(&future->mutex))) HPD_LOG_RETURN_PTHREAD_CODE(future->context, stat);
+    if (future->fd < 0 && (future->fd = eventfd(future->done ? 1 : 0, EFD_CLOEXEC | EFD_NONBLOCK)) < 0) err = errno;
+    (*fd) = future->fd;
+    if ((stat = pthread_mutex_unlock(&future->mutex))) HPD_LOG_RETURN_PTHREAD_CODE(future->context, stat);
+    if (err) HPD_LOG_RETURN(future->context, HPD_E_UNKNOWN, "eventfd failed [code: %i].", err);
 
     return HPD_E_SUCCESS;
+}
+
+hpd_error_t hpd_thread_future_get_response(hpd_thread_future_t *future, hpd_status_t *status, hpd_value_t **value)
+{
+    if (!future) return HPD_E_NULL;
+
+    hpd_error_t rc;
+    hpd_bool_t done;
+
+    if ((rc = hpd_thread_future_poll(future, &done))) return rc;
+    if (!done) HPD_LOG_RETURN(future->context, HPD_E_STATE, "Request is not done yet.");
+
+    if (status) (*status) = future->status;
+    if (value) {
+        (*value) = future->val;
+        future->val = NULL;
+    }
+    if (future->status == HPD_S_NONE)
+        HPD_LOG_RETURN(future->context, HPD_E_STATE, "Request was freed without a response.");
+
+    return HPD_E_SUCCESS;
+}
+
+hpd_error_t hpd_thread_future_free(hpd_thread_future_t *future)
+{
+    if (!future) return HPD_E_NULL;
+    thread_future_unref(future);
+    return HPD_E_SUCCESS;
+}
+
+hpd_error_t hpd_thread_request_sync_safe(const hpd_module_t *context, const hpd_service_id_t *srv,
+                                         hpd_method_t method, hpd_value_t *req_value, hpd_status_t *status,
+                                         hpd_value_t **res_value)
+{
+    hpd_error_t rc, rc2;
+    hpd_thread_future_t *future;
 
-    error_hpd_free_request:
-    if ((rc2 = hpd_request_free(req)))
+    if ((rc = hpd_thread_request_async(context, srv, method, req_value, &future))) return rc;
+    if (!(rc = hpd_thread_future_wait(future, -1, NULL)))
+        rc = hpd_thread_future_get_response(future, status, res_value);
+    if ((rc2 = hpd_thread_future_free(future)))
         HPD_LOG_ERROR(context, "hpd free (code: %i)", rc2);
-    error_hpd_unlock:
-    if ((rc2 = hpd_thread_unlock(context)))
-        HPD_LOG_ERROR(context, "unlock failed (code: %i)", rc2);
-    error_hpd_free_data:
-    if ((stat2 = sem_destroy(&data.sem)))
-        HPD_LOG_ERROR(context, "pthread failed [code: %i].", stat2);
-    if (data.val && (rc2 = hpd_value_free(data.val)))
-        HPD_LOG_ERROR(context, "hpd free failed (code: %i)", rc2);
-    return rc;
 
-    error_pthread_free:
-    if ((stat2 = sem_destroy(&data.sem)))
-        HPD_LOG_ERROR(context, "pthread failed [code: %i].", stat2);
-    error_pthread_free_data:
-    if (data.val && (rc2 = hpd_value_free(data.val)))
-        HPD_LOG_ERROR(context, "hpd free failed (code: %i)", rc2);
-    error_pthread_return:
-    HPD_LOG_RETURN_PTHREAD_CODE(thread->context, stat);
-}
\ No newline at end of file
+    return rc;
+}
@@ -30,6 +30,7 @@
 #include "hpd-0.6/common/hpd_thread.h"
 #include "hpd-0.6/common/hpd_thread_module.h"
 #include <ev.h>
+#include <poll.h>
 
 #define HPD_LOG_RETURN_PTHREAD(CONTEXT, RC) HPD_LOG_RETURN((CONTEXT), HPD_E_UNKNOWN, "pthread failed [code: %i].", (RC))
 #define CASE hpd_thread
@@ -123,3 +124,332 @@ TEST(CASE, lock_unlock) {
     ASSERT_EQ(hpd_start(hpd, argc, argv), HPD_E_SUCCESS);
     ASSERT_EQ(hpd_free(hpd), HPD_E_SUCCESS);
 }
+
+#define REQUEST_THREADS 4
+#define REQUESTS 1000
+#define BATCH 10
+
+typedef struct {
+    const hpd_module_t *context;
+    hpd_ev_loop_t *loop;
+    ev_async stop;
+    hpd_adapter_t *adapter;
+    hpd_service_id_t *sid;
+    pthread_t thread;
+    int responses;
+    int refused;
+} request_data_t;
+
+static const hpd_module_t *request_context;
+
+static hpd_status_t on_get(void *, hpd_request_t *req)
+{
+    hpd_response_t *res;
+    hpd_value_t *value;
+
+    if (hpd_response_alloc(&res, req, HPD_S_200)) return HPD_S_500;
+    if (hpd_value_alloc(&value, request_context, "42", HPD_NULL_TERMINATED)) return HPD_S_500;
+    if (hpd_response_set_value(res, value)) return HPD_S_500;
+    if (hpd_respond(res)) return HPD_S_500;
+    return HPD_S_NONE;
+}
+
+typedef struct {
+    ev_timer timer;
+    hpd_request_t *req;
+} delayed_t;
+
+static int late_responses;
+
+static void on_delay(hpd_ev_loop_t *loop, ev_timer *w, int)
+{
+    auto *delayed = (delayed_t *) w;
+
+    ev_timer_stop(loop, w);
+    if (on_get(nullptr, delayed->req) == HPD_S_NONE)
+        __atomic_add_fetch(&late_responses, 1, __ATOMIC_RELEASE);
+    free(delayed);
+}
+
+static hpd_status_t on_get_delayed(void *, hpd_request_t *req)
+{
+    const hpd_value_t *value;
+    hpd_ev_loop_t *loop;
+
+    // Requests without a value are answered long after their callers have given up on them
+    if (hpd_request_get_value(req, &value)) return HPD_S_500;
+    if (value) return on_get(nullptr, req);
+
+    auto *delayed = (delayed_t *) calloc(1, sizeof(delayed_t));
+    if (!delayed) return HPD_S_500;
+    delayed->req = req;
+    hpd_get_loop(request_context, &loop);
+    ev_timer_init(&delayed->timer, on_delay, 0.2, 0);
+    ev_timer_start(loop, &delayed->timer);
+    return HPD_S_NONE;
+}
+
+static hpd_action_f request_action = on_get;
+
+static void count_response(request_data_t *request_data, hpd_status_t status, hpd_value_t *value)
+{
+    const char *body;
+    size_t len;
+
+    if (status == HPD_S_200 && value && !hpd_value_get_body(value, &body, &len) && len == 2)
+        __atomic_add_fetch(&request_data->responses, 1, __ATOMIC_RELAXED);
+    if (value) hpd_value_free(value);
+}
+
+static void *on_request_thread(void *data)
+{
+    auto *request_data = (request_data_t *) data;
+
+    for (int i = 0; i < REQUESTS; i++) {
+        hpd_status_t status;
+        hpd_value_t *value;
+        if (hpd_thread_request_sync_safe(request_data->context, request_data->sid, HPD_M_GET, nullptr, &status, &value))
+            break;
+        count_response(request_data, status, value);
+    }
+
+    return nullptr;
+}
+
+static bool wait_future(hpd_thread_future_t *future, bool use_fd)
+{
+    hpd_bool_t done = HPD_FALSE;
+
+    if (use_fd) {
+        struct pollfd pfd {};
+        if (hpd_thread_future_get_fd(future, &pfd.fd)) return false;
+        pfd.events = POLLIN;
+        if (poll(&pfd, 1, 5000) != 1) return false;
+        if (hpd_thread_future_poll(future, &done)) return false;
+    } else {
+        if (hpd_thread_future_wait(future, 5, &done)) return false;
+    }
+
+    return done == HPD_TRUE;
+}
+
+static void *on_request_thread_async(void *data)
+{
+    auto *request_data = (request_data_t *) data;
+    hpd_thread_request_t requests[BATCH];
+    hpd_thread_future_t *futures[BATCH];
+
+    for (auto &request : requests) request = { request_data->sid, HPD_M_GET, nullptr };
+
+    for (int i = 0; i < REQUESTS / BATCH; i++) {
+        if (hpd_thread_request_batch(request_data->context, requests, BATCH, futures)) break;
+        for (int j = 0; j < BATCH; j++) {
+            hpd_status_t status;
+            hpd_value_t *value;
+            // Alternate between waiting on the future and on its eventfd
+            if (wait_future(futures[j], j % 2 == 1) && !hpd_thread_future_get_response(futures[j], &status, &value))
+                count_response(request_data, status, value);
+            hpd_thread_future_free(futures[j]);
+        }
+    }
+
+    return nullptr;
+}
+
+static void *on_request_thread_until_stopped(void *data)
+{
+    auto *request_data = (request_data_t *) data;
+    hpd_error_t rc;
+
+    // Stops hpd halfway, and keeps sending until hpd refuses the request or frees it without a response
+    for (;;) {
+        hpd_status_t status;
+        hpd_value_t *value;
+        if ((rc = hpd_thread_request_sync_safe(request_data->context, request_data->sid, HPD_M_GET, nullptr, &status,
+                                               &value)))
+            break;
+        count_response(request_data, status, value);
+        if (__atomic_load_n(&request_data->responses, __ATOMIC_RELAXED) >= REQUESTS)
+            ev_async_send(request_data->loop, &request_data->stop);
+    }
+    if (rc == HPD_E_STATE) __atomic_add_fetch(&request_data->refused, 1, __ATOMIC_RELAXED);
+
+    return nullptr;
+}
+
+static void *on_request_thread_late(void *data)
+{
+    auto *request_data = (request_data_t *) data;
+    hpd_thread_future_t *future;
+    hpd_bool_t done;
+    hpd_status_t status;
+    hpd_value_t *value;
+
+    // Give up waiting, and free the future while the request is still pending
+    if (hpd_thread_request_async(request_data->context, request_data->sid, HPD_M_GET, nullptr, &future))
+        return nullptr;
+    if (hpd_thread_future_wait(future, 0.05, &done) || done) {
+        hpd_thread_future_free(future);
+        return nullptr;
+    }
+    hpd_thread_future_free(future);
+
+    // Responses are dispatched in order, so the late ones are delivered before the response to this request
+    while (__atomic_load_n(&late_responses, __ATOMIC_ACQUIRE) < REQUEST_THREADS) usleep(1000);
+    if (hpd_value_alloc(&value, request_data->context, "now", HPD_NULL_TERMINATED)) return nullptr;
+    if (!hpd_thread_request_sync_safe(request_data->context, request_data->sid, HPD_M_GET, value, &status, &value))
+        count_response(request_data, status, value);
+
+    return nullptr;
+}
+
+static void *(*request_worker)(void *);
+
+static void *on_request_threads(void *data)
+{
+    auto *request_data = (request_data_t *) data;
+    pthread_t threads[REQUEST_THREADS];
+
+    // The loop keeps running while the requests are sent
+    for (auto &thread : threads) pthread_create(&thread, nullptr, request_worker, request_data);
+    for (auto &thread : threads) pthread_join(thread, nullptr);
+    ev_async_send(request_data->loop, &request_data->stop);
+
+    return nullptr;
+}
+
+static hpd_error_t on_request_create(void **data, const hpd_module_t *context)
+{
+    auto *request_data = (request_data_t *) calloc(1, sizeof(request_data_t));
+    if (!request_data) return HPD_E_ALLOC;
+    request_data->context = context;
+    request_context = context;
+    ev_async_init(&request_data->stop, stop_hpd);
+    *data = request_data;
+    return HPD_E_SUCCESS;
+}
+
+static hpd_error_t on_request_start(void *data)
+{
+    auto *request_data = (request_data_t *) data;
+    const hpd_module_t *context = request_data->context;
+    hpd_device_t *device;
+    hpd_service_t *service;
+    hpd_error_t rc;
+    int stat;
+
+    if ((rc = hpd_adapter_alloc(&request_data->adapter, context, "adapter"))) return rc;
+    if ((rc = hpd_adapter_attach(request_data->adapter))) return rc;
+    if ((rc = hpd_device_alloc(&device, context, "device"))) return rc;
+    if ((rc = hpd_device_attach(request_data->adapter, device))) return rc;
+    if ((rc = hpd_service_alloc(&service, context, "service"))) return rc;
+    if ((rc = hpd_service_set_action(service, HPD_M_GET, request_action))) return rc;
+    if ((rc = hpd_service_attach(device, service))) return rc;
+    if ((rc = hpd_service_id_alloc(&request_data->sid, context, "adapter", "device", "service"))) return rc;
+
+    if ((rc = hpd_get_loop(context, &request_data->loop))) return rc;
+    ev_async_start(request_data->loop, &request_data->stop);
+    if ((stat = pthread_create(&request_data->thread, nullptr, on_request_threads, request_data)))
+        HPD_LOG_RETURN_PTHREAD(context, stat);
+    return HPD_E_SUCCESS;
+}
+
+static hpd_error_t on_request_stop(void *data)
+{
+    auto *request_data = (request_data_t *) data;
+    hpd_error_t rc;
+
+    pthread_join(request_data->thread, nullptr);
+    ev_async_stop(request_data->loop, &request_data->stop);
+    if ((rc = hpd_service_id_free(request_data->sid))) return rc;
+    return hpd_adapter_free(request_data->adapter);
+}
+
+static request_data_t *request_data;
+
+static hpd_error_t on_request_destroy(void *data)
+{
+    request_data = (request_data_t *) data;
+    return HPD_E_SUCCESS;
+}
+
+TEST(CASE, request_sync_safe) {
+    int argc = 1;
+    char *argv[] = {
+            (char *) "/usr/local/bin/hpd",
+            nullptr
+    };
+    hpd_module_def_t module_def { on_request_create, on_request_destroy, on_request_start, on_request_stop, on_parse_opt };
+
+    request_worker = on_request_thread;
+    ASSERT_EQ(hpd_alloc(&hpd), HPD_E_SUCCESS);
+    ASSERT_EQ(hpd_module(hpd, "thread", &hpd_thread), HPD_E_SUCCESS);
+    ASSERT_EQ(hpd_module(hpd, "mod", &module_def), HPD_E_SUCCESS);
+    ASSERT_EQ(hpd_start(hpd, argc, argv), HPD_E_SUCCESS);
+    ASSERT_EQ(hpd_free(hpd), HPD_E_SUCCESS);
+
+    ASSERT_EQ(request_data->responses, REQUEST_THREADS * REQUESTS);
+    free(request_data);
+}
+
+TEST(CASE, request_async) {
+    int argc = 1;
+    char *argv[] = {
+            (char *) "/usr/local/bin/hpd",
+            nullptr
+    };
+    hpd_module_def_t module_def { on_request_create, on_request_destroy, on_request_start, on_request_stop, on_parse_opt };
+
+    request_worker = on_request_thread_async;
+    ASSERT_EQ(hpd_alloc(&hpd), HPD_E_SUCCESS);
+    ASSERT_EQ(hpd_module(hpd, "thread", &hpd_thread), HPD_E_SUCCESS);
+    ASSERT_EQ(hpd_module(hpd, "mod", &module_def), HPD_E_SUCCESS);
+    ASSERT_EQ(hpd_start(hpd, argc, argv), HPD_E_SUCCESS);
+    ASSERT_EQ(hpd_free(hpd), HPD_E_SUCCESS);
+
+    ASSERT_EQ(request_data->responses, REQUEST_THREADS * REQUESTS);
+    free(request_data);
+}
+
+TEST(CASE, request_stop_while_running) {
+    int argc = 1;
+    char *argv[] = {
+            (char *) "/usr/local/bin/hpd",
+            nullptr
+    };
+    hpd_module_def_t module_def { on_request_create, on_request_destroy, on_request_start, on_request_stop, on_parse_opt };
+
+    // The module joins the threads when it stops, which hangs if a request queued during the shutdown is never freed
+    request_worker = on_request_thread_until_stopped;
+    ASSERT_EQ(hpd_alloc(&hpd), HPD_E_SUCCESS);
+    ASSERT_EQ(hpd_module(hpd, "thread", &hpd_thread), HPD_E_SUCCESS);
+    ASSERT_EQ(hpd_module(hpd, "mod", &module_def), HPD_E_SUCCESS);
+    ASSERT_EQ(hpd_start(hpd, argc, argv), HPD_E_SUCCESS);
+    ASSERT_EQ(hpd_free(hpd), HPD_E_SUCCESS);
+
+    ASSERT_GE(request_data->responses, REQUESTS);
+    ASSERT_EQ(request_data->refused, REQUEST_THREADS);
+    free(request_data);
+}
+
+TEST(CASE, request_async_late_response) {
+    int argc = 1;
+    char *argv[] = {
+            (char *) "/usr/local/bin/hpd",
+            nullptr
+    };
+    hpd_module_def_t module_def { on_request_create, on_request_destroy, on_request_start, on_request_stop, on_parse_opt };
+
+    request_worker = on_request_thread_late;
+    request_action = on_get_delayed;
+    ASSERT_EQ(hpd_alloc(&hpd), HPD_E_SUCCESS);
+    ASSERT_EQ(hpd_module(hpd, "thread", &hpd_thread), HPD_E_SUCCESS);
+    ASSERT_EQ(hpd_module(hpd, "mod", &module_def), HPD_E_SUCCESS);
+    ASSERT_EQ(hpd_start(hpd, argc, argv), HPD_E_SUCCESS);
+    ASSERT_EQ(hpd_free(hpd), HPD_E_SUCCESS);
+    request_action = on_get;
+
+    ASSERT_EQ(late_responses, REQUEST_THREADS);
+    ASSERT_EQ(request_data->responses, REQUEST_THREADS);
+    free(request_data);
+}
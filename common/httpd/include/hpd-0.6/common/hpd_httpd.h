@@ -34,6 +34,10 @@
 #include <hpd-0.6/hpd_types.h>
 #include <hpd-0.6/common/hpd_httpd_types.h>
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 // Structs
 typedef struct hpd_httpd hpd_httpd_t;
 typedef struct hpd_httpd_request hpd_httpd_request_t;
@@ -94,12 +98,34 @@ typedef hpd_httpd_return_t (*hpd_httpd_nodata_f)(hpd_httpd_t *httpd, hpd_httpd_r
  *  - zero: Continue parsing of message.
  *  - non-zero: Stop any further parsing of message.
  *  Note that the connection is kept open in both cases, thus a response can be
- *  sent to the client without parsing it entirely. The return value of
- *  on_req_destroy is ignored.
+ *  sent to the client without parsing it entirely. After a stop the connection
+ *  is closed once the response has been sent, and messages pipelined after it
+ *  are dropped. The return value of on_req_destroy is ignored.
+ *
+ *  Connections are persistent, unless the client asks otherwise (HTTP/1.1
+ *  "Connection: close", or HTTP/1.0 without "Connection: keep-alive"). A
+ *  request object lives for a single message: on_req_destroy is called once
+ *  the response has been sent and the message has been received in full,
+ *  after which the next (possibly pipelined) message on the connection
+ *  starts over with on_req_begin. Pipelined messages are not parsed before
+ *  the response to the previous message has been destroyed.
+ *
+ *  With workers set, each worker thread runs its own event loop with its own
+ *  listener on the port (SO_REUSEPORT), and parses messages and sends
+ *  responses there. The callbacks are still called on the event loop given
+ *  to hpd_httpd_create(), once a message has been received in full. In this
+ *  mode on_req_url is called once with the decoded path, and
+ *  on_req_hdr_field/on_req_hdr_value once per header with the combined
+ *  value. The connection timeout does not apply while a message is handled
+ *  by the callbacks, as if hpd_httpd_request_keep_open() had been called.
+ *  HPD must be compiled with THREAD_SAFE to use workers.
  */
 struct hpd_httpd_settings {
     hpd_tcpd_port_t port;
     int timeout;
+    int keep_alive_timeout; ///< Seconds to keep an idle persistent connection open, 0 to disable persistent connections
+    int max_idle_conns;     ///< Maximum number of idle persistent connections (per worker), further connections are closed
+    int workers;            ///< Number of worker threads, each with its own listener, 0 to parse on the given loop
     void* httpd_ctx;
     hpd_httpd_nodata_f on_req_begin;
     hpd_httpd_data_f   on_req_url;
@@ -123,6 +149,9 @@ struct hpd_httpd_settings {
 #define HPD_HTTPD_SETTINGS_DEFAULT { \
    .port = HPD_TCPD_P_HTTP, \
    .timeout = 15, \
+   .keep_alive_timeout = 5, \
+   .max_idle_conns = 64, \
+   .workers = 0, \
    .httpd_ctx = NULL, \
    .on_req_begin = NULL, \
    .on_req_url = NULL, \
@@ -146,6 +175,7 @@ hpd_error_t hpd_httpd_request_get_method(hpd_httpd_request_t *req, hpd_httpd_met
 hpd_error_t hpd_httpd_request_get_url(hpd_httpd_request_t *req, const char **url);
 hpd_error_t hpd_httpd_request_get_headers(hpd_httpd_request_t *req, hpd_map_t **headers);
 hpd_error_t hpd_httpd_request_get_header(hpd_httpd_request_t *req, const char *key, const char **value);
+hpd_error_t hpd_httpd_request_get_header_by_id(hpd_httpd_request_t *req, hpd_httpd_header_t header, const char **value);
 hpd_error_t hpd_httpd_request_get_arguments(hpd_httpd_request_t *req, hpd_map_t **arguments);
 hpd_error_t hpd_httpd_request_get_argument(hpd_httpd_request_t *req, const char *key, const char **val);
 hpd_error_t hpd_httpd_request_get_cookies(hpd_httpd_request_t *req, hpd_map_t **cookies);
@@ -158,11 +188,17 @@ hpd_error_t hpd_httpd_response_destroy(hpd_httpd_response_t *res);
 hpd_error_t hpd_httpd_response_create(hpd_httpd_response_t **response, hpd_httpd_request_t *req,
                                       hpd_status_t status);
 hpd_error_t hpd_httpd_response_add_header(hpd_httpd_response_t *res, const char *field, const char *value);
+hpd_error_t hpd_httpd_response_send(hpd_httpd_response_t *res, const char *buf, size_t len);
 hpd_error_t hpd_httpd_response_sendf(hpd_httpd_response_t *res, const char *fmt, ...);
 hpd_error_t hpd_httpd_response_vsendf(hpd_httpd_response_t *res, const char *fmt, va_list arg);
+hpd_error_t hpd_httpd_response_send_chunk(hpd_httpd_response_t *res, char *buf, size_t len, hpd_free_f on_free);
 hpd_error_t hpd_httpd_response_add_cookie(hpd_httpd_response_t *res, const char *field, const char *value,
                                           const char *expires, const char *max_age, const char *domain,
                                           const char *path,
                                           int secure, int http_only, const char *extension);
 
+#ifdef __cplusplus
+}
+#endif
+
 #endif // HOMEPORT_HTTPD_H
@@ -38,4 +38,26 @@ typedef enum hpd_httpd_method
     HPD_HTTPD_M_OPTIONS
 } hpd_httpd_method_t;
 
+/// Well-known request headers, which are interned while parsing
+typedef enum hpd_httpd_header
+{
+    HPD_HTTPD_H_UNKNOWN = -1,
+    HPD_HTTPD_H_ACCEPT,
+    HPD_HTTPD_H_ACCEPT_CHARSET,
+    HPD_HTTPD_H_ACCEPT_ENCODING,
+    HPD_HTTPD_H_ACCEPT_LANGUAGE,
+    HPD_HTTPD_H_AUTHORIZATION,
+    HPD_HTTPD_H_CACHE_CONTROL,
+    HPD_HTTPD_H_CONNECTION,
+    HPD_HTTPD_H_CONTENT_LENGTH,
+    HPD_HTTPD_H_CONTENT_TYPE,
+    HPD_HTTPD_H_COOKIE,
+    HPD_HTTPD_H_HOST,
+    HPD_HTTPD_H_IF_NONE_MATCH,
+    HPD_HTTPD_H_ORIGIN,
+    HPD_HTTPD_H_TRANSFER_ENCODING,
+    HPD_HTTPD_H_USER_AGENT,
+    HPD_HTTPD_H_COUNT
+} hpd_httpd_header_t;
+
 #endif //HOMEPORT_HTTPD_TYPES_H
@@ -25,8 +25,7 @@
  * authors and should not be interpreted as representing official policies, either expressed
  */
 
-#include "hpd-0.6/common/hpd_httpd.h"
-#include "hpd-0.6/common/hpd_tcpd.h"
+#include "httpd_intern.h"
 #include "httpd_request.h"
 #include "hpd-0.6/hpd_shared_api.h"
 
@@ -34,13 +33,6 @@
 #include <stdio.h>
 #include <string.h>
 
-/// httpd instance struct
-struct hpd_httpd {
-    hpd_httpd_settings_t settings; ///< Settings
-    hpd_tcpd_t *webserver; ///< Webserver instance
-    const hpd_module_t *context;
-};
-
 /**
  * Callback for tcpd library.
  *
@@ -120,6 +112,27 @@ static hpd_tcpd_return_t httpd_on_disconnect(hpd_tcpd_t *instance, hpd_tcpd_conn
     return HPD_TCPD_R_CONTINUE;
 }
 
+/**
+ * Create the tcpd of a httpd instance.
+ *
+ *  Workers share the port with each other.
+ *
+ *  \param  httpd  The httpd instance, either the main instance or a worker.
+ */
+hpd_error_t httpd_tcpd_create(hpd_httpd_t *httpd)
+{
+    hpd_tcpd_settings_t ws_settings = HPD_TCPD_SETTINGS_DEFAULT;
+    ws_settings.port          = httpd->settings.port;
+    ws_settings.timeout       = httpd->settings.timeout;
+    ws_settings.reuse_port    = httpd->main ? 1 : 0;
+    ws_settings.on_connect    = httpd_on_connect;
+    ws_settings.on_receive    = httpd_on_receive;
+    ws_settings.on_disconnect = httpd_on_disconnect;
+    ws_settings.tcpd_ctx      = httpd;
+
+    return hpd_tcpd_create(&httpd->webserver, &ws_settings, httpd->context, httpd->loop);
+}
+
 /**
  * Create a new httpd instance.
  *
@@ -127,7 +140,7 @@ static hpd_tcpd_return_t httpd_on_disconnect(hpd_tcpd_t *instance, hpd_tcpd_conn
  *  hpd_httpd_destroy()
  *
  *  The settings is copied to the instance and a webserver instance is
- *  created for it.
+ *  created for it, or for each of its workers if settings.workers is set.
  *
  *  \param  httpd     The newly created instance will be stored here.
  *  \param  settings  The settings for the httpd.
@@ -139,29 +152,26 @@ hpd_error_t hpd_httpd_create(hpd_httpd_t **httpd, hpd_httpd_settings_t *settings
 {
     if (!context) return HPD_E_NULL;
     if (!httpd || !settings || !loop) HPD_LOG_RETURN_E_NULL(context);
+    if (settings->workers < 0) HPD_LOG_RETURN(context, HPD_E_ARGUMENT, "Number of workers cannot be negative.");
+    if (settings->workers > 0) HPD_THREAD_SAFE_CHECK(context);
 
     // Allocate instance
-    (*httpd) = malloc(sizeof(hpd_httpd_t));
+    (*httpd) = calloc(1, sizeof(hpd_httpd_t));
     if (!(*httpd)) HPD_LOG_RETURN_E_ALLOC(context);
 
     // Set context
     (*httpd)->context = context;
+    (*httpd)->loop = loop;
+    (*httpd)->idle_conns = 0;
 
     // Copy settings
     memcpy(&(*httpd)->settings, settings, sizeof(hpd_httpd_settings_t));
 
-    // Construct settings for tcpd
-    hpd_tcpd_settings_t ws_settings = HPD_TCPD_SETTINGS_DEFAULT;
-    ws_settings.port          = settings->port;
-    ws_settings.timeout       = settings->timeout;
-    ws_settings.on_connect    = httpd_on_connect;
-    ws_settings.on_receive    = httpd_on_receive;
-    ws_settings.on_disconnect = httpd_on_disconnect;
-    ws_settings.tcpd_ctx      = (*httpd);
-
-    // Create tcpd
+    // Create tcpd, or workers with a tcpd each
     hpd_error_t rc;
-    if ((rc = hpd_tcpd_create(&(*httpd)->webserver, &ws_settings, context, loop))) {
+    if (settings->workers > 0) rc = httpd_workers_create(*httpd);
+    else rc = httpd_tcpd_create(*httpd);
+    if (rc) {
         hpd_httpd_destroy(*httpd);
         return rc;
     }
@@ -181,7 +191,9 @@ hpd_error_t hpd_httpd_destroy(hpd_httpd_t *httpd)
 {
     if (!httpd) return HPD_E_NULL;
 
-    hpd_error_t rc = hpd_tcpd_destroy(httpd->webserver);
+    hpd_error_t rc = HPD_E_SUCCESS, tmp;
+    if ((tmp = httpd_workers_destroy(httpd)) && !rc) rc = tmp;
+    if (httpd->webserver && (tmp = hpd_tcpd_destroy(httpd->webserver)) && !rc) rc = tmp;
     free(httpd);
     return rc;
 }
@@ -189,7 +201,7 @@ hpd_error_t hpd_httpd_destroy(hpd_httpd_t *httpd)
 /**
  * Start a httpd instance.
  *
- *  Starts a created httpd.
+ *  Starts a created httpd, and the threads of its workers.
  *
  *  \param  httpd  The instance to start.
  *
@@ -199,6 +211,7 @@ hpd_error_t hpd_httpd_start(hpd_httpd_t *httpd)
 {
     if (!httpd) return HPD_E_NULL;
 
+    if (httpd->workers) return httpd_workers_start(httpd);
     return hpd_tcpd_start(httpd->webserver);
 }
 
@@ -214,6 +227,6 @@ hpd_error_t hpd_httpd_stop(hpd_httpd_t *httpd)
 {
     if (!httpd) return HPD_E_NULL;
 
+    if (httpd->workers) return httpd_workers_stop(httpd);
     return hpd_tcpd_stop(httpd->webserver);
 }
-
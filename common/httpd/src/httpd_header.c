@@ -0,0 +1,138 @@
+/*
+ * Copyright 2011 Aalborg University. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are
+ * permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of
+ * conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list
+ * of conditions and the following disclaimer in the documentation and/or other materials
+ * provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY Aalborg University ''AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL Aalborg University OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are those of the
+ * authors and should not be interpreted as representing official policies, either expressed
+ */
+
+#include "httpd_header.h"
+#include <strings.h>
+
+/// Lowercase names of the well-known headers, indexed by hpd_httpd_header_t
+static const struct {
+    const char *name;
+    size_t len;
+} http_headers[HPD_HTTPD_H_COUNT] = {
+#define HTTP_HEADER(ID, NAME) [ID] = { NAME, sizeof(NAME) - 1 }
+        HTTP_HEADER(HPD_HTTPD_H_ACCEPT, "accept"),
+        HTTP_HEADER(HPD_HTTPD_H_ACCEPT_CHARSET, "accept-charset"),
+        HTTP_HEADER(HPD_HTTPD_H_ACCEPT_ENCODING, "accept-encoding"),
+        HTTP_HEADER(HPD_HTTPD_H_ACCEPT_LANGUAGE, "accept-language"),
+        HTTP_HEADER(HPD_HTTPD_H_AUTHORIZATION, "authorization"),
+        HTTP_HEADER(HPD_HTTPD_H_CACHE_CONTROL, "cache-control"),
+        HTTP_HEADER(HPD_HTTPD_H_CONNECTION, "connection"),
+        HTTP_HEADER(HPD_HTTPD_H_CONTENT_LENGTH, "content-length"),
+        HTTP_HEADER(HPD_HTTPD_H_CONTENT_TYPE, "content-type"),
+        HTTP_HEADER(HPD_HTTPD_H_COOKIE, "cookie"),
+        HTTP_HEADER(HPD_HTTPD_H_HOST, "host"),
+        HTTP_HEADER(HPD_HTTPD_H_IF_NONE_MATCH, "if-none-match"),
+        HTTP_HEADER(HPD_HTTPD_H_ORIGIN, "origin"),
+        HTTP_HEADER(HPD_HTTPD_H_TRANSFER_ENCODING, "transfer-encoding"),
+        HTTP_HEADER(HPD_HTTPD_H_USER_AGENT, "user-agent"),
+#undef HTTP_HEADER
+};
+
+/**
+ * Pick the only well-known header that a field can be, from its length and first character.
+ *
+ *  \param  field  Header field, not null-terminated, in any case
+ *  \param  len    Length of field, at least one
+ *
+ *  \return The candidate, or HPD_HTTPD_H_UNKNOWN if there is none
+ */
+static hpd_httpd_header_t http_header_candidate(const char *field, size_t len)
+{
+    // Lowercases letters, anything else cannot match a name anyway
+    char c = (char) (field[0] | 0x20);
+
+    switch (len) {
+        case 4:
+            if (c == 'h') return HPD_HTTPD_H_HOST;
+            break;
+        case 6:
+            if (c == 'a') return HPD_HTTPD_H_ACCEPT;
+            if (c == 'c') return HPD_HTTPD_H_COOKIE;
+            if (c == 'o') return HPD_HTTPD_H_ORIGIN;
+            break;
+        case 10:
+            if (c == 'c') return HPD_HTTPD_H_CONNECTION;
+            if (c == 'u') return HPD_HTTPD_H_USER_AGENT;
+            break;
+        case 12:
+            if (c == 'c') return HPD_HTTPD_H_CONTENT_TYPE;
+            break;
+        case 13:
+            if (c == 'a') return HPD_HTTPD_H_AUTHORIZATION;
+            if (c == 'c') return HPD_HTTPD_H_CACHE_CONTROL;
+            if (c == 'i') return HPD_HTTPD_H_IF_NONE_MATCH;
+            break;
+        case 14:
+            if (c == 'a') return HPD_HTTPD_H_ACCEPT_CHARSET;
+            if (c == 'c') return HPD_HTTPD_H_CONTENT_LENGTH;
+            break;
+        case 15:
+            // accept-encoding and accept-language differ first after "accept-"
+            if (c == 'a') return (field[7] | 0x20) == 'e' ? HPD_HTTPD_H_ACCEPT_ENCODING : HPD_HTTPD_H_ACCEPT_LANGUAGE;
+            break;
+        case 17:
+            if (c == 't') return HPD_HTTPD_H_TRANSFER_ENCODING;
+            break;
+        default:
+            break;
+    }
+    return HPD_HTTPD_H_UNKNOWN;
+}
+
+/**
+ * Find the id of a well-known header.
+ *
+ *  The length and first character select a single candidate, which a
+ *  single compare then confirms.
+ *
+ *  \param  field  Header field, not null-terminated, in any case
+ *  \param  len    Length of field
+ *
+ *  \return The id, or HPD_HTTPD_H_UNKNOWN if it is not a well-known header
+ */
+hpd_httpd_header_t http_header_lookup(const char *field, size_t len)
+{
+    if (len == 0) return HPD_HTTPD_H_UNKNOWN;
+
+    hpd_httpd_header_t header = http_header_candidate(field, len);
+    if (header == HPD_HTTPD_H_UNKNOWN || strncasecmp(http_headers[header].name, field, len) != 0)
+        return HPD_HTTPD_H_UNKNOWN;
+    return header;
+}
+
+/**
+ * Get the lowercase name of a well-known header.
+ *
+ *  \param  header  Header id
+ *
+ *  \return The name, or NULL for unknown ids
+ */
+const char *http_header_name(hpd_httpd_header_t header)
+{
+    if (header < 0 || header >= HPD_HTTPD_H_COUNT) return NULL;
+    return http_headers[header].name;
+}
@@ -47,21 +47,34 @@ struct hp {
 
 	char* field_buffer;
 	size_t field_buffer_size;
+	size_t field_buffer_cap;
 
 	char* value_buffer;
 	size_t value_buffer_size;
+	size_t value_buffer_cap;
 };
 
+/// Empties the buffers, keeping their memory for the next header
 static void hp_reset_buffers(struct hp *instance)
 {
-		if(instance->field_buffer) free(instance->field_buffer);
-		if(instance->value_buffer) free(instance->value_buffer);
-
 		instance -> field_buffer_size = 0;
-		instance -> field_buffer = NULL;
-
 		instance -> value_buffer_size = 0;
-		instance -> value_buffer = NULL;
+}
+
+/// Appends a chunk to a buffer, doubling its capacity when it is full
+static hpd_error_t hp_append(struct hp *instance, char **buffer, size_t *size, size_t *cap, const char *chunk, size_t length)
+{
+    if (*size + length > *cap) {
+        size_t new_cap = *cap ? *cap * 2 : 64;
+        while (new_cap < *size + length) new_cap *= 2;
+        char *new_buf = realloc(*buffer, new_cap * (sizeof(char)));
+        if (!new_buf) HPD_LOG_RETURN_E_ALLOC(instance->context);
+        *buffer = new_buf;
+        *cap = new_cap;
+    }
+    memcpy(*buffer + *size, chunk, length);
+    *size += length;
+    return HPD_E_SUCCESS;
 }
 
 hpd_error_t hp_create(struct hp **instance, struct hp_settings *settings, const hpd_module_t *context)
@@ -79,9 +92,11 @@ hpd_error_t hp_create(struct hp **instance, struct hp_settings *settings, const
 	(*instance)->state = S_FIELD;
 
 	(*instance)->field_buffer_size = 0;
+	(*instance)->field_buffer_cap = 0;
     (*instance)->field_buffer = NULL;
 
 	(*instance)->value_buffer_size = 0;
+	(*instance)->value_buffer_cap = 0;
 	(*instance)->value_buffer = NULL;
 
 	return HPD_E_SUCCESS;
@@ -95,7 +110,6 @@ hpd_error_t hp_on_header_field(struct hp *instance, const char *field_chunk, siz
         HPD_LOG_RETURN_E_NULL(instance->context);
 
     hpd_error_t rc;
-    size_t old_buffer_size = instance->field_buffer_size;
 
     switch (instance->state) {
         case S_VALUE: {
@@ -107,18 +121,11 @@ hpd_error_t hp_on_header_field(struct hp *instance, const char *field_chunk, siz
                         return rc;
                     }
             hp_reset_buffers(instance);
-            old_buffer_size = 0;
             instance->state = S_FIELD;
         }
-        case S_FIELD: {
-            size_t new_len = instance->field_buffer_size + length;
-            char *new_buf = realloc(instance->field_buffer, new_len * (sizeof(char)));
-            if (!new_buf) HPD_LOG_RETURN_E_ALLOC(instance->context);
-            instance->field_buffer = new_buf;
-            instance->field_buffer_size = new_len;
-            memcpy(instance->field_buffer+old_buffer_size, field_chunk, length);
-            return HPD_E_SUCCESS;
-        }
+        case S_FIELD:
+            return hp_append(instance, &instance->field_buffer, &instance->field_buffer_size,
+                             &instance->field_buffer_cap, field_chunk, length);
         case S_COMPLETED:
             HPD_LOG_RETURN(instance->context, HPD_E_STATE, "Received additional data after hp_on_header_complete().");
         case S_ERROR:
@@ -132,20 +139,12 @@ hpd_error_t hp_on_header_value(struct hp *instance, const char *value_chunk, siz
 {
     if (!instance || !value_chunk) return  HPD_E_NULL;
 
-    size_t old_buffer_size = instance->value_buffer_size;
-
     switch (instance->state) {
         case S_FIELD:
             instance->state = S_VALUE;
-        case S_VALUE: {
-            size_t new_len = instance->value_buffer_size + length;
-            char *new_buf = realloc(instance->value_buffer, new_len * (sizeof(char)));
-            if (!new_buf) HPD_LOG_RETURN_E_ALLOC(instance->context);
-            instance->value_buffer = new_buf;
-            instance->value_buffer_size = new_len;
-            memcpy(instance->value_buffer+old_buffer_size, value_chunk, length);
-            return HPD_E_SUCCESS;
-        }
+        case S_VALUE:
+            return hp_append(instance, &instance->value_buffer, &instance->value_buffer_size,
+                             &instance->value_buffer_cap, value_chunk, length);
         case S_COMPLETED:
             HPD_LOG_RETURN(instance->context, HPD_E_STATE, "Received additional data after hp_on_header_complete().");
         case S_ERROR:
@@ -180,11 +179,22 @@ hpd_error_t hp_on_header_complete(struct hp *instance)
     }
 }
 
-hpd_error_t hp_destroy(struct hp *instance)
+hpd_error_t hp_reset(struct hp *instance)
 {
     if (!instance) return HPD_E_NULL;
 
     hp_reset_buffers(instance);
+    instance->state = S_FIELD;
+
+    return HPD_E_SUCCESS;
+}
+
+hpd_error_t hp_destroy(struct hp *instance)
+{
+    if (!instance) return HPD_E_NULL;
+
+    free(instance->field_buffer);
+    free(instance->value_buffer);
     free(instance);
 
     return HPD_E_SUCCESS;
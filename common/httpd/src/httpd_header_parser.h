@@ -45,6 +45,7 @@ struct hp_settings {
 
 hpd_error_t hp_create(struct hp **instance, struct hp_settings *settings, const hpd_module_t *context);
 hpd_error_t hp_destroy(struct hp*);
+hpd_error_t hp_reset(struct hp *instance);
 
 hpd_error_t hp_on_header_field(struct hp *instance, const char *field_chunk, size_t length);
 hpd_error_t hp_on_header_value(struct hp *instance, const char *value_chunk, size_t length);
@@ -0,0 +1,103 @@
+/*
+ * Copyright 2011 Aalborg University. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are
+ * permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of
+ * conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list
+ * of conditions and the following disclaimer in the documentation and/or other materials
+ * provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY Aalborg University ''AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL Aalborg University OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are those of the
+ * authors and should not be interpreted as representing official policies, either expressed
+ */
+
+#ifndef HOMEPORT_HTTPD_INTERN_H
+#define HOMEPORT_HTTPD_INTERN_H
+
+#include "hpd-0.6/common/hpd_httpd.h"
+#include "hpd-0.6/common/hpd_tcpd.h"
+#include <ev.h>
+#include <pthread.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct httpd_seg httpd_seg_t;
+typedef struct httpd_msg httpd_msg_t;
+typedef struct httpd_queue httpd_queue_t;
+
+/// Types of messages passed between the main event loop and workers
+typedef enum httpd_msg_type {
+    HTTPD_MSG_REQUEST,  ///< Worker to main: A message has been received in full
+    HTTPD_MSG_CLOSED,   ///< Worker to main: The connection was closed while the main loop handled the message
+    HTTPD_MSG_RESPONSE, ///< Main to worker: The response to send
+} httpd_msg_type_t;
+
+/// Segment of data to send
+struct httpd_seg {
+    httpd_seg_t *next;  ///< Next segment
+    char *buf;          ///< Data
+    size_t len;         ///< Length of data
+    hpd_free_f on_free; ///< Frees buf, may be NULL
+};
+
+/// Message passed between the main event loop and workers
+struct httpd_msg {
+    httpd_msg_t *next;        ///< Next message in queue
+    httpd_msg_type_t type;    ///< Type of message
+    hpd_httpd_request_t *req; ///< Request, the message holds a reference to it
+    httpd_seg_t *segs;        ///< Data to send, for HTTPD_MSG_RESPONSE
+    httpd_seg_t **segs_tail;  ///< Next pointer of the last segment
+};
+
+/// Lock-free queue with many producers and a single consumer
+struct httpd_queue {
+    httpd_msg_t *head; ///< Last pushed message, swapped in by producers
+    httpd_msg_t *tail; ///< Next message to pop, owned by the consumer
+    httpd_msg_t stub;  ///< Placeholder keeping the queue non-empty
+};
+
+/// httpd instance struct
+struct hpd_httpd {
+    hpd_httpd_settings_t settings; ///< Settings
+    hpd_tcpd_t *webserver; ///< Webserver instance, NULL if all connections are handled by workers
+    hpd_ev_loop_t *loop;   ///< Event loop
+    int idle_conns;        ///< Number of persistent connections waiting for a new request
+    const hpd_module_t *context;
+    hpd_httpd_t *main;     ///< Instance calling the user callbacks, if this is a worker
+    hpd_httpd_t **workers; ///< Worker instances, if settings.workers is set
+    httpd_queue_t queue;   ///< Messages for this instance, used with workers
+    ev_async async;        ///< Wakes up the event loop on new messages, used with workers
+    pthread_t thread;      ///< Thread running the event loop, if this is a worker
+    int stopping;          ///< Set when a worker should stop
+};
+
+hpd_error_t httpd_tcpd_create(hpd_httpd_t *httpd);
+hpd_error_t httpd_workers_create(hpd_httpd_t *httpd);
+hpd_error_t httpd_workers_destroy(hpd_httpd_t *httpd);
+hpd_error_t httpd_workers_start(hpd_httpd_t *httpd);
+hpd_error_t httpd_workers_stop(hpd_httpd_t *httpd);
+hpd_error_t httpd_msg_alloc(httpd_msg_t **msg, hpd_httpd_t *httpd, httpd_msg_type_t type, hpd_httpd_request_t *req);
+void httpd_msg_send(hpd_httpd_t *httpd, httpd_msg_t *msg);
+void httpd_msg_free(httpd_msg_t *msg);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //HOMEPORT_HTTPD_INTERN_H
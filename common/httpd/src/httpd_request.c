@@ -26,15 +26,37 @@
  */
 
 #include "httpd_request.h"
+#include "httpd_intern.h"
 #include "http_parser.h"
 #include "httpd_url_parser.h"
 #include "httpd_header_parser.h"
+#include "httpd_header.h"
 #include "hpd-0.6/hpd_shared_api.h"
 #include <string.h>
 #include <stdlib.h>
 #include <ctype.h>
+#include <stdarg.h>
+#include <ev.h>
 #include <hpd-0.6/common/hpd_common.h>
 
+/// Initial size of the buffer holding the values of well-known headers
+#define HTTPD_KNOWN_HEADERS_SIZE 512
+
+/// Maximum amount of pipelined data held back while waiting for a response
+#define HTTPD_PENDING_MAX (64*1024)
+
+/// Format of the end of the response head, after status line and headers
+#define HTTPD_HEAD_END_FMT "%sContent-Length: %zu\r\nConnection: %s\r\n\r\n"
+
+/// Format of the end of the response head, for responses that cannot have a body
+#define HTTPD_HEAD_END_NO_BODY_FMT "%sConnection: %s\r\n\r\n"
+
+/// Format of the end of the response head, for a body sent in chunks
+#define HTTPD_HEAD_END_CHUNKED_FMT "%sTransfer-Encoding: chunked\r\nConnection: %s\r\n\r\n"
+
+/// Format of the end of the response head, for a body ended by closing the connection
+#define HTTPD_HEAD_END_CLOSE_FMT "%sConnection: close\r\n\r\n"
+
 /// The possible states of a request
 enum state {
     S_START,           ///< The initial state
@@ -119,6 +141,25 @@ enum state {
  * }
  * \enddot
  *
+ * <h1>Persistent connections</h1>
+ *
+ * A request is created per connection, and reused for each message
+ * received on it. When a message has been received in full, the
+ * http_parser is paused and any further data is held back, until the
+ * response has been destroyed. The request is then reset to S_START,
+ * outside of any user callbacks, and the held back data is parsed as
+ * the next message.
+ *
+ * <h1>Workers</h1>
+ *
+ * Requests of workers are parsed without calling any callbacks, and the
+ * body is buffered. Once the message has been received in full, the
+ * request is handed off to the main event loop, which calls the
+ * callbacks and builds the response. The request is handed back to the
+ * worker, once the message has ended on the main event loop, and the
+ * response is sent. Only one of the two event loops uses the message
+ * data of the request at any time, and the request is freed when the
+ * last of the connection and the main event loop lets go of it.
  */
 struct hpd_httpd_request
 {
@@ -132,10 +173,32 @@ struct hpd_httpd_request
     enum state state;               ///< Current state
     char *url;                      ///< URL
     hpd_map_t *arguments;           ///< URL Arguments
-    hpd_map_t *headers;             ///< Header Pairs
+    hpd_map_t *headers;             ///< Header Pairs (well-known headers only once merged)
+    size_t known_headers[HPD_HTTPD_H_COUNT]; ///< Offsets of well-known header values in known_buf plus one, or 0
+    char *known_buf;                ///< Values of well-known headers, kept for all messages on the connection
+    size_t known_len;               ///< Used length of known_buf
+    size_t known_size;              ///< Size of known_buf
+    hpd_bool_t known_headers_merged; ///< Whether well-known headers are also kept in headers
     hpd_map_t *cookies;             ///< Cookie Pairs
     void* data;                     ///< User data
     hpd_httpd_method_t method;
+    hpd_bool_t keep_alive;          ///< Keep connection open after this message
+    hpd_bool_t received;            ///< Message has been received in full
+    hpd_bool_t responded;           ///< Response to message has been sent
+    hpd_bool_t chunked;             ///< Body of response is sent with chunked transfer-encoding
+    hpd_bool_t idle;                ///< Waiting for the next message on a persistent connection
+    char *pending;                  ///< Data of pipelined messages, held back until responded
+    size_t pending_len;             ///< Length of pending data
+    ev_timer next_watcher;          ///< Starts the next message on the connection
+    char *ip;                       ///< IP address of client
+    char *body;                     ///< Body of message, only buffered by workers
+    size_t body_len;                ///< Length of body
+    int refs;                       ///< References, by the connection and by the main event loop
+    hpd_bool_t handed_off;          ///< Message is handled by the main event loop (worker side)
+    hpd_bool_t closed;              ///< Connection has been closed (worker side)
+    hpd_bool_t dispatched;          ///< Message is handled by the callbacks (main event loop side)
+    httpd_msg_t *response;          ///< Response, sent when the message ends (main event loop side)
+    ev_timer end_watcher;           ///< Ends the message on the main event loop
 };
 
 // Methods for http_parser settings
@@ -200,6 +263,116 @@ static hpd_error_t url_parser_key_value(void *data, const char *key, size_t key_
     return hpd_map_set_n(req->arguments, key, key_len, value, value_len);
 }
 
+/**
+ * Store a cookie header in the list of cookies.
+ *
+ *  \param  req           The HTTP Request
+ *  \param  value         The value, not null-terminated
+ *  \param  value_length  The length of the value
+ */
+static hpd_error_t header_parser_cookie(hpd_httpd_request_t *req, const char *value, size_t value_length)
+{
+    hpd_error_t rc;
+    size_t key_s = 0, key_e, val_s, val_e;
+
+    while (key_s < value_length) {
+        for (key_e = key_s; key_e < value_length && value[key_e] != '='; key_e++);
+        if (key_e == value_length)
+            HPD_LOG_RETURN(req->context, HPD_E_ARGUMENT, "Parse error.");
+        val_s = key_e + 1;
+        for (val_e = val_s; val_e < value_length && value[val_e] != ';'; val_e++);
+        if (key_e-key_s > 0 && val_e-val_s > 0) {
+            if ((rc = hpd_map_set_n(req->cookies, &value[key_s], (size_t) key_e - key_s, &value[val_s], val_e - val_s)))
+                return rc;
+        } else {
+            HPD_LOG_RETURN(req->context, HPD_E_ARGUMENT, "Parse error.");
+        }
+        key_s = val_e + 2;
+    }
+
+    return HPD_E_SUCCESS;
+}
+
+/**
+ * Get the value of a well-known header.
+ *
+ *  \param  req     The HTTP Request
+ *  \param  header  The id of the header
+ *
+ *  \return The value, or NULL if not present
+ */
+static char *request_known_header(const hpd_httpd_request_t *req, hpd_httpd_header_t header)
+{
+    size_t offset = req->known_headers[header];
+    return offset ? &req->known_buf[offset - 1] : NULL;
+}
+
+/**
+ * Store a well-known header, combining it with any previous value.
+ *
+ *  Values are appended to a buffer that is reused for every message on
+ *  the connection, so once it has grown to fit, storing a header does
+ *  not allocate. A combined value is appended as a whole, leaving the
+ *  previous one unused until the request is reset.
+ *
+ *  \param  req           The HTTP Request
+ *  \param  header        The id of the header
+ *  \param  value         The value, not null-terminated
+ *  \param  value_length  The length of the value
+ */
+static hpd_error_t header_parser_known_header(hpd_httpd_request_t *req, hpd_httpd_header_t header, const char *value,
+                                              size_t value_length)
+{
+    size_t offset = req->known_headers[header];
+    size_t existing_len = offset ? strlen(&req->known_buf[offset - 1]) + 1 : 0;
+    size_t len = req->known_len + existing_len + value_length + 1;
+
+    if (len > req->known_size) {
+        size_t size = req->known_size ? req->known_size : HTTPD_KNOWN_HEADERS_SIZE;
+        while (size < len) size *= 2;
+        HPD_REALLOC(req->known_buf, size, char);
+        req->known_size = size;
+    }
+
+    char *dst = &req->known_buf[req->known_len];
+    if (offset) {
+        // Combine values
+        memcpy(dst, &req->known_buf[offset - 1], existing_len - 1);
+        dst[existing_len - 1] = ',';
+    }
+    memcpy(&dst[existing_len], value, value_length);
+    dst[existing_len + value_length] = '\0';
+    req->known_headers[header] = req->known_len + 1;
+    req->known_len = len;
+
+    if (req->known_headers_merged)
+        return hpd_map_set(req->headers, http_header_name(header), dst);
+    return HPD_E_SUCCESS;
+
+    alloc_error:
+        HPD_LOG_RETURN_E_ALLOC(req->context);
+}
+
+/**
+ * Copy the well-known headers into the map of headers, and keep doing so for later headers.
+ *
+ *  \param  req  The HTTP Request
+ */
+static hpd_error_t request_merge_known_headers(hpd_httpd_request_t *req)
+{
+    hpd_error_t rc;
+
+    if (req->known_headers_merged) return HPD_E_SUCCESS;
+
+    for (int i = 0; i < HPD_HTTPD_H_COUNT; i++) {
+        const char *value = request_known_header(req, (hpd_httpd_header_t) i);
+        if (!value) continue;
+        if ((rc = hpd_map_set(req->headers, http_header_name((hpd_httpd_header_t) i), value))) return rc;
+    }
+    req->known_headers_merged = HPD_TRUE;
+    return HPD_E_SUCCESS;
+}
+
 /**
  * Callback for the header parser.
  *
@@ -209,6 +382,9 @@ static hpd_error_t url_parser_key_value(void *data, const char *key, size_t key_
  *  a single with a comma-seperated list of values, according to the RFC
  *  2616.
  *
+ *  Well-known headers are interned and stored by id, without touching
+ *  the map of headers, see hpd_httpd_request_get_header_by_id().
+ *
  *  \param  data          The HTTP Request
  *  \param  field         The field, not null-terminated
  *  \param  field_length  The length of the field
@@ -220,6 +396,13 @@ static hpd_error_t header_parser_field_value_pair_complete(void* data, const cha
     hpd_error_t rc;
     hpd_httpd_request_t *req = data;
 
+    hpd_httpd_header_t header = http_header_lookup(field_in, field_length);
+    if (header != HPD_HTTPD_H_UNKNOWN) {
+        // If cookie, then store it in cookie list
+        if (header == HPD_HTTPD_H_COOKIE && (rc = header_parser_cookie(req, value, value_length))) return rc;
+        return header_parser_known_header(req, header, value, value_length);
+    }
+
     char *field = NULL;
     HPD_STR_N_CPY(field, field_in, field_length);
     for (int i = 0; i < field_length; i++) field[i] = (char) tolower(field[i]);
@@ -234,31 +417,6 @@ static hpd_error_t header_parser_field_value_pair_complete(void* data, const cha
             return rc;
     }
 
-    // If cookie, then store it in cookie list
-    if (strncmp(field, "cookie", 6) == 0) {
-        size_t key_s = 0, key_e, val_s, val_e;
-
-        while (key_s < value_length) {
-            for (key_e = key_s; key_e < value_length && value[key_e] != '='; key_e++);
-            if (key_e == value_length) {
-                free(field);
-                HPD_LOG_RETURN(req->context, HPD_E_ARGUMENT, "Parse error.");
-            }
-            val_s = key_e + 1;
-            for (val_e = val_s; val_e < value_length && value[val_e] != ';'; val_e++);
-            if (key_e-key_s > 0 && val_e-val_s > 0) {
-                if ((rc = hpd_map_set_n(req->cookies, &value[key_s], (size_t) key_e - key_s, &value[val_s], val_e - val_s))) {
-                    free(field);
-                    return rc;
-                }
-            } else {
-                free(field);
-                HPD_LOG_RETURN(req->context, HPD_E_ARGUMENT, "Parse error.");
-            }
-            key_s = val_e + 2;
-        }
-    }
-
     // Store header in headers list
     if (existing) {
         // Combine values
@@ -297,6 +455,316 @@ static hpd_error_t header_parser_field_value_pair_complete(void* data, const cha
         HPD_LOG_RETURN_E_ALLOC(req->context);
 }
 
+/**
+ * Hold back data for pipelined messages.
+ *
+ *  \param  req  The HTTP Request
+ *  \param  buf  The data, not null-terminated
+ *  \param  len  The length of the data
+ */
+static hpd_error_t request_hold(hpd_httpd_request_t *req, const char *buf, size_t len)
+{
+    if (req->pending_len + len > HTTPD_PENDING_MAX)
+        HPD_LOG_RETURN(req->context, HPD_E_STATE, "Too much pipelined data.");
+
+    HPD_REALLOC(req->pending, req->pending_len + len, char);
+    memcpy(&req->pending[req->pending_len], buf, len);
+    req->pending_len += len;
+    return HPD_E_SUCCESS;
+
+    alloc_error:
+        HPD_LOG_RETURN_E_ALLOC(req->context);
+}
+
+/**
+ * Buffer a chunk of the body, to pass it on to the main event loop.
+ *
+ *  \param  req  The HTTP Request
+ *  \param  buf  The chunk, not null-terminated
+ *  \param  len  The length of the chunk
+ */
+static hpd_error_t request_append_body(hpd_httpd_request_t *req, const char *buf, size_t len)
+{
+    HPD_REALLOC(req->body, req->body_len + len, char);
+    memcpy(&req->body[req->body_len], buf, len);
+    req->body_len += len;
+    return HPD_E_SUCCESS;
+
+    alloc_error:
+        HPD_LOG_RETURN_E_ALLOC(req->context);
+}
+
+/**
+ * Reset the request, ready to parse a new message.
+ *
+ *  \param  req  The HTTP Request
+ */
+static hpd_error_t request_reset(hpd_httpd_request_t *req)
+{
+    hpd_error_t rc;
+
+    http_parser_init(&req->parser, HTTP_REQUEST);
+    req->parser.data = req;
+    req->state = S_START;
+
+    if ((rc = up_reset(req->url_parser))) return rc;
+    if ((rc = hp_reset(req->header_parser))) return rc;
+
+    if ((rc = hpd_map_free(req->arguments))) return rc;
+    req->arguments = NULL;
+    if ((rc = hpd_map_alloc(&req->arguments))) return rc;
+    if ((rc = hpd_map_free(req->headers))) return rc;
+    req->headers = NULL;
+    if ((rc = hpd_map_alloc(&req->headers))) return rc;
+    if ((rc = hpd_map_free(req->cookies))) return rc;
+    req->cookies = NULL;
+    if ((rc = hpd_map_alloc(&req->cookies))) return rc;
+
+    memset(req->known_headers, 0, sizeof(req->known_headers));
+    req->known_len = 0;
+    req->known_headers_merged = HPD_FALSE;
+
+    free(req->url);
+    req->url = NULL;
+    free(req->body);
+    req->body = NULL;
+    req->body_len = 0;
+    req->method = HPD_HTTPD_M_UNKNOWN;
+    req->keep_alive = HPD_FALSE;
+    req->received = HPD_FALSE;
+    req->responded = HPD_FALSE;
+    req->chunked = HPD_FALSE;
+
+    return HPD_E_SUCCESS;
+}
+
+/**
+ * End the current message and start the next on the same connection.
+ *
+ *  Any held back data is parsed, otherwise the connection is left idle
+ *  with the keep-alive timeout. If a callback stopped the current message
+ *  the connection is closed instead.
+ *
+ *  \param  req  The HTTP Request
+ */
+static hpd_error_t request_next(hpd_httpd_request_t *req)
+{
+    hpd_error_t rc;
+    hpd_httpd_settings_t *settings = req->settings;
+
+    // Messages pipelined after a stopped one are dropped, on_req_destroy is called when the connection is closed
+    if (req->state == S_STOP) return hpd_tcpd_conn_close(req->conn);
+
+    // Call callback
+    if (settings->on_req_destroy)
+        settings->on_req_destroy(req->webserver, req, settings->httpd_ctx, &req->data);
+    req->data = NULL;
+
+    if ((rc = request_reset(req))) return rc;
+
+    if (req->pending) {
+        char *buf = req->pending;
+        size_t len = req->pending_len;
+        req->pending = NULL;
+        req->pending_len = 0;
+
+        if ((rc = hpd_tcpd_conn_set_timeout(req->conn, settings->timeout))) {
+            free(buf);
+            return rc;
+        }
+        rc = http_request_parse(req, buf, len);
+        free(buf);
+        return rc;
+    }
+
+    req->idle = HPD_TRUE;
+    req->webserver->idle_conns++;
+    return hpd_tcpd_conn_set_timeout(req->conn, settings->keep_alive_timeout);
+}
+
+/**
+ * Timer callback for starting the next message.
+ *
+ *  Kills the connection if the next message cannot be started.
+ *
+ *  \param  loop     The event loop
+ *  \param  watcher  The timer watcher causing the call
+ *  \param  revents  Not used
+ */
+static void request_on_ev_next(hpd_ev_loop_t *loop, ev_timer *watcher, int revents)
+{
+    hpd_error_t rc;
+    hpd_httpd_request_t *req = watcher->data;
+    const hpd_module_t *context = req->context;
+
+    if ((rc = request_next(req))) {
+        HPD_LOG_ERROR(context, "Failed to start next message, killing connection (code: %d).", rc);
+        if (hpd_tcpd_conn_kill(req->conn)) HPD_LOG_ERROR(context, "Failed to kill connection.");
+    }
+}
+
+/**
+ * Schedule the start of the next message.
+ *
+ *  This is deferred to the event loop, as the user may still be using
+ *  the request data of the current message.
+ *
+ *  \param  req  The HTTP Request
+ */
+static void request_schedule_next(hpd_httpd_request_t *req)
+{
+    if (ev_is_active(&req->next_watcher)) return;
+    ev_timer_set(&req->next_watcher, 0., 0.);
+    ev_timer_start(req->webserver->loop, &req->next_watcher);
+}
+
+/**
+ * Let go of a reference to the request, freeing it with the last one.
+ *
+ *  \param  req  The HTTP Request
+ */
+static hpd_error_t request_unref(hpd_httpd_request_t *req)
+{
+    if (__atomic_sub_fetch(&req->refs, 1, __ATOMIC_ACQ_REL) > 0) return HPD_E_SUCCESS;
+
+    hpd_error_t rc = HPD_E_SUCCESS, tmp;
+
+    if ((tmp = up_destroy(req->url_parser)) && !rc) rc = tmp;
+    if ((tmp = hpd_map_free(req->arguments)) && !rc) rc = tmp;
+    if ((tmp = hpd_map_free(req->headers)) && !rc) rc = tmp;
+    if ((tmp = hpd_map_free(req->cookies)) && !rc) rc = tmp;
+    if ((tmp = hp_destroy(req->header_parser)) && !rc) rc = tmp;
+    free(req->known_buf);
+    free(req->url);
+    free(req->body);
+    free(req->ip);
+    free(req);
+
+    return rc;
+}
+
+/**
+ * Hand off a message, received in full by a worker, to the main event loop.
+ *
+ *  The connection timeout is disabled until the message has been handed
+ *  back, and whether the connection is kept open is decided here, as
+ *  only the worker knows its idle connections.
+ *
+ *  \param  req  The HTTP Request
+ */
+static hpd_error_t request_submit(hpd_httpd_request_t *req)
+{
+    hpd_error_t rc;
+    hpd_bool_t keep_alive;
+    httpd_msg_t *msg;
+
+    if ((rc = http_request_get_keep_alive(req, &keep_alive))) return rc;
+    if ((rc = hpd_tcpd_conn_keep_open(req->conn))) return rc;
+    if ((rc = httpd_msg_alloc(&msg, req->webserver, HTTPD_MSG_REQUEST, req))) return rc;
+
+    // The message holds the reference of the main event loop
+    __atomic_add_fetch(&req->refs, 1, __ATOMIC_RELAXED);
+    req->handed_off = HPD_TRUE;
+    httpd_msg_send(req->webserver->main, msg);
+    return HPD_E_SUCCESS;
+}
+
+/**
+ * End the message on the main event loop, and hand the request back to the worker.
+ *
+ *  The response is passed on to the worker, along with the reference of
+ *  the main event loop. Without a response the reference is dropped.
+ *
+ *  \param  req  The HTTP Request
+ */
+static hpd_error_t request_end(hpd_httpd_request_t *req)
+{
+    hpd_httpd_t *httpd = req->webserver->main;
+    hpd_httpd_settings_t *settings = &httpd->settings;
+
+    ev_timer_stop(httpd->loop, &req->end_watcher);
+
+    // Call callback
+    if (settings->on_req_destroy)
+        settings->on_req_destroy(httpd, req, settings->httpd_ctx, &req->data);
+    req->data = NULL;
+    req->dispatched = HPD_FALSE;
+
+    httpd_msg_t *msg = req->response;
+    req->response = NULL;
+    if (!msg) return request_unref(req);
+    httpd_msg_send(req->webserver, msg);
+    return HPD_E_SUCCESS;
+}
+
+/**
+ * Timer callback for ending the message on the main event loop.
+ *
+ *  \param  loop     The main event loop
+ *  \param  watcher  The timer watcher causing the call
+ *  \param  revents  Not used
+ */
+static void request_on_ev_end(hpd_ev_loop_t *loop, ev_timer *watcher, int revents)
+{
+    hpd_error_t rc;
+    hpd_httpd_request_t *req = watcher->data;
+    const hpd_module_t *context = req->context;
+
+    if ((rc = request_end(req))) HPD_LOG_ERROR(context, "Failed to end message (code: %d).", rc);
+}
+
+/**
+ * Call the callbacks for a message received by a worker, as if it was parsed here.
+ *
+ *  The URL is given as the decoded path, and headers with their combined
+ *  values.
+ *
+ *  \param  req  The HTTP Request
+ */
+static void request_dispatch(hpd_httpd_request_t *req)
+{
+    hpd_error_t rc;
+    hpd_httpd_t *httpd = req->webserver->main;
+    hpd_httpd_settings_t *settings = &httpd->settings;
+    void *ctx = settings->httpd_ctx;
+
+    if (settings->on_req_begin && settings->on_req_begin(httpd, req, ctx, &req->data)) goto stop;
+    if (settings->on_req_url && req->url &&
+        settings->on_req_url(httpd, req, ctx, &req->data, req->url, strlen(req->url))) goto stop;
+    if (settings->on_req_url_cmpl && settings->on_req_url_cmpl(httpd, req, ctx, &req->data)) goto stop;
+
+    if (settings->on_req_hdr_field || settings->on_req_hdr_value) {
+        const hpd_pair_t *pair;
+        const char *field, *value;
+
+        if ((rc = request_merge_known_headers(req))) {
+            HPD_LOG_ERROR(req->context, "Failed to merge headers (code: %d).", rc);
+            goto stop;
+        }
+        hpd_map_foreach(rc, pair, req->headers) {
+            if ((rc = hpd_pair_get(pair, &field, &value))) break;
+            if (settings->on_req_hdr_field &&
+                settings->on_req_hdr_field(httpd, req, ctx, &req->data, field, strlen(field))) goto stop;
+            if (settings->on_req_hdr_value &&
+                settings->on_req_hdr_value(httpd, req, ctx, &req->data, value, strlen(value))) goto stop;
+        }
+        if (rc) {
+            HPD_LOG_ERROR(req->context, "Failed to iterate headers (code: %d).", rc);
+            goto stop;
+        }
+    }
+
+    if (settings->on_req_hdr_cmpl && settings->on_req_hdr_cmpl(httpd, req, ctx, &req->data)) goto stop;
+    if (settings->on_req_body && req->body_len > 0 &&
+        settings->on_req_body(httpd, req, ctx, &req->data, req->body, req->body_len)) goto stop;
+    if (settings->on_req_cmpl && settings->on_req_cmpl(httpd, req, ctx, &req->data)) goto stop;
+    return;
+
+    stop:
+    // The worker closes the connection once the message is handed back
+    req->state = S_STOP;
+}
+
 /**
  * Message begin callback for http_parser.
  *
@@ -319,9 +787,16 @@ static int parser_msg_begin(http_parser *parser)
             return 1;
         case S_START:
             req->state = S_BEGIN;
+            // Leave idle state of persistent connection
+            if (req->idle) {
+                req->idle = HPD_FALSE;
+                req->webserver->idle_conns--;
+                if (hpd_tcpd_conn_set_timeout(req->conn, settings->timeout))
+                    HPD_LOG_WARN(req->context, "Failed to reset timeout.");
+            }
             // Send request begin
             if(settings->on_req_begin && (stat = settings->on_req_begin(req->webserver, req, settings->httpd_ctx, &req->data))) {
-                req->state = S_STOP; return stat;
+                req->state = S_STOP; return 0;
             }
 
             return 0;
@@ -369,7 +844,7 @@ static int parser_url(http_parser *parser, const char *buf, size_t len)
 
     switch (req->state) {
         case S_STOP:
-            return 1;
+            return 0;
         case S_BEGIN:
             req->state = S_URL;
         case S_URL:
@@ -380,7 +855,7 @@ static int parser_url(http_parser *parser, const char *buf, size_t len)
             }
             if(settings->on_req_url && (stat = settings->on_req_url(req->webserver, req, settings->httpd_ctx, &req->data, buf, len))) {
                 req->state = S_STOP;
-                return stat;
+                return 0;
             }
             return 0;
         default:
@@ -413,7 +888,7 @@ static int parser_hdr_field(http_parser *parser, const char *buf, size_t len)
 
     switch (req->state) {
         case S_STOP:
-            return 1;
+            return 0;
         case S_URL:
             if ((rc = up_complete(req->url_parser))) {
                 HPD_LOG_ERROR(req->context, "URL parser failed (code: %d).", rc);
@@ -422,7 +897,7 @@ static int parser_hdr_field(http_parser *parser, const char *buf, size_t len)
             }
             if(settings->on_req_url_cmpl && (stat = settings->on_req_url_cmpl(req->webserver, req, settings->httpd_ctx, &req->data))) {
                 req->state = S_STOP;
-                return stat;
+                return 0;
             }
         case S_HEADER_VALUE:
             req->state = S_HEADER_FIELD;
@@ -434,7 +909,7 @@ static int parser_hdr_field(http_parser *parser, const char *buf, size_t len)
             }
             if(settings->on_req_hdr_field && (stat = settings->on_req_hdr_field(req->webserver, req, settings->httpd_ctx, &req->data, buf, len))) {
                 req->state = S_STOP;
-                return stat;
+                return 0;
             }
             return 0;
         default:
@@ -466,7 +941,7 @@ static int parser_hdr_value(http_parser *parser, const char *buf, size_t len)
 
     switch (req->state) {
         case S_STOP:
-            return 1;
+            return 0;
         case S_HEADER_FIELD:
             req->state = S_HEADER_VALUE;
         case S_HEADER_VALUE:
@@ -477,7 +952,7 @@ static int parser_hdr_value(http_parser *parser, const char *buf, size_t len)
             }
             if(settings->on_req_hdr_value && (stat = settings->on_req_hdr_value(req->webserver, req, settings->httpd_ctx, &req->data, buf, len))) {
                 req->state = S_STOP;
-                return stat;
+                return 0;
             }
             return 0;
         default:
@@ -507,9 +982,12 @@ static int parser_hdr_cmpl(http_parser *parser)
     hpd_httpd_request_t *req = parser->data;
     hpd_httpd_settings_t *settings = req->settings;
 
+    // Persistence according to version and Connection header
+    req->keep_alive = http_should_keep_alive(parser) && settings->keep_alive_timeout > 0 ? HPD_TRUE : HPD_FALSE;
+
     switch (req->state) {
         case S_STOP:
-            return 1;
+            return 0;
         case S_URL:
             if ((rc = up_complete(req->url_parser))) {
                 HPD_LOG_ERROR(req->context, "Header parser failed (code: %d).", rc);
@@ -518,7 +996,7 @@ static int parser_hdr_cmpl(http_parser *parser)
             }
             if(settings->on_req_url_cmpl && (stat = settings->on_req_url_cmpl(req->webserver, req, settings->httpd_ctx, &req->data))){
                 req->state = S_STOP;
-                return stat;
+                return 0;
             }
         case S_HEADER_VALUE:
             if ((rc = hp_on_header_complete(req->header_parser))) {
@@ -529,7 +1007,7 @@ static int parser_hdr_cmpl(http_parser *parser)
             req->state = S_HEADER_COMPLETE;
             if(settings->on_req_hdr_cmpl && (stat = settings->on_req_hdr_cmpl(req->webserver, req, settings->httpd_ctx, &req->data))) {
                 req->state = S_STOP;
-                return stat;
+                return 0;
             }
             return 0;
         default:
@@ -554,19 +1032,28 @@ static int parser_hdr_cmpl(http_parser *parser)
  */
 static int parser_body(http_parser *parser, const char *buf, size_t len)
 {
+    hpd_error_t rc;
     hpd_httpd_return_t stat;
     hpd_httpd_request_t *req = parser->data;
     hpd_httpd_settings_t *settings = req->settings;
 
     switch (req->state) {
         case S_STOP:
-            return 1;
+            return 0;
         case S_HEADER_COMPLETE:
             req->state = S_BODY;
         case S_BODY:
+            if (req->webserver->main) {
+                if ((rc = request_append_body(req, buf, len))) {
+                    HPD_LOG_ERROR(req->context, "Failed to buffer body (code: %d).", rc);
+                    req->state = S_ERROR;
+                    return 1;
+                }
+                return 0;
+            }
             if (settings->on_req_body) {
                 stat = settings->on_req_body(req->webserver, req, settings->httpd_ctx, &req->data, buf, len);
-                if (stat) { req->state = S_STOP; return stat; }
+                if (stat) { req->state = S_STOP; return 0; }
             }
             return 0;
         default:
@@ -587,19 +1074,32 @@ static int parser_body(http_parser *parser, const char *buf, size_t len)
  */
 static int parser_msg_cmpl(http_parser *parser)
 {
+    hpd_error_t rc;
     hpd_httpd_return_t stat;
     hpd_httpd_request_t *req = parser->data;
     hpd_httpd_settings_t *settings = req->settings;
 
     switch (req->state) {
         case S_STOP:
-            return 1;
         case S_HEADER_COMPLETE:
         case S_BODY:
+            // Hold back pipelined messages until the response has been sent
+            req->received = HPD_TRUE;
+            http_parser_pause(parser, 1);
+            if (req->responded) request_schedule_next(req);
+
+            if (req->state == S_STOP) return 0;
             req->state = S_COMPLETE;
+            if (req->webserver->main) {
+                if ((rc = request_submit(req))) {
+                    HPD_LOG_ERROR(req->context, "Failed to pass on message (code: %d).", rc);
+                    req->state = S_ERROR;
+                    return 1;
+                }
+                return 0;
+            }
             if(settings->on_req_cmpl && (stat = settings->on_req_cmpl(req->webserver, req, settings->httpd_ctx, &req->data))) {
                 req->state = S_STOP;
-                return stat;
             }
             return 0;
         default:
@@ -642,6 +1142,27 @@ hpd_error_t http_request_create(hpd_httpd_request_t **req, hpd_httpd_t *httpd, h
     (*req)->conn = conn;
     (*req)->settings = settings;
 
+    // Init connection state
+    (*req)->keep_alive = HPD_FALSE;
+    (*req)->received = HPD_FALSE;
+    (*req)->responded = HPD_FALSE;
+    (*req)->chunked = HPD_FALSE;
+    (*req)->idle = HPD_FALSE;
+    (*req)->pending = NULL;
+    (*req)->pending_len = 0;
+    ev_init(&(*req)->next_watcher, request_on_ev_next);
+    (*req)->next_watcher.data = (*req);
+    (*req)->ip = NULL;
+    (*req)->body = NULL;
+    (*req)->body_len = 0;
+    (*req)->refs = 1;
+    (*req)->handed_off = HPD_FALSE;
+    (*req)->closed = HPD_FALSE;
+    (*req)->dispatched = HPD_FALSE;
+    (*req)->response = NULL;
+    ev_init(&(*req)->end_watcher, request_on_ev_end);
+    (*req)->end_watcher.data = (*req);
+
     // Init parser
     http_parser_init(&((*req)->parser), HTTP_REQUEST);
     (*req)->parser.data = (*req);
@@ -667,9 +1188,22 @@ hpd_error_t http_request_create(hpd_httpd_request_t **req, hpd_httpd_t *httpd, h
     // Other field to init
     (*req)->url = NULL;
     (*req)->data = NULL;
+    memset((*req)->known_headers, 0, sizeof((*req)->known_headers));
+    (*req)->known_buf = NULL;
+    (*req)->known_len = 0;
+    (*req)->known_size = 0;
+    (*req)->known_headers_merged = HPD_FALSE;
+
+    // Copy IP, as the main event loop may still use it after the connection has gone
+    const char *ip;
+    if ((rc = hpd_tcpd_conn_get_ip(conn, &ip))) goto error;
+    HPD_STR_CPY((*req)->ip, ip);
 
     return HPD_E_SUCCESS;
-    
+
+    alloc_error:
+        HPD_LOG_ERROR(context, "Unable to allocate memory.");
+        rc = HPD_E_ALLOC;
     error:
         if ((rc2 = http_request_destroy(*req)))
             HPD_LOG_ERROR(context, "Failed to destroy request (code: %d)\n", rc2);
@@ -687,24 +1221,31 @@ hpd_error_t http_request_create(hpd_httpd_request_t **req, hpd_httpd_t *httpd, h
 hpd_error_t http_request_destroy(hpd_httpd_request_t *req)
 {
     if (!req) return HPD_E_NULL;
-    
-    hpd_error_t rc = HPD_E_SUCCESS, tmp;
 
     // Call callback
     hpd_httpd_settings_t *settings = req->settings;
     if (settings->on_req_destroy)
         settings->on_req_destroy(req->webserver, req, settings->httpd_ctx, &req->data);
 
-    // Free request
-    if ((tmp = up_destroy(req->url_parser)) && !rc) rc = tmp;
-    if ((tmp = hpd_map_free(req->arguments)) && !rc) rc = tmp;
-    if ((tmp = hpd_map_free(req->headers)) && !rc) rc = tmp;
-    if ((tmp = hpd_map_free(req->cookies)) && !rc) rc = tmp;
-    if ((tmp = hp_destroy(req->header_parser)) && !rc) rc = tmp;
-    free(req->url);
-    free(req);
-    
-    return rc;
+    // Leave connection state
+    ev_timer_stop(req->webserver->loop, &req->next_watcher);
+    if (req->idle) req->webserver->idle_conns--;
+    req->idle = HPD_FALSE;
+    free(req->pending);
+    req->pending = NULL;
+    req->pending_len = 0;
+
+    // Let the main event loop end the message, passing on the reference of the connection
+    if (req->handed_off) {
+        hpd_error_t rc;
+        httpd_msg_t *msg;
+        req->closed = HPD_TRUE;
+        if ((rc = httpd_msg_alloc(&msg, req->webserver, HTTPD_MSG_CLOSED, req))) return rc;
+        httpd_msg_send(req->webserver->main, msg);
+        return HPD_E_SUCCESS;
+    }
+
+    return request_unref(req);
 }
 
 /**
@@ -723,6 +1264,9 @@ hpd_error_t http_request_destroy(hpd_httpd_request_t *req)
  */
 hpd_error_t http_request_parse(hpd_httpd_request_t *req, const char *buf, size_t len)
 {
+    // Hold back pipelined messages until the response has been sent
+    if (req->received) return request_hold(req, buf, len);
+
     size_t read = http_parser_execute(&req->parser, &parser_settings, buf, len);
 
     enum http_errno err = HTTP_PARSER_ERRNO(&req->parser);
@@ -730,6 +1274,8 @@ hpd_error_t http_request_parse(hpd_httpd_request_t *req, const char *buf, size_t
     switch (err) {
         case HPE_OK:
             break;
+        case HPE_PAUSED:
+            if (req->received) break;
         case HPE_CB_message_begin:
         case HPE_CB_url:
         case HPE_CB_header_field:
@@ -761,21 +1307,368 @@ hpd_error_t http_request_parse(hpd_httpd_request_t *req, const char *buf, size_t
         case HPE_INVALID_CONSTANT:
         case HPE_INVALID_INTERNAL_STATE:
         case HPE_STRICT:
-        case HPE_PAUSED:
         case HPE_UNKNOWN:
             HPD_LOG_RETURN(req->context, HPD_E_ARGUMENT, "HTTP Parser failed with message: %s (code: %i).",
                            http_errno_description(err), err);
     }
 
-    if (read != len  && req->state != S_STOP)
-        HPD_LOG_RETURN(req->context, HPD_E_STATE, "Unexpected state.");
-
     if (req->parser.upgrade)
         HPD_LOG_RETURN(req->context, HPD_E_ARGUMENT, "Do not support HTTP upgrade messages.");
 
+    if (read != len) {
+        if (req->received) return request_hold(req, &buf[read], len - read);
+        HPD_LOG_RETURN(req->context, HPD_E_STATE, "Unexpected state.");
+    }
+
+    return HPD_E_SUCCESS;
+}
+
+/**
+ * Decide whether the connection is kept open after the response.
+ *
+ *  Based on the HTTP version and Connection header of the message, and the
+ *  number of idle connections. The decision is final, and must be made
+ *  before the response headers are sent.
+ *
+ *  \param  req         The request responded to
+ *  \param  keep_alive  Will be set to whether the connection is kept open
+ */
+hpd_error_t http_request_get_keep_alive(hpd_httpd_request_t *req, hpd_bool_t *keep_alive)
+{
+    if (!req) return HPD_E_NULL;
+    if (!keep_alive) HPD_LOG_RETURN_E_NULL(req->context);
+
+    // A stopped message may be followed by data the client meant as its body, so the connection is not reused
+    if (req->state == S_STOP) req->keep_alive = HPD_FALSE;
+    // Workers decide before handing off the message
+    else if (req->keep_alive && !req->dispatched && req->webserver->idle_conns >= req->settings->max_idle_conns)
+        req->keep_alive = HPD_FALSE;
+
+    (*keep_alive) = req->keep_alive;
+    return HPD_E_SUCCESS;
+}
+
+/**
+ * Signal that the response to the current message has been sent.
+ *
+ *  Closes the connection, once the data has been sent, unless it is kept
+ *  open. Otherwise the next message is started once the current one has
+ *  been received in full.
+ *
+ *  \param  req  The request responded to
+ */
+hpd_error_t http_request_responded(hpd_httpd_request_t *req)
+{
+    if (!req) return HPD_E_NULL;
+
+    req->responded = HPD_TRUE;
+    if (!req->keep_alive) return hpd_tcpd_conn_close(req->conn);
+    if (req->received) request_schedule_next(req);
+    return HPD_E_SUCCESS;
+}
+
+/**
+ * Queue data of the response to the current message.
+ *
+ *  The data is sent directly on the connection, or for workers added to
+ *  the response, which is sent by the worker when the message ends.
+ *
+ *  \param  req      The request responded to
+ *  \param  buf      The data, ownership is taken, also on errors
+ *  \param  len      The length of the data
+ *  \param  on_free  Function to free buf with, may be NULL
+ */
+static hpd_error_t request_out(hpd_httpd_request_t *req, char *buf, size_t len, hpd_free_f on_free)
+{
+    if (!req->webserver->main) return hpd_tcpd_conn_send(req->conn, buf, len, on_free);
+
+    if (!len) {
+        if (on_free) on_free(buf);
+        return HPD_E_SUCCESS;
+    }
+
+    httpd_seg_t *seg;
+    HPD_CALLOC(seg, 1, httpd_seg_t);
+    seg->buf = buf;
+    seg->len = len;
+    seg->on_free = on_free;
+    (*req->response->segs_tail) = seg;
+    req->response->segs_tail = &seg->next;
+    return HPD_E_SUCCESS;
+
+    alloc_error:
+        if (on_free) on_free(buf);
+        HPD_LOG_RETURN_E_ALLOC(req->context);
+}
+
+/**
+ * Queue formatted data of the response to the current message.
+ *
+ *  See request_out().
+ *
+ *  \param  req  The request responded to
+ *  \param  fmt  Format string
+ */
+static hpd_error_t request_outf(hpd_httpd_request_t *req, const char *fmt, ...)
+{
+    hpd_error_t rc;
+    va_list vp;
+    char *buf;
+
+    va_start(vp, fmt);
+    if (!req->webserver->main) {
+        rc = hpd_tcpd_conn_vsendf(req->conn, fmt, vp);
+        va_end(vp);
+        return rc;
+    }
+    HPD_VSPRINTF_ALLOC(buf, fmt, vp);
+    va_end(vp);
+    return request_out(req, buf, strlen(buf), free);
+
+    alloc_error:
+        va_end(vp);
+        HPD_LOG_RETURN_E_ALLOC(req->context);
+
+    vsnprintf_error:
+        va_end(vp);
+        HPD_LOG_RETURN(req->context, HPD_E_UNKNOWN, "vsnprintf() failed.");
+}
+
+/**
+ * Begin the response to the current message.
+ *
+ *  For workers, the response is held until the message ends on the main
+ *  event loop.
+ *
+ *  \param  req  The request responded to
+ */
+static hpd_error_t request_begin_response(hpd_httpd_request_t *req)
+{
+    if (!req->webserver->main) return HPD_E_SUCCESS;
+
+    if (!req->dispatched || req->response)
+        HPD_LOG_RETURN(req->context, HPD_E_STATE, "Message has already been responded to.");
+    return httpd_msg_alloc(&req->response, req->webserver, HTTPD_MSG_RESPONSE, req);
+}
+
+/**
+ * End the response to the current message.
+ *
+ *  \param  req  The request responded to
+ */
+static hpd_error_t request_end_response(hpd_httpd_request_t *req)
+{
+    if (!req->webserver->main) return http_request_responded(req);
+
+    // Deferred, as the user may still be using the request data
+    ev_timer_set(&req->end_watcher, 0., 0.);
+    ev_timer_start(req->webserver->main->loop, &req->end_watcher);
     return HPD_E_SUCCESS;
 }
 
+/**
+ * Send a response to the current message.
+ *
+ *  The Content-Length and Connection headers are added to the status line
+ *  and headers. For workers, the response is held until the message ends
+ *  on the main event loop, and then sent by the worker.
+ *
+ *  \param  req         The request responded to
+ *  \param  msg         The status line and headers, each ended by CRLF
+ *  \param  keep_alive  Whether the connection is kept open, from http_request_get_keep_alive()
+ *  \param  body        The body, ownership is taken, also on errors, or NULL if the response
+ *                      cannot have a body, in which case no Content-Length header is added
+ *  \param  body_len    The length of the body
+ */
+hpd_error_t http_request_send(hpd_httpd_request_t *req, const char *msg, hpd_bool_t keep_alive, char *body,
+                              size_t body_len)
+{
+    hpd_error_t rc;
+
+    if (!req) {
+        free(body);
+        return HPD_E_NULL;
+    }
+    if (!msg) {
+        free(body);
+        HPD_LOG_RETURN_E_NULL(req->context);
+    }
+
+    if ((rc = request_begin_response(req))) {
+        free(body);
+        return rc;
+    }
+
+    if (!body) {
+        if ((rc = request_outf(req, HTTPD_HEAD_END_NO_BODY_FMT, msg, keep_alive ? "keep-alive" : "close")))
+            return rc;
+        return request_end_response(req);
+    }
+
+    if ((rc = request_outf(req, HTTPD_HEAD_END_FMT, msg, body_len, keep_alive ? "keep-alive" : "close"))) {
+        free(body);
+        return rc;
+    }
+    if ((rc = request_out(req, body, body_len, free))) return rc;
+    return request_end_response(req);
+}
+
+/**
+ * Send the head of a response to the current message, with the body to follow in chunks.
+ *
+ *  The body is sent with chunked transfer-encoding. HTTP/1.0 clients do
+ *  not support this, so for these the body is instead ended by closing
+ *  the connection.
+ *
+ *  \param  req         The request responded to
+ *  \param  msg         The status line and headers, each ended by CRLF
+ *  \param  keep_alive  Whether the connection is kept open, from http_request_get_keep_alive()
+ */
+hpd_error_t http_request_send_head(hpd_httpd_request_t *req, const char *msg, hpd_bool_t keep_alive)
+{
+    hpd_error_t rc;
+
+    if (!req) return HPD_E_NULL;
+    if (!msg) HPD_LOG_RETURN_E_NULL(req->context);
+
+    if ((rc = request_begin_response(req))) return rc;
+
+    req->chunked = req->parser.http_major > 1 || (req->parser.http_major == 1 && req->parser.http_minor >= 1);
+    if (req->chunked)
+        return request_outf(req, HTTPD_HEAD_END_CHUNKED_FMT, msg, keep_alive ? "keep-alive" : "close");
+
+    req->keep_alive = HPD_FALSE;
+    return request_outf(req, HTTPD_HEAD_END_CLOSE_FMT, msg);
+}
+
+/**
+ * Send a chunk of the body of a response, after http_request_send_head().
+ *
+ *  \param  req      The request responded to
+ *  \param  buf      The chunk, ownership is taken, also on errors
+ *  \param  len      The length of the chunk
+ *  \param  on_free  Function to free buf with, may be NULL
+ */
+hpd_error_t http_request_send_chunk(hpd_httpd_request_t *req, char *buf, size_t len, hpd_free_f on_free)
+{
+    hpd_error_t rc;
+
+    if (!req) {
+        if (on_free) on_free(buf);
+        return HPD_E_NULL;
+    }
+    if (!buf) HPD_LOG_RETURN_E_NULL(req->context);
+
+    // An empty chunk would end the body
+    if (!req->chunked || !len) return request_out(req, buf, len, on_free);
+
+    if ((rc = request_outf(req, "%zx\r\n", len))) {
+        if (on_free) on_free(buf);
+        return rc;
+    }
+    if ((rc = request_out(req, buf, len, on_free))) return rc;
+    return request_outf(req, "\r\n");
+}
+
+/**
+ * End a response sent with http_request_send_head().
+ *
+ *  \param  req  The request responded to
+ */
+hpd_error_t http_request_send_end(hpd_httpd_request_t *req)
+{
+    hpd_error_t rc;
+
+    if (!req) return HPD_E_NULL;
+
+    if (req->chunked && (rc = request_outf(req, "0\r\n\r\n"))) return rc;
+    req->chunked = HPD_FALSE;
+    return request_end_response(req);
+}
+
+/**
+ * Handle a message handed off by a worker, on the main event loop.
+ *
+ *  The reference held by the message is taken over by the main event
+ *  loop, until the message ends.
+ *
+ *  \param  req  The HTTP Request
+ */
+hpd_error_t http_request_on_received(hpd_httpd_request_t *req)
+{
+    if (!req) return HPD_E_NULL;
+
+    req->dispatched = HPD_TRUE;
+
+    // The connection is about to be closed, await the close message
+    if (req->webserver->main->stopping) return HPD_E_SUCCESS;
+
+    request_dispatch(req);
+    return HPD_E_SUCCESS;
+}
+
+/**
+ * Handle that the connection of a worker was closed, on the main event loop.
+ *
+ *  Ends the message, if not already ended, and drops any response. The
+ *  reference held by the message is dropped.
+ *
+ *  \param  req  The HTTP Request
+ */
+hpd_error_t http_request_on_closed(hpd_httpd_request_t *req)
+{
+    if (!req) return HPD_E_NULL;
+
+    hpd_error_t rc = HPD_E_SUCCESS, tmp;
+
+    if (req->dispatched) {
+        httpd_msg_t *res = req->response;
+        req->response = NULL;
+        if (res) httpd_msg_free(res);
+        rc = request_end(req);
+    }
+
+    if ((tmp = request_unref(req)) && !rc) rc = tmp;
+    return rc;
+}
+
+/**
+ * Send the response handed back from the main event loop, on the worker.
+ *
+ *  The data of the response is taken from the message. The reference
+ *  held by the message is dropped.
+ *
+ *  \param  req  The HTTP Request
+ *  \param  msg  The message with the response
+ */
+hpd_error_t http_request_on_response(hpd_httpd_request_t *req, httpd_msg_t *msg)
+{
+    if (!req) return HPD_E_NULL;
+    if (!msg) HPD_LOG_RETURN_E_NULL(req->context);
+
+    hpd_error_t rc;
+    httpd_seg_t *seg;
+
+    req->handed_off = HPD_FALSE;
+    if (req->closed) return request_unref(req);
+
+    // Ownership of each segment is passed on to the connection, and the rest are freed with the message
+    while ((seg = msg->segs)) {
+        msg->segs = seg->next;
+        rc = hpd_tcpd_conn_send(req->conn, seg->buf, seg->len, seg->on_free);
+        free(seg);
+        if (rc) goto error;
+    }
+    if ((rc = http_request_responded(req))) goto error;
+
+    return request_unref(req);
+
+    error:
+        if (hpd_tcpd_conn_kill(req->conn)) HPD_LOG_ERROR(req->context, "Failed to kill connection.");
+        request_unref(req);
+        return rc;
+}
+
 /**
  * Get the method of the http request.
  *
@@ -809,6 +1702,10 @@ hpd_error_t hpd_httpd_request_get_url(hpd_httpd_request_t *req, const char **url
 /**
  * Get a linked map of all headers for a request.
  *
+ *  Keys are lowercase. Prefer hpd_httpd_request_get_header_by_id() for
+ *  well-known headers, as they are only copied into the map once this
+ *  has been called.
+ *
  *  \param  req      http request
  *  \param  headers  Will be set to the headers.
  */
@@ -817,6 +1714,9 @@ hpd_error_t hpd_httpd_request_get_headers(hpd_httpd_request_t *req, hpd_map_t **
     if (!req) return HPD_E_NULL;
     if (!headers) HPD_LOG_RETURN_E_NULL(req->context);
 
+    hpd_error_t rc;
+    if ((rc = request_merge_known_headers(req))) return rc;
+
     (*headers) = req->headers;
     return HPD_E_SUCCESS;
 }
@@ -833,9 +1733,31 @@ hpd_error_t hpd_httpd_request_get_header(hpd_httpd_request_t *req, const char *k
     if (!req) return HPD_E_NULL;
     if (!key || !value) HPD_LOG_RETURN_E_NULL(req->context);
 
+    hpd_httpd_header_t header = http_header_lookup(key, strlen(key));
+    if (header != HPD_HTTPD_H_UNKNOWN) return hpd_httpd_request_get_header_by_id(req, header, value);
+
     return hpd_map_get(req->headers, key, value);
 }
 
+/**
+ * Get a well-known header of a request.
+ *
+ *  \param  req     http request
+ *  \param  header  Id of the header to get
+ *  \param  value   Will be set to the value of the header, or NULL if not present. Valid until another
+ *                  header is received, e.g. a trailer, or the next message
+ */
+hpd_error_t hpd_httpd_request_get_header_by_id(hpd_httpd_request_t *req, hpd_httpd_header_t header, const char **value)
+{
+    if (!req) return HPD_E_NULL;
+    if (!value) HPD_LOG_RETURN_E_NULL(req->context);
+    if (header < 0 || header >= HPD_HTTPD_H_COUNT) HPD_LOG_RETURN(req->context, HPD_E_ARGUMENT, "Unknown header.");
+
+    (*value) = request_known_header(req, header);
+    if (!(*value)) return HPD_E_NOT_FOUND;
+    return HPD_E_SUCCESS;
+}
+
 /**
  * Get a linked map of all URL arguements for a request.
  *
@@ -924,7 +1846,8 @@ hpd_error_t hpd_httpd_request_get_ip(hpd_httpd_request_t *req, const char **ip)
     if (!req) return HPD_E_NULL;
     if (!ip) HPD_LOG_RETURN_E_NULL(req->context);
 
-    return hpd_tcpd_conn_get_ip(req->conn, ip);
+    (*ip) = req->ip;
+    return HPD_E_SUCCESS;
 }
 
 /**
@@ -942,6 +1865,9 @@ hpd_error_t hpd_httpd_request_keep_open(hpd_httpd_request_t *req)
 {
     if (!req) return HPD_E_NULL;
 
+    // Workers do not time out while the message is handled
+    if (req->webserver->main) return HPD_E_SUCCESS;
+
     return hpd_tcpd_conn_keep_open(req->conn);
 }
 
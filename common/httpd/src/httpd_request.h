@@ -30,6 +30,7 @@
 
 #include "hpd-0.6/common/hpd_httpd.h"
 #include "hpd-0.6/common/hpd_tcpd.h"
+#include "httpd_intern.h"
 #include <stddef.h>
 
 hpd_error_t http_request_create(hpd_httpd_request_t **req, hpd_httpd_t *httpd, hpd_httpd_settings_t *settings,
@@ -38,5 +39,15 @@ hpd_error_t http_request_destroy(hpd_httpd_request_t *req);
 hpd_error_t http_request_parse(hpd_httpd_request_t *req, const char *buf, size_t len);
 hpd_error_t http_request_get_connection(hpd_httpd_request_t *req, hpd_tcpd_conn_t **conn);
 hpd_error_t http_request_get_context(hpd_httpd_request_t *req, const hpd_module_t **context);
+hpd_error_t http_request_get_keep_alive(hpd_httpd_request_t *req, hpd_bool_t *keep_alive);
+hpd_error_t http_request_responded(hpd_httpd_request_t *req);
+hpd_error_t http_request_send(hpd_httpd_request_t *req, const char *msg, hpd_bool_t keep_alive, char *body,
+                              size_t body_len);
+hpd_error_t http_request_send_head(hpd_httpd_request_t *req, const char *msg, hpd_bool_t keep_alive);
+hpd_error_t http_request_send_chunk(hpd_httpd_request_t *req, char *buf, size_t len, hpd_free_f on_free);
+hpd_error_t http_request_send_end(hpd_httpd_request_t *req);
+hpd_error_t http_request_on_received(hpd_httpd_request_t *req);
+hpd_error_t http_request_on_closed(hpd_httpd_request_t *req);
+hpd_error_t http_request_on_response(hpd_httpd_request_t *req, httpd_msg_t *msg);
 
 #endif
@@ -31,6 +31,7 @@
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <hpd-0.6/common/hpd_common.h>
 
 #define HTTPD_HTTP_VERSION "HTTP/1.1 "
 #define HTTPD_CRLF "\r\n"
@@ -45,15 +46,26 @@
  *  Headers are added with hpd_httpd_response_add_header(), if the header is
  *  a cookie it can also be added with hpd_httpd_response_add_cookie().
  *
- *  The body is sent in chunks by repeating the calls to
- *  hpd_httpd_response_sendf() and http_response_vsentf(). The status and
- *  headers will be sent on the first call.
+ *  The body is added in chunks by repeating the calls to
+ *  hpd_httpd_response_sendf() and http_response_vsentf(), or
+ *  hpd_httpd_response_send() for binary data. Headers can no longer be
+ *  added after the first call. The response is sent, with a
+ *  Content-Length header, when it is destroyed.
+ *
+ *  Alternatively, large bodies can be streamed with
+ *  hpd_httpd_response_send_chunk(). The status line and headers are sent
+ *  on the first call, and each chunk is handed on to the connection as
+ *  is, with chunked transfer-encoding. The body is ended when the
+ *  response is destroyed. The two ways of sending cannot be mixed.
  */
 struct hpd_httpd_response
 {
     const hpd_module_t *context;
-    hpd_tcpd_conn_t *conn; ///< The connection to send on
+    hpd_httpd_request_t *req; ///< The request responded to
     char *msg;            ///< Status/headers to send
+    char *body;           ///< Body to send, NULL if no send function has been called
+    size_t body_len;      ///< Length of body
+    hpd_bool_t chunked;   ///< Status/headers have been sent, and the body is sent in chunks
     hpd_status_t status;
 };
 
@@ -75,14 +87,57 @@ static char* httpd_status_codes_to_str(hpd_status_t status)
     return NULL;
 }
 
+/**
+ * Log that a response is being sent.
+ *
+ *  \param  res  The HTTP Response
+ */
+static void httpd_response_log(hpd_httpd_response_t *res)
+{
+    hpd_error_t rc;
+    const char *ip;
+
+    if ((rc = hpd_httpd_request_get_ip(res->req, &ip))) {
+        HPD_LOG_WARN(res->context, "Failed to get ip [code: %i].", rc);
+        ip = "(unknown)";
+    }
+    HPD_LOG_VERBOSE(res->context, "Sending response to %s: %i %s.", ip, res->status, httpd_status_codes_to_str(res->status));
+}
+
+/**
+ * Send the status, headers and body of a response.
+ *
+ *  \param  res  The HTTP Response to send
+ */
+static hpd_error_t httpd_response_flush(hpd_httpd_response_t *res)
+{
+    hpd_error_t rc;
+    hpd_bool_t keep_alive;
+
+    if ((rc = http_request_get_keep_alive(res->req, &keep_alive))) return rc;
+    httpd_response_log(res);
+
+    // No Content-Length and body for responses that cannot have one
+    if (res->status == HPD_S_204 || res->status == HPD_S_304)
+        return http_request_send(res->req, res->msg, keep_alive, NULL, 0);
+
+    // Hand over body
+    char *body = res->body;
+    res->body = NULL;
+    return http_request_send(res->req, res->msg, keep_alive, body, res->body_len);
+}
+
 /**
  * Destroy a hpd_httpd_response.
  *
- *  The will close the connection and free up any memory used by the
- *  response.
+ *  This will send the response and free up any memory used by it.
+ *  Afterwards the connection is either closed, once the data has been
+ *  sent, or kept open for the next request from the client.
  *
- *  Any data sent with hpd_httpd_response_sendf() and http_reponse_vsendf()
- *  will be sent before the connection is closed.
+ *  If neither hpd_httpd_response_sendf() nor http_reponse_vsendf() has
+ *  been called, nothing is sent, and a new response may be created for
+ *  the request. If hpd_httpd_response_send_chunk() has been called, the
+ *  body is ended.
  *
  *  \param  res  The HTTP Response to destroy
  */
@@ -90,8 +145,11 @@ hpd_error_t hpd_httpd_response_destroy(hpd_httpd_response_t *res)
 {
     if (!res) return  HPD_E_NULL;
 
-    hpd_error_t rc = hpd_tcpd_conn_close(res->conn);
+    hpd_error_t rc = HPD_E_SUCCESS;
+    if (res->chunked) rc = http_request_send_end(res->req);
+    else if (res->msg && res->body) rc = httpd_response_flush(res);
     free(res->msg);
+    free(res->body);
     free(res);
     return rc;
 }
@@ -99,9 +157,9 @@ hpd_error_t hpd_httpd_response_destroy(hpd_httpd_response_t *res)
 /**
  *  Create the reponse and constructs the status line.
  *
- *  Currently it also adds the header "Connection: close", because it do
- *  not yet support persistant connections. That is, connection where
- *  status and headers are sent multiple times.
+ *  The Content-Length and Connection headers are added when the response
+ *  is sent, and should not be added by the caller. Responses with status
+ *  204 or 304 are sent without Content-Length and body.
  *
  *  The response is not send before one of the send functions are
  *  called, it is possible to call these with a NULL body to send
@@ -116,7 +174,7 @@ hpd_error_t hpd_httpd_response_destroy(hpd_httpd_response_t *res)
 hpd_error_t hpd_httpd_response_create(hpd_httpd_response_t **response, hpd_httpd_request_t *req, hpd_status_t status)
 {
     if (!req) return HPD_E_NULL;
-    hpd_error_t rc, rc2;
+    hpd_error_t rc;
     const hpd_module_t *context;
     if ((rc = http_request_get_context(req, &context))) return rc;
     if (!response) HPD_LOG_RETURN_E_NULL(context);
@@ -138,6 +196,10 @@ hpd_error_t hpd_httpd_response_create(hpd_httpd_response_t **response, hpd_httpd
     (*response) = malloc(sizeof(hpd_httpd_response_t));
     if (!(*response)) HPD_LOG_RETURN_E_ALLOC(context);
     (*response)->status = status;
+    (*response)->req = req;
+    (*response)->body = NULL;
+    (*response)->body_len = 0;
+    (*response)->chunked = HPD_FALSE;
     (*response)->msg = malloc(len*sizeof(char));
     if (!(*response)->msg) {
         if ((rc = hpd_httpd_response_destroy((*response))))
@@ -147,7 +209,6 @@ hpd_error_t hpd_httpd_response_create(hpd_httpd_response_t **response, hpd_httpd
 
     // Init struct
     (*response)->context = context;
-    if ((rc = http_request_get_connection(req, &(*response)->conn))) return rc;
 
     // Construct msg
     strcpy((*response)->msg, HTTPD_HTTP_VERSION);
@@ -155,11 +216,7 @@ hpd_error_t hpd_httpd_response_create(hpd_httpd_response_t **response, hpd_httpd
     if (status_str) strcat((*response)->msg, status_str);
     strcat((*response)->msg, HTTPD_CRLF);
 
-    // Real persistent connections is not supported, so tell client that we close connection after response has been sent
-    rc = hpd_httpd_response_add_header((*response), "Connection", "close");
-    if (rc && (rc2 = hpd_httpd_response_destroy(*response)))
-        HPD_LOG_ERROR(context, "Failed to destroy response (code: %d).", rc2);;
-    return rc;
+    return HPD_E_SUCCESS;
 }
 
 /**
@@ -182,7 +239,7 @@ hpd_error_t hpd_httpd_response_add_header(hpd_httpd_response_t *res, const char
     if (!field || !value) HPD_LOG_RETURN_E_NULL(res->context);
 
     // Headers already sent
-    if (!res->msg)
+    if (res->body || res->chunked)
         HPD_LOG_RETURN(res->context, HPD_E_STATE, "Cannot add header, they have already been sent to client.");
 
     char *msg;
@@ -231,7 +288,7 @@ hpd_error_t hpd_httpd_response_add_cookie(hpd_httpd_response_t *res,
     if (!field || !value) HPD_LOG_RETURN_E_NULL(res->context);
 
     // Headers already sent
-    if (!res->msg) return HPD_E_STATE;
+    if (res->body || res->chunked) return HPD_E_STATE;
 
     char *msg;
     size_t msg_len = strlen(res->msg) + 12 + strlen(field) + 1 + strlen(value) + strlen(HTTPD_CRLF) + 1;
@@ -307,14 +364,13 @@ hpd_error_t hpd_httpd_response_sendf(hpd_httpd_response_t *res, const char *fmt,
  *
  *  Similar to the standard vprintf functions
  *
- *  First it sends the status and header lines, if these haven't been
- *  sent yet. Then it sends the body as given in the format string and
- *  variable arguments.
+ *  Appends the body as given in the format string and variable arguments.
+ *  After the first call, headers can no longer be added.
  *
- *  If NULL is given as format no body is sent.
+ *  If NULL is given as format no body is added.
  *
- *  The response is sent delayed, when the connection is ready for it. Likewise
- *  the connection is kept open afterwards for further messages.
+ *  The response is sent delayed, when it is destroyed and the connection
+ *  is ready for it.
  *
  *  \param  res  The http response to send.
  *  \param  fmt  The format string for the body
@@ -323,25 +379,103 @@ hpd_error_t hpd_httpd_response_sendf(hpd_httpd_response_t *res, const char *fmt,
 hpd_error_t hpd_httpd_response_vsendf(hpd_httpd_response_t *res, const char *fmt, va_list arg)
 {
     if (!res) return HPD_E_NULL;
+    if (res->chunked)
+        HPD_LOG_RETURN(res->context, HPD_E_STATE, "Cannot send formatted body, the body is sent in chunks.");
 
-    hpd_error_t rc;
-
-    if (res->msg) {
-        const char *ip;
-        if ((rc = hpd_tcpd_conn_get_ip(res->conn, &ip))) {
-            HPD_LOG_WARN(res->context, "Failed to get ip [code: %i].", rc);
-            ip = "(unknown)";
-        }
-        HPD_LOG_VERBOSE(res->context, "Sending response to %s: %i %s.", ip, res->status, httpd_status_codes_to_str(res->status));
-        if ((rc = hpd_tcpd_conn_sendf(res->conn, "%s%s", res->msg, HTTPD_CRLF))) return rc;
-        free(res->msg);
-        res->msg = NULL;
-    }
+    int len = 0;
 
     if (fmt) {
-        return hpd_tcpd_conn_vsendf(res->conn, fmt, arg);
+        va_list arg2;
+        va_copy(arg2, arg);
+        len = vsnprintf(NULL, 0, fmt, arg2);
+        va_end(arg2);
+        if (len < 0) HPD_LOG_RETURN(res->context, HPD_E_UNKNOWN, "vsnprintf() failed.");
     }
 
+    HPD_REALLOC(res->body, res->body_len + len + 1, char);
+    if (fmt) vsnprintf(&res->body[res->body_len], (size_t) len + 1, fmt, arg);
+    res->body_len += len;
+    res->body[res->body_len] = '\0';
+
+    return HPD_E_SUCCESS;
+
+    alloc_error:
+        HPD_LOG_RETURN_E_ALLOC(res->context);
+}
+
+/**
+ * Send response to client.
+ *
+ *  Appends len bytes from buf to the body. Unlike
+ *  hpd_httpd_response_vsendf(), the body may contain any bytes, including
+ *  '\0'. After the first call, headers can no longer be added.
+ *
+ *  The response is sent delayed, when it is destroyed and the connection
+ *  is ready for it.
+ *
+ *  \param  res  The http response to send.
+ *  \param  buf  The data to append, copied
+ *  \param  len  The length of buf
+ */
+hpd_error_t hpd_httpd_response_send(hpd_httpd_response_t *res, const char *buf, size_t len)
+{
+    if (!res) return HPD_E_NULL;
+    if (!buf && len) HPD_LOG_RETURN_E_NULL(res->context);
+    if (res->chunked)
+        HPD_LOG_RETURN(res->context, HPD_E_STATE, "Cannot send body, the body is sent in chunks.");
+
+    HPD_REALLOC(res->body, res->body_len + len + 1, char);
+    if (len) memcpy(&res->body[res->body_len], buf, len);
+    res->body_len += len;
+    res->body[res->body_len] = '\0';
+
     return HPD_E_SUCCESS;
+
+    alloc_error:
+        HPD_LOG_RETURN_E_ALLOC(res->context);
 }
 
+/**
+ * Send a chunk of the body of a response to client.
+ *
+ *  The status line and headers are sent on the first call, and headers
+ *  can no longer be added afterwards. Each chunk is handed on to the
+ *  connection without being copied, so a large body can be produced and
+ *  sent piece by piece. The body is ended when the response is
+ *  destroyed.
+ *
+ *  This cannot be mixed with hpd_httpd_response_send(),
+ *  hpd_httpd_response_sendf() or hpd_httpd_response_vsendf().
+ *
+ *  \param  res      The http response to send.
+ *  \param  buf      The chunk, ownership is taken, also on errors
+ *  \param  len      The length of the chunk
+ *  \param  on_free  Function to free buf with, may be NULL
+ */
+hpd_error_t hpd_httpd_response_send_chunk(hpd_httpd_response_t *res, char *buf, size_t len, hpd_free_f on_free)
+{
+    hpd_error_t rc;
+    hpd_bool_t keep_alive;
+
+    if (!res) {
+        if (on_free) on_free(buf);
+        return HPD_E_NULL;
+    }
+    if (!buf) HPD_LOG_RETURN_E_NULL(res->context);
+    if (res->body) {
+        if (on_free) on_free(buf);
+        HPD_LOG_RETURN(res->context, HPD_E_STATE, "Cannot send chunk, a formatted body has already been sent.");
+    }
+
+    if (!res->chunked) {
+        if ((rc = http_request_get_keep_alive(res->req, &keep_alive)) ||
+            (rc = http_request_send_head(res->req, res->msg, keep_alive))) {
+            if (on_free) on_free(buf);
+            return rc;
+        }
+        res->chunked = HPD_TRUE;
+        httpd_response_log(res);
+    }
+
+    return http_request_send_chunk(res->req, buf, len, on_free);
+}
@@ -111,29 +111,9 @@ hpd_error_t up_create(struct up **instance, struct up_settings *settings, const
     }
     memcpy((*instance)->settings, settings, sizeof(struct up_settings));
 
-    // Set state
-    (*instance)->state = S_START;
+    // Set state and pointers
     (*instance)->buffer = NULL;
-
-    // Set pointers
-    (*instance)->protocol = 0;
-    (*instance)->protocol_l = 0;
-    (*instance)->host = 0;
-    (*instance)->host_l = 0;
-    (*instance)->port = 0;
-    (*instance)->port_l = 0;
-    (*instance)->path = 0;
-    (*instance)->path_l = 0;
-    (*instance)->key_value = 0;
-    (*instance)->end = 0;
-    (*instance)->last_key = 0;
-    (*instance)->last_key_l = 0;
-    (*instance)->last_value = 0;
-    (*instance)->last_value_l = 0;
-    (*instance)->last_path = 0;
-    (*instance)->last_path_l = 0;
-    (*instance)->parser = 0;
-    (*instance)->insert = 0;
+    up_reset(*instance);
 
     // Store data
     (*instance)->data = data;
@@ -141,6 +121,44 @@ hpd_error_t up_create(struct up **instance, struct up_settings *settings, const
     return HPD_E_SUCCESS;
 }
 
+/**
+ * Reset URL parser instance.
+ *
+ *  Clears the buffer and sets all values to default, making the
+ *  instance ready to parse a new URL.
+ *
+ *  \param  instance  A pointer to an url_parser_instance to reset
+ */
+hpd_error_t up_reset(struct up *instance)
+{
+    if (!instance) return HPD_E_NULL;
+
+    free(instance->buffer);
+    instance->buffer = NULL;
+    instance->state = S_START;
+
+    instance->protocol = 0;
+    instance->protocol_l = 0;
+    instance->host = 0;
+    instance->host_l = 0;
+    instance->port = 0;
+    instance->port_l = 0;
+    instance->path = 0;
+    instance->path_l = 0;
+    instance->key_value = 0;
+    instance->end = 0;
+    instance->last_key = 0;
+    instance->last_key_l = 0;
+    instance->last_value = 0;
+    instance->last_value_l = 0;
+    instance->last_path = 0;
+    instance->last_path_l = 0;
+    instance->parser = 0;
+    instance->insert = 0;
+
+    return HPD_E_SUCCESS;
+}
+
 /**
  * Destroy URL parser instance.
  *
@@ -74,6 +74,7 @@ struct up_settings {
 
 hpd_error_t up_create(struct up **instance, struct up_settings *settings, const hpd_module_t *context, void *data);
 hpd_error_t up_destroy(struct up *instance);
+hpd_error_t up_reset(struct up *instance);
 
 hpd_error_t up_add_chunk(struct up *instance, const char *chunk, size_t chunk_size);
 hpd_error_t up_complete(struct up *instance);
@@ -0,0 +1,403 @@
+/*
+ * Copyright 2011 Aalborg University. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are
+ * permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of
+ * conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list
+ * of conditions and the following disclaimer in the documentation and/or other materials
+ * provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY Aalborg University ''AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL Aalborg University OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are those of the
+ * authors and should not be interpreted as representing official policies, either expressed
+ */
+
+#include "httpd_intern.h"
+#include "httpd_request.h"
+#include "hpd-0.6/hpd_shared_api.h"
+#include <stdlib.h>
+#include <string.h>
+#include <hpd-0.6/common/hpd_common.h>
+
+/**
+ * Worker threads.
+ *
+ *  Each worker is a httpd instance of its own, with an event loop in a
+ *  separate thread and a tcpd listening on the same port as the other
+ *  workers (SO_REUSEPORT). Workers parse messages and send responses,
+ *  but never call the user callbacks. Instead requests and responses are
+ *  passed as messages between the worker and the main event loop:
+ *
+ *  - HTTPD_MSG_REQUEST: A message has been received in full, the user
+ *    callbacks are called with it on the main event loop.
+ *  - HTTPD_MSG_RESPONSE: The response has been created, and the request
+ *    is handed back to the worker to send it.
+ *  - HTTPD_MSG_CLOSED: The connection was closed while the message was
+ *    handled on the main event loop.
+ *
+ *  Each instance has a queue of incoming messages, which is only popped
+ *  by its own event loop.
+ */
+
+/**
+ * Initialise an empty queue.
+ *
+ *  \param  queue  The queue
+ */
+static void httpd_queue_init(httpd_queue_t *queue)
+{
+    queue->stub.next = NULL;
+    queue->head = &queue->stub;
+    queue->tail = &queue->stub;
+}
+
+/**
+ * Push a message on a queue.
+ *
+ *  May be called from any thread.
+ *
+ *  \param  queue  The queue
+ *  \param  msg    The message to push
+ */
+static void httpd_queue_push(httpd_queue_t *queue, httpd_msg_t *msg)
+{
+    __atomic_store_n(&msg->next, NULL, __ATOMIC_RELAXED);
+    httpd_msg_t *prev = __atomic_exchange_n(&queue->head, msg, __ATOMIC_ACQ_REL);
+    __atomic_store_n(&prev->next, msg, __ATOMIC_RELEASE);
+}
+
+/**
+ * Pop a message from a queue.
+ *
+ *  May only be called from the thread owning the queue. NULL is returned
+ *  if the queue is empty, or if a push has not yet been completed, in
+ *  which case the pushing thread will wake up the owner once it has.
+ *
+ *  \param  queue  The queue
+ *
+ *  \return The message, or NULL
+ */
+static httpd_msg_t *httpd_queue_pop(httpd_queue_t *queue)
+{
+    httpd_msg_t *tail = queue->tail;
+    httpd_msg_t *next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+
+    // Skip the stub
+    if (tail == &queue->stub) {
+        if (!next) return NULL;
+        queue->tail = next;
+        tail = next;
+        next = __atomic_load_n(&next->next, __ATOMIC_ACQUIRE);
+    }
+
+    if (next) {
+        queue->tail = next;
+        return tail;
+    }
+
+    // Push in progress
+    if (tail != __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE)) return NULL;
+
+    // Last message, put the stub behind it, so it can be taken
+    httpd_queue_push(queue, &queue->stub);
+    next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+    if (next) {
+        queue->tail = next;
+        return tail;
+    }
+
+    return NULL;
+}
+
+/**
+ * Allocate a message.
+ *
+ *  The message holds a reference to the request, that must be accounted
+ *  for by the caller.
+ *
+ *  \param  msg    Will point to the message on success
+ *  \param  httpd  The httpd allocating the message
+ *  \param  type   The type of message
+ *  \param  req    The request
+ */
+hpd_error_t httpd_msg_alloc(httpd_msg_t **msg, hpd_httpd_t *httpd, httpd_msg_type_t type, hpd_httpd_request_t *req)
+{
+    HPD_CALLOC(*msg, 1, httpd_msg_t);
+    (*msg)->type = type;
+    (*msg)->req = req;
+    (*msg)->segs = NULL;
+    (*msg)->segs_tail = &(*msg)->segs;
+    return HPD_E_SUCCESS;
+
+    alloc_error:
+        HPD_LOG_RETURN_E_ALLOC(httpd->context);
+}
+
+/**
+ * Free a message, and any data it holds.
+ *
+ *  \param  msg  The message
+ */
+void httpd_msg_free(httpd_msg_t *msg)
+{
+    httpd_seg_t *seg;
+
+    while ((seg = msg->segs)) {
+        msg->segs = seg->next;
+        if (seg->on_free) seg->on_free(seg->buf);
+        free(seg);
+    }
+    free(msg);
+}
+
+/**
+ * Send a message to the event loop of a httpd.
+ *
+ *  May be called from any thread. The message is freed by the receiver.
+ *
+ *  \param  httpd  The receiving httpd, either the main instance or a worker
+ *  \param  msg    The message
+ */
+void httpd_msg_send(hpd_httpd_t *httpd, httpd_msg_t *msg)
+{
+    httpd_queue_push(&httpd->queue, msg);
+    ev_async_send(httpd->loop, &httpd->async);
+}
+
+/**
+ * Handle all queued messages.
+ *
+ *  \param  httpd  The httpd owning the queue
+ */
+static void httpd_msg_receive(hpd_httpd_t *httpd)
+{
+    hpd_error_t rc;
+    httpd_msg_t *msg;
+
+    while ((msg = httpd_queue_pop(&httpd->queue))) {
+        switch (msg->type) {
+            case HTTPD_MSG_REQUEST:
+                rc = http_request_on_received(msg->req);
+                break;
+            case HTTPD_MSG_CLOSED:
+                rc = http_request_on_closed(msg->req);
+                break;
+            case HTTPD_MSG_RESPONSE:
+                rc = http_request_on_response(msg->req, msg);
+                break;
+            default:
+                rc = HPD_E_ARGUMENT;
+                break;
+        }
+        if (rc) HPD_LOG_ERROR(httpd->context, "Failed to handle message (code: %d).", rc);
+        httpd_msg_free(msg);
+    }
+}
+
+/**
+ * Async callback, for new messages or a stop request.
+ *
+ *  \param  loop     The event loop of the httpd
+ *  \param  watcher  The async watcher
+ *  \param  revents  Not used
+ */
+static void httpd_on_ev_async(hpd_ev_loop_t *loop, ev_async *watcher, int revents)
+{
+    hpd_error_t rc;
+    hpd_httpd_t *httpd = watcher->data;
+
+    httpd_msg_receive(httpd);
+
+    if (httpd->main && __atomic_load_n(&httpd->stopping, __ATOMIC_ACQUIRE)) {
+        if ((rc = hpd_tcpd_stop(httpd->webserver)))
+            HPD_LOG_ERROR(httpd->context, "Failed to stop worker (code: %d).", rc);
+        ev_async_stop(loop, watcher);
+        ev_break(loop, EVBREAK_ALL);
+    }
+}
+
+/**
+ * Thread function of a worker, runs its event loop until stopped.
+ *
+ *  \param  data  The worker
+ */
+static void *httpd_worker_run(void *data)
+{
+    hpd_httpd_t *worker = data;
+    ev_run(worker->loop, 0);
+    return NULL;
+}
+
+/**
+ * Stop the thread of a started worker.
+ *
+ *  \param  worker  The worker
+ */
+static hpd_error_t httpd_worker_join(hpd_httpd_t *worker)
+{
+    int stat;
+
+    __atomic_store_n(&worker->stopping, 1, __ATOMIC_RELEASE);
+    ev_async_send(worker->loop, &worker->async);
+    if ((stat = pthread_join(worker->thread, NULL)))
+        HPD_LOG_RETURN(worker->context, HPD_E_UNKNOWN, "pthread_join() failed [code: %i].", stat);
+    worker->stopping = 0;
+
+    return HPD_E_SUCCESS;
+}
+
+/**
+ * Create the workers of a httpd.
+ *
+ *  The workers get a copy of the settings, without callbacks.
+ *
+ *  \param  httpd  The main httpd instance, with settings.workers set
+ */
+hpd_error_t httpd_workers_create(hpd_httpd_t *httpd)
+{
+    hpd_error_t rc;
+    int n = httpd->settings.workers;
+
+    httpd_queue_init(&httpd->queue);
+    ev_async_init(&httpd->async, httpd_on_ev_async);
+    httpd->async.data = httpd;
+
+    HPD_CALLOC(httpd->workers, n, hpd_httpd_t *);
+
+    for (int i = 0; i < n; i++) {
+        hpd_httpd_t *worker;
+        HPD_CALLOC(worker, 1, hpd_httpd_t);
+        httpd->workers[i] = worker;
+
+        worker->context = httpd->context;
+        worker->main = httpd;
+        memcpy(&worker->settings, &httpd->settings, sizeof(hpd_httpd_settings_t));
+        worker->settings.workers = 0;
+        worker->settings.httpd_ctx = NULL;
+        worker->settings.on_req_begin = NULL;
+        worker->settings.on_req_url = NULL;
+        worker->settings.on_req_url_cmpl = NULL;
+        worker->settings.on_req_hdr_field = NULL;
+        worker->settings.on_req_hdr_value = NULL;
+        worker->settings.on_req_hdr_cmpl = NULL;
+        worker->settings.on_req_body = NULL;
+        worker->settings.on_req_cmpl = NULL;
+        worker->settings.on_req_destroy = NULL;
+
+        httpd_queue_init(&worker->queue);
+        ev_async_init(&worker->async, httpd_on_ev_async);
+        worker->async.data = worker;
+
+        if (!(worker->loop = ev_loop_new(EVFLAG_AUTO)))
+            HPD_LOG_RETURN(httpd->context, HPD_E_UNKNOWN, "Failed to create event loop for worker.");
+        if ((rc = httpd_tcpd_create(worker))) return rc;
+    }
+
+    return HPD_E_SUCCESS;
+
+    alloc_error:
+        HPD_LOG_RETURN_E_ALLOC(httpd->context);
+}
+
+/**
+ * Destroy the workers of a httpd.
+ *
+ *  Works on partially created workers as well. The workers should be
+ *  stopped first.
+ *
+ *  \param  httpd  The main httpd instance
+ */
+hpd_error_t httpd_workers_destroy(hpd_httpd_t *httpd)
+{
+    hpd_error_t rc = HPD_E_SUCCESS, tmp;
+
+    if (!httpd->workers) return HPD_E_SUCCESS;
+
+    for (int i = 0; i < httpd->settings.workers; i++) {
+        hpd_httpd_t *worker = httpd->workers[i];
+        if (!worker) continue;
+        if (worker->webserver && (tmp = hpd_tcpd_destroy(worker->webserver)) && !rc) rc = tmp;
+        if (worker->loop) ev_loop_destroy(worker->loop);
+        free(worker);
+    }
+    free(httpd->workers);
+    httpd->workers = NULL;
+
+    return rc;
+}
+
+/**
+ * Start listening in the workers, each in its own thread.
+ *
+ *  \param  httpd  The main httpd instance
+ */
+hpd_error_t httpd_workers_start(hpd_httpd_t *httpd)
+{
+    hpd_error_t rc;
+    int i, stat;
+
+    ev_async_start(httpd->loop, &httpd->async);
+
+    for (i = 0; i < httpd->settings.workers; i++) {
+        hpd_httpd_t *worker = httpd->workers[i];
+
+        if ((rc = hpd_tcpd_start(worker->webserver))) goto error;
+        ev_async_start(worker->loop, &worker->async);
+        if ((stat = pthread_create(&worker->thread, NULL, httpd_worker_run, worker))) {
+            HPD_LOG_ERROR(httpd->context, "pthread_create() failed [code: %i].", stat);
+            ev_async_stop(worker->loop, &worker->async);
+            if (hpd_tcpd_stop(worker->webserver)) HPD_LOG_ERROR(httpd->context, "Failed to stop tcpd.");
+            rc = HPD_E_UNKNOWN;
+            goto error;
+        }
+    }
+
+    return HPD_E_SUCCESS;
+
+    error:
+        while (i-- > 0)
+            if (httpd_worker_join(httpd->workers[i])) HPD_LOG_ERROR(httpd->context, "Failed to stop worker.");
+        httpd_msg_receive(httpd);
+        ev_async_stop(httpd->loop, &httpd->async);
+        return rc;
+}
+
+/**
+ * Stop the workers.
+ *
+ *  Stops the threads of the workers, which kills all their connections,
+ *  and settles the messages that were in flight.
+ *
+ *  \param  httpd  The main httpd instance
+ */
+hpd_error_t httpd_workers_stop(hpd_httpd_t *httpd)
+{
+    hpd_error_t rc = HPD_E_SUCCESS, tmp;
+
+    for (int i = 0; i < httpd->settings.workers; i++)
+        if ((tmp = httpd_worker_join(httpd->workers[i])) && !rc) rc = tmp;
+
+    // Connections are closed, so requests are no longer passed on to the callbacks
+    httpd->stopping = 1;
+    httpd_msg_receive(httpd);
+    for (int i = 0; i < httpd->settings.workers; i++)
+        httpd_msg_receive(httpd->workers[i]);
+    httpd->stopping = 0;
+
+    ev_async_stop(httpd->loop, &httpd->async);
+
+    return rc;
+}
@@ -0,0 +1,554 @@
+/*
+ * Copyright 2011 Aalborg University. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are
+ * permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of
+ * conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list
+ * of conditions and the following disclaimer in the documentation and/or other materials
+ * provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY Aalborg University ''AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL Aalborg University OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are those of the
+ * authors and should not be interpreted as representing official policies, either expressed
+ */
+
+/*
+ * Runs a webserver on the loopback interface and talks to it from a client thread, to check how persistent
+ * connections are kept or closed, that pipelined messages are answered in order, and how headers are looked up.
+ * Connections are tested both on the loop of hpd, and with worker threads passing messages to it.
+ */
+
+#include <gtest/gtest.h>
+#include "hpd-0.6/hpd_api.h"
+#include "hpd-0.6/common/hpd_httpd.h"
+#include "hpd-0.6/common/hpd_map.h"
+#include "../src/httpd_header.h"
+#include <ev.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <string>
+
+#define CASE httpd
+
+#define PORT 18089
+
+/// Workers in the tests of worker threads, more than one, so messages of each worker are interleaved on the loop
+#define WORKERS 2
+
+typedef void (*client_f)();
+
+static hpd_t *hpd;
+static const hpd_module_t *test_context;
+static hpd_httpd_t *httpd;
+static client_f client;
+static pthread_t client_thread;
+static ev_timer timer;
+static volatile bool client_done;
+static int workers;
+static int held, destroyed;
+
+/// Headers of the request to /headers, as the callback found them, "-" if not found
+static std::string by_id[HPD_HTTPD_H_COUNT], by_name_known, by_name_unknown, in_map_known, in_map_unknown;
+
+static std::string header_str(hpd_error_t rc, const char *value)
+{
+    if (rc == HPD_E_NOT_FOUND) return "-";
+    if (rc) return "error " + std::to_string(rc);
+    return value;
+}
+
+static void on_headers(hpd_httpd_request_t *req)
+{
+    hpd_error_t rc;
+    const char *value;
+    hpd_map_t *headers;
+
+    for (int i = 0; i < HPD_HTTPD_H_COUNT; i++) {
+        rc = hpd_httpd_request_get_header_by_id(req, (hpd_httpd_header_t) i, &value);
+        by_id[i] = header_str(rc, value);
+    }
+    rc = hpd_httpd_request_get_header(req, "Accept-Encoding", &value);
+    by_name_known = header_str(rc, value);
+    rc = hpd_httpd_request_get_header(req, "x-custom", &value);
+    by_name_unknown = header_str(rc, value);
+
+    // Well-known headers are only in the map once it is asked for
+    if ((rc = hpd_httpd_request_get_headers(req, &headers))) return;
+    rc = hpd_map_get(headers, "accept", &value);
+    in_map_known = header_str(rc, value);
+    rc = hpd_map_get(headers, "accept-elephant", &value);
+    in_map_unknown = header_str(rc, value);
+}
+
+static hpd_httpd_return_t on_req_cmpl(hpd_httpd_t *h, hpd_httpd_request_t *req, void *ctx, void **data)
+{
+    hpd_httpd_response_t *res;
+    const char *url;
+
+    if (hpd_httpd_request_get_url(req, &url)) return HPD_HTTPD_R_STOP;
+
+    // A failing callback responds with an error and stops the message
+    if (!strcmp(url, "/error")) {
+        if (hpd_httpd_response_create(&res, req, HPD_S_500)) return HPD_HTTPD_R_STOP;
+        hpd_httpd_response_sendf(res, "error");
+        hpd_httpd_response_destroy(res);
+        return HPD_HTTPD_R_STOP;
+    }
+
+    if (!strcmp(url, "/headers")) on_headers(req);
+
+    // Left without a response, until the connection is closed
+    if (!strcmp(url, "/hold")) {
+        __atomic_add_fetch(&held, 1, __ATOMIC_SEQ_CST);
+        return HPD_HTTPD_R_CONTINUE;
+    }
+
+    if (hpd_httpd_response_create(&res, req, HPD_S_200)) return HPD_HTTPD_R_STOP;
+    hpd_httpd_response_sendf(res, "url=%s", url);
+    hpd_httpd_response_destroy(res);
+    return HPD_HTTPD_R_CONTINUE;
+}
+
+static hpd_httpd_return_t on_req_destroy(hpd_httpd_t *h, hpd_httpd_request_t *req, void *ctx, void **data)
+{
+    __atomic_add_fetch(&destroyed, 1, __ATOMIC_SEQ_CST);
+    return HPD_HTTPD_R_CONTINUE;
+}
+
+static void *on_client(void *data)
+{
+    client();
+    client_done = true;
+    return nullptr;
+}
+
+static void on_timeout(hpd_ev_loop_t *loop, ev_timer *w, int revents)
+{
+    if (!client_done) return;
+    ev_timer_stop(loop, w);
+    hpd_stop(hpd);
+}
+
+static hpd_error_t on_create(void **data, const hpd_module_t *context)
+{
+    test_context = context;
+    *data = &timer;
+    return HPD_E_SUCCESS;
+}
+
+static hpd_error_t on_destroy(void *data)
+{
+    return HPD_E_SUCCESS;
+}
+
+static hpd_error_t on_start(void *data)
+{
+    hpd_error_t rc;
+    hpd_ev_loop_t *loop;
+    // HPD_HTTPD_SETTINGS_DEFAULT uses designators out of order, which C++ does not allow
+    hpd_httpd_settings_t settings = {};
+
+    settings.port = (hpd_tcpd_port_t) PORT;
+    settings.timeout = 15;
+    settings.keep_alive_timeout = 5;
+    settings.max_idle_conns = 64;
+    settings.workers = workers;
+    settings.on_req_cmpl = on_req_cmpl;
+    settings.on_req_destroy = on_req_destroy;
+
+    if ((rc = hpd_get_loop(test_context, &loop))) return rc;
+    if ((rc = hpd_httpd_create(&httpd, &settings, test_context, loop))) return rc;
+    if ((rc = hpd_httpd_start(httpd))) return rc;
+    if (pthread_create(&client_thread, nullptr, on_client, nullptr)) return HPD_E_UNKNOWN;
+    ev_timer_init(&timer, on_timeout, 0.01, 0.01);
+    ev_timer_start(loop, &timer);
+    return HPD_E_SUCCESS;
+}
+
+static hpd_error_t on_stop(void *data)
+{
+    hpd_error_t rc;
+
+    pthread_join(client_thread, nullptr);
+    if ((rc = hpd_httpd_stop(httpd))) return rc;
+    return hpd_httpd_destroy(httpd);
+}
+
+static hpd_error_t on_parse_opt(void *data, const char *name, const char *arg)
+{
+    return HPD_E_ARGUMENT;
+}
+
+static hpd_module_def_t module_def = { on_create, on_destroy, on_start, on_stop, on_parse_opt };
+
+static void run(client_f f, int n = 0)
+{
+    char *argv[] = { (char *) "test" };
+
+    client = f;
+    client_done = false;
+    workers = n;
+    held = 0;
+    destroyed = 0;
+    ASSERT_EQ(hpd_alloc(&hpd), HPD_E_SUCCESS);
+    ASSERT_EQ(hpd_module(hpd, "test", &module_def), HPD_E_SUCCESS);
+    ASSERT_EQ(hpd_start(hpd, 1, argv), HPD_E_SUCCESS);
+    ASSERT_EQ(hpd_free(hpd), HPD_E_SUCCESS);
+}
+
+static int conn_open(const char *msgs)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr = {};
+    struct timeval timeout = { 0, 500000 };
+
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(PORT);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    EXPECT_GE(fd, 0);
+    EXPECT_EQ(setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)), 0);
+    EXPECT_EQ(connect(fd, (struct sockaddr *) &addr, sizeof(addr)), 0);
+    EXPECT_EQ(write(fd, msgs, strlen(msgs)), (ssize_t) strlen(msgs));
+    return fd;
+}
+
+/** Read until the server closes the connection (true), or nothing more arrives before the timeout (false). */
+static bool conn_read(int fd, std::string &out)
+{
+    char buf[1024];
+    ssize_t len;
+
+    while ((len = read(fd, buf, sizeof(buf))) > 0) out.append(buf, (size_t) len);
+    return len == 0;
+}
+
+static std::string pipelined;
+static bool pipelined_closed;
+
+static void on_pipelined()
+{
+    int fd = conn_open("GET /first HTTP/1.1\r\nHost: a\r\n\r\n"
+                       "GET /second HTTP/1.1\r\nHost: a\r\n\r\n");
+    pipelined_closed = conn_read(fd, pipelined);
+    close(fd);
+}
+
+static void pipelined_test(int n)
+{
+    pipelined.clear();
+    run(on_pipelined, n);
+
+    size_t first = pipelined.find("url=/first"), second = pipelined.find("url=/second");
+    ASSERT_NE(first, std::string::npos);
+    ASSERT_NE(second, std::string::npos);
+    ASSERT_LT(first, second);
+    ASSERT_EQ(pipelined.find("HTTP/1.1 200", second), std::string::npos);
+    ASSERT_FALSE(pipelined_closed);
+}
+
+static std::string close_11, close_10, default_11;
+static bool close_11_closed, close_10_closed, default_11_closed;
+
+static void on_persistence()
+{
+    int fd = conn_open("GET /a HTTP/1.1\r\nHost: a\r\nConnection: close\r\n\r\n");
+    close_11_closed = conn_read(fd, close_11);
+    close(fd);
+
+    fd = conn_open("GET /b HTTP/1.0\r\nHost: a\r\n\r\n");
+    close_10_closed = conn_read(fd, close_10);
+    close(fd);
+
+    fd = conn_open("GET /c HTTP/1.1\r\nHost: a\r\n\r\n");
+    default_11_closed = conn_read(fd, default_11);
+    close(fd);
+}
+
+static void persistence_test(int n)
+{
+    close_11.clear();
+    close_10.clear();
+    default_11.clear();
+    run(on_persistence, n);
+
+    // HTTP/1.1 closes on request
+    ASSERT_NE(close_11.find("Connection: close\r\n"), std::string::npos);
+    ASSERT_NE(close_11.find("url=/a"), std::string::npos);
+    ASSERT_TRUE(close_11_closed);
+
+    // HTTP/1.0 closes by default
+    ASSERT_NE(close_10.find("Connection: close\r\n"), std::string::npos);
+    ASSERT_NE(close_10.find("url=/b"), std::string::npos);
+    ASSERT_TRUE(close_10_closed);
+
+    // HTTP/1.1 is persistent by default
+    ASSERT_NE(default_11.find("Connection: keep-alive\r\n"), std::string::npos);
+    ASSERT_NE(default_11.find("url=/c"), std::string::npos);
+    ASSERT_FALSE(default_11_closed);
+}
+
+static std::string stopped;
+static bool stopped_closed;
+
+static void on_stopped()
+{
+    int fd = conn_open("GET /first HTTP/1.1\r\nHost: a\r\n\r\n"
+                       "GET /error HTTP/1.1\r\nHost: a\r\n\r\n"
+                       "GET /third HTTP/1.1\r\nHost: a\r\n\r\n");
+    stopped_closed = conn_read(fd, stopped);
+    close(fd);
+}
+
+static void stop_mid_pipeline_test(int n)
+{
+    stopped.clear();
+    run(on_stopped, n);
+
+    // The message after the stopped one is dropped, and the connection closed
+    size_t first = stopped.find("url=/first"), error = stopped.find("HTTP/1.1 500");
+    ASSERT_NE(first, std::string::npos);
+    ASSERT_NE(error, std::string::npos);
+    ASSERT_LT(first, error);
+    ASSERT_EQ(stopped.find("url=/third"), std::string::npos);
+    ASSERT_TRUE(stopped_closed);
+}
+
+TEST(CASE, pipelined) {
+    pipelined_test(0);
+}
+
+TEST(CASE, persistence) {
+    persistence_test(0);
+}
+
+TEST(CASE, stop_mid_pipeline) {
+    stop_mid_pipeline_test(0);
+}
+
+TEST(CASE, workers_pipelined) {
+    pipelined_test(WORKERS);
+}
+
+TEST(CASE, workers_persistence) {
+    persistence_test(WORKERS);
+}
+
+TEST(CASE, workers_stop_mid_pipeline) {
+    stop_mid_pipeline_test(WORKERS);
+}
+
+TEST(CASE, header_lookup_case) {
+    for (int i = 0; i < HPD_HTTPD_H_COUNT; i++) {
+        const char *name = http_header_name((hpd_httpd_header_t) i);
+        std::string upper = name, mixed = name;
+        for (size_t j = 0; j < upper.size(); j++) {
+            upper[j] = (char) toupper(upper[j]);
+            if (j % 2 == 0) mixed[j] = (char) toupper(mixed[j]);
+        }
+        SCOPED_TRACE(name);
+        ASSERT_EQ(http_header_lookup(name, strlen(name)), i);
+        ASSERT_EQ(http_header_lookup(upper.c_str(), upper.size()), i);
+        ASSERT_EQ(http_header_lookup(mixed.c_str(), mixed.size()), i);
+    }
+
+    // The field need not be terminated
+    ASSERT_EQ(http_header_lookup("Hostname", 4), HPD_HTTPD_H_HOST);
+    ASSERT_EQ(http_header_lookup("Accept: text/xml", 6), HPD_HTTPD_H_ACCEPT);
+}
+
+TEST(CASE, header_lookup_unknown) {
+    static const char *unknown[] = {
+            "", "X-Custom", "Hos", "Hosts", "Accepts", "Acceptcharset", "Content-Lengthy", "If-Match", "Date",
+            // The length and first letter of a well-known header
+            "hope", "accent", "crayon", "oracle", "connectiom", "user-agenT-", "contenT-typo", "authorizatiom",
+            "cache-controls", "if-none-catch", "accept-charsex", "content-lengtx", "accept-encodinG-", "transfer-encodinx",
+            // As accept-encoding and accept-language, which differ first after "accept-"
+            "accept-elephant", "accept-language-", "accept-lemonade", "accept-encoders", "accept-xxxxxxxx", "assert-encoding",
+    };
+
+    for (size_t i = 0; i < sizeof(unknown) / sizeof(unknown[0]); i++) {
+        SCOPED_TRACE(unknown[i]);
+        ASSERT_EQ(http_header_lookup(unknown[i], strlen(unknown[i])), HPD_HTTPD_H_UNKNOWN);
+    }
+    ASSERT_EQ(http_header_name(HPD_HTTPD_H_UNKNOWN), nullptr);
+    ASSERT_EQ(http_header_name(HPD_HTTPD_H_COUNT), nullptr);
+}
+
+static void on_headers_client()
+{
+    std::string res;
+    int fd = conn_open("GET /headers HTTP/1.1\r\n"
+                       "host: a\r\n"
+                       "ACCEPT: text/xml\r\n"
+                       "aCcEpT-EnCoDiNg: gzip\r\n"
+                       "Accept-Language: da\r\n"
+                       "accept-charset: utf-8\r\n"
+                       "Accept-Elephant: big\r\n"
+                       "Authorization: Basic x\r\n"
+                       "Cache-Control: no-cache\r\n"
+                       "Content-Type: text/plain\r\n"
+                       "If-None-Match: \"1\"\r\n"
+                       "Origin: http://a\r\n"
+                       "User-Agent: test\r\n"
+                       "X-Custom: 1\r\n"
+                       "Accept: application/json\r\n"
+                       "x-custom: 2\r\n"
+                       "If-None-Match: W/\"2\"\r\n"
+                       "\r\n");
+    conn_read(fd, res);
+    close(fd);
+}
+
+TEST(CASE, request_headers) {
+    for (int i = 0; i < HPD_HTTPD_H_COUNT; i++) by_id[i].clear();
+    run(on_headers_client);
+
+    // Mixed case, and headers of the same length and first letter, each under its own id
+    ASSERT_EQ(by_id[HPD_HTTPD_H_HOST], "a");
+    ASSERT_EQ(by_id[HPD_HTTPD_H_ACCEPT_ENCODING], "gzip");
+    ASSERT_EQ(by_id[HPD_HTTPD_H_ACCEPT_LANGUAGE], "da");
+    ASSERT_EQ(by_id[HPD_HTTPD_H_ACCEPT_CHARSET], "utf-8");
+    ASSERT_EQ(by_id[HPD_HTTPD_H_AUTHORIZATION], "Basic x");
+    ASSERT_EQ(by_id[HPD_HTTPD_H_CACHE_CONTROL], "no-cache");
+    ASSERT_EQ(by_id[HPD_HTTPD_H_CONTENT_TYPE], "text/plain");
+    ASSERT_EQ(by_id[HPD_HTTPD_H_ORIGIN], "http://a");
+    ASSERT_EQ(by_id[HPD_HTTPD_H_USER_AGENT], "test");
+    ASSERT_EQ(by_id[HPD_HTTPD_H_COOKIE], "-");
+    ASSERT_EQ(by_id[HPD_HTTPD_H_CONTENT_LENGTH], "-");
+    ASSERT_EQ(by_id[HPD_HTTPD_H_TRANSFER_ENCODING], "-");
+    ASSERT_EQ(by_name_known, "gzip");
+
+    // Repeated headers are combined, known or not
+    ASSERT_EQ(by_id[HPD_HTTPD_H_ACCEPT], "text/xml,application/json");
+    ASSERT_EQ(by_id[HPD_HTTPD_H_IF_NONE_MATCH], "\"1\",W/\"2\"");
+    ASSERT_EQ(by_name_unknown, "1,2");
+
+    // The map holds both kinds, with lowercase keys
+    ASSERT_EQ(in_map_known, "text/xml,application/json");
+    ASSERT_EQ(in_map_unknown, "big");
+}
+
+/** Read until out holds str (true), or nothing more arrives before the timeout (false). */
+static bool conn_read_until(int fd, std::string &out, const std::string &str)
+{
+    char buf[1024];
+    ssize_t len;
+
+    while (out.find(str) == std::string::npos) {
+        if ((len = read(fd, buf, sizeof(buf))) <= 0) return false;
+        out.append(buf, (size_t) len);
+    }
+    return true;
+}
+
+/** Wait for a counter updated on the loop to reach n (true), or give up after a second (false). */
+static bool wait_for(int *counter, int n)
+{
+    for (int i = 0; i < 1000; i++) {
+        if (__atomic_load_n(counter, __ATOMIC_SEQ_CST) >= n) return true;
+        usleep(1000);
+    }
+    return false;
+}
+
+#define KEEP_ALIVE_CONNS 8
+#define KEEP_ALIVE_MSGS 4
+
+static std::string keep_alive[KEEP_ALIVE_CONNS];
+static bool keep_alive_read[KEEP_ALIVE_CONNS][KEEP_ALIVE_MSGS];
+
+static void on_keep_alive()
+{
+    int fds[KEEP_ALIVE_CONNS];
+
+    // The connections are open at the same time, so the kernel spreads them over the workers
+    for (int c = 0; c < KEEP_ALIVE_CONNS; c++) fds[c] = conn_open("");
+    for (int m = 0; m < KEEP_ALIVE_MSGS; m++) {
+        for (int c = 0; c < KEEP_ALIVE_CONNS; c++) {
+            std::string url = "/c" + std::to_string(c) + "m" + std::to_string(m);
+            std::string msg = "GET " + url + " HTTP/1.1\r\nHost: a\r\n\r\n";
+            EXPECT_EQ(write(fds[c], msg.data(), msg.size()), (ssize_t) msg.size());
+        }
+        for (int c = 0; c < KEEP_ALIVE_CONNS; c++) {
+            std::string url = "/c" + std::to_string(c) + "m" + std::to_string(m);
+            keep_alive_read[c][m] = conn_read_until(fds[c], keep_alive[c], "url=" + url);
+        }
+    }
+    for (int c = 0; c < KEEP_ALIVE_CONNS; c++) close(fds[c]);
+}
+
+TEST(CASE, workers_keep_alive) {
+    for (int c = 0; c < KEEP_ALIVE_CONNS; c++) keep_alive[c].clear();
+    run(on_keep_alive, WORKERS);
+
+    // Each connection is kept open, and answered in order
+    for (int c = 0; c < KEEP_ALIVE_CONNS; c++) {
+        size_t pos = 0;
+        SCOPED_TRACE(c);
+        for (int m = 0; m < KEEP_ALIVE_MSGS; m++) {
+            ASSERT_TRUE(keep_alive_read[c][m]);
+            pos = keep_alive[c].find("url=/c" + std::to_string(c) + "m" + std::to_string(m), pos);
+            ASSERT_NE(pos, std::string::npos);
+        }
+        ASSERT_EQ(keep_alive[c].find("Connection: close"), std::string::npos);
+    }
+    ASSERT_EQ(destroyed, KEEP_ALIVE_CONNS * KEEP_ALIVE_MSGS);
+}
+
+#define IN_FLIGHT_CONNS 4
+
+static int in_flight_fds[IN_FLIGHT_CONNS];
+static bool in_flight_held, closed_destroyed;
+
+static void on_in_flight()
+{
+    // A held message whose connection the client closes is settled on the loop while hpd runs
+    int fd = conn_open("GET /hold HTTP/1.1\r\nHost: a\r\n\r\n");
+    bool closed_held = wait_for(&held, 1);
+    close(fd);
+    closed_destroyed = closed_held && wait_for(&destroyed, 1);
+
+    // These are still held when hpd stops, and the message pipelined after each is never handled
+    for (int c = 0; c < IN_FLIGHT_CONNS; c++)
+        in_flight_fds[c] = conn_open("GET /first HTTP/1.1\r\nHost: a\r\n\r\n"
+                                     "GET /hold HTTP/1.1\r\nHost: a\r\n\r\n"
+                                     "GET /never HTTP/1.1\r\nHost: a\r\n\r\n");
+    in_flight_held = wait_for(&held, 1 + IN_FLIGHT_CONNS);
+}
+
+TEST(CASE, workers_stop_in_flight) {
+    run(on_in_flight, WORKERS);
+
+    ASSERT_TRUE(closed_destroyed);
+    ASSERT_TRUE(in_flight_held);
+
+    // Stopping closed the connections, after the responses already sent
+    for (int c = 0; c < IN_FLIGHT_CONNS; c++) {
+        std::string res;
+        SCOPED_TRACE(c);
+        ASSERT_TRUE(conn_read(in_flight_fds[c], res));
+        close(in_flight_fds[c]);
+        ASSERT_NE(res.find("url=/first"), std::string::npos);
+        ASSERT_EQ(res.find("url=/never"), std::string::npos);
+    }
+
+    // And every message was destroyed, the held ones when the workers were joined
+    ASSERT_EQ(held, 1 + IN_FLIGHT_CONNS);
+    ASSERT_EQ(destroyed, 1 + 2 * IN_FLIGHT_CONNS);
+}
@@ -28,21 +28,216 @@
 #include "hpd-0.6/hpd_types.h"
 #include "hpd-0.6/common/hpd_map.h"
 #include "hpd-0.6/common/hpd_common.h"
+#include <stdint.h>
 
-TAILQ_HEAD(hpd_map, hpd_pair);
+/*
+ * Pairs are kept in insertion order in a dense array of pointers, so iteration is ordered and removing a pair only
+ * leaves a hole, which is compacted when the array is full. Maps with up to MAP_FLAT_MAX pairs are searched linearly
+ * in that array; larger maps also maintain an open addressing table (linear probing) from key hash to position.
+ */
+
+#define MAP_FLAT_MAX 8
+#define MAP_PAIRS_MIN 4
+#define MAP_SLOTS_MIN 32
+#define MAP_SLOT_EMPTY 0
+#define MAP_SLOT_DELETED UINT32_MAX
+
+typedef struct map_slot {
+    uint32_t hash;
+    uint32_t pos; //< Position in pairs plus one, MAP_SLOT_EMPTY or MAP_SLOT_DELETED
+} map_slot_t;
+
+struct hpd_map {
+    hpd_pair_t **pairs;  //< Pairs in insertion order, NULL for removed pairs
+    size_t len;          //< Used entries in pairs
+    size_t cap;          //< Allocated entries in pairs
+    size_t count;        //< Pairs in map
+    map_slot_t *slots;   //< Hash table, NULL while the map is flat
+    size_t slots_size;   //< Number of slots, a power of two
+    size_t slots_used;   //< Slots that are not empty (including deleted)
+};
 
 struct hpd_pair {
-    TAILQ_ENTRY(hpd_pair) HPD_TAILQ_FIELD; //< Tailq members
-    char *k; //< Key (not null)
-    char *v; //< Value
+    hpd_map_t *map; //< Owning map
+    size_t pos;     //< Position in map->pairs
+    uint32_t hash;  //< Hash of key (once the map is no longer flat)
+    size_t k_len;   //< Length of key
+    char *v;        //< Value
+    char k[];       //< Key (inline, null terminated)
 };
 
+static uint32_t map_hash(const char *k, size_t k_len)
+{
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < k_len; i++) {
+        hash ^= (unsigned char) k[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static hpd_pair_t *map_find(hpd_map_t *map, const char *k, size_t k_len)
+{
+    hpd_pair_t *pair;
+
+    // Flat maps are cheaper to scan than to hash the key
+    if (!map->slots) {
+        for (size_t i = 0; i < map->len; i++) {
+            pair = map->pairs[i];
+            if (pair && pair->k_len == k_len && memcmp(pair->k, k, k_len) == 0) return pair;
+        }
+        return NULL;
+    }
+
+    uint32_t hash = map_hash(k, k_len);
+    size_t mask = map->slots_size - 1;
+    for (size_t i = hash & mask; map->slots[i].pos != MAP_SLOT_EMPTY; i = (i + 1) & mask) {
+        map_slot_t *slot = &map->slots[i];
+        if (slot->pos == MAP_SLOT_DELETED || slot->hash != hash) continue;
+        pair = map->pairs[slot->pos - 1];
+        if (pair->k_len == k_len && memcmp(pair->k, k, k_len) == 0) return pair;
+    }
+    return NULL;
+}
+
+static map_slot_t *map_find_slot(hpd_map_t *map, const hpd_pair_t *pair)
+{
+    size_t mask = map->slots_size - 1;
+    for (size_t i = pair->hash & mask; map->slots[i].pos != MAP_SLOT_EMPTY; i = (i + 1) & mask)
+        if (map->slots[i].pos == pair->pos + 1) return &map->slots[i];
+    return NULL;
+}
+
+static void map_insert_slot(hpd_map_t *map, const hpd_pair_t *pair)
+{
+    size_t mask = map->slots_size - 1;
+    size_t i;
+    for (i = pair->hash & mask; map->slots[i].pos != MAP_SLOT_EMPTY; i = (i + 1) & mask)
+        if (map->slots[i].pos == MAP_SLOT_DELETED) break;
+    if (map->slots[i].pos == MAP_SLOT_EMPTY) map->slots_used++;
+    map->slots[i].hash = pair->hash;
+    map->slots[i].pos = (uint32_t) (pair->pos + 1);
+}
+
+static hpd_error_t map_rehash(hpd_map_t *map, size_t count)
+{
+    size_t size = MAP_SLOTS_MIN;
+    while (size < count * 4) size *= 2;
+
+    map_slot_t *slots = calloc(size, sizeof(map_slot_t));
+    if (!slots) return HPD_E_ALLOC;
+
+    // Pairs of flat maps are not hashed yet
+    if (!map->slots) {
+        for (size_t i = 0; i < map->len; i++)
+            if (map->pairs[i]) map->pairs[i]->hash = map_hash(map->pairs[i]->k, map->pairs[i]->k_len);
+    }
+
+    free(map->slots);
+    map->slots = slots;
+    map->slots_size = size;
+    map->slots_used = 0;
+    for (size_t i = 0; i < map->len; i++)
+        if (map->pairs[i]) map_insert_slot(map, map->pairs[i]);
+    return HPD_E_SUCCESS;
+}
+
+static void map_compact(hpd_map_t *map)
+{
+    size_t len = 0;
+    for (size_t i = 0; i < map->len; i++) {
+        hpd_pair_t *pair = map->pairs[i];
+        if (!pair) continue;
+        if (pair->pos != len) {
+            if (map->slots) map_find_slot(map, pair)->pos = (uint32_t) (len + 1);
+            pair->pos = len;
+            map->pairs[len] = pair;
+        }
+        len++;
+    }
+    map->len = len;
+}
+
+/**
+ * Make room for one more pair, in both the pairs array and the hash table.
+ */
+static hpd_error_t map_reserve(hpd_map_t *map)
+{
+    if (map->len == map->cap) {
+        if (map->cap - map->count > map->cap / 4) {
+            map_compact(map);
+        } else {
+            size_t cap = map->cap ? map->cap * 2 : MAP_PAIRS_MIN;
+            HPD_REALLOC(map->pairs, cap, hpd_pair_t *);
+            map->cap = cap;
+        }
+    }
+
+    if (map->count + 1 > MAP_FLAT_MAX && (!map->slots || (map->slots_used + 1) * 2 > map->slots_size))
+        return map_rehash(map, map->count + 1);
+
+    return HPD_E_SUCCESS;
+
+    alloc_error:
+    return HPD_E_ALLOC;
+}
+
+static hpd_error_t map_insert(hpd_map_t *map, const char *k, size_t k_len, const char *v, size_t v_len)
+{
+    hpd_error_t rc;
+    hpd_pair_t *pair;
+
+    if ((rc = map_reserve(map))) return rc;
+
+    if (!(pair = malloc(sizeof(hpd_pair_t) + k_len + 1))) return HPD_E_ALLOC;
+    pair->map = map;
+    pair->hash = map->slots ? map_hash(k, k_len) : 0;
+    pair->k_len = k_len;
+    memcpy(pair->k, k, k_len);
+    pair->k[k_len] = '\0';
+    pair->v = NULL;
+    HPD_STR_N_CPY(pair->v, v, v_len);
+
+    pair->pos = map->len;
+    map->pairs[map->len++] = pair;
+    map->count++;
+    if (map->slots) map_insert_slot(map, pair);
+    return HPD_E_SUCCESS;
+
+    alloc_error:
+    free(pair);
+    return HPD_E_ALLOC;
+}
+
+static hpd_error_t map_replace(hpd_pair_t *pair, const char *v, size_t v_len)
+{
+    HPD_STR_N_CPY(pair->v, v, v_len);
+    return HPD_E_SUCCESS;
+
+    alloc_error:
+    return HPD_E_ALLOC;
+}
+
+static hpd_error_t map_set(hpd_map_t *map, const char *k, size_t k_len, const char *v, size_t v_len)
+{
+    hpd_pair_t *pair = map_find(map, k, k_len);
+
+    if (v == NULL) {
+        if (pair) return hpd_map_remove(map, pair);
+        return HPD_E_SUCCESS;
+    } else if (!pair) {
+        return map_insert(map, k, k_len, v, v_len);
+    } else {
+        return map_replace(pair, v, v_len);
+    }
+}
+
 hpd_error_t hpd_map_alloc(hpd_map_t **map)
 {
     if (!map) return HPD_E_NULL;
 
     HPD_CALLOC(*map, 1, hpd_map_t);
-    TAILQ_INIT(*map);
     return HPD_E_SUCCESS;
 
     alloc_error:
@@ -53,7 +248,13 @@ hpd_error_t hpd_map_first(hpd_map_t *map, const hpd_pair_t **pair)
 {
     if (!map || !pair) return HPD_E_NULL;
 
-    (*pair) = TAILQ_FIRST(map);
+    (*pair) = NULL;
+    for (size_t i = 0; i < map->len; i++) {
+        if (map->pairs[i]) {
+            (*pair) = map->pairs[i];
+            break;
+        }
+    }
     return HPD_E_SUCCESS;
 }
 
@@ -61,7 +262,15 @@ hpd_error_t hpd_map_next(const hpd_pair_t **pair)
 {
     if (!pair || !(*pair)) return HPD_E_NULL;
 
-    (*pair) = TAILQ_NEXT(*pair, HPD_TAILQ_FIELD);
+    hpd_map_t *map = (*pair)->map;
+    size_t pos = (*pair)->pos;
+    (*pair) = NULL;
+    for (size_t i = pos + 1; i < map->len; i++) {
+        if (map->pairs[i]) {
+            (*pair) = map->pairs[i];
+            break;
+        }
+    }
     return HPD_E_SUCCESS;
 }
 
@@ -69,8 +278,10 @@ hpd_error_t hpd_map_remove(hpd_map_t *map, hpd_pair_t *pair)
 {
     if (!map || !pair) return HPD_E_NULL;
 
-    TAILQ_REMOVE(map, pair, HPD_TAILQ_FIELD);
-    free(pair->k);
+    if (map->slots) map_find_slot(map, pair)->pos = MAP_SLOT_DELETED;
+    map->pairs[pair->pos] = NULL;
+    map->count--;
+    while (map->len > 0 && !map->pairs[map->len - 1]) map->len--;
     free(pair->v);
     free(pair);
     return HPD_E_SUCCESS;
@@ -80,136 +291,68 @@ hpd_error_t hpd_map_free(hpd_map_t *map)
 {
     if (!map) return HPD_E_NULL;
 
-    hpd_error_t rc = HPD_E_SUCCESS;
-    hpd_pair_t *pair, *tmp;
-    TAILQ_FOREACH_SAFE(pair, map, HPD_TAILQ_FIELD, tmp) {
-        rc = hpd_map_remove(map, pair);
+    for (size_t i = 0; i < map->len; i++) {
+        hpd_pair_t *pair = map->pairs[i];
+        if (!pair) continue;
+        free(pair->v);
+        free(pair);
     }
+    free(map->pairs);
+    free(map->slots);
     free(map);
-    return rc;
+    return HPD_E_SUCCESS;
 }
 
 hpd_error_t hpd_map_get(hpd_map_t *map, const char *k, const char **v)
-{
-    if (!map || !k || !v) return HPD_E_NULL;
-    
-    hpd_pair_t *attr;
-    (*v) = NULL;
-    TAILQ_FOREACH(attr, map, HPD_TAILQ_FIELD) {
-        if (strcmp(attr->k, k) == 0) {
-            (*v) = attr->v;
-            return HPD_E_SUCCESS;
-        }
-    }
-    return HPD_E_NOT_FOUND;
-}
-
-hpd_error_t hpd_map_get_n(hpd_map_t *map, const char *k, size_t k_len, const char **v)
 {
     if (!map || !k || !v) return HPD_E_NULL;
 
-    hpd_pair_t *attr;
-    (*v) = NULL;
-    TAILQ_FOREACH(attr, map, HPD_TAILQ_FIELD) {
-        if (strncmp(attr->k, k, k_len) == 0) {
-            (*v) = attr->v;
-            return HPD_E_SUCCESS;
+    hpd_pair_t *pair = NULL;
+    if (!map->slots) {
+        // Avoid measuring the key for flat maps
+        for (size_t i = 0; i < map->len; i++) {
+            if (map->pairs[i] && strcmp(map->pairs[i]->k, k) == 0) {
+                pair = map->pairs[i];
+                break;
+            }
         }
+    } else {
+        pair = map_find(map, k, strlen(k));
     }
-    (*v) = NULL;
-    return HPD_E_NOT_FOUND;
-}
-
-static hpd_error_t map_insert(hpd_map_t *map, const char *k, const char *v)
-{
-    hpd_pair_t *attr = NULL;
-    HPD_CALLOC(attr, 1, hpd_pair_t);
-    HPD_STR_CPY(attr->k, k);
-    HPD_STR_CPY(attr->v, v);
-    TAILQ_INSERT_TAIL(map, attr, tailq);
-    return HPD_E_SUCCESS;
-
-    alloc_error:
-        if (attr) {
-            free(attr->k);
-            free(attr->v);
-            free(attr);
-        }
-    return HPD_E_ALLOC;
-}
-
-static hpd_error_t map_replace(hpd_pair_t *attr, const char *v) {
-    HPD_STR_CPY(attr->v, v);
+    if (!pair) {
+        (*v) = NULL;
+        return HPD_E_NOT_FOUND;
+    }
+    (*v) = pair->v;
     return HPD_E_SUCCESS;
-
-    alloc_error:
-        return HPD_E_ALLOC;
 }
 
-static hpd_error_t map_insert_n(hpd_map_t *map, const char *k, size_t k_len, const char *v, size_t v_len)
+hpd_error_t hpd_map_get_n(hpd_map_t *map, const char *k, size_t k_len, const char **v)
 {
-    hpd_pair_t *attr = NULL;
-    HPD_CALLOC(attr, 1, hpd_pair_t);
-    HPD_STR_N_CPY(attr->k, k, k_len);
-    HPD_STR_N_CPY(attr->v, v, v_len);
-    TAILQ_INSERT_TAIL(map, attr, tailq);
-    return HPD_E_SUCCESS;
+    if (!map || !k || !v) return HPD_E_NULL;
 
-    alloc_error:
-    if (attr) {
-        free(attr->k);
-        free(attr->v);
-        free(attr);
+    k_len = strnlen(k, k_len);
+    hpd_pair_t *pair = map_find(map, k, k_len);
+    if (!pair) {
+        (*v) = NULL;
+        return HPD_E_NOT_FOUND;
     }
-    return HPD_E_ALLOC;
-}
-
-static hpd_error_t map_replace_n(hpd_pair_t *attr, const char *v, size_t v_len) {
-    HPD_STR_N_CPY(attr->v, v, v_len);
+    (*v) = pair->v;
     return HPD_E_SUCCESS;
-
-    alloc_error:
-    return HPD_E_ALLOC;
 }
 
 hpd_error_t hpd_map_set(hpd_map_t *map, const char *k, const char *v)
 {
     if (!map || !k) return HPD_E_NULL;
 
-    hpd_error_t rc;
-    hpd_pair_t *attr = NULL;
-    TAILQ_FOREACH(attr, map, HPD_TAILQ_FIELD)
-        if (strcmp(attr->k, k) == 0)
-            break;
-
-    if (v == NULL) {
-        if (attr && (rc = hpd_map_remove(map, attr))) return rc;
-        return HPD_E_SUCCESS;
-    } else if (!attr) {
-        return map_insert(map, k, v);
-    } else {
-        return map_replace(attr, v);
-    }
+    return map_set(map, k, strlen(k), v, v ? strlen(v) : 0);
 }
 
 hpd_error_t hpd_map_set_n(hpd_map_t *map, const char *k, size_t k_len, const char *v, size_t v_len)
 {
     if (!map || !k) return HPD_E_NULL;
 
-    hpd_error_t rc;
-    hpd_pair_t *attr = NULL;
-    TAILQ_FOREACH(attr, map, HPD_TAILQ_FIELD)
-        if (strncmp(attr->k, k, k_len) == 0)
-            break;
-    
-    if (v == NULL) {
-        if (attr && (rc = hpd_map_remove(map, attr))) return rc;
-        return HPD_E_SUCCESS;
-    } else if (!attr) {
-        return map_insert_n(map, k, k_len, v, v_len);
-    } else {
-        return map_replace_n(attr, v, v_len);
-    }
+    return map_set(map, k, strnlen(k, k_len), v, v_len);
 }
 
 hpd_error_t hpd_map_v_matches(hpd_map_t *map, va_list vp)
@@ -0,0 +1,163 @@
+/*
+ * Copyright 2011 Aalborg University. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are
+ * permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of
+ * conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list
+ * of conditions and the following disclaimer in the documentation and/or other materials
+ * provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY Aalborg University ''AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL Aalborg University OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are those of the
+ * authors and should not be interpreted as representing official policies, either expressed
+ */
+
+/*
+ * Map micro-benchmark.
+ *
+ * Compares hpd_map_t against the linked list it replaced (a TAILQ of malloc'd pairs, searched with strcmp), which is
+ * reproduced below. For each size, a map is built, every key is looked up, and the map is freed, until roughly
+ * BENCH_OPS operations have been done. Prints nanoseconds per operation for both.
+ *
+ * Usage: bench_map
+ */
+
+#include "hpd-0.6/common/hpd_map.h"
+#include "hpd-0.6/common/hpd_common.h"
+#include <stdio.h>
+#include <time.h>
+
+#define BENCH_OPS 4000000
+#define BENCH_LOOKUPS 8
+
+static const int sizes[] = { 2, 4, 8, 16, 32, 64, 256, 1024, 0 };
+
+typedef struct list_pair list_pair_t;
+TAILQ_HEAD(list, list_pair);
+typedef struct list list_t;
+
+struct list_pair {
+    TAILQ_ENTRY(list_pair) HPD_TAILQ_FIELD;
+    char *k;
+    char *v;
+};
+
+static const char *list_get(list_t *list, const char *k)
+{
+    list_pair_t *pair;
+    TAILQ_FOREACH(pair, list, HPD_TAILQ_FIELD)
+        if (strcmp(pair->k, k) == 0) return pair->v;
+    return NULL;
+}
+
+static hpd_error_t list_set(list_t *list, const char *k, const char *v)
+{
+    list_pair_t *pair = NULL;
+    TAILQ_FOREACH(pair, list, HPD_TAILQ_FIELD)
+        if (strcmp(pair->k, k) == 0) break;
+    if (pair) {
+        HPD_STR_CPY(pair->v, v);
+        return HPD_E_SUCCESS;
+    }
+    HPD_CALLOC(pair, 1, list_pair_t);
+    HPD_STR_CPY(pair->k, k);
+    HPD_STR_CPY(pair->v, v);
+    TAILQ_INSERT_TAIL(list, pair, HPD_TAILQ_FIELD);
+    return HPD_E_SUCCESS;
+
+    alloc_error:
+    if (pair) {
+        free(pair->k);
+        free(pair);
+    }
+    return HPD_E_ALLOC;
+}
+
+static void list_free(list_t *list)
+{
+    list_pair_t *pair, *tmp;
+    TAILQ_FOREACH_SAFE(pair, list, HPD_TAILQ_FIELD, tmp) {
+        TAILQ_REMOVE(list, pair, HPD_TAILQ_FIELD);
+        free(pair->k);
+        free(pair->v);
+        free(pair);
+    }
+}
+
+static double bench_elapsed(const struct timespec *start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double) (now.tv_sec - start->tv_sec) + (double) (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static double bench_list(char **keys, int n, int rounds)
+{
+    struct timespec start;
+    const char *v;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int r = 0; r < rounds; r++) {
+        list_t *list = malloc(sizeof(list_t));
+        if (!list) abort();
+        TAILQ_INIT(list);
+        for (int i = 0; i < n; i++) list_set(list, keys[i], "value");
+        for (int l = 0; l < BENCH_LOOKUPS; l++)
+            for (int i = 0; i < n; i++) if (!(v = list_get(list, keys[i]))) abort();
+        list_free(list);
+        free(list);
+    }
+    return bench_elapsed(&start);
+}
+
+static double bench_map(char **keys, int n, int rounds)
+{
+    struct timespec start;
+    const char *v;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int r = 0; r < rounds; r++) {
+        hpd_map_t *map;
+        if (hpd_map_alloc(&map)) abort();
+        for (int i = 0; i < n; i++) hpd_map_set(map, keys[i], "value");
+        for (int l = 0; l < BENCH_LOOKUPS; l++)
+            for (int i = 0; i < n; i++) if (hpd_map_get(map, keys[i], &v)) abort();
+        hpd_map_free(map);
+    }
+    return bench_elapsed(&start);
+}
+
+int main(int argc, char *argv[])
+{
+    for (const int *n = sizes; *n; n++) {
+        char **keys = calloc((size_t) *n, sizeof(char *));
+        if (!keys) return EXIT_FAILURE;
+        for (int i = 0; i < *n; i++) {
+            keys[i] = malloc(32);
+            if (!keys[i]) return EXIT_FAILURE;
+            sprintf(keys[i], "X-Header-Name-%i", i);
+        }
+
+        int ops_per_round = *n * (1 + BENCH_LOOKUPS);
+        int rounds = BENCH_OPS / ops_per_round;
+        double ops = (double) rounds * ops_per_round;
+        double list_secs = bench_list(keys, *n, rounds);
+        double map_secs = bench_map(keys, *n, rounds);
+        printf("size %5i: list %8.1f ns/op, map %8.1f ns/op\n", *n, list_secs * 1e9 / ops, map_secs * 1e9 / ops);
+
+        for (int i = 0; i < *n; i++) free(keys[i]);
+        free(keys);
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,135 @@
+/*
+ * Copyright 2011 Aalborg University. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are
+ * permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of
+ * conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list
+ * of conditions and the following disclaimer in the documentation and/or other materials
+ * provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY Aalborg University ''AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL Aalborg University OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are those of the
+ * authors and should not be interpreted as representing official policies, either expressed
+ */
+
+#include <gtest/gtest.h>
+#include "hpd-0.6/common/hpd_map.h"
+
+#define CASE hpd_map
+
+static void expect_order(hpd_map_t *map, const char *const *keys, size_t n)
+{
+    hpd_error_t rc;
+    const hpd_pair_t *pair;
+    const char *k;
+    size_t i = 0;
+    hpd_map_foreach(rc, pair, map) {
+        ASSERT_LT(i, n);
+        ASSERT_EQ(hpd_pair_get(pair, &k, nullptr), HPD_E_SUCCESS);
+        EXPECT_STREQ(k, keys[i]);
+        i++;
+    }
+    EXPECT_EQ(rc, HPD_E_SUCCESS);
+    EXPECT_EQ(i, n);
+}
+
+TEST(CASE, set_get_replace)
+{
+    hpd_map_t *map;
+    const char *v;
+    ASSERT_EQ(hpd_map_alloc(&map), HPD_E_SUCCESS);
+
+    EXPECT_EQ(hpd_map_get(map, "a", &v), HPD_E_NOT_FOUND);
+    EXPECT_EQ(v, nullptr);
+    ASSERT_EQ(hpd_map_set(map, "a", "1"), HPD_E_SUCCESS);
+    ASSERT_EQ(hpd_map_set(map, "b", "2"), HPD_E_SUCCESS);
+    ASSERT_EQ(hpd_map_set(map, "a", "3"), HPD_E_SUCCESS);
+    ASSERT_EQ(hpd_map_get(map, "a", &v), HPD_E_SUCCESS);
+    EXPECT_STREQ(v, "3");
+
+    const char *keys[] = { "a", "b" };
+    expect_order(map, keys, 2);
+
+    ASSERT_EQ(hpd_map_set(map, "a", nullptr), HPD_E_SUCCESS);
+    EXPECT_EQ(hpd_map_get(map, "a", &v), HPD_E_NOT_FOUND);
+    expect_order(map, &keys[1], 1);
+
+    EXPECT_EQ(hpd_map_free(map), HPD_E_SUCCESS);
+}
+
+TEST(CASE, get_n_set_n)
+{
+    hpd_map_t *map;
+    const char *v;
+    ASSERT_EQ(hpd_map_alloc(&map), HPD_E_SUCCESS);
+
+    ASSERT_EQ(hpd_map_set_n(map, "Content-Type: x", 12, "text/plain; y", 10), HPD_E_SUCCESS);
+    ASSERT_EQ(hpd_map_get(map, "Content-Type", &v), HPD_E_SUCCESS);
+    EXPECT_STREQ(v, "text/plain");
+    // Only the exact key matches, not a prefix of it
+    EXPECT_EQ(hpd_map_get_n(map, "Content", 7, &v), HPD_E_NOT_FOUND);
+    ASSERT_EQ(hpd_map_get_n(map, "Content-Type: x", 12, &v), HPD_E_SUCCESS);
+    EXPECT_STREQ(v, "text/plain");
+
+    EXPECT_EQ(hpd_map_free(map), HPD_E_SUCCESS);
+}
+
+TEST(CASE, large)
+{
+    hpd_map_t *map;
+    const char *v;
+    char k[32], val[32];
+    ASSERT_EQ(hpd_map_alloc(&map), HPD_E_SUCCESS);
+
+    for (int i = 0; i < 1000; i++) {
+        sprintf(k, "key-%i", i);
+        sprintf(val, "%i", i);
+        ASSERT_EQ(hpd_map_set(map, k, val), HPD_E_SUCCESS);
+    }
+    for (int i = 0; i < 1000; i += 2) {
+        sprintf(k, "key-%i", i);
+        ASSERT_EQ(hpd_map_set(map, k, nullptr), HPD_E_SUCCESS);
+    }
+    for (int i = 1000; i < 1500; i++) {
+        sprintf(k, "key-%i", i);
+        sprintf(val, "%i", i);
+        ASSERT_EQ(hpd_map_set(map, k, val), HPD_E_SUCCESS);
+    }
+
+    for (int i = 0; i < 1500; i++) {
+        sprintf(k, "key-%i", i);
+        if (i < 1000 && i % 2 == 0) {
+            EXPECT_EQ(hpd_map_get(map, k, &v), HPD_E_NOT_FOUND);
+        } else {
+            ASSERT_EQ(hpd_map_get(map, k, &v), HPD_E_SUCCESS);
+            EXPECT_EQ(atoi(v), i);
+        }
+    }
+
+    hpd_error_t rc;
+    const hpd_pair_t *pair;
+    int prev = -1, n = 0;
+    hpd_map_foreach(rc, pair, map) {
+        ASSERT_EQ(hpd_pair_get(pair, nullptr, &v), HPD_E_SUCCESS);
+        EXPECT_GT(atoi(v), prev);
+        prev = atoi(v);
+        n++;
+    }
+    EXPECT_EQ(rc, HPD_E_SUCCESS);
+    EXPECT_EQ(n, 1000);
+
+    EXPECT_EQ(hpd_map_free(map), HPD_E_SUCCESS);
+}
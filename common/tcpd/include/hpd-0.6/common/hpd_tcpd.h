@@ -95,7 +95,9 @@ struct hpd_tcpd_settings {
     hpd_tcpd_port_t port; ///< Port number
     int timeout;
     int retry_delay;
-    size_t max_data_size;
+    size_t max_data_size; ///< Maximum size of the receive buffer, and thus of data passed to on_receive at once
+    size_t recv_budget;   ///< Maximum bytes read from one connection before other events are handled
+    int reuse_port;       ///< Bind with SO_REUSEPORT, allowing several instances to listen on the same port
     hpd_tcpd_nodata_f on_connect;
     hpd_tcpd_data_f on_receive;
     hpd_tcpd_nodata_f on_disconnect;
@@ -114,7 +116,9 @@ struct hpd_tcpd_settings {
    .port = HPD_TCPD_P_HTTP, \
    .timeout = 15, \
    .retry_delay = 5, \
-   .max_data_size = 1024, \
+   .max_data_size = 64*1024, \
+   .recv_budget = 256*1024, \
+   .reuse_port = 0, \
    .on_connect = NULL, \
    .on_receive = NULL, \
    .on_disconnect = NULL, \
@@ -130,8 +134,10 @@ hpd_error_t hpd_tcpd_stop(hpd_tcpd_t *tcpd);
 // Client functions
 hpd_error_t hpd_tcpd_conn_get_ip(hpd_tcpd_conn_t *conn, const char **ip);
 hpd_error_t hpd_tcpd_conn_keep_open(hpd_tcpd_conn_t *conn);
+hpd_error_t hpd_tcpd_conn_set_timeout(hpd_tcpd_conn_t *conn, int timeout);
 hpd_error_t hpd_tcpd_conn_sendf(hpd_tcpd_conn_t *conn, const char *fmt, ...);
 hpd_error_t hpd_tcpd_conn_vsendf(hpd_tcpd_conn_t *conn, const char *fmt, va_list vp);
+hpd_error_t hpd_tcpd_conn_send(hpd_tcpd_conn_t *conn, const char *buf, size_t len, hpd_free_f on_free);
 hpd_error_t hpd_tcpd_conn_close(hpd_tcpd_conn_t *conn);
 hpd_error_t hpd_tcpd_conn_kill(hpd_tcpd_conn_t *conn);
 
@@ -27,6 +27,7 @@
 
 #include "tcpd_intern.h"
 #include "hpd-0.6/hpd_shared_api.h"
+#include "hpd-0.6/common/hpd_common.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -36,6 +37,42 @@
 #include <arpa/inet.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <sys/uio.h>
+
+/// Maximum number of segments written in one call
+#define TCPD_IOV_MAX 64
+
+/// Minimum capacity of segments formatted by tcpd
+#define TCPD_SEG_MIN 256
+
+/// Initial size of the receive buffer
+#define TCPD_RECV_MIN 4096
+
+/**
+ * Free a segment, including its data.
+ *
+ *  \param  seg  The segment
+ */
+static void tcpd_seg_free(hpd_tcpd_seg_t *seg)
+{
+    if (seg->on_free) seg->on_free(seg->buf);
+    free(seg);
+}
+
+/**
+ * Append a segment to the data to send on a connection.
+ *
+ *  Starts the send watcher, if there was no data to send.
+ *
+ *  \param  conn  The connection
+ *  \param  seg   The segment
+ */
+static void tcpd_conn_append(hpd_tcpd_conn_t *conn, hpd_tcpd_seg_t *seg)
+{
+    if (TAILQ_EMPTY(&conn->send_segs) && conn->tcpd != NULL)
+        ev_io_start(conn->tcpd->loop, &conn->send_watcher);
+    TAILQ_INSERT_TAIL(&conn->send_segs, seg, HPD_TAILQ_FIELD);
+}
 
 /**
  * Get the in_addr from a sockaddr (IPv4 or IPv6)
@@ -60,12 +97,40 @@ static void *tcpd_get_in_addr(struct sockaddr *sa)
     }
 }
 
+/**
+ * Grow the receive buffer, up to max_data_size (from hpd_tcpd_settings_t).
+ *
+ *  The buffer is shared by all connections, as on_receive consumes the
+ *  data before returning. It starts small and is doubled whenever a read
+ *  fills it.
+ *
+ *  \param  tcpd  The tcpd instance
+ */
+static hpd_error_t tcpd_recv_buf_grow(hpd_tcpd_t *tcpd)
+{
+    size_t max = tcpd->settings.max_data_size;
+    size_t cap = tcpd->recv_cap ? tcpd->recv_cap * 2 : TCPD_RECV_MIN;
+    if (cap > max) cap = max;
+    if (cap <= tcpd->recv_cap) return HPD_E_SUCCESS;
+
+    HPD_REALLOC(tcpd->recv_buf, cap, char);
+    tcpd->recv_cap = cap;
+    return HPD_E_SUCCESS;
+
+    alloc_error:
+        // Keep using the current buffer, if any
+        if (tcpd->recv_buf) return HPD_E_SUCCESS;
+        HPD_LOG_RETURN_E_ALLOC(tcpd->context);
+}
+
 /**
  * Recieve callback for io-watcher.
  *
- * Recieves up to max_data_size (from hpd_tcpd_settings_t) of data from a
- * connection and calls on_recieve with it. Also resets the timeout for
- * the connection, if one.
+ * Reads from a connection into the receive buffer and calls on_recieve
+ * with each chunk, until the socket has been drained or recv_budget (from
+ * hpd_tcpd_settings_t) has been read, in which case the rest is left for
+ * the next loop iteration. Also resets the timeout for the connection, if
+ * one.
  *
  * \param  loop     The event loop
  * \param  watcher  The io watcher causing the call
@@ -74,52 +139,67 @@ static void *tcpd_get_in_addr(struct sockaddr *sa)
 static void tcpd_on_ev_recv(hpd_ev_loop_t *loop, struct ev_io *watcher, int revents)
 {
     ssize_t received;
+    size_t total = 0;
     hpd_tcpd_conn_t *conn = watcher->data;
-    hpd_tcpd_settings_t *settings = &conn->tcpd->settings;
-    size_t max_data_size = settings->max_data_size;
-    char buffer[max_data_size];
-    const hpd_module_t *context = conn->tcpd->context;
+    hpd_tcpd_t *tcpd = conn->tcpd;
+    hpd_tcpd_settings_t *settings = &tcpd->settings;
+    const hpd_module_t *context = tcpd->context;
 
-    HPD_LOG_VERBOSE(context, "Receiving data from %s", conn->ip);
-    if ((received = recv(watcher->fd, buffer, max_data_size-1, 0)) < 0) {
-        int err = errno;
-        if (received == -1 && errno == EWOULDBLOCK) {
-            HPD_LOG_WARN(context, "libev callback called without data to receive (conn: %s)", conn->ip);
-            return;
-        }
-        HPD_LOG_ERROR(context, "recv(): %s", strerror(err));
-        if (hpd_tcpd_conn_kill(conn)) HPD_LOG_ERROR(context, "Failed to kill connection.");
-        return;
-    } else if (received == 0) {
-        HPD_LOG_VERBOSE(context, "Connection closed by %s", conn->ip);
+    if (!tcpd->recv_buf && tcpd_recv_buf_grow(tcpd)) {
         if (hpd_tcpd_conn_kill(conn)) HPD_LOG_ERROR(context, "Failed to kill connection.");
         return;
     }
 
-    if (settings->on_receive) {
-        if (settings->on_receive(conn->tcpd, conn,
-                                 settings->tcpd_ctx, &conn->ctx,
-                                 buffer, (size_t) received)) {
-            HPD_LOG_ERROR(context, "Failed to handle new data, killing it.");
+    HPD_LOG_VERBOSE(context, "Receiving data from %s", conn->ip);
+    tcpd->recv_conn = conn;
+    do {
+        if ((received = recv(watcher->fd, tcpd->recv_buf, tcpd->recv_cap, 0)) < 0) {
+            int err = errno;
+            if (err == EAGAIN || err == EWOULDBLOCK || err == EINTR) {
+                if (!total) HPD_LOG_WARN(context, "libev callback called without data to receive (conn: %s)", conn->ip);
+                break;
+            }
+            HPD_LOG_ERROR(context, "recv(): %s", strerror(err));
+            if (hpd_tcpd_conn_kill(conn)) HPD_LOG_ERROR(context, "Failed to kill connection.");
+            return;
+        } else if (received == 0) {
+            HPD_LOG_VERBOSE(context, "Connection closed by %s", conn->ip);
             if (hpd_tcpd_conn_kill(conn)) HPD_LOG_ERROR(context, "Failed to kill connection.");
             return;
         }
-    }
+        total += received;
+
+        if (settings->on_receive) {
+            if (settings->on_receive(tcpd, conn,
+                                     settings->tcpd_ctx, &conn->ctx,
+                                     tcpd->recv_buf, (size_t) received)) {
+                HPD_LOG_ERROR(context, "Failed to handle new data, killing it.");
+                if (hpd_tcpd_conn_kill(conn)) HPD_LOG_ERROR(context, "Failed to kill connection.");
+                return;
+            }
+            // Killed from callback
+            if (tcpd->recv_conn != conn) return;
+        }
+
+        // A short read means the socket has been drained
+        if ((size_t) received < tcpd->recv_cap) break;
+        if (tcpd_recv_buf_grow(tcpd)) break;
+    } while (total < settings->recv_budget);
+    tcpd->recv_conn = NULL;
 
     // Reset timeout
-    if (conn->timeout) {
-        conn->timeout_watcher.repeat = conn->tcpd->settings.timeout;
+    if (conn->timeout)
         ev_timer_again(loop, &conn->timeout_watcher);
-    }
 }
 
 /**
  * Send callback for io-watcher
  *
- * Sends message stored in send_msg on the connection. If not all the
- * data could be sent at once, the remainer is store in send_msg again
- * and the watcher is not stopped. If a connection is flaggted with
- * close, the connection is closed when all the data has been sent.
+ * Writes as many of the segments waiting on the connection as the socket
+ * accepts. Segments that have been sent in full are freed, and the
+ * offset into the first remaining segment is kept for the next call. If a
+ * connection is flagged with close, the connection is closed when all the
+ * data has been sent.
  *
  * \param  loop     The event loop
  * \param  watcher  The io watcher causing the call
@@ -128,31 +208,43 @@ static void tcpd_on_ev_recv(hpd_ev_loop_t *loop, struct ev_io *watcher, int reve
 static void tcpd_on_ev_send(hpd_ev_loop_t *loop, struct ev_io *watcher, int revents)
 {
     hpd_tcpd_conn_t *conn = watcher->data;
-    ssize_t sent;
     const hpd_module_t *context = conn->tcpd->context;
+    struct iovec iov[TCPD_IOV_MAX];
+    int iovcnt = 0;
+    hpd_tcpd_seg_t *seg, *tmp;
+    ssize_t sent;
 
-    sent = send(watcher->fd, conn->send_msg, conn->send_len, 0);
-    if (sent < 0) {
-        int err = errno;
-        HPD_LOG_ERROR(context, "send(): %s", strerror(err));
-    } else if (sent == conn->send_len) {
-        free(conn->send_msg);
-        conn->send_msg = NULL;
-        conn->send_len = 0;
-    } else {
-        conn->send_len -= sent;
-        char *s = malloc(conn->send_len*sizeof(char));
-        if (!s) {
-            HPD_LOG_ERROR(context, "Cannot allocate enough memory.");
-            free(conn->send_msg);
-            conn->send_msg = NULL;
-            conn->send_len = 0;
-        } else {
-            strcpy(s, &conn->send_msg[sent]);
-            free(conn->send_msg);
-            conn->send_msg = s;
+    // Gather segments
+    TAILQ_FOREACH(seg, &conn->send_segs, HPD_TAILQ_FIELD) {
+        if (iovcnt == TCPD_IOV_MAX) break;
+        size_t off = iovcnt ? 0 : conn->send_off;
+        iov[iovcnt].iov_base = &seg->buf[off];
+        iov[iovcnt].iov_len = seg->len - off;
+        iovcnt++;
+    }
+
+    if (iovcnt) {
+        if ((sent = writev(watcher->fd, iov, iovcnt)) < 0) {
+            int err = errno;
+            if (err == EAGAIN || err == EWOULDBLOCK || err == EINTR) return;
+            HPD_LOG_ERROR(context, "writev(): %s", strerror(err));
+            if (hpd_tcpd_conn_kill(conn)) HPD_LOG_ERROR(context, "Failed to kill connection.");
             return;
         }
+
+        // Release sent segments
+        size_t left = (size_t) sent;
+        TAILQ_FOREACH_SAFE(seg, &conn->send_segs, HPD_TAILQ_FIELD, tmp) {
+            size_t remaining = seg->len - conn->send_off;
+            if (left < remaining) {
+                conn->send_off += left;
+                return;
+            }
+            left -= remaining;
+            conn->send_off = 0;
+            TAILQ_REMOVE(&conn->send_segs, seg, HPD_TAILQ_FIELD);
+            tcpd_seg_free(seg);
+        }
     }
 
     ev_io_stop(conn->tcpd->loop, &conn->send_watcher);
@@ -227,8 +319,8 @@ static void tcpd_on_ev_conn(hpd_ev_loop_t *loop, struct ev_io *watcher, int reve
     conn->recv_watcher.data = conn;
     conn->send_watcher.data = conn;
     conn->ctx = NULL;
-    conn->send_msg = NULL;
-    conn->send_len = 0;
+    TAILQ_INIT(&conn->send_segs);
+    conn->send_off = 0;
     conn->send_close = 0;
     conn->timeout = 1;
 
@@ -280,6 +372,9 @@ hpd_error_t hpd_tcpd_create(hpd_tcpd_t **tcpd, hpd_tcpd_settings_t *settings, co
 
     (*tcpd)->context = context;
     (*tcpd)->loop = loop;
+    (*tcpd)->recv_buf = NULL;
+    (*tcpd)->recv_cap = 0;
+    (*tcpd)->recv_conn = NULL;
     TAILQ_INIT(&(*tcpd)->conns);
 
     return HPD_E_SUCCESS;
@@ -297,6 +392,7 @@ hpd_error_t hpd_tcpd_create(hpd_tcpd_t **tcpd, hpd_tcpd_settings_t *settings, co
 hpd_error_t hpd_tcpd_destroy(hpd_tcpd_t *tcpd)
 {
     if (!tcpd) return HPD_E_NULL;
+    free(tcpd->recv_buf);
     free(tcpd);
     return HPD_E_SUCCESS;
 }
@@ -375,6 +471,24 @@ hpd_error_t hpd_tcpd_start(hpd_tcpd_t *tcpd)
         }
 #endif
 
+        // Share port with other instances, the kernel balances connections between them
+        if (tcpd->settings.reuse_port) {
+#ifdef SO_REUSEPORT
+            int on = 1;
+            if (setsockopt(tcpd->sockfd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(int)) == -1) {
+                int err = errno;
+                HPD_LOG_DEBUG(tcpd->context, "setsockopt() failed with: %s", strerror(err));
+                close(tcpd->sockfd);
+                continue;
+            }
+#else
+            HPD_LOG_ERROR(tcpd->context, "SO_REUSEPORT is not supported on this platform.");
+            close(tcpd->sockfd);
+            freeaddrinfo(servinfo);
+            return HPD_E_ARGUMENT;
+#endif
+        }
+
         // Bind to socket
         if (bind(tcpd->sockfd, p->ai_addr, p->ai_addrlen) != 0) {
             int err = errno;
@@ -483,6 +597,26 @@ hpd_error_t hpd_tcpd_conn_keep_open(hpd_tcpd_conn_t *conn)
 }
 
 
+/**
+ * Set timeout on connection
+ *
+ *  Enables the timeout on a connection, with a value that replaces the
+ *  one in hpd_tcpd_settings_t for this connection. This also reenables
+ *  the timeout after a call to hpd_tcpd_conn_keep_open().
+ *
+ *  \param  conn     The connection
+ *  \param  timeout  Timeout in seconds
+ */
+hpd_error_t hpd_tcpd_conn_set_timeout(hpd_tcpd_conn_t *conn, int timeout)
+{
+    if (!conn) return HPD_E_NULL;
+    if (timeout <= 0) HPD_LOG_RETURN(conn->tcpd->context, HPD_E_ARGUMENT, "Timeout must be positive.");
+    conn->timeout = 1;
+    conn->timeout_watcher.repeat = timeout;
+    ev_timer_again(conn->tcpd->loop, &conn->timeout_watcher);
+    return HPD_E_SUCCESS;
+}
+
 /**
  * Send message on connection
  *
@@ -515,6 +649,10 @@ hpd_error_t hpd_tcpd_conn_sendf(hpd_tcpd_conn_t *conn, const char *fmt, ...)
  * This function is simiar to the standard vprintf function, with a
  * format string and a list of variable arguments.
  *
+ * The message is formatted directly into the last segment waiting to be
+ * sent, if it was formatted by tcpd and has room for it, otherwise into a
+ * new segment.
+ *
  * Note that this function only schedules the message to be send. A send
  * watcher on the event loop will trigger the actual sending, when the
  * connection is ready for it.
@@ -533,38 +671,84 @@ hpd_error_t hpd_tcpd_conn_vsendf(hpd_tcpd_conn_t *conn, const char *fmt, va_list
 {
     if (!conn) return HPD_E_NULL;
 
-    char *new_msg;
+    hpd_tcpd_seg_t *seg = TAILQ_LAST(&conn->send_segs, hpd_tcpd_segs);
+    hpd_tcpd_seg_t *new_seg = NULL;
     int new_len;
     va_list vp2;
 
-    // Copy arg to avoid errors on 64bit
-    va_copy(vp2, vp);
+    // Use last segment if appendable, without reallocating the part being sent
+    if (!seg || !seg->cap || (seg == TAILQ_FIRST(&conn->send_segs) && conn->send_off)) {
+        HPD_CALLOC(new_seg, 1, hpd_tcpd_seg_t);
+        new_seg->on_free = free;
+        seg = new_seg;
+    }
 
-    // Get the length to expand with
-    new_len = vsnprintf("", 0, fmt, vp);
+    // Try to format into the free space
+    va_copy(vp2, vp);
+    new_len = vsnprintf(seg->cap ? &seg->buf[seg->len] : NULL, seg->cap - seg->len, fmt, vp2);
+    va_end(vp2);
     if (new_len < 0) {
         int err = errno;
         HPD_LOG_DEBUG(conn->tcpd->context, "vsnprintf(): %s", strerror(err));
+        free(new_seg);
         return HPD_E_UNKNOWN;
     }
 
-    // Expand message to send
-    new_msg = realloc(conn->send_msg,
-                      (conn->send_len + new_len + 1)*sizeof(char));
-    if (new_msg == NULL) HPD_LOG_RETURN_E_ALLOC(conn->tcpd->context);
-    conn->send_msg = new_msg;
+    // Expand and format again, if it did not fit
+    if (seg->len + new_len + 1 > seg->cap) {
+        size_t cap = seg->len + new_len + 1;
+        if (cap < TCPD_SEG_MIN) cap = TCPD_SEG_MIN;
+        HPD_REALLOC(seg->buf, cap, char);
+        seg->cap = cap;
+        vsnprintf(&seg->buf[seg->len], seg->cap - seg->len, fmt, vp);
+    }
+    seg->len += new_len;
 
-    // Concatenate strings
-    vsprintf(&(conn->send_msg[conn->send_len]), fmt, vp2);
+    if (new_seg) tcpd_conn_append(conn, new_seg);
+    return HPD_E_SUCCESS;
 
-    // Start send watcher
-    if (conn->send_len == 0 && conn->tcpd != NULL)
-        ev_io_start(conn->tcpd->loop, &conn->send_watcher);
+    alloc_error:
+        if (new_seg) tcpd_seg_free(new_seg);
+        HPD_LOG_RETURN_E_ALLOC(conn->tcpd->context);
+}
 
-    // Update length
-    conn->send_len += new_len;
+/**
+ * Send a buffer on connection
+ *
+ * The buffer is not copied, instead ownership is handed over to the
+ * connection: on_free is called with buf, once it has been sent or the
+ * connection is killed. If on_free is NULL the caller must keep the buffer
+ * valid until then, which in practice means that it should be static.
+ *
+ * The buffer may contain binary data. Like hpd_tcpd_conn_vsendf() this
+ * only schedules the buffer to be sent.
+ *
+ * \param  conn     Connection to send on
+ * \param  buf      The data to send
+ * \param  len      Length of data
+ * \param  on_free  Free function for buf, or NULL
+ */
+hpd_error_t hpd_tcpd_conn_send(hpd_tcpd_conn_t *conn, const char *buf, size_t len, hpd_free_f on_free)
+{
+    if (!conn) return HPD_E_NULL;
+    if (!buf) HPD_LOG_RETURN_E_NULL(conn->tcpd->context);
 
+    if (!len) {
+        if (on_free) on_free((void *) buf);
+        return HPD_E_SUCCESS;
+    }
+
+    hpd_tcpd_seg_t *seg;
+    HPD_CALLOC(seg, 1, hpd_tcpd_seg_t);
+    seg->buf = (char *) buf;
+    seg->len = len;
+    seg->on_free = on_free;
+    tcpd_conn_append(conn, seg);
     return HPD_E_SUCCESS;
+
+    alloc_error:
+        if (on_free) on_free((void *) buf);
+        HPD_LOG_RETURN_E_ALLOC(conn->tcpd->context);
 }
 
 /**
@@ -584,7 +768,7 @@ hpd_error_t hpd_tcpd_conn_close(hpd_tcpd_conn_t *conn)
 
     conn->send_close = 1;
 
-    if (conn->send_msg == NULL) {
+    if (TAILQ_EMPTY(&conn->send_segs)) {
         ev_io_stop(conn->tcpd->loop, &conn->send_watcher);
         if (conn->send_close && hpd_tcpd_conn_kill(conn)) HPD_LOG_ERROR(context, "Failed to kill connection.");
     }
@@ -615,6 +799,9 @@ hpd_error_t hpd_tcpd_conn_kill(hpd_tcpd_conn_t *conn)
     // Stop circular calls and only kill this connection once
     if (conn->recv_watcher.fd < 0) return HPD_E_SUCCESS;
 
+    // Tell receive callback, if called from within it
+    if (conn->tcpd->recv_conn == conn) conn->tcpd->recv_conn = NULL;
+
     // Stop watchers
     ev_io_stop(conn->tcpd->loop, &conn->recv_watcher);
     ev_io_stop(conn->tcpd->loop, &conn->send_watcher);
@@ -635,7 +822,11 @@ hpd_error_t hpd_tcpd_conn_kill(hpd_tcpd_conn_t *conn)
         HPD_LOG_ERROR(conn->tcpd->context, "Failed to disconnect.");
 
     // Cleanup
-    free(conn->send_msg);
+    hpd_tcpd_seg_t *seg, *tmp;
+    TAILQ_FOREACH_SAFE(seg, &conn->send_segs, HPD_TAILQ_FIELD, tmp) {
+        TAILQ_REMOVE(&conn->send_segs, seg, HPD_TAILQ_FIELD);
+        tcpd_seg_free(seg);
+    }
     free(conn);
 
     return HPD_E_SUCCESS;
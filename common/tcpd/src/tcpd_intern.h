@@ -41,6 +41,19 @@ extern "C" {
 TAILQ_HEAD(hpd_tcpd_conns, hpd_tcpd_conn);
 typedef struct hpd_tcpd_conns hpd_tcpd_conns_t;
 
+typedef struct hpd_tcpd_seg hpd_tcpd_seg_t;
+TAILQ_HEAD(hpd_tcpd_segs, hpd_tcpd_seg);
+typedef struct hpd_tcpd_segs hpd_tcpd_segs_t;
+
+/// A segment of data waiting to be sent on a connection
+struct hpd_tcpd_seg {
+    TAILQ_ENTRY(hpd_tcpd_seg) HPD_TAILQ_FIELD;
+    char *buf;                 ///< Data
+    size_t len;                ///< Length of data
+    size_t cap;                ///< Capacity of buf if owned and appendable by tcpd, otherwise 0
+    hpd_free_f on_free;        ///< Free function for buf, or NULL
+};
+
 /// Instance of a tcpd
 struct hpd_tcpd {
     hpd_tcpd_settings_t settings; ///< Settings
@@ -49,6 +62,9 @@ struct hpd_tcpd {
     hpd_tcpd_conns_t conns;       ///< Linked List of connections
     int sockfd;                 ///< Socket file descriptor
     ev_io watcher;              ///< New connection watcher
+    char *recv_buf;             ///< Receive buffer, shared by all connections
+    size_t recv_cap;            ///< Size of receive buffer
+    hpd_tcpd_conn_t *recv_conn; ///< Connection being received on, reset if killed meanwhile
     const hpd_module_t *context;
 };
 
@@ -61,8 +77,8 @@ struct hpd_tcpd_conn {
     int timeout;               ///< Restart timeout watcher ?
     ev_io recv_watcher;        ///< Recieve watcher
     ev_io send_watcher;        ///< Send watcher
-    char *send_msg;            ///< Data to send
-    size_t send_len;           ///< Length of data to send
+    hpd_tcpd_segs_t send_segs; ///< Segments of data to send
+    size_t send_off;           ///< Offset of unsent data in first segment
     int send_close;            ///< Close socket after send ?
     void *ctx;                 ///< Connection context
 };
@@ -31,11 +31,30 @@
 
 #include "tcpd_intern.h"
 
+static void conn_init(hpd_tcpd_conn_t *conn) {
+    TAILQ_INIT(&conn->send_segs);
+    conn->send_off = 0;
+    conn->tcpd = NULL;
+}
+
+static void conn_free_segs(hpd_tcpd_conn_t *conn) {
+    hpd_tcpd_seg_t *seg, *tmp;
+    TAILQ_FOREACH_SAFE(seg, &conn->send_segs, HPD_TAILQ_FIELD, tmp) {
+        TAILQ_REMOVE(&conn->send_segs, seg, HPD_TAILQ_FIELD);
+        if (seg->on_free) seg->on_free(seg->buf);
+        free(seg);
+    }
+}
+
+static int freed = 0;
+
+static void count_free(void *data) {
+    freed++;
+}
+
 TEST(CASE, sendf) {
     hpd_tcpd_conn_t conn;
-    conn.send_msg = NULL;
-    conn.send_len = 0;
-    conn.tcpd = NULL;
+    conn_init(&conn);
 
     hpd_error_t rc;
     rc = hpd_tcpd_conn_sendf(&conn, "Hello");
@@ -43,8 +62,41 @@ TEST(CASE, sendf) {
     rc = hpd_tcpd_conn_sendf(&conn, " World");
     ASSERT_EQ(rc, HPD_E_SUCCESS);
 
-    ASSERT_STREQ(conn.send_msg, "Hello World");
-    ASSERT_EQ(conn.send_len, (size_t) 11);
+    // Formatted data is appended to the same segment
+    hpd_tcpd_seg_t *seg = TAILQ_FIRST(&conn.send_segs);
+    ASSERT_TRUE(seg != NULL);
+    ASSERT_TRUE(TAILQ_NEXT(seg, HPD_TAILQ_FIELD) == NULL);
+    ASSERT_EQ(seg->len, (size_t) 11);
+    ASSERT_EQ(memcmp(seg->buf, "Hello World", 11), 0);
+
+    conn_free_segs(&conn);
+}
+
+TEST(CASE, send) {
+    hpd_tcpd_conn_t conn;
+    conn_init(&conn);
+    freed = 0;
+
+    static const char data[] = { 'a', '\0', 'b' };
+
+    hpd_error_t rc;
+    rc = hpd_tcpd_conn_sendf(&conn, "Head");
+    ASSERT_EQ(rc, HPD_E_SUCCESS);
+    rc = hpd_tcpd_conn_send(&conn, data, sizeof(data), count_free);
+    ASSERT_EQ(rc, HPD_E_SUCCESS);
+    rc = hpd_tcpd_conn_sendf(&conn, "Tail");
+    ASSERT_EQ(rc, HPD_E_SUCCESS);
+
+    // Buffer is not copied, and formatting after it starts a new segment
+    hpd_tcpd_seg_t *seg = TAILQ_FIRST(&conn.send_segs);
+    ASSERT_EQ(seg->len, (size_t) 4);
+    seg = TAILQ_NEXT(seg, HPD_TAILQ_FIELD);
+    ASSERT_TRUE(seg->buf == data);
+    ASSERT_EQ(seg->len, sizeof(data));
+    seg = TAILQ_NEXT(seg, HPD_TAILQ_FIELD);
+    ASSERT_EQ(seg->len, (size_t) 4);
+    ASSERT_EQ(memcmp(seg->buf, "Tail", 4), 0);
 
-    free(conn.send_msg);
+    conn_free_segs(&conn);
+    ASSERT_EQ(freed, 1);
 }
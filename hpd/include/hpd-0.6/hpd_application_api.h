@@ -40,6 +40,7 @@ hpd_error_t hpd_request_free(hpd_request_t *request);
 hpd_error_t hpd_request_set_value(hpd_request_t *request, hpd_value_t *value);
 hpd_error_t hpd_request_set_data(hpd_request_t *request, void *data, hpd_free_f on_free);
 hpd_error_t hpd_request(hpd_request_t *request);
+hpd_error_t hpd_requests(hpd_request_t **requests, size_t n);
 /// [hpd_request_t functions]
 
 /// [hpd_response_t functions]
@@ -55,10 +56,19 @@ hpd_error_t hpd_response_get_request_value(const hpd_response_t *response, const
 hpd_error_t hpd_listener_alloc(hpd_listener_t **listener, const hpd_module_t *context);
 hpd_error_t hpd_listener_set_data(hpd_listener_t *listener, void *data, hpd_free_f on_free);
 hpd_error_t hpd_listener_set_value_callback(hpd_listener_t *listener, hpd_value_f on_change);
+hpd_error_t hpd_listener_set_value_batch_callback(hpd_listener_t *listener, hpd_changes_f on_change_batch);
 hpd_error_t hpd_listener_set_adapter_callback(hpd_listener_t *listener, hpd_adapter_f on_attach, hpd_adapter_f on_detach, hpd_adapter_f on_change);
 hpd_error_t hpd_listener_set_device_callback(hpd_listener_t *listener, hpd_device_f on_attach, hpd_device_f on_detach, hpd_device_f on_change);
 hpd_error_t hpd_listener_set_service_callback(hpd_listener_t *listener, hpd_service_f on_attach, hpd_service_f on_detach, hpd_service_f on_change);
 hpd_error_t hpd_listener_set_log_callback(hpd_listener_t *listener, hpd_log_f on_log);
+hpd_error_t hpd_listener_set_log_record_callback(hpd_listener_t *listener, hpd_log_record_f on_log_record);
+hpd_error_t hpd_listener_add_service_filter(hpd_listener_t *listener, const hpd_service_id_t *id);
+hpd_error_t hpd_listener_add_device_filter(hpd_listener_t *listener, const hpd_device_id_t *id);
+hpd_error_t hpd_listener_add_adapter_filter(hpd_listener_t *listener, const char *prefix);
+hpd_error_t hpd_listener_set_attr_filter(hpd_listener_t *listener, ...);
+hpd_error_t hpd_listener_set_coalescing(hpd_listener_t *listener, double window, hpd_changes_f on_changes);
+hpd_error_t hpd_listener_get_coalesce_stats(const hpd_listener_t *listener, unsigned long *received,
+                                            unsigned long *absorbed);
 hpd_error_t hpd_subscribe(hpd_listener_t *listener);
 hpd_error_t hpd_listener_free(hpd_listener_t *listener);
 hpd_error_t hpd_listener_get_data(const hpd_listener_t *listener, void **data);
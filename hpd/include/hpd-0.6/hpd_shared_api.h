@@ -45,17 +45,24 @@ hpd_error_t hpd_module_add_option(const hpd_module_t *context, const char *name,
 hpd_error_t hpd_module_get_id(const hpd_module_t *context, const char **id);
 hpd_error_t hpd_module_get_def(const hpd_module_t *context, const hpd_module_def_t **mdef);
 hpd_error_t hpd_get_loop(const hpd_module_t *context, hpd_ev_loop_t **loop);
+hpd_error_t hpd_get_pool_stats(const hpd_module_t *context, hpd_pool_type_t type, size_t *live, size_t *high_water);
 /// [hpd_t functions]
 
 /// [log functions]
 // TODO Should *logf() be allowed to return errors - not really checked anywhere and HPD_LOG_RETURN just ignore return values...
 hpd_error_t hpd_logf(const hpd_module_t *context, hpd_log_level_t level, const char *file, int line, const char *fmt, ...);
 hpd_error_t hpd_vlogf(const hpd_module_t *context, hpd_log_level_t level, const char *file, int line, const char *fmt, va_list vp);
-#define HPD_LOG_ERROR(CONTEXT, FMT, ...) hpd_logf((CONTEXT), HPD_L_ERROR, __FILE__, __LINE__, (FMT), ##__VA_ARGS__)
-#define HPD_LOG_WARN(CONTEXT, FMT, ...) hpd_logf((CONTEXT), HPD_L_WARN , __FILE__, __LINE__, (FMT), ##__VA_ARGS__)
-#define HPD_LOG_INFO(CONTEXT, FMT, ...) hpd_logf((CONTEXT), HPD_L_INFO , __FILE__, __LINE__, (FMT), ##__VA_ARGS__)
-#define HPD_LOG_DEBUG(CONTEXT, FMT, ...) hpd_logf((CONTEXT), HPD_L_DEBUG, __FILE__, __LINE__, (FMT), ##__VA_ARGS__)
-#define HPD_LOG_VERBOSE(CONTEXT, FMT, ...) hpd_logf((CONTEXT), HPD_L_VERBOSE, __FILE__, __LINE__, (FMT), ##__VA_ARGS__)
+hpd_error_t hpd_module_set_log_level(const hpd_module_t *context, hpd_log_level_t level);
+hpd_error_t hpd_module_get_log_level(const hpd_module_t *context, hpd_log_level_t *level);
+#define HPD_LOG_ENABLED(CONTEXT, LEVEL) (!(CONTEXT) || \
+    (LEVEL) <= __atomic_load_n(&((const hpd_module_head_t *) (CONTEXT))->log_level, __ATOMIC_RELAXED))
+#define HPD_LOG_LEVEL(CONTEXT, LEVEL, FMT, ...) (HPD_LOG_ENABLED((CONTEXT), (LEVEL)) ? \
+    hpd_logf((CONTEXT), (LEVEL), __FILE__, __LINE__, (FMT), ##__VA_ARGS__) : HPD_E_SUCCESS)
+#define HPD_LOG_ERROR(CONTEXT, FMT, ...) HPD_LOG_LEVEL((CONTEXT), HPD_L_ERROR, (FMT), ##__VA_ARGS__)
+#define HPD_LOG_WARN(CONTEXT, FMT, ...) HPD_LOG_LEVEL((CONTEXT), HPD_L_WARN, (FMT), ##__VA_ARGS__)
+#define HPD_LOG_INFO(CONTEXT, FMT, ...) HPD_LOG_LEVEL((CONTEXT), HPD_L_INFO, (FMT), ##__VA_ARGS__)
+#define HPD_LOG_DEBUG(CONTEXT, FMT, ...) HPD_LOG_LEVEL((CONTEXT), HPD_L_DEBUG, (FMT), ##__VA_ARGS__)
+#define HPD_LOG_VERBOSE(CONTEXT, FMT, ...) HPD_LOG_LEVEL((CONTEXT), HPD_L_VERBOSE, (FMT), ##__VA_ARGS__)
 
 #define HPD_LOG_RETURN(CONTEXT, E, FMT, ...) do { HPD_LOG_DEBUG((CONTEXT), (FMT), ##__VA_ARGS__); return (E); } while(0)
 #define HPD_LOG_RETURN_E_NULL(CONTEXT)  HPD_LOG_RETURN((CONTEXT), HPD_E_NULL,  "Unexpected null pointer.")
@@ -221,6 +228,8 @@ hpd_error_t hpd_value_alloc(hpd_value_t **value, const hpd_module_t *context, co
 hpd_error_t hpd_value_allocf(hpd_value_t **value, const hpd_module_t *context, const char *fmt, ...);
 hpd_error_t hpd_value_vallocf(hpd_value_t **value, const hpd_module_t *context, const char *fmt, va_list vp);
 hpd_error_t hpd_value_copy(const hpd_module_t *context, hpd_value_t **dst, const hpd_value_t *src);
+hpd_error_t hpd_value_ref(const hpd_value_t *value, hpd_value_t **ref);
+hpd_error_t hpd_value_unref(hpd_value_t *value);
 hpd_error_t hpd_value_free(hpd_value_t *value);
 hpd_error_t hpd_value_set_header(hpd_value_t *value, const char *key, const char *val);
 hpd_error_t hpd_value_set_headers(hpd_value_t *value, ...);
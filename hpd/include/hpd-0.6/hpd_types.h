@@ -28,6 +28,8 @@
 #ifndef HOMEPORT_HPD_TYPES_H
 #define HOMEPORT_HPD_TYPES_H
 
+#include <stddef.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -173,10 +175,63 @@ enum hpd_log_level {
 };
 /// [hpd_log_level_t]
 
+/**
+ * Leading part of hpd_module_t that the log macros read directly, so that messages below the level of a module are
+ * skipped without evaluating their arguments. Use hpd_module_set_log_level() to change it.
+ */
+struct hpd_module_head {
+    enum hpd_log_level log_level;
+};
+
+/**
+ * A log message before it is turned into text, as given to hpd_log_record_f callbacks. The strings are only valid
+ * during the callback, and msg is a single, unpadded message.
+ */
+/// [hpd_log_record_t]
+struct hpd_log_record {
+    unsigned long long time;    //< Microseconds since the epoch
+    enum hpd_log_level level;
+    const char *module;
+    const char *file;
+    int line;
+    const char *msg;
+    size_t len;                 //< Length of msg
+};
+/// [hpd_log_record_t]
+
+/**
+ * A changed value, as given to hpd_changes_f callbacks. Both are only valid during the callback, use
+ * hpd_service_id_copy() and hpd_value_ref() to keep them.
+ */
+/// [hpd_change_t]
+struct hpd_change {
+    const hpd_service_id_t *service;
+    const hpd_value_t *value;
+};
+/// [hpd_change_t]
+
+/**
+ * Kinds of objects that hpd keeps in its pool, statistics are available per kind through hpd_get_pool_stats().
+ */
+/// [hpd_pool_type_t]
+enum hpd_pool_type {
+    HPD_P_REQUEST = 0,  //< Requests, along with their response and service id
+    HPD_P_CHANGE,       //< Changed values on their way to listeners
+    HPD_P_VALUE,        //< Values
+    HPD_P_VALUE_DATA,   //< Bodies and headers, shared by copies of a value
+    HPD_P_SERVICE_ID,   //< Service ids
+    HPD_P_COUNT         //< Last
+};
+/// [hpd_pool_type_t]
+
 typedef enum hpd_method hpd_method_t;
 typedef enum hpd_error hpd_error_t;
 typedef enum hpd_status hpd_status_t;
 typedef enum hpd_log_level hpd_log_level_t;
+typedef enum hpd_pool_type hpd_pool_type_t;
+typedef struct hpd_module_head hpd_module_head_t;
+typedef struct hpd_log_record hpd_log_record_t;
+typedef struct hpd_change hpd_change_t;
 
 /**
  * On failure data should be left as NULL.
@@ -207,6 +262,9 @@ typedef void (*hpd_adapter_f) (void *data, const hpd_adapter_id_t *adapter);
 typedef void (*hpd_device_f) (void *data, const hpd_device_id_t *device);
 typedef void (*hpd_service_f) (void *data, const hpd_service_id_t *service);
 typedef void (*hpd_log_f) (void *data, const char *msg);
+typedef void (*hpd_log_record_f) (void *data, const hpd_log_record_t *record);
+/// Batched or coalesced value changes for listeners
+typedef void (*hpd_changes_f) (void *data, const hpd_change_t *changes, size_t n);
 /// [Application API Callbacks]
 
 /// [hpd_module_def_t]
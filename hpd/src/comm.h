@@ -33,10 +33,27 @@ extern "C" {
 #endif
 
 #include "hpd-0.6/common/hpd_map.h"
+#include <ev.h>
 
 typedef struct hpd_listeners hpd_listeners_t;
+typedef struct hpd_filter hpd_filter_t;
+typedef struct hpd_filters hpd_filters_t;
 
 TAILQ_HEAD(hpd_listeners, hpd_listener);
+TAILQ_HEAD(hpd_filters, hpd_filter);
+
+/// Changes held back by a coalescing listener, the latest value of each service until the timer fires
+typedef struct hpd_coalesce {
+    ev_timer timer;
+    ev_tstamp window;           ///< Zero to deliver on the next loop iteration
+    hpd_change_t *changes;      ///< Owns copies of the ids and references to the values
+    size_t count;
+    size_t size;
+    size_t *slots;              ///< Open addressing on the id hash, position in changes + 1, or 0 if empty
+    size_t slots_size;          ///< Twice size, so never full
+    unsigned long received;     ///< Changes given to the listener
+    unsigned long absorbed;     ///< Changes replaced by a later value before they were delivered
+} hpd_coalesce_t;
 
 struct hpd_listener {
     // Navigational members
@@ -44,6 +61,7 @@ struct hpd_listener {
     const hpd_module_t *context;
     // Data members
     hpd_value_f on_change;
+    hpd_changes_f on_change_batch;
     hpd_adapter_f on_adp_attach;
     hpd_adapter_f on_adp_detach;
     hpd_adapter_f on_adp_change;
@@ -54,6 +72,21 @@ struct hpd_listener {
     hpd_service_f on_srv_detach;
     hpd_service_f on_srv_change;
     hpd_log_f on_log;
+    hpd_log_record_f on_log_record;
+    // Subscription filters, see hpd_listener_add_service_filter()
+    hpd_filters_t filters;
+    hpd_map_t *attrs;           ///< Attributes a service must have for changes to be delivered, NULL if any
+    hpd_bool_t subscribed;
+    TAILQ_ENTRY(hpd_listener) unfiltered_field;
+    unsigned long changes;      ///< Last change delivered, a listener can match more than one filter
+    // Coalescing, see hpd_listener_set_coalescing()
+    hpd_changes_f on_changes;
+    hpd_coalesce_t coalesce;
+    // Changes for on_change_batch, dispatched from the current wakeup of the changed queue
+    hpd_change_t *batch;
+    size_t batch_count;
+    size_t batch_size;
+    TAILQ_ENTRY(hpd_listener) batch_field;
     // User data
     void *data;
     hpd_free_f on_free;
@@ -75,11 +108,19 @@ struct hpd_response {
     hpd_value_t    *value;
 };
 
+/// Body and headers of a value, shared by copies of it until one of them is modified
+typedef struct hpd_value_data {
+    int         refs;       ///< Number of values sharing this
+    hpd_map_t  *headers;    ///< NULL until a header is set
+    char       *body;       ///< len bytes, may contain '\0', always followed by a '\0' not counted in len
+    size_t      len;
+    char        buf[];      ///< Storage for body
+} hpd_value_data_t;
+
 struct hpd_value {
     const hpd_module_t *context;
-    hpd_map_t  *headers;
-    char       *body;
-    size_t      len;
+    int         refs;       ///< Holders of this value, see hpd_value_ref()
+    hpd_value_data_t *data;
 };
 
 #ifdef __cplusplus
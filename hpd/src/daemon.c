@@ -34,6 +34,7 @@
 #include "model.h"
 #ifdef THREAD_SAFE
 #include <pthread.h>
+#include <sched.h>
 #endif
 
 static hpd_error_t daemon_options_parse(hpd_t *hpd, int argc, char **argv);
@@ -179,6 +180,12 @@ static hpd_error_t daemon_loop_create(hpd_t *hpd)
     // Create event loop
     hpd->loop = ev_loop_new(EVFLAG_AUTO);
     if (!hpd->loop) LOG_RETURN_E_ALLOC(hpd);
+
+    // Start queue watchers
+    ev_async_start(hpd->loop, &hpd->request_queue.watcher);
+    ev_async_start(hpd->loop, &hpd->respond_queue.watcher);
+    ev_async_start(hpd->loop, &hpd->changed_queue.watcher);
+    hpd->queues_closed = HPD_FALSE;
     return HPD_E_SUCCESS;
 }
 
@@ -345,10 +352,19 @@ static hpd_error_t daemon_options_parse(hpd_t *hpd, int argc, char **argv)
 
 static hpd_error_t daemon_runtime_create(hpd_t *hpd)
 {
-    HPD_CALLOC(hpd->configuration, 1, hpd_configuration_t);
-    TAILQ_INIT(&hpd->configuration->adapters);
-    TAILQ_INIT(&hpd->configuration->listeners);
-    hpd->configuration->hpd = hpd;
+    hpd_configuration_t *configuration;
+    HPD_CALLOC(configuration, 1, hpd_configuration_t);
+    TAILQ_INIT(&configuration->adapters);
+    TAILQ_INIT(&configuration->listeners);
+    TAILQ_INIT(&configuration->unfiltered);
+    TAILQ_INIT(&configuration->batched);
+    TAILQ_INIT(&configuration->prefix_filters);
+    configuration->hpd = hpd;
+
+    // The log writer reads the listeners from another thread
+    log_lock(hpd);
+    hpd->configuration = configuration;
+    log_unlock(hpd);
     return HPD_E_SUCCESS;
 
     alloc_error:
@@ -358,68 +374,103 @@ static hpd_error_t daemon_runtime_create(hpd_t *hpd)
 static hpd_error_t daemon_runtime_destroy(hpd_t *hpd)
 {
     hpd_error_t rc;
+
+    // Let log listeners see everything logged while they were subscribed
+    log_flush(hpd);
+    log_lock(hpd);
     HPD_TAILQ_MAP_REMOVE(&hpd->configuration->adapters, discovery_free_adapter, hpd_adapter_t, rc);
     HPD_TAILQ_MAP_REMOVE(&hpd->configuration->listeners, event_free_listener, hpd_listener_t, rc);
+    discovery_index_free(hpd->configuration);
     free(hpd->configuration);
     hpd->configuration = NULL;
+    log_unlock(hpd);
     return HPD_E_SUCCESS;
 
     map_error:
+    log_unlock(hpd);
     LOG_RETURN(hpd, rc, "Free function returned an error [code: %i]", rc);
 }
 
-static hpd_error_t daemon_watchers_stop(hpd_t *hpd)
+/**
+ * Refuses further pushes and frees the items that were never dispatched. Pushes in progress on other threads are
+ * waited for first, so the queues stay empty afterwards and nothing is pushed onto a loop that is about to be destroyed.
+ */
+static hpd_error_t daemon_queues_close(hpd_t *hpd)
 {
     hpd_error_t rc = HPD_E_SUCCESS, tmp;
 
-    // Stop other watchers
+#ifdef THREAD_SAFE
+    __atomic_store_n(&hpd->queues_closed, HPD_TRUE, __ATOMIC_SEQ_CST);
+    while (__atomic_load_n(&hpd->queue_pushers, __ATOMIC_ACQUIRE)) sched_yield();
+#else
+    hpd->queues_closed = HPD_TRUE;
+#endif
+
+    hpd_ev_asyncs_t items;
     hpd_ev_async_t *async, *async_tmp;
-    TAILQ_FOREACH_SAFE(async, &hpd->request_watchers, HPD_TAILQ_FIELD, async_tmp) {
-        TAILQ_REMOVE(&hpd->request_watchers, async, HPD_TAILQ_FIELD);
-        ev_async_stop(hpd->loop, &async->watcher);
+    daemon_queue_take(&hpd->request_queue, &items);
+    TAILQ_FOREACH_SAFE(async, &items, HPD_TAILQ_FIELD, async_tmp) {
+        TAILQ_REMOVE(&items, async, HPD_TAILQ_FIELD);
+        // The node is part of the request, and freed with it
         tmp = request_free_request(async->request);
         if (!rc) rc = tmp;
         else LOG_ERROR(hpd, "free function failed [code: %i]", tmp);
-        free(async);
     }
-    TAILQ_FOREACH_SAFE(async, &hpd->respond_watchers, HPD_TAILQ_FIELD, async_tmp) {
-        TAILQ_REMOVE(&hpd->respond_watchers, async, HPD_TAILQ_FIELD);
-        ev_async_stop(hpd->loop, &async->watcher);
+    daemon_queue_take(&hpd->respond_queue, &items);
+    TAILQ_FOREACH_SAFE(async, &items, HPD_TAILQ_FIELD, async_tmp) {
+        TAILQ_REMOVE(&items, async, HPD_TAILQ_FIELD);
         tmp = request_free_response(async->response);
         if (!rc) rc = tmp;
         else LOG_ERROR(hpd, "free function failed [code: %i]", tmp);
-        free(async);
     }
-    TAILQ_FOREACH_SAFE(async, &hpd->changed_watchers, HPD_TAILQ_FIELD, async_tmp) {
-        TAILQ_REMOVE(&hpd->changed_watchers, async, HPD_TAILQ_FIELD);
-        ev_async_stop(hpd->loop, &async->watcher);
-        tmp = discovery_free_sid(async->service);
-        if (!rc) rc = tmp;
-        else LOG_ERROR(hpd, "free function failed [code: %i]", tmp);
+    daemon_queue_take(&hpd->changed_queue, &items);
+    TAILQ_FOREACH_SAFE(async, &items, HPD_TAILQ_FIELD, async_tmp) {
+        TAILQ_REMOVE(&items, async, HPD_TAILQ_FIELD);
+        // The service id is embedded in the node, see event_changed()
         tmp = value_free(async->value);
         if (!rc) rc = tmp;
         else LOG_ERROR(hpd, "free function failed [code: %i]", tmp);
-        free(async);
+        pool_free(async);
     }
 
     return rc;
 }
 
+static hpd_error_t daemon_watchers_stop(hpd_t *hpd)
+{
+    // Stop queue watchers
+    ev_async_stop(hpd->loop, &hpd->request_queue.watcher);
+    ev_async_stop(hpd->loop, &hpd->respond_queue.watcher);
+    ev_async_stop(hpd->loop, &hpd->changed_queue.watcher);
+
+    // Already closed after a normal run, but not if starting the modules failed
+    return daemon_queues_close(hpd);
+}
+
 hpd_error_t daemon_alloc(hpd_t **hpd)
 {
+    hpd_error_t rc;
+
     HPD_CALLOC(*hpd, 1, hpd_t);
-#ifdef THREAD_SAFE
-    // TODO Better thing to do?
-    if (pthread_mutex_init(&(*hpd)->log_mutex, NULL)) {
+    if ((rc = log_init(*hpd))) {
         free(*hpd);
-        return HPD_E_UNKNOWN;
+        return rc;
     }
-#endif
     (*hpd)->hpd_log_level = HPD_L_INFO;
+    (*hpd)->queues_closed = HPD_TRUE;
+    pool_init(&(*hpd)->pool);
     TAILQ_INIT(&(*hpd)->modules);
-    TAILQ_INIT(&(*hpd)->request_watchers);
-    TAILQ_INIT(&(*hpd)->respond_watchers);
-    TAILQ_INIT(&(*hpd)->changed_watchers);
+#ifndef THREAD_SAFE
+    TAILQ_INIT(&(*hpd)->request_queue.items);
+    TAILQ_INIT(&(*hpd)->respond_queue.items);
+    TAILQ_INIT(&(*hpd)->changed_queue.items);
+#endif
+    ev_async_init(&(*hpd)->request_queue.watcher, request_on_request_queue);
+    ev_async_init(&(*hpd)->respond_queue.watcher, request_on_respond_queue);
+    ev_async_init(&(*hpd)->changed_queue.watcher, event_on_changed_queue);
+    (*hpd)->request_queue.watcher.data = *hpd;
+    (*hpd)->respond_queue.watcher.data = *hpd;
+    (*hpd)->changed_queue.watcher.data = *hpd;
     ev_signal_init(&(*hpd)->sigint_watcher, daemon_on_signal, SIGINT);
     ev_signal_init(&(*hpd)->sigterm_watcher, daemon_on_signal, SIGTERM);
     (*hpd)->sigint_watcher.data = hpd;
@@ -443,10 +494,8 @@ hpd_error_t daemon_free(hpd_t *hpd)
         free(module->id);
         free(module);
     }
-#ifdef THREAD_SAFE
-    // TODO Better thing to do?
-    if (pthread_mutex_destroy(&hpd->log_mutex)) return HPD_E_UNKNOWN;
-#endif
+    pool_destroy(hpd, &hpd->pool);
+    log_destroy(hpd);
     free(hpd);
     return HPD_E_SUCCESS;
 }
@@ -509,6 +558,7 @@ hpd_error_t daemon_start(hpd_t *hpd, int argc, char *argv[])
     hpd_error_t rc, rc2;
 
     hpd->argv0 = argv[0];
+    pool_set_owner(&hpd->pool);
 
     // Allocate run-time and option memory
     LOG_INFO(hpd, "Starting...");
@@ -528,6 +578,8 @@ hpd_error_t daemon_start(hpd_t *hpd, int argc, char *argv[])
     LOG_INFO(hpd, "Started.");
     daemon_loop_run(hpd);
     LOG_INFO(hpd, "Stopping...");
+    // Before the modules stop, as they may wait for threads that wait for a queued request
+    if ((rc2 = daemon_queues_close(hpd))) LOG_ERROR(hpd, "Failed to free queued items [code: %i]", rc2);
     if ((rc = daemon_modules_stop(hpd)))
         goto modules_stop_error;
     if ((rc = daemon_watchers_stop(hpd)))
@@ -587,3 +639,70 @@ hpd_error_t daemon_get_loop(const hpd_t *hpd, hpd_ev_loop_t **loop)
     (*loop) = hpd->loop;
     return HPD_E_SUCCESS;
 }
+
+hpd_error_t daemon_queue_push(hpd_t *hpd, hpd_ev_queue_t *queue, hpd_ev_async_t *async)
+{
+#ifdef THREAD_SAFE
+    // Counted before the flag is checked, daemon_queues_close() sets the flag before it waits for the count to drop
+    __atomic_add_fetch(&hpd->queue_pushers, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&hpd->queues_closed, __ATOMIC_SEQ_CST)) {
+        __atomic_sub_fetch(&hpd->queue_pushers, 1, __ATOMIC_RELEASE);
+        LOG_RETURN(hpd, HPD_E_STATE, "Cannot queue while hpd is stopped.");
+    }
+    async->next = __atomic_load_n(&queue->pushed, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&queue->pushed, &async->next, async, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+    ev_async_send(hpd->loop, &queue->watcher);
+    __atomic_sub_fetch(&hpd->queue_pushers, 1, __ATOMIC_RELEASE);
+#else
+    if (hpd->queues_closed) LOG_RETURN(hpd, HPD_E_STATE, "Cannot queue while hpd is stopped.");
+    TAILQ_INSERT_TAIL(&queue->items, async, HPD_TAILQ_FIELD);
+    ev_async_send(hpd->loop, &queue->watcher);
+#endif
+    return HPD_E_SUCCESS;
+}
+
+/**
+ * Pushes all items, in order, and wakes the loop once. Items is left in an undefined state, unless the push is refused.
+ */
+hpd_error_t daemon_queue_push_all(hpd_t *hpd, hpd_ev_queue_t *queue, hpd_ev_asyncs_t *items)
+{
+    hpd_ev_async_t *first = TAILQ_FIRST(items);
+    if (!first) return HPD_E_SUCCESS;
+#ifdef THREAD_SAFE
+    __atomic_add_fetch(&hpd->queue_pushers, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&hpd->queues_closed, __ATOMIC_SEQ_CST)) {
+        __atomic_sub_fetch(&hpd->queue_pushers, 1, __ATOMIC_RELEASE);
+        LOG_RETURN(hpd, HPD_E_STATE, "Cannot queue while hpd is stopped.");
+    }
+    hpd_ev_async_t *last = NULL, *async;
+    // Link the items newest first, as they would have been pushed one by one, then push them in one exchange
+    TAILQ_FOREACH(async, items, HPD_TAILQ_FIELD) {
+        async->next = last;
+        last = async;
+    }
+    first->next = __atomic_load_n(&queue->pushed, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&queue->pushed, &first->next, last, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+    ev_async_send(hpd->loop, &queue->watcher);
+    __atomic_sub_fetch(&hpd->queue_pushers, 1, __ATOMIC_RELEASE);
+#else
+    if (hpd->queues_closed) LOG_RETURN(hpd, HPD_E_STATE, "Cannot queue while hpd is stopped.");
+    TAILQ_CONCAT(&queue->items, items, HPD_TAILQ_FIELD);
+    ev_async_send(hpd->loop, &queue->watcher);
+#endif
+    return HPD_E_SUCCESS;
+}
+
+/**
+ * Moves all pending items onto items in the order they were pushed, leaving the queue empty. Items pushed while the
+ * caller processes the taken ones are dispatched on the next wakeup.
+ */
+void daemon_queue_take(hpd_ev_queue_t *queue, hpd_ev_asyncs_t *items)
+{
+    TAILQ_INIT(items);
+#ifdef THREAD_SAFE
+    hpd_ev_async_t *async = __atomic_exchange_n(&queue->pushed, NULL, __ATOMIC_ACQUIRE);
+    for (; async; async = async->next) TAILQ_INSERT_HEAD(items, async, HPD_TAILQ_FIELD);
+#else
+    TAILQ_CONCAT(items, &queue->items, HPD_TAILQ_FIELD);
+#endif
+}
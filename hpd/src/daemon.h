@@ -31,6 +31,8 @@
 #include "hpd-0.6/hpd_types.h"
 #include "hpd-0.6/common/hpd_common.h"
 #include "hpd-0.6/common/hpd_queue.h"
+#include "pool.h"
+#include "log.h"
 #include <ev.h>
 #include <argp.h>
 
@@ -43,13 +45,28 @@ typedef struct hpd_modules hpd_modules_t;
 typedef struct argp_option hpd_argp_option_t;
 typedef struct hpd_ev_async hpd_ev_async_t;
 typedef struct hpd_ev_asyncs hpd_ev_asyncs_t;
+typedef struct hpd_ev_queue hpd_ev_queue_t;
 
 TAILQ_HEAD(hpd_modules, hpd_module);
 TAILQ_HEAD(hpd_ev_asyncs, hpd_ev_async);
 
+/**
+ * Dispatch queue, a single async watcher serves all pending items of one kind. The watcher callback drains everything
+ * queued at the time it is invoked. With THREAD_SAFE, items may be pushed from any thread: they go onto a lock-free
+ * stack, which the loop takes in one exchange and reverses, so the loop is never stopped to push.
+ */
+struct hpd_ev_queue {
+    ev_async watcher;
+#ifdef THREAD_SAFE
+    hpd_ev_async_t *pushed;     ///< Most recent first
+#else
+    hpd_ev_asyncs_t items;
+#endif
+};
 struct hpd {
     hpd_ev_loop_t *loop;
     hpd_configuration_t *configuration;
+    unsigned long generation; //< Bumped when objects are detached, invalidates ids resolved before
     ev_signal sigint_watcher;
     ev_signal sigterm_watcher;
     hpd_modules_t modules;
@@ -58,12 +75,18 @@ struct hpd {
     hpd_argp_option_t *options;
     const hpd_module_t **option2module;
     const char **option2name;
-    hpd_ev_asyncs_t request_watchers;
-    hpd_ev_asyncs_t respond_watchers;
-    hpd_ev_asyncs_t changed_watchers;
+    hpd_ev_queue_t request_queue;
+    hpd_ev_queue_t respond_queue;
+    hpd_ev_queue_t changed_queue;
+    hpd_bool_t queues_closed;   ///< Set when the loop stops, from then on pushes are refused
+#ifdef THREAD_SAFE
+    unsigned queue_pushers;     ///< Pushes in progress, waited for before the queues are drained for the last time
+#endif
+    hpd_pool_t pool;
     char *argv0;
+    log_sink_t log_sink;
 #ifdef THREAD_SAFE
-    pthread_mutex_t log_mutex;
+    pthread_mutex_t log_mutex;  ///< Guards the listeners that the log writer hands messages to
 #endif
     hpd_log_level_t hpd_log_level;
     hpd_bool_t log_colored;
@@ -71,8 +94,9 @@ struct hpd {
 
 struct hpd_ev_async {
     TAILQ_ENTRY(hpd_ev_async) HPD_TAILQ_FIELD;
-    // TODO Using async watches wrongly here, one global watcher (maybe per queue) would be better
-    ev_async watcher;
+#ifdef THREAD_SAFE
+    hpd_ev_async_t *next;       ///< In hpd_ev_queue::pushed
+#endif
     union {
         hpd_request_t *request;
         hpd_response_t *response;
@@ -85,12 +109,12 @@ struct hpd_ev_async {
 };
 
 typedef struct hpd_module {
+    hpd_log_level_t log_level;  ///< Must be first, read through hpd_module_head_t by the HPD_LOG_* macros
     hpd_t *hpd;
     TAILQ_ENTRY(hpd_module) HPD_TAILQ_FIELD;
     hpd_module_def_t def;
     char *id;
     void *data;
-    hpd_log_level_t log_level;
 } hpd_module_t;
 
 hpd_error_t daemon_alloc(hpd_t **hpd);
@@ -103,6 +127,9 @@ hpd_error_t daemon_stop(const hpd_t *hpd);
 hpd_error_t daemon_get_id(const hpd_module_t *context, const char **id);
 hpd_error_t daemon_get_mdef(const hpd_module_t *context, const hpd_module_def_t **mdef);
 hpd_error_t daemon_get_loop(const hpd_t *hpd, hpd_ev_loop_t **loop);
+hpd_error_t daemon_queue_push(hpd_t *hpd, hpd_ev_queue_t *queue, hpd_ev_async_t *async);
+hpd_error_t daemon_queue_push_all(hpd_t *hpd, hpd_ev_queue_t *queue, hpd_ev_asyncs_t *items);
+void daemon_queue_take(hpd_ev_queue_t *queue, hpd_ev_asyncs_t *items);
 
 #ifdef __cplusplus
 }
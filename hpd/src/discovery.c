@@ -189,8 +189,16 @@ hpd_error_t discovery_attach_adapter(hpd_t *hpd, hpd_adapter_t *adapter)
     TAILQ_INSERT_TAIL(&hpd->configuration->adapters, adapter, HPD_TAILQ_FIELD);
     adapter->configuration = hpd->configuration;
 
+    if ((rc = discovery_index_adapter(adapter))) {
+        TAILQ_REMOVE(&hpd->configuration->adapters, adapter, HPD_TAILQ_FIELD);
+        adapter->configuration = NULL;
+        return rc;
+    }
+
     if ((rc = event_inform_adp_attached(adapter))) {
+        discovery_unindex_adapter(adapter);
         TAILQ_REMOVE(&hpd->configuration->adapters, adapter, HPD_TAILQ_FIELD);
+        adapter->configuration = NULL;
         return rc;
     }
 
@@ -205,7 +213,12 @@ hpd_error_t discovery_attach_device(hpd_adapter_t *adapter, hpd_device_t *device
     device->adapter = adapter;
 
     if (adapter->configuration) {
+        if ((rc = discovery_index_device(device))) {
+            TAILQ_REMOVE(adapter->devices, device, HPD_TAILQ_FIELD);
+            return rc;
+        }
         if ((rc = event_inform_dev_attached(device))) {
+            discovery_unindex_device(device);
             TAILQ_REMOVE(adapter->devices, device, HPD_TAILQ_FIELD);
             return rc;
         }
@@ -222,7 +235,12 @@ hpd_error_t discovery_attach_service(hpd_device_t *device, hpd_service_t *servic
     service->device = device;
 
     if (device->adapter && device->adapter->configuration) {
+        if ((rc = discovery_index_service(service))) {
+            TAILQ_REMOVE(device->services, service, HPD_TAILQ_FIELD);
+            return rc;
+        }
         if ((rc = event_inform_srv_attached(service))) {
+            discovery_unindex_service(service);
             TAILQ_REMOVE(device->services, service, HPD_TAILQ_FIELD);
             return rc;
         }
@@ -239,7 +257,12 @@ hpd_error_t discovery_attach_parameter(hpd_service_t *service, hpd_parameter_t *
     parameter->service = service;
 
     if (service->device && service->device->adapter && service->device->adapter->configuration) {
+        if ((rc = discovery_index_parameter(parameter))) {
+            TAILQ_REMOVE(service->parameters, parameter, HPD_TAILQ_FIELD);
+            return rc;
+        }
         if ((rc = event_inform_srv_changed(service))) {
+            discovery_unindex_parameter(parameter);
             TAILQ_REMOVE(service->parameters, parameter, HPD_TAILQ_FIELD);
             return rc;
         }
@@ -256,6 +279,7 @@ hpd_error_t discovery_detach_adapter(hpd_adapter_t *adapter)
     if ((rc = event_inform_adp_detached(adapter))) return rc;
 
     // Detach it
+    discovery_unindex_adapter(adapter);
     TAILQ_REMOVE(&adapter->configuration->adapters, adapter, HPD_TAILQ_FIELD);
     adapter->configuration = NULL;
 
@@ -269,6 +293,7 @@ hpd_error_t discovery_detach_device(hpd_device_t *device)
     // Inform event listeners
     if (device->adapter->configuration) {
         if ((rc = event_inform_dev_detached(device))) return rc;
+        discovery_unindex_device(device);
     }
 
     // Detach it
@@ -285,6 +310,7 @@ hpd_error_t discovery_detach_service(hpd_service_t *service)
     // Inform event listeners
     if (service->device && service->device->adapter && service->device->adapter->configuration) {
         if ((rc = event_inform_srv_detached(service))) return rc;
+        discovery_unindex_service(service);
     }
 
     TAILQ_REMOVE(service->device->services, service, HPD_TAILQ_FIELD);
@@ -300,6 +326,7 @@ hpd_error_t discovery_detach_parameter(hpd_parameter_t *parameter)
     // Inform event listeners
     if (parameter->service && parameter->service->device && parameter->service->device->adapter && parameter->service->device->adapter->configuration) {
         if ((rc = event_inform_srv_changed(parameter->service))) return rc;
+        discovery_unindex_parameter(parameter);
     }
 
     TAILQ_REMOVE(parameter->service->parameters, parameter, HPD_TAILQ_FIELD);
@@ -884,14 +911,16 @@ hpd_bool_t discovery_has_service_action(const hpd_service_t *service, const hpd_
 
 hpd_bool_t discovery_is_adapter_id_unique(hpd_t *hpd, hpd_adapter_t *adapter)
 {
-    hpd_adapter_t *a;
-    TAILQ_FOREACH(a, &hpd->configuration->adapters, HPD_TAILQ_FIELD)
-        if (strcmp(a->id, adapter->id) == 0) return HPD_FALSE;
-    return HPD_TRUE;
+    return discovery_index_find_adapter(hpd->configuration, discovery_index_hash(adapter->id, NULL, NULL, NULL),
+                                        adapter->id) == NULL;
 }
 
 hpd_bool_t discovery_is_device_id_unique(hpd_adapter_t *adapter, hpd_device_t *device)
 {
+    if (adapter->configuration)
+        return discovery_index_find_device(adapter->configuration, discovery_index_hash(adapter->id, device->id, NULL, NULL),
+                                           adapter->id, device->id) == NULL;
+
     hpd_device_t *d;
     TAILQ_FOREACH(d, adapter->devices, HPD_TAILQ_FIELD)
         if (strcmp(d->id, device->id) == 0) return HPD_FALSE;
@@ -900,6 +929,11 @@ hpd_bool_t discovery_is_device_id_unique(hpd_adapter_t *adapter, hpd_device_t *d
 
 hpd_bool_t discovery_is_service_id_unique(hpd_device_t *device, hpd_service_t *service)
 {
+    if (device->adapter && device->adapter->configuration)
+        return discovery_index_find_service(device->adapter->configuration,
+                                            discovery_index_hash(device->adapter->id, device->id, service->id, NULL),
+                                            device->adapter->id, device->id, service->id) == NULL;
+
     hpd_service_t *s;
     TAILQ_FOREACH(s, device->services, HPD_TAILQ_FIELD)
         if (strcmp(s->id, service->id) == 0) return HPD_FALSE;
@@ -908,6 +942,13 @@ hpd_bool_t discovery_is_service_id_unique(hpd_device_t *device, hpd_service_t *s
 
 hpd_bool_t discovery_is_parameter_id_unique(hpd_service_t *service, hpd_parameter_t *parameter)
 {
+    if (service->device && service->device->adapter && service->device->adapter->configuration)
+        return discovery_index_find_parameter(service->device->adapter->configuration,
+                                              discovery_index_hash(service->device->adapter->id, service->device->id,
+                                                                   service->id, parameter->id),
+                                              service->device->adapter->id, service->device->id, service->id,
+                                              parameter->id) == NULL;
+
     hpd_parameter_t *p;
     TAILQ_FOREACH(p, service->parameters, HPD_TAILQ_FIELD)
         if (strcmp(p->id, parameter->id) == 0) return HPD_FALSE;
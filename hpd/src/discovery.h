@@ -34,25 +34,55 @@ extern "C" {
 
 #include "hpd-0.6/hpd_types.h"
 #include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct hpd_configuration hpd_configuration_t;
+typedef struct hpd_index hpd_index_t;
+typedef struct hpd_index_node hpd_index_node_t;
+
+/*
+ * Ids cache the object they last resolved to. The cache is valid as long as the generation matches
+ * hpd_t::generation, which is bumped whenever an object is detached, otherwise the id is looked up again.
+ */
+
+/*
+ * An id is a single block: the struct, followed by its strings packed in order (aid, did, sid, pid), each terminated
+ * by '\0'. The string pointers point into the block, and hash is discovery_index_hash() of the id up to its own level,
+ * computed once when the id is made. So a copy is a memcpy, a comparison checks the hash before a memcmp, and a free
+ * is a single free. Ids embedded in other structs must be their last member, followed by room for the strings.
+ */
 
 typedef struct hpd_adapter_id {
     const hpd_module_t *context;
     char *aid;
+    uint32_t hash;
+    hpd_adapter_t *node;
+    unsigned long generation;
 } hpd_adapter_id_t;
 
 typedef struct hpd_device_id {
     hpd_adapter_id_t adapter;
     char *did;
+    uint32_t hash;
+    hpd_device_t *node;
+    unsigned long generation;
 } hpd_device_id_t;
 
 typedef struct hpd_service_id {
     hpd_device_id_t device;
     char *sid;
+    uint32_t hash;
+    hpd_service_t *node;
+    unsigned long generation;
 } hpd_service_id_t;
 
 typedef struct hpd_parameter_id {
     hpd_service_id_t service;
     char *pid;
+    uint32_t hash;
+    hpd_parameter_t *node;
+    unsigned long generation;
 } hpd_parameter_id_t;
 
 hpd_error_t discovery_alloc_aid(hpd_adapter_id_t **id, const hpd_module_t *context, const char *aid);
@@ -70,10 +100,20 @@ hpd_error_t discovery_free_did(hpd_device_id_t *id);
 hpd_error_t discovery_free_sid(hpd_service_id_t *id);
 hpd_error_t discovery_free_pid(hpd_parameter_id_t *id);
 
-hpd_error_t discovery_set_aid(hpd_adapter_id_t *id, const hpd_module_t *context, const char *aid);
-hpd_error_t discovery_set_did(hpd_device_id_t *id, const hpd_module_t *context, const char *aid, const char *did);
-hpd_error_t discovery_set_sid(hpd_service_id_t *id, const hpd_module_t *context, const char *aid, const char *did, const char *sid);
-hpd_error_t discovery_set_pid(hpd_parameter_id_t *id, const hpd_module_t *context, const char *aid, const char *did, const char *sid, const char *pid);
+size_t discovery_sid_size(const hpd_service_id_t *id);
+void discovery_copy_sid_to(hpd_service_id_t *dst, const hpd_service_id_t *src);
+hpd_bool_t discovery_did_equal(const hpd_device_id_t *a, const hpd_device_id_t *b);
+hpd_bool_t discovery_sid_equal(const hpd_service_id_t *a, const hpd_service_id_t *b);
+
+hpd_error_t discovery_set_aid(hpd_adapter_id_t **id, const hpd_module_t *context, const char *aid);
+hpd_error_t discovery_set_did(hpd_device_id_t **id, const hpd_module_t *context, const char *aid, const char *did);
+hpd_error_t discovery_set_sid(hpd_service_id_t **id, const hpd_module_t *context, const char *aid, const char *did, const char *sid);
+hpd_error_t discovery_set_pid(hpd_parameter_id_t **id, const hpd_module_t *context, const char *aid, const char *did, const char *sid, const char *pid);
+
+void discovery_cache_aid(hpd_adapter_id_t *id, hpd_adapter_t *adapter);
+void discovery_cache_did(hpd_device_id_t *id, hpd_device_t *device);
+void discovery_cache_sid(hpd_service_id_t *id, hpd_service_t *service);
+void discovery_cache_pid(hpd_parameter_id_t *id, hpd_parameter_t *parameter);
 
 hpd_error_t discovery_find_adapter(const hpd_adapter_id_t *id, hpd_adapter_t **adapter);
 hpd_error_t discovery_find_device(const hpd_device_id_t *id, hpd_device_t **device);
@@ -203,6 +243,29 @@ hpd_bool_t discovery_is_parameter_id_unique(hpd_service_t *service, hpd_paramete
 
 hpd_bool_t discovery_has_service_action(const hpd_service_t *service, const hpd_method_t method);
 
+#define DISCOVERY_INDEX_HASH_SEED 2166136261u
+uint32_t discovery_index_hash_str(uint32_t hash, const char *str);
+uint32_t discovery_index_hash(const char *aid, const char *did, const char *sid, const char *pid);
+void discovery_index_free(hpd_configuration_t *configuration);
+hpd_error_t discovery_index_insert(hpd_index_t *index, hpd_index_node_t *node, uint32_t hash);
+void discovery_index_remove(hpd_index_t *index, hpd_index_node_t *node);
+hpd_index_node_t *discovery_index_bucket(const hpd_index_t *index, uint32_t hash);
+hpd_error_t discovery_index_adapter(hpd_adapter_t *adapter);
+hpd_error_t discovery_index_device(hpd_device_t *device);
+hpd_error_t discovery_index_service(hpd_service_t *service);
+hpd_error_t discovery_index_parameter(hpd_parameter_t *parameter);
+void discovery_unindex_adapter(hpd_adapter_t *adapter);
+void discovery_unindex_device(hpd_device_t *device);
+void discovery_unindex_service(hpd_service_t *service);
+void discovery_unindex_parameter(hpd_parameter_t *parameter);
+hpd_adapter_t *discovery_index_find_adapter(const hpd_configuration_t *configuration, uint32_t hash, const char *aid);
+hpd_device_t *discovery_index_find_device(const hpd_configuration_t *configuration, uint32_t hash, const char *aid,
+                                          const char *did);
+hpd_service_t *discovery_index_find_service(const hpd_configuration_t *configuration, uint32_t hash, const char *aid,
+                                            const char *did, const char *sid);
+hpd_parameter_t *discovery_index_find_parameter(const hpd_configuration_t *configuration, uint32_t hash,
+                                                const char *aid, const char *did, const char *sid, const char *pid);
+
 #ifdef __cplusplus
 }
 #endif
@@ -1135,7 +1135,9 @@ hpd_error_t hpd_first_adapter_id(const hpd_module_t *context, hpd_adapter_id_t *
         return HPD_E_SUCCESS;
     }
 
-    return discovery_alloc_aid(adapter_id, context, adapter->id);
+    if ((rc = discovery_alloc_aid(adapter_id, context, adapter->id))) return rc;
+    discovery_cache_aid(*adapter_id, adapter);
+    return HPD_E_SUCCESS;
 }
 
 hpd_error_t hpd_first_device_id(const hpd_module_t *context, hpd_device_id_t **device_id)
@@ -1154,7 +1156,9 @@ hpd_error_t hpd_first_device_id(const hpd_module_t *context, hpd_device_id_t **d
     }
 
     hpd_adapter_t *adapter = device->adapter;
-    return discovery_alloc_did(device_id, context, adapter->id, device->id);
+    if ((rc = discovery_alloc_did(device_id, context, adapter->id, device->id))) return rc;
+    discovery_cache_did(*device_id, device);
+    return HPD_E_SUCCESS;
 }
 
 hpd_error_t hpd_first_service_id(const hpd_module_t *context, hpd_service_id_t **service_id)
@@ -1174,7 +1178,9 @@ hpd_error_t hpd_first_service_id(const hpd_module_t *context, hpd_service_id_t *
 
     hpd_device_t *device = service->device;
     hpd_adapter_t *adapter = device->adapter;
-    return discovery_alloc_sid(service_id, context, adapter->id, device->id, service->id);
+    if ((rc = discovery_alloc_sid(service_id, context, adapter->id, device->id, service->id))) return rc;
+    discovery_cache_sid(*service_id, service);
+    return HPD_E_SUCCESS;
 }
 
 hpd_error_t hpd_adapter_id_first_device_id(const hpd_adapter_id_t *adapter_id, hpd_device_id_t **device_id)
@@ -1196,7 +1202,9 @@ hpd_error_t hpd_adapter_id_first_device_id(const hpd_adapter_id_t *adapter_id, h
         return HPD_E_SUCCESS;
     }
     
-    return discovery_alloc_did(device_id, adapter_id->context, adapter->id, device->id);
+    if ((rc = discovery_alloc_did(device_id, adapter_id->context, adapter->id, device->id))) return rc;
+    discovery_cache_did(*device_id, device);
+    return HPD_E_SUCCESS;
 }
 
 hpd_error_t hpd_adapter_id_first_service_id(const hpd_adapter_id_t *adapter_id, hpd_service_id_t **service_id)
@@ -1219,7 +1227,9 @@ hpd_error_t hpd_adapter_id_first_service_id(const hpd_adapter_id_t *adapter_id,
     }
     
     hpd_device_t *device = service->device;
-    return discovery_alloc_sid(service_id, adapter_id->context, adapter->id, device->id, service->id);
+    if ((rc = discovery_alloc_sid(service_id, adapter_id->context, adapter->id, device->id, service->id))) return rc;
+    discovery_cache_sid(*service_id, service);
+    return HPD_E_SUCCESS;
 }
 
 hpd_error_t hpd_device_id_first_service_id(const hpd_device_id_t *device_id, hpd_service_id_t **service_id)
@@ -1243,7 +1253,9 @@ hpd_error_t hpd_device_id_first_service_id(const hpd_device_id_t *device_id, hpd
     }
 
     hpd_adapter_t *adapter = device->adapter;
-    return discovery_alloc_sid(service_id, context, adapter->id, device->id, service->id);
+    if ((rc = discovery_alloc_sid(service_id, context, adapter->id, device->id, service->id))) return rc;
+    discovery_cache_sid(*service_id, service);
+    return HPD_E_SUCCESS;
 }
 
 hpd_error_t hpd_service_id_first_parameter_id(const hpd_service_id_t *service_id, hpd_parameter_id_t **parameter_id)
@@ -1268,7 +1280,9 @@ hpd_error_t hpd_service_id_first_parameter_id(const hpd_service_id_t *service_id
 
     hpd_device_t *device = service->device;
     hpd_adapter_t *adapter = device->adapter;
-    return discovery_alloc_pid(parameter_id, context, adapter->id, device->id, service->id, parameter->id);
+    if ((rc = discovery_alloc_pid(parameter_id, context, adapter->id, device->id, service->id, parameter->id))) return rc;
+    discovery_cache_pid(*parameter_id, parameter);
+    return HPD_E_SUCCESS;
 }
 
 
@@ -1291,11 +1305,13 @@ hpd_error_t hpd_next_adapter_id(hpd_adapter_id_t **adapter_id)
         return HPD_E_SUCCESS;
     }
 
-    if ((rc = discovery_set_aid(*adapter_id, context, adapter->id))) {
+    if ((rc = discovery_set_aid(adapter_id, context, adapter->id))) {
         discovery_free_aid(*adapter_id);
         *adapter_id = NULL;
+        return rc;
     }
-    return rc;
+    discovery_cache_aid(*adapter_id, adapter);
+    return HPD_E_SUCCESS;
 }
 
 hpd_error_t hpd_next_device_id(hpd_device_id_t **device_id)
@@ -1318,11 +1334,13 @@ hpd_error_t hpd_next_device_id(hpd_device_id_t **device_id)
     }
 
     hpd_adapter_t *adapter = device->adapter;
-    if ((rc = discovery_set_did(*device_id, context, adapter->id, device->id))) {
+    if ((rc = discovery_set_did(device_id, context, adapter->id, device->id))) {
         discovery_free_did(*device_id);
         *device_id = NULL;
+        return rc;
     }
-    return rc;
+    discovery_cache_did(*device_id, device);
+    return HPD_E_SUCCESS;
 }
 
 hpd_error_t hpd_next_service_id(hpd_service_id_t **service_id)
@@ -1346,11 +1364,13 @@ hpd_error_t hpd_next_service_id(hpd_service_id_t **service_id)
 
     hpd_device_t *device = service->device;
     hpd_adapter_t *adapter = device->adapter;
-    if ((rc = discovery_set_sid(*service_id, context, adapter->id, device->id, service->id))) {
+    if ((rc = discovery_set_sid(service_id, context, adapter->id, device->id, service->id))) {
         discovery_free_sid(*service_id);
         *service_id = NULL;
+        return rc;
     }
-    return rc;
+    discovery_cache_sid(*service_id, service);
+    return HPD_E_SUCCESS;
 }
 
 hpd_error_t hpd_adapter_id_next_device_id(hpd_device_id_t **device_id)
@@ -1373,11 +1393,13 @@ hpd_error_t hpd_adapter_id_next_device_id(hpd_device_id_t **device_id)
     }
 
     hpd_adapter_t *adapter = device->adapter;
-    if ((rc = discovery_set_did(*device_id, context, adapter->id, device->id))) {
+    if ((rc = discovery_set_did(device_id, context, adapter->id, device->id))) {
         discovery_free_did(*device_id);
         *device_id = NULL;
+        return rc;
     }
-    return rc;
+    discovery_cache_did(*device_id, device);
+    return HPD_E_SUCCESS;
 }
 
 hpd_error_t hpd_adapter_id_next_service_id(hpd_service_id_t **service_id)
@@ -1401,11 +1423,13 @@ hpd_error_t hpd_adapter_id_next_service_id(hpd_service_id_t **service_id)
 
     hpd_device_t *device = service->device;
     hpd_adapter_t *adapter = device->adapter;
-    if ((rc = discovery_set_sid(*service_id, context, adapter->id, device->id, service->id))) {
+    if ((rc = discovery_set_sid(service_id, context, adapter->id, device->id, service->id))) {
         discovery_free_sid(*service_id);
         *service_id = NULL;
+        return rc;
     }
-    return rc;
+    discovery_cache_sid(*service_id, service);
+    return HPD_E_SUCCESS;
 }
 
 // TODO ALL next functions should free their iterator on errors...
@@ -1430,11 +1454,13 @@ hpd_error_t hpd_device_id_next_service_id(hpd_service_id_t **service_id)
 
     hpd_device_t *device = service->device;
     hpd_adapter_t *adapter = device->adapter;
-    if ((rc = discovery_set_sid(*service_id, context, adapter->id, device->id, service->id))) {
+    if ((rc = discovery_set_sid(service_id, context, adapter->id, device->id, service->id))) {
         discovery_free_sid(*service_id);
         *service_id = NULL;
+        return rc;
     }
-    return rc;
+    discovery_cache_sid(*service_id, service);
+    return HPD_E_SUCCESS;
 }
 
 hpd_error_t hpd_service_id_next_parameter_id(hpd_parameter_id_t **parameter_id)
@@ -1459,11 +1485,13 @@ hpd_error_t hpd_service_id_next_parameter_id(hpd_parameter_id_t **parameter_id)
     hpd_service_t *service = parameter->service;
     hpd_device_t *device = service->device;
     hpd_adapter_t *adapter = device->adapter;
-    if ((rc = discovery_set_pid(*parameter_id, context, adapter->id, device->id, service->id, parameter->id))) {
+    if ((rc = discovery_set_pid(parameter_id, context, adapter->id, device->id, service->id, parameter->id))) {
         discovery_free_pid(*parameter_id);
         *parameter_id = NULL;
+        return rc;
     }
-    return rc;
+    discovery_cache_pid(*parameter_id, parameter);
+    return HPD_E_SUCCESS;
 }
 
 hpd_error_t hpd_device_get_adapter(const hpd_device_t *device, const hpd_adapter_t **adapter)
@@ -31,232 +31,343 @@
 #include "log.h"
 #include "model.h"
 
-/**
- * HPD_E_ALLOC: id might be partially updated
+// Moves a string pointer of SRC to the same place in DST, a copy of the block SRC
+#define DISCOVERY_REBASE(DST, SRC, FIELD) ((DST)->FIELD = (char *) (DST) + ((SRC)->FIELD - (const char *) (SRC)))
+
+/*
+ * The fill functions initialise an id in place, packing its strings into buf, and return the end of what they wrote.
  */
-hpd_error_t discovery_set_aid(hpd_adapter_id_t *id, const hpd_module_t *context, const char *aid)
+
+static char *discovery_fill_aid(hpd_adapter_id_t *id, const hpd_module_t *context, char *buf, const char *aid)
 {
+    size_t len = strlen(aid) + 1;
     id->context = context;
-    HPD_STR_CPY(id->aid, aid);
-    return HPD_E_SUCCESS;
+    id->aid = memcpy(buf, aid, len);
+    id->node = NULL;
+    id->generation = 0;
+    id->hash = discovery_index_hash_str(DISCOVERY_INDEX_HASH_SEED, aid);
+    return buf + len;
+}
 
-    alloc_error:
-    LOG_RETURN_E_ALLOC(context->hpd);
+static char *discovery_fill_did(hpd_device_id_t *id, const hpd_module_t *context, char *buf, const char *aid,
+                                const char *did)
+{
+    buf = discovery_fill_aid(&id->adapter, context, buf, aid);
+    size_t len = strlen(did) + 1;
+    id->did = memcpy(buf, did, len);
+    id->node = NULL;
+    id->generation = 0;
+    id->hash = discovery_index_hash_str(id->adapter.hash, did);
+    return buf + len;
 }
 
-/**
- * HPD_E_ALLOC: id might be partially updated
- */
-hpd_error_t discovery_set_did(hpd_device_id_t *id, const hpd_module_t *context, const char *aid, const char *did)
+static char *discovery_fill_sid(hpd_service_id_t *id, const hpd_module_t *context, char *buf, const char *aid,
+                                const char *did, const char *sid)
 {
-    hpd_error_t rc;
-    if ((rc = discovery_set_aid(&id->adapter, context, aid))) return rc;
-    HPD_STR_CPY(id->did, did);
+    buf = discovery_fill_did(&id->device, context, buf, aid, did);
+    size_t len = strlen(sid) + 1;
+    id->sid = memcpy(buf, sid, len);
+    id->node = NULL;
+    id->generation = 0;
+    id->hash = discovery_index_hash_str(id->device.hash, sid);
+    return buf + len;
+}
+
+static char *discovery_fill_pid(hpd_parameter_id_t *id, const hpd_module_t *context, char *buf, const char *aid,
+                                const char *did, const char *sid, const char *pid)
+{
+    buf = discovery_fill_sid(&id->service, context, buf, aid, did, sid);
+    size_t len = strlen(pid) + 1;
+    id->pid = memcpy(buf, pid, len);
+    id->node = NULL;
+    id->generation = 0;
+    id->hash = discovery_index_hash_str(id->service.hash, pid);
+    return buf + len;
+}
+
+hpd_error_t discovery_alloc_aid(hpd_adapter_id_t **id, const hpd_module_t *context, const char *aid)
+{
+    if (!((*id) = malloc(sizeof(hpd_adapter_id_t) + strlen(aid) + 1))) LOG_RETURN_E_ALLOC(context->hpd);
+    discovery_fill_aid(*id, context, (char *) ((*id) + 1), aid);
     return HPD_E_SUCCESS;
+}
 
-    alloc_error:
-    LOG_RETURN_E_ALLOC(context->hpd);
+hpd_error_t discovery_alloc_did(hpd_device_id_t **id, const hpd_module_t *context, const char *aid, const char *did)
+{
+    if (!((*id) = malloc(sizeof(hpd_device_id_t) + strlen(aid) + strlen(did) + 2))) LOG_RETURN_E_ALLOC(context->hpd);
+    discovery_fill_did(*id, context, (char *) ((*id) + 1), aid, did);
+    return HPD_E_SUCCESS;
 }
 
-/**
- * HPD_E_ALLOC: id might be partially updated
- */
-hpd_error_t discovery_set_sid(hpd_service_id_t *id, const hpd_module_t *context, const char *aid, const char *did, const char *sid)
+hpd_error_t discovery_alloc_sid(hpd_service_id_t **id, const hpd_module_t *context, const char *aid, const char *did, const char *sid)
 {
-    hpd_error_t rc;
-    if ((rc = discovery_set_did(&id->device, context, aid, did))) return rc;
-    HPD_STR_CPY(id->sid, sid);
+    size_t size = sizeof(hpd_service_id_t) + strlen(aid) + strlen(did) + strlen(sid) + 3;
+    if (!((*id) = pool_alloc(&context->hpd->pool, HPD_P_SERVICE_ID, size))) LOG_RETURN_E_ALLOC(context->hpd);
+    discovery_fill_sid(*id, context, (char *) ((*id) + 1), aid, did, sid);
     return HPD_E_SUCCESS;
+}
 
-    alloc_error:
-    LOG_RETURN_E_ALLOC(context->hpd);
+hpd_error_t discovery_alloc_pid(hpd_parameter_id_t **id, const hpd_module_t *context, const char *aid, const char *did, const char *sid,
+                                const char *pid)
+{
+    size_t size = sizeof(hpd_parameter_id_t) + strlen(aid) + strlen(did) + strlen(sid) + strlen(pid) + 4;
+    if (!((*id) = malloc(size))) LOG_RETURN_E_ALLOC(context->hpd);
+    discovery_fill_pid(*id, context, (char *) ((*id) + 1), aid, did, sid, pid);
+    return HPD_E_SUCCESS;
 }
 
-/**
- * HPD_E_ALLOC: id might be partially updated
+/*
+ * The set functions replace an id with one for other objects. On failure the old id is left as it was.
  */
-hpd_error_t discovery_set_pid(hpd_parameter_id_t *id, const hpd_module_t *context, const char *aid, const char *did, const char *sid, const char *pid)
+
+hpd_error_t discovery_set_aid(hpd_adapter_id_t **id, const hpd_module_t *context, const char *aid)
 {
     hpd_error_t rc;
-    if ((rc = discovery_set_sid(&id->service, context, aid, did, sid))) return rc;
-    HPD_STR_CPY(id->pid, pid);
+    hpd_adapter_id_t *new_id;
+    if ((rc = discovery_alloc_aid(&new_id, context, aid))) return rc;
+    discovery_free_aid(*id);
+    (*id) = new_id;
     return HPD_E_SUCCESS;
-
-    alloc_error:
-    LOG_RETURN_E_ALLOC(context->hpd);
 }
 
-hpd_error_t discovery_alloc_aid(hpd_adapter_id_t **id, const hpd_module_t *context, const char *aid)
+hpd_error_t discovery_set_did(hpd_device_id_t **id, const hpd_module_t *context, const char *aid, const char *did)
 {
     hpd_error_t rc;
-    HPD_CALLOC(*id, 1, hpd_adapter_id_t);
-    if ((rc = discovery_set_aid(*id, context, aid))) {
-        discovery_free_aid(*id);
-        (*id) = NULL;
-        return rc;
-    }
+    hpd_device_id_t *new_id;
+    if ((rc = discovery_alloc_did(&new_id, context, aid, did))) return rc;
+    discovery_free_did(*id);
+    (*id) = new_id;
     return HPD_E_SUCCESS;
-
-    alloc_error:
-    LOG_RETURN_E_ALLOC(context->hpd);
 }
 
-hpd_error_t discovery_alloc_did(hpd_device_id_t **id, const hpd_module_t *context, const char *aid, const char *did)
+hpd_error_t discovery_set_sid(hpd_service_id_t **id, const hpd_module_t *context, const char *aid, const char *did, const char *sid)
 {
     hpd_error_t rc;
-    HPD_CALLOC(*id, 1, hpd_device_id_t);
-    if ((rc = discovery_set_did(*id, context, aid, did))) {
-        discovery_free_did(*id);
-        (*id) = NULL;
-        return rc;
-    }
+    hpd_service_id_t *new_id;
+    if ((rc = discovery_alloc_sid(&new_id, context, aid, did, sid))) return rc;
+    discovery_free_sid(*id);
+    (*id) = new_id;
     return HPD_E_SUCCESS;
-
-    alloc_error:
-    LOG_RETURN_E_ALLOC(context->hpd);
 }
 
-hpd_error_t discovery_alloc_sid(hpd_service_id_t **id, const hpd_module_t *context, const char *aid, const char *did, const char *sid)
+hpd_error_t discovery_set_pid(hpd_parameter_id_t **id, const hpd_module_t *context, const char *aid, const char *did, const char *sid, const char *pid)
 {
     hpd_error_t rc;
-    HPD_CALLOC(*id, 1, hpd_service_id_t);
-    if ((rc = discovery_set_sid(*id, context, aid, did, sid))) {
-        discovery_free_sid(*id);
-        (*id) = NULL;
-        return rc;
-    }
+    hpd_parameter_id_t *new_id;
+    if ((rc = discovery_alloc_pid(&new_id, context, aid, did, sid, pid))) return rc;
+    discovery_free_pid(*id);
+    (*id) = new_id;
     return HPD_E_SUCCESS;
+}
 
-    alloc_error:
-    LOG_RETURN_E_ALLOC(context->hpd);
+/*
+ * Size of an id block, from the start of the struct to the end of its last string.
+ */
+
+static size_t discovery_aid_size(const hpd_adapter_id_t *id)
+{
+    return (size_t) (id->aid - (const char *) id) + strlen(id->aid) + 1;
 }
 
-hpd_error_t discovery_alloc_pid(hpd_parameter_id_t **id, const hpd_module_t *context, const char *aid, const char *did, const char *sid,
-                                const char *pid)
+static size_t discovery_did_size(const hpd_device_id_t *id)
 {
-    hpd_error_t rc;
-    HPD_CALLOC(*id, 1, hpd_parameter_id_t);
-    if ((rc = discovery_set_pid(*id, context, aid, did, sid, pid))) {
-        discovery_free_pid(*id);
-        (*id) = NULL;
-        return rc;
-    }
-    return HPD_E_SUCCESS;
+    return (size_t) (id->did - (const char *) id) + strlen(id->did) + 1;
+}
+
+size_t discovery_sid_size(const hpd_service_id_t *id)
+{
+    return (size_t) (id->sid - (const char *) id) + strlen(id->sid) + 1;
+}
+
+static size_t discovery_pid_size(const hpd_parameter_id_t *id)
+{
+    return (size_t) (id->pid - (const char *) id) + strlen(id->pid) + 1;
+}
 
-    alloc_error:
-    LOG_RETURN_E_ALLOC(context->hpd);
+/**
+ * Copies src into dst, which must have room for discovery_sid_size(src) bytes. The copy includes the cached object.
+ */
+void discovery_copy_sid_to(hpd_service_id_t *dst, const hpd_service_id_t *src)
+{
+    memcpy(dst, src, discovery_sid_size(src));
+    DISCOVERY_REBASE(dst, src, device.adapter.aid);
+    DISCOVERY_REBASE(dst, src, device.did);
+    DISCOVERY_REBASE(dst, src, sid);
 }
 
 hpd_error_t discovery_copy_aid(hpd_adapter_id_t **dst, const hpd_adapter_id_t *src)
 {
-    return discovery_alloc_aid(dst, src->context, src->aid);
+    size_t size = discovery_aid_size(src);
+    if (!((*dst) = malloc(size))) LOG_RETURN_E_ALLOC(src->context->hpd);
+    memcpy(*dst, src, size);
+    DISCOVERY_REBASE(*dst, src, aid);
+    return HPD_E_SUCCESS;
 }
 
 hpd_error_t discovery_copy_did(hpd_device_id_t **dst, const hpd_device_id_t *src)
 {
-    return discovery_alloc_did(dst, src->adapter.context, src->adapter.aid, src->did);
+    size_t size = discovery_did_size(src);
+    if (!((*dst) = malloc(size))) LOG_RETURN_E_ALLOC(src->adapter.context->hpd);
+    memcpy(*dst, src, size);
+    DISCOVERY_REBASE(*dst, src, adapter.aid);
+    DISCOVERY_REBASE(*dst, src, did);
+    return HPD_E_SUCCESS;
 }
 
 hpd_error_t discovery_copy_sid(hpd_service_id_t **dst, const hpd_service_id_t *src)
 {
-    return discovery_alloc_sid(dst, src->device.adapter.context, src->device.adapter.aid, src->device.did, src->sid);
+    hpd_t *hpd = src->device.adapter.context->hpd;
+    if (!((*dst) = pool_alloc(&hpd->pool, HPD_P_SERVICE_ID, discovery_sid_size(src)))) LOG_RETURN_E_ALLOC(hpd);
+    discovery_copy_sid_to(*dst, src);
+    return HPD_E_SUCCESS;
 }
 
 hpd_error_t discovery_copy_pid(hpd_parameter_id_t **dst, const hpd_parameter_id_t *src)
 {
-    return discovery_alloc_pid(dst, src->service.device.adapter.context, src->service.device.adapter.aid, src->service.device.did, src->service.sid, src->pid);
+    size_t size = discovery_pid_size(src);
+    if (!((*dst) = malloc(size))) LOG_RETURN_E_ALLOC(src->service.device.adapter.context->hpd);
+    memcpy(*dst, src, size);
+    DISCOVERY_REBASE(*dst, src, service.device.adapter.aid);
+    DISCOVERY_REBASE(*dst, src, service.device.did);
+    DISCOVERY_REBASE(*dst, src, service.sid);
+    DISCOVERY_REBASE(*dst, src, pid);
+    return HPD_E_SUCCESS;
+}
+
+/**
+ * Whether a and b refer to the same device, see discovery_sid_equal().
+ */
+hpd_bool_t discovery_did_equal(const hpd_device_id_t *a, const hpd_device_id_t *b)
+{
+    if (a->hash != b->hash) return HPD_FALSE;
+    size_t a_len = discovery_did_size(a) - (size_t) (a->adapter.aid - (const char *) a);
+    size_t b_len = discovery_did_size(b) - (size_t) (b->adapter.aid - (const char *) b);
+    return (hpd_bool_t) (a_len == b_len && memcmp(a->adapter.aid, b->adapter.aid, a_len) == 0);
 }
 
+/**
+ * Whether a and b refer to the same service. The strings of both are packed in the same order, so they are compared in
+ * one go, after the hashes.
+ */
+hpd_bool_t discovery_sid_equal(const hpd_service_id_t *a, const hpd_service_id_t *b)
+{
+    if (a->hash != b->hash) return HPD_FALSE;
+    size_t a_len = discovery_sid_size(a) - (size_t) (a->device.adapter.aid - (const char *) a);
+    size_t b_len = discovery_sid_size(b) - (size_t) (b->device.adapter.aid - (const char *) b);
+    return (hpd_bool_t) (a_len == b_len && memcmp(a->device.adapter.aid, b->device.adapter.aid, a_len) == 0);
+}
 
 hpd_error_t discovery_free_aid(hpd_adapter_id_t *id)
 {
-    free(id->aid);
     free(id);
     return HPD_E_SUCCESS;
 }
 
 hpd_error_t discovery_free_did(hpd_device_id_t *id)
 {
-    free(id->adapter.aid);
-    free(id->did);
     free(id);
     return HPD_E_SUCCESS;
 }
 
 hpd_error_t discovery_free_sid(hpd_service_id_t *id)
 {
-    free(id->device.adapter.aid);
-    free(id->device.did);
-    free(id->sid);
-    free(id);
+    pool_free(id);
     return HPD_E_SUCCESS;
 }
 
 hpd_error_t discovery_free_pid(hpd_parameter_id_t *id)
 {
-    free(id->service.device.adapter.aid);
-    free(id->service.device.did);
-    free(id->service.sid);
-    free(id->pid);
     free(id);
     return HPD_E_SUCCESS;
 }
 
-#define DISCOVERY_FIND_ADAPTER(ID, ADAPTER) do { \
-    (ADAPTER) = NULL; \
-    TAILQ_FOREACH((ADAPTER), &(ID)->context->hpd->configuration->adapters, HPD_TAILQ_FIELD) \
-        if (strcmp((ADAPTER)->id, (ID)->aid) == 0) break; \
-    if (!(ADAPTER)) return HPD_E_NOT_FOUND; \
-} while (0)
-
-#define DISCOVERY_FIND_DEVICE(ID, DEVICE) do { \
-    hpd_adapter_t *a = NULL; \
-    DISCOVERY_FIND_ADAPTER(&(ID)->adapter, a); \
-    (DEVICE) = NULL; \
-    TAILQ_FOREACH((DEVICE), a->devices, HPD_TAILQ_FIELD) \
-        if (strcmp((DEVICE)->id, (ID)->did) == 0) break; \
-    if (!(DEVICE)) return HPD_E_NOT_FOUND; \
-} while (0)
-
-#define DISCOVERY_FIND_SERVICE(ID, SERVICE) do { \
-    hpd_device_t *d = NULL; \
-    DISCOVERY_FIND_DEVICE(&(ID)->device, d); \
-    (SERVICE) = NULL; \
-    TAILQ_FOREACH((SERVICE), d->services, HPD_TAILQ_FIELD) \
-        if (strcmp((SERVICE)->id, (ID)->sid) == 0) break; \
-    if (!(SERVICE)) return HPD_E_NOT_FOUND; \
-} while (0)
-
-#define DISCOVERY_FIND_PARAMETER(ID, PARAMETER) do { \
-    hpd_service_t *s = NULL; \
-    DISCOVERY_FIND_SERVICE(&(ID)->service, s); \
-    (PARAMETER) = NULL; \
-    TAILQ_FOREACH((PARAMETER), s->parameters, HPD_TAILQ_FIELD) \
-        if (strcmp((PARAMETER)->id, (ID)->pid) == 0) break; \
-    if (!(PARAMETER)) return HPD_E_NOT_FOUND; \
-} while (0)
+/**
+ * Remember the object an id refers to, and its parents, until the next detach.
+ */
+void discovery_cache_aid(hpd_adapter_id_t *id, hpd_adapter_t *adapter)
+{
+    id->node = adapter;
+    id->generation = id->context->hpd->generation;
+}
+
+void discovery_cache_did(hpd_device_id_t *id, hpd_device_t *device)
+{
+    discovery_cache_aid(&id->adapter, device->adapter);
+    id->node = device;
+    id->generation = id->adapter.generation;
+}
+
+void discovery_cache_sid(hpd_service_id_t *id, hpd_service_t *service)
+{
+    discovery_cache_did(&id->device, service->device);
+    id->node = service;
+    id->generation = id->device.generation;
+}
+
+void discovery_cache_pid(hpd_parameter_id_t *id, hpd_parameter_t *parameter)
+{
+    discovery_cache_sid(&id->service, parameter->service);
+    id->node = parameter;
+    id->generation = id->service.generation;
+}
 
+// The cache is not part of the id's value, so lookups through const ids may still update it
 hpd_error_t discovery_find_adapter(const hpd_adapter_id_t *id, hpd_adapter_t **adapter)
 {
-    DISCOVERY_FIND_ADAPTER(id, *adapter);
+    hpd_t *hpd = id->context->hpd;
+    if (id->node && id->generation == hpd->generation) {
+        (*adapter) = id->node;
+        return HPD_E_SUCCESS;
+    }
+
+    (*adapter) = discovery_index_find_adapter(hpd->configuration, id->hash, id->aid);
+    if (!(*adapter)) return HPD_E_NOT_FOUND;
+    discovery_cache_aid((hpd_adapter_id_t *) id, *adapter);
     return HPD_E_SUCCESS;
 }
 
 hpd_error_t discovery_find_device(const hpd_device_id_t *id, hpd_device_t **device)
 {
-    DISCOVERY_FIND_DEVICE(id, *device);
+    hpd_t *hpd = id->adapter.context->hpd;
+    if (id->node && id->generation == hpd->generation) {
+        (*device) = id->node;
+        return HPD_E_SUCCESS;
+    }
+
+    (*device) = discovery_index_find_device(hpd->configuration, id->hash, id->adapter.aid, id->did);
+    if (!(*device)) return HPD_E_NOT_FOUND;
+    discovery_cache_did((hpd_device_id_t *) id, *device);
     return HPD_E_SUCCESS;
 }
 
 hpd_error_t discovery_find_service(const hpd_service_id_t *id, hpd_service_t **service)
 {
-    DISCOVERY_FIND_SERVICE(id, *service);
+    const hpd_device_id_t *did = &id->device;
+    hpd_t *hpd = did->adapter.context->hpd;
+    if (id->node && id->generation == hpd->generation) {
+        (*service) = id->node;
+        return HPD_E_SUCCESS;
+    }
+
+    (*service) = discovery_index_find_service(hpd->configuration, id->hash, did->adapter.aid, did->did, id->sid);
+    if (!(*service)) return HPD_E_NOT_FOUND;
+    discovery_cache_sid((hpd_service_id_t *) id, *service);
     return HPD_E_SUCCESS;
 }
 
 hpd_error_t discovery_find_parameter(const hpd_parameter_id_t *id, hpd_parameter_t **parameter)
 {
-    DISCOVERY_FIND_PARAMETER(id, *parameter);
+    const hpd_device_id_t *did = &id->service.device;
+    hpd_t *hpd = did->adapter.context->hpd;
+    if (id->node && id->generation == hpd->generation) {
+        (*parameter) = id->node;
+        return HPD_E_SUCCESS;
+    }
+
+    (*parameter) = discovery_index_find_parameter(hpd->configuration, id->hash, did->adapter.aid, did->did,
+                                                  id->service.sid, id->pid);
+    if (!(*parameter)) return HPD_E_NOT_FOUND;
+    discovery_cache_pid((hpd_parameter_id_t *) id, *parameter);
     return HPD_E_SUCCESS;
 }
 
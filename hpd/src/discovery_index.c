@@ -0,0 +1,307 @@
+/*
+ * Copyright 2011 Aalborg University. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are
+ * permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of
+ * conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list
+ * of conditions and the following disclaimer in the documentation and/or other materials
+ * provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY Aalborg University ''AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL Aalborg University OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are those of the
+ * authors and should not be interpreted as representing official policies, either expressed
+ */
+
+#include "discovery.h"
+#include "hpd-0.6/common/hpd_common.h"
+#include "daemon.h"
+#include "log.h"
+#include "model.h"
+
+#define DISCOVERY_INDEX_INITIAL_SIZE 16
+
+uint32_t discovery_index_hash_str(uint32_t hash, const char *str)
+{
+    // FNV-1a, including the terminating null byte so ("ab", "c") and ("a", "bc") differ
+    do {
+        hash ^= (unsigned char) *str;
+        hash *= 16777619u;
+    } while (*str++);
+    return hash;
+}
+
+/**
+ * Hash of an id tuple, each of did, sid and pid may be NULL to terminate the tuple.
+ */
+uint32_t discovery_index_hash(const char *aid, const char *did, const char *sid, const char *pid)
+{
+    uint32_t hash = discovery_index_hash_str(DISCOVERY_INDEX_HASH_SEED, aid);
+    if (!did) return hash;
+    hash = discovery_index_hash_str(hash, did);
+    if (!sid) return hash;
+    hash = discovery_index_hash_str(hash, sid);
+    if (!pid) return hash;
+    return discovery_index_hash_str(hash, pid);
+}
+
+static hpd_error_t discovery_index_grow(hpd_index_t *index)
+{
+    size_t size = index->size ? index->size * 2 : DISCOVERY_INDEX_INITIAL_SIZE;
+    hpd_index_node_t **buckets = calloc(size, sizeof(hpd_index_node_t *));
+    if (!buckets) return HPD_E_ALLOC;
+
+    for (size_t i = 0; i < index->size; i++) {
+        hpd_index_node_t *node, *next;
+        for (node = index->buckets[i]; node; node = next) {
+            next = node->next;
+            node->next = buckets[node->hash & (size - 1)];
+            buckets[node->hash & (size - 1)] = node;
+        }
+    }
+
+    free(index->buckets);
+    index->buckets = buckets;
+    index->size = size;
+    return HPD_E_SUCCESS;
+}
+
+hpd_error_t discovery_index_insert(hpd_index_t *index, hpd_index_node_t *node, uint32_t hash)
+{
+    // A failed grow only costs longer chains, unless there are no buckets at all
+    if (index->count >= index->size && discovery_index_grow(index) && !index->size) return HPD_E_ALLOC;
+
+    hpd_index_node_t **bucket = &index->buckets[hash & (index->size - 1)];
+    node->hash = hash;
+    node->next = *bucket;
+    node->indexed = HPD_TRUE;
+    *bucket = node;
+    index->count++;
+    return HPD_E_SUCCESS;
+}
+
+void discovery_index_remove(hpd_index_t *index, hpd_index_node_t *node)
+{
+    if (!node->indexed) return;
+
+    hpd_index_node_t **link;
+    for (link = &index->buckets[node->hash & (index->size - 1)]; *link; link = &(*link)->next) {
+        if (*link == node) {
+            *link = node->next;
+            index->count--;
+            break;
+        }
+    }
+    node->next = NULL;
+    node->indexed = HPD_FALSE;
+}
+
+hpd_index_node_t *discovery_index_bucket(const hpd_index_t *index, uint32_t hash)
+{
+    if (!index->size) return NULL;
+    return index->buckets[hash & (index->size - 1)];
+}
+
+void discovery_index_free(hpd_configuration_t *configuration)
+{
+    configuration->hpd->generation++;
+    free(configuration->adapter_index.buckets);
+    free(configuration->device_index.buckets);
+    free(configuration->service_index.buckets);
+    free(configuration->parameter_index.buckets);
+    free(configuration->service_filters.buckets);
+    free(configuration->device_filters.buckets);
+}
+
+void discovery_unindex_parameter(hpd_parameter_t *parameter)
+{
+    hpd_configuration_t *configuration = parameter->service->device->adapter->configuration;
+    discovery_index_remove(&configuration->parameter_index, &parameter->index);
+    configuration->hpd->generation++;
+}
+
+void discovery_unindex_service(hpd_service_t *service)
+{
+    hpd_configuration_t *configuration = service->device->adapter->configuration;
+    hpd_parameter_t *parameter;
+    TAILQ_FOREACH(parameter, service->parameters, HPD_TAILQ_FIELD)
+        discovery_unindex_parameter(parameter);
+    discovery_index_remove(&configuration->service_index, &service->index);
+    configuration->hpd->generation++;
+}
+
+void discovery_unindex_device(hpd_device_t *device)
+{
+    hpd_configuration_t *configuration = device->adapter->configuration;
+    hpd_service_t *service;
+    TAILQ_FOREACH(service, device->services, HPD_TAILQ_FIELD)
+        discovery_unindex_service(service);
+    discovery_index_remove(&configuration->device_index, &device->index);
+    configuration->hpd->generation++;
+}
+
+void discovery_unindex_adapter(hpd_adapter_t *adapter)
+{
+    hpd_device_t *device;
+    TAILQ_FOREACH(device, adapter->devices, HPD_TAILQ_FIELD)
+        discovery_unindex_device(device);
+    discovery_index_remove(&adapter->configuration->adapter_index, &adapter->index);
+    adapter->configuration->hpd->generation++;
+}
+
+/**
+ * Index the parameter, its parents must be attached.
+ */
+hpd_error_t discovery_index_parameter(hpd_parameter_t *parameter)
+{
+    hpd_service_t *service = parameter->service;
+    hpd_device_t *device = service->device;
+    hpd_adapter_t *adapter = device->adapter;
+    hpd_configuration_t *configuration = adapter->configuration;
+
+    uint32_t hash = discovery_index_hash(adapter->id, device->id, service->id, parameter->id);
+    if (discovery_index_insert(&configuration->parameter_index, &parameter->index, hash))
+        LOG_RETURN_E_ALLOC(configuration->hpd);
+    return HPD_E_SUCCESS;
+}
+
+/**
+ * Index the service and its parameters, its parents must be attached. On failure nothing is indexed.
+ */
+hpd_error_t discovery_index_service(hpd_service_t *service)
+{
+    hpd_error_t rc;
+    hpd_device_t *device = service->device;
+    hpd_adapter_t *adapter = device->adapter;
+    hpd_configuration_t *configuration = adapter->configuration;
+
+    uint32_t hash = discovery_index_hash(adapter->id, device->id, service->id, NULL);
+    if (discovery_index_insert(&configuration->service_index, &service->index, hash))
+        LOG_RETURN_E_ALLOC(configuration->hpd);
+
+    hpd_parameter_t *parameter;
+    TAILQ_FOREACH(parameter, service->parameters, HPD_TAILQ_FIELD) {
+        if ((rc = discovery_index_parameter(parameter))) {
+            discovery_unindex_service(service);
+            return rc;
+        }
+    }
+
+    return HPD_E_SUCCESS;
+}
+
+/**
+ * Index the device and its services, its adapter must be attached. On failure nothing is indexed.
+ */
+hpd_error_t discovery_index_device(hpd_device_t *device)
+{
+    hpd_error_t rc;
+    hpd_adapter_t *adapter = device->adapter;
+    hpd_configuration_t *configuration = adapter->configuration;
+
+    uint32_t hash = discovery_index_hash(adapter->id, device->id, NULL, NULL);
+    if (discovery_index_insert(&configuration->device_index, &device->index, hash))
+        LOG_RETURN_E_ALLOC(configuration->hpd);
+
+    hpd_service_t *service;
+    TAILQ_FOREACH(service, device->services, HPD_TAILQ_FIELD) {
+        if ((rc = discovery_index_service(service))) {
+            discovery_unindex_device(device);
+            return rc;
+        }
+    }
+
+    return HPD_E_SUCCESS;
+}
+
+/**
+ * Index the adapter and its devices, the adapter must be attached. On failure nothing is indexed.
+ */
+hpd_error_t discovery_index_adapter(hpd_adapter_t *adapter)
+{
+    hpd_error_t rc;
+    hpd_configuration_t *configuration = adapter->configuration;
+
+    uint32_t hash = discovery_index_hash(adapter->id, NULL, NULL, NULL);
+    if (discovery_index_insert(&configuration->adapter_index, &adapter->index, hash))
+        LOG_RETURN_E_ALLOC(configuration->hpd);
+
+    hpd_device_t *device;
+    TAILQ_FOREACH(device, adapter->devices, HPD_TAILQ_FIELD) {
+        if ((rc = discovery_index_device(device))) {
+            discovery_unindex_adapter(adapter);
+            return rc;
+        }
+    }
+
+    return HPD_E_SUCCESS;
+}
+
+/*
+ * The find functions take the hash of the id, as ids carry it precomputed.
+ */
+
+hpd_adapter_t *discovery_index_find_adapter(const hpd_configuration_t *configuration, uint32_t hash, const char *aid)
+{
+    hpd_index_node_t *node;
+    for (node = discovery_index_bucket(&configuration->adapter_index, hash); node; node = node->next) {
+        if (node->hash != hash) continue;
+        hpd_adapter_t *adapter = HPD_INDEX_ENTRY(node, hpd_adapter_t);
+        if (strcmp(adapter->id, aid) == 0) return adapter;
+    }
+    return NULL;
+}
+
+hpd_device_t *discovery_index_find_device(const hpd_configuration_t *configuration, uint32_t hash, const char *aid,
+                                          const char *did)
+{
+    hpd_index_node_t *node;
+    for (node = discovery_index_bucket(&configuration->device_index, hash); node; node = node->next) {
+        if (node->hash != hash) continue;
+        hpd_device_t *device = HPD_INDEX_ENTRY(node, hpd_device_t);
+        if (strcmp(device->id, did) == 0 &&
+            strcmp(device->adapter->id, aid) == 0) return device;
+    }
+    return NULL;
+}
+
+hpd_service_t *discovery_index_find_service(const hpd_configuration_t *configuration, uint32_t hash, const char *aid,
+                                            const char *did, const char *sid)
+{
+    hpd_index_node_t *node;
+    for (node = discovery_index_bucket(&configuration->service_index, hash); node; node = node->next) {
+        if (node->hash != hash) continue;
+        hpd_service_t *service = HPD_INDEX_ENTRY(node, hpd_service_t);
+        if (strcmp(service->id, sid) == 0 &&
+            strcmp(service->device->id, did) == 0 &&
+            strcmp(service->device->adapter->id, aid) == 0) return service;
+    }
+    return NULL;
+}
+
+hpd_parameter_t *discovery_index_find_parameter(const hpd_configuration_t *configuration, uint32_t hash,
+                                                const char *aid, const char *did, const char *sid, const char *pid)
+{
+    hpd_index_node_t *node;
+    for (node = discovery_index_bucket(&configuration->parameter_index, hash); node; node = node->next) {
+        if (node->hash != hash) continue;
+        hpd_parameter_t *parameter = HPD_INDEX_ENTRY(node, hpd_parameter_t);
+        if (strcmp(parameter->id, pid) == 0 &&
+            strcmp(parameter->service->id, sid) == 0 &&
+            strcmp(parameter->service->device->id, did) == 0 &&
+            strcmp(parameter->service->device->adapter->id, aid) == 0) return parameter;
+    }
+    return NULL;
+}
@@ -37,14 +37,55 @@ hpd_error_t event_alloc_listener(hpd_listener_t **listener, const hpd_module_t *
 {
     HPD_CALLOC(*listener, 1, hpd_listener_t);
     (*listener)->context = context;
+    TAILQ_INIT(&(*listener)->filters);
     return HPD_E_SUCCESS;
 
     alloc_error:
     LOG_RETURN_E_ALLOC(context->hpd);
 }
 
+/**
+ * Frees the changes held back by a coalescing listener.
+ */
+static void event_coalesce_clear(hpd_coalesce_t *coalesce)
+{
+    hpd_change_t *change;
+    for (change = coalesce->changes; change < coalesce->changes + coalesce->count; change++) {
+        discovery_free_sid((hpd_service_id_t *) change->service);
+        value_free((hpd_value_t *) change->value);
+    }
+    if (coalesce->count) memset(coalesce->slots, 0, coalesce->slots_size * sizeof(size_t));
+    coalesce->count = 0;
+}
+
+static void event_free_filter(hpd_filter_t *filter)
+{
+    switch (filter->type) {
+        case HPD_F_SERVICE:
+            if (filter->service) discovery_free_sid(filter->service);
+            break;
+        case HPD_F_DEVICE:
+            if (filter->device) discovery_free_did(filter->device);
+            break;
+        case HPD_F_ADAPTER_PREFIX:
+            free(filter->prefix);
+            break;
+    }
+    free(filter);
+}
+
 hpd_error_t event_free_listener(hpd_listener_t *listener)
 {
+    hpd_filter_t *filter, *filter_tmp;
+    TAILQ_FOREACH_SAFE(filter, &listener->filters, HPD_TAILQ_FIELD, filter_tmp) {
+        TAILQ_REMOVE(&listener->filters, filter, HPD_TAILQ_FIELD);
+        event_free_filter(filter);
+    }
+    if (listener->attrs) hpd_map_free(listener->attrs);
+    event_coalesce_clear(&listener->coalesce);
+    free(listener->coalesce.changes);
+    free(listener->coalesce.slots);
+    free(listener->batch);
     if (listener->on_free) listener->on_free(listener->data);
     free(listener);
     return HPD_E_SUCCESS;
@@ -88,25 +129,229 @@ hpd_error_t event_set_service_callback(hpd_listener_t *listener, hpd_service_f o
     return HPD_E_SUCCESS;
 }
 
+hpd_error_t event_set_value_batch_callback(hpd_listener_t *listener, hpd_changes_f on_change_batch)
+{
+    listener->on_change_batch = on_change_batch;
+    return HPD_E_SUCCESS;
+}
+
 hpd_error_t event_set_log_callback(hpd_listener_t *listener, hpd_log_f on_log)
 {
     listener->on_log = on_log;
     return HPD_E_SUCCESS;
 }
 
+hpd_error_t event_set_log_record_callback(hpd_listener_t *listener, hpd_log_record_f on_log_record)
+{
+    listener->on_log_record = on_log_record;
+    return HPD_E_SUCCESS;
+}
+
+static hpd_error_t event_index_filter(hpd_configuration_t *configuration, hpd_filter_t *filter)
+{
+    hpd_error_t rc = HPD_E_SUCCESS;
+
+    switch (filter->type) {
+        case HPD_F_SERVICE:
+            rc = discovery_index_insert(&configuration->service_filters, &filter->index, filter->service->hash);
+            break;
+        case HPD_F_DEVICE:
+            rc = discovery_index_insert(&configuration->device_filters, &filter->index, filter->device->hash);
+            break;
+        case HPD_F_ADAPTER_PREFIX:
+            TAILQ_INSERT_TAIL(&configuration->prefix_filters, filter, prefix_field);
+            filter->index.indexed = HPD_TRUE;
+            break;
+    }
+
+    if (rc) LOG_RETURN_E_ALLOC(configuration->hpd);
+    return HPD_E_SUCCESS;
+}
+
+static void event_unindex_filter(hpd_configuration_t *configuration, hpd_filter_t *filter)
+{
+    switch (filter->type) {
+        case HPD_F_SERVICE:
+            discovery_index_remove(&configuration->service_filters, &filter->index);
+            break;
+        case HPD_F_DEVICE:
+            discovery_index_remove(&configuration->device_filters, &filter->index);
+            break;
+        case HPD_F_ADAPTER_PREFIX:
+            if (filter->index.indexed) TAILQ_REMOVE(&configuration->prefix_filters, filter, prefix_field);
+            filter->index.indexed = HPD_FALSE;
+            break;
+    }
+}
+
+static void event_unindex_filters(hpd_configuration_t *configuration, hpd_listener_t *listener)
+{
+    hpd_filter_t *filter;
+    TAILQ_FOREACH(filter, &listener->filters, HPD_TAILQ_FIELD) event_unindex_filter(configuration, filter);
+}
+
+/**
+ * Adds filter to listener, taking ownership of it. Filters of subscribed listeners are indexed right away.
+ */
+static hpd_error_t event_add_filter(hpd_listener_t *listener, hpd_filter_t *filter)
+{
+    hpd_error_t rc;
+
+    filter->listener = listener;
+    if (listener->subscribed) {
+        hpd_configuration_t *configuration = listener->context->hpd->configuration;
+        if ((rc = event_index_filter(configuration, filter))) {
+            event_free_filter(filter);
+            return rc;
+        }
+        if (TAILQ_EMPTY(&listener->filters))
+            TAILQ_REMOVE(&configuration->unfiltered, listener, unfiltered_field);
+    }
+    TAILQ_INSERT_TAIL(&listener->filters, filter, HPD_TAILQ_FIELD);
+    return HPD_E_SUCCESS;
+}
+
+hpd_error_t event_add_service_filter(hpd_listener_t *listener, const hpd_service_id_t *id)
+{
+    hpd_error_t rc;
+    hpd_filter_t *filter;
+
+    HPD_CALLOC(filter, 1, hpd_filter_t);
+    filter->type = HPD_F_SERVICE;
+    if ((rc = discovery_copy_sid(&filter->service, id))) {
+        event_free_filter(filter);
+        return rc;
+    }
+    return event_add_filter(listener, filter);
+
+    alloc_error:
+    LOG_RETURN_E_ALLOC(listener->context->hpd);
+}
+
+hpd_error_t event_add_device_filter(hpd_listener_t *listener, const hpd_device_id_t *id)
+{
+    hpd_error_t rc;
+    hpd_filter_t *filter;
+
+    HPD_CALLOC(filter, 1, hpd_filter_t);
+    filter->type = HPD_F_DEVICE;
+    if ((rc = discovery_copy_did(&filter->device, id))) {
+        event_free_filter(filter);
+        return rc;
+    }
+    return event_add_filter(listener, filter);
+
+    alloc_error:
+    LOG_RETURN_E_ALLOC(listener->context->hpd);
+}
+
+hpd_error_t event_add_adapter_filter(hpd_listener_t *listener, const char *prefix)
+{
+    hpd_filter_t *filter;
+
+    HPD_CALLOC(filter, 1, hpd_filter_t);
+    filter->type = HPD_F_ADAPTER_PREFIX;
+    HPD_STR_CPY(filter->prefix, prefix);
+    filter->prefix_len = strlen(prefix);
+    return event_add_filter(listener, filter);
+
+    alloc_error:
+    if (filter) event_free_filter(filter);
+    LOG_RETURN_E_ALLOC(listener->context->hpd);
+}
+
+hpd_error_t event_set_attr_filter_v(hpd_listener_t *listener, va_list vp)
+{
+    hpd_error_t rc;
+    hpd_t *hpd = listener->context->hpd;
+    hpd_map_t *attrs = NULL;
+    const char *key, *val;
+
+    while ((key = va_arg(vp, const char *))) {
+        val = va_arg(vp, const char *);
+        if (!val) {
+            if (attrs) hpd_map_free(attrs);
+            LOG_RETURN_E_NULL(hpd);
+        }
+        if ((!attrs && (rc = hpd_map_alloc(&attrs))) || (rc = hpd_map_set(attrs, key, val))) {
+            if (attrs) hpd_map_free(attrs);
+            LOG_RETURN(hpd, rc, "Failed to set attribute filter [code: %i].", rc);
+        }
+    }
+
+    if (listener->attrs) hpd_map_free(listener->attrs);
+    listener->attrs = attrs;
+    return HPD_E_SUCCESS;
+}
+
+static void event_on_coalesce_timeout(hpd_ev_loop_t *loop, ev_timer *w, int revents)
+{
+    hpd_listener_t *listener = w->data;
+    hpd_coalesce_t *coalesce = &listener->coalesce;
+
+    if (coalesce->count) listener->on_changes(listener->data, coalesce->changes, coalesce->count);
+    event_coalesce_clear(coalesce);
+}
+
+hpd_error_t event_set_coalescing(hpd_listener_t *listener, double window, hpd_changes_f on_changes)
+{
+    listener->on_changes = on_changes;
+    listener->coalesce.window = window;
+    ev_init(&listener->coalesce.timer, event_on_coalesce_timeout);
+    listener->coalesce.timer.data = listener;
+    return HPD_E_SUCCESS;
+}
+
+hpd_error_t event_get_coalesce_stats(const hpd_listener_t *listener, unsigned long *received, unsigned long *absorbed)
+{
+    if (received) (*received) = listener->coalesce.received;
+    if (absorbed) (*absorbed) = listener->coalesce.absorbed;
+    return HPD_E_SUCCESS;
+}
+
 hpd_error_t event_subscribe(hpd_listener_t *listener)
 {
-    TAILQ_INSERT_TAIL(&listener->context->hpd->configuration->listeners, listener, HPD_TAILQ_FIELD);
+    hpd_error_t rc;
+    hpd_t *hpd = listener->context->hpd;
+    hpd_configuration_t *configuration = hpd->configuration;
+
+    hpd_filter_t *filter;
+    TAILQ_FOREACH(filter, &listener->filters, HPD_TAILQ_FIELD) {
+        if ((rc = event_index_filter(configuration, filter))) {
+            event_unindex_filters(configuration, listener);
+            return rc;
+        }
+    }
+    if (TAILQ_EMPTY(&listener->filters))
+        TAILQ_INSERT_TAIL(&configuration->unfiltered, listener, unfiltered_field);
+    listener->subscribed = HPD_TRUE;
+
+    log_lock(hpd);
+    TAILQ_INSERT_TAIL(&configuration->listeners, listener, HPD_TAILQ_FIELD);
+    log_unlock(hpd);
     return HPD_E_SUCCESS;
 }
 
 hpd_error_t event_unsubscribe(hpd_listener_t *listener)
 {
-    if (listener) {
-        if (listener->on_free) listener->on_free(listener->data);
-        TAILQ_REMOVE(&listener->context->hpd->configuration->listeners, listener, HPD_TAILQ_FIELD);
-        free(listener);
+    if (listener && listener->subscribed) {
+        hpd_t *hpd = listener->context->hpd;
+        hpd_configuration_t *configuration = hpd->configuration;
+        // Deliver what was logged before the listener goes away, on_log() is called from the log writer
+        if (listener->on_log || listener->on_log_record) log_flush(hpd);
+        log_lock(hpd);
+        TAILQ_REMOVE(&configuration->listeners, listener, HPD_TAILQ_FIELD);
+        log_unlock(hpd);
+        if (TAILQ_EMPTY(&listener->filters))
+            TAILQ_REMOVE(&configuration->unfiltered, listener, unfiltered_field);
+        else
+            event_unindex_filters(configuration, listener);
+        // Changes that are held back are dropped along with the listener
+        if (hpd->loop) ev_timer_stop(hpd->loop, &listener->coalesce.timer);
+        if (listener->batch_count) TAILQ_REMOVE(&configuration->batched, listener, batch_field);
+        listener->subscribed = HPD_FALSE;
     }
+    if (listener) event_free_listener(listener);
     return HPD_E_SUCCESS;
 }
 
@@ -125,67 +370,240 @@ hpd_error_t event_foreach_attached(const hpd_listener_t *listener)
     TAILQ_FOREACH(adapter, &configuration->adapters, HPD_TAILQ_FIELD) {
         hpd_adapter_id_t *aid;
         if ((rc = discovery_alloc_aid(&aid, context, adapter->id))) return rc;
+        discovery_cache_aid(aid, adapter);
         listener->on_adp_attach(listener->data, aid);
         if ((rc = discovery_free_aid(aid))) return rc;
     }
     return HPD_E_SUCCESS;
 }
 
-static void event_on_changed(hpd_ev_loop_t *loop, ev_async *w, int revents)
+/**
+ * A pending change, the queue node and a copy of the service id in a single pool object. The value is not copied, its
+ * ownership is transferred from the caller of event_changed().
+ */
+typedef struct event_change {
+    hpd_ev_async_t async;       ///< Must be first, nodes are freed as changes
+    hpd_service_id_t service;   ///< Must be last, followed by its strings
+} event_change_t;
+
+/**
+ * Whether the service of id has the attributes in the attribute filter of listener. The service is looked up once per
+ * change, on the first listener with such a filter.
+ */
+static hpd_bool_t event_attrs_match(const hpd_listener_t *listener, const hpd_service_id_t *id,
+                                    hpd_service_t **service)
 {
     hpd_error_t rc;
-    hpd_ev_async_t *async = w->data;
-    hpd_t *hpd = async->hpd;
-    hpd_service_id_t *id = async->service;
-    hpd_value_t *value = async->value;
+    const hpd_pair_t *pair;
+    const char *key, *val, *val2;
 
-    TAILQ_REMOVE(&hpd->changed_watchers, async, HPD_TAILQ_FIELD);
-    ev_async_stop(loop, w);
-    free(async);
+    if (!listener->attrs) return HPD_TRUE;
+    if (!(*service) && discovery_find_service(id, service)) return HPD_FALSE;
 
-    hpd_listener_t *listener;
-    TAILQ_FOREACH(listener, &hpd->configuration->listeners, HPD_TAILQ_FIELD) {
-        if (listener->on_change) listener->on_change(listener->data, id, value);
+    hpd_map_foreach(rc, pair, listener->attrs) {
+        hpd_pair_get(pair, &key, &val);
+        hpd_map_get((*service)->attributes, key, &val2);
+        if (!val2 || strcmp(val, val2) != 0) return HPD_FALSE;
     }
+    return HPD_TRUE;
+}
 
-    if ((rc = discovery_free_sid(id))) {
-        LOG_ERROR(hpd, "free function failed [code: %i].", rc);
+static hpd_error_t event_coalesce_grow(hpd_coalesce_t *coalesce)
+{
+    size_t size = coalesce->size ? coalesce->size * 2 : 16;
+    hpd_change_t *changes = realloc(coalesce->changes, size * sizeof(hpd_change_t));
+    if (!changes) return HPD_E_ALLOC;
+    coalesce->changes = changes;
+    size_t *slots = calloc(size * 2, sizeof(size_t));
+    if (!slots) return HPD_E_ALLOC;
+    free(coalesce->slots);
+    coalesce->slots = slots;
+    coalesce->slots_size = size * 2;
+    coalesce->size = size;
+
+    size_t mask = coalesce->slots_size - 1;
+    for (size_t i = 0; i < coalesce->count; i++) {
+        size_t slot = coalesce->changes[i].service->hash & mask;
+        while (slots[slot]) slot = (slot + 1) & mask;
+        slots[slot] = i + 1;
     }
+    return HPD_E_SUCCESS;
+}
 
-    if ((rc = value_free(value))) {
-        LOG_ERROR(hpd, "free function failed [code: %i].", rc);
+/**
+ * Holds back a change for a coalescing listener, replacing the value of an earlier change to the same service. The
+ * first change held back starts the timer, which delivers them all.
+ */
+static hpd_error_t event_coalesce(hpd_listener_t *listener, const hpd_service_id_t *id, hpd_value_t *value)
+{
+    hpd_error_t rc;
+    hpd_t *hpd = listener->context->hpd;
+    hpd_coalesce_t *coalesce = &listener->coalesce;
+    hpd_change_t *change;
+    size_t i, slot, mask;
+
+    coalesce->received++;
+    if (coalesce->count == coalesce->size && event_coalesce_grow(coalesce)) LOG_RETURN_E_ALLOC(hpd);
+
+    mask = coalesce->slots_size - 1;
+    for (i = id->hash & mask; (slot = coalesce->slots[i]); i = (i + 1) & mask) {
+        change = &coalesce->changes[slot - 1];
+        if (discovery_sid_equal(change->service, id)) {
+            value_free((hpd_value_t *) change->value);
+            change->value = value_ref(value);
+            coalesce->absorbed++;
+            return HPD_E_SUCCESS;
+        }
+    }
+
+    hpd_service_id_t *copy;
+    if ((rc = discovery_copy_sid(&copy, id))) return rc;
+    change = &coalesce->changes[coalesce->count];
+    change->service = copy;
+    change->value = value_ref(value);
+    coalesce->slots[i] = ++coalesce->count;
+
+    if (!ev_is_active(&coalesce->timer)) {
+        ev_timer_set(&coalesce->timer, coalesce->window, 0);
+        ev_timer_start(hpd->loop, &coalesce->timer);
     }
+    return HPD_E_SUCCESS;
 }
 
-hpd_error_t event_changed(const hpd_service_id_t *id, hpd_value_t *val)
+/**
+ * Adds a change to the batch of listener, which is delivered when all changes taken from the queue are dispatched. Ids
+ * and values are not copied, they outlive the batch.
+ */
+static hpd_error_t event_batch(hpd_listener_t *listener, const hpd_service_id_t *id, const hpd_value_t *value)
 {
-    hpd_error_t rc = HPD_E_ALLOC;
-    hpd_ev_async_t *async;
-    hpd_t *hpd = id->device.adapter.context->hpd;
-    HPD_CALLOC(async, 1, hpd_ev_async_t);
-    HPD_CPY_ALLOC(async->value, val, hpd_value_t);
-    if ((rc = discovery_copy_sid(&async->service, id))) goto copy_sid_error;
-    async->hpd = hpd;
-    ev_async_init(&async->watcher, event_on_changed);
-    async->watcher.data = async;
-    ev_async_start(hpd->loop, &async->watcher);
-    ev_async_send(hpd->loop, &async->watcher);
-    TAILQ_INSERT_TAIL(&hpd->changed_watchers, async, HPD_TAILQ_FIELD);
-    free(val);
+    if (listener->batch_count == listener->batch_size) {
+        size_t size = listener->batch_size ? listener->batch_size * 2 : 16;
+        hpd_change_t *batch = realloc(listener->batch, size * sizeof(hpd_change_t));
+        if (!batch) LOG_RETURN_E_ALLOC(listener->context->hpd);
+        listener->batch = batch;
+        listener->batch_size = size;
+    }
+
+    if (!listener->batch_count)
+        TAILQ_INSERT_TAIL(&listener->context->hpd->configuration->batched, listener, batch_field);
+    listener->batch[listener->batch_count].service = id;
+    listener->batch[listener->batch_count].value = value;
+    listener->batch_count++;
     return HPD_E_SUCCESS;
+}
 
-    copy_sid_error:
-    free(async->value);
-    alloc_error:
-    free(async);
-    switch (rc) {
-        case HPD_E_ALLOC:
-            LOG_RETURN_E_ALLOC(hpd);
-        default:
-            return rc;
+static void event_deliver_change(hpd_listener_t *listener, unsigned long change, const hpd_service_id_t *id,
+                                 hpd_value_t *value, hpd_service_t **service)
+{
+    hpd_error_t rc;
+
+    if ((!listener->on_change && !listener->on_changes && !listener->on_change_batch) || listener->changes == change)
+        return;
+    listener->changes = change;
+    if (!event_attrs_match(listener, id, service)) return;
+    if (listener->on_changes) {
+        if ((rc = event_coalesce(listener, id, value)))
+            LOG_ERROR(listener->context->hpd, "Failed to hold back change [code: %i].", rc);
+    } else if (listener->on_change_batch) {
+        if ((rc = event_batch(listener, id, value)))
+            LOG_ERROR(listener->context->hpd, "Failed to add change to batch [code: %i].", rc);
+    } else {
+        listener->on_change(listener->data, id, value);
+    }
+}
+
+/**
+ * Calls the listeners without id filters, and those with a filter matching id, found in the filter indices. Each
+ * listener is called at most once, even if several of its filters match.
+ */
+static void event_on_changed(hpd_t *hpd, hpd_service_id_t *id, hpd_value_t *value)
+{
+    hpd_configuration_t *configuration = hpd->configuration;
+    unsigned long change = ++configuration->changes;
+    hpd_service_t *service = NULL;
+
+    hpd_listener_t *listener, *listener_tmp;
+    TAILQ_FOREACH_SAFE(listener, &configuration->unfiltered, unfiltered_field, listener_tmp) {
+        event_deliver_change(listener, change, id, value, &service);
+    }
+
+    hpd_index_node_t *node, *next;
+    hpd_filter_t *filter, *filter_tmp;
+    for (node = discovery_index_bucket(&configuration->service_filters, id->hash); node; node = next) {
+        next = node->next;
+        filter = (hpd_filter_t *) node;
+        if (discovery_sid_equal(filter->service, id))
+            event_deliver_change(filter->listener, change, id, value, &service);
+    }
+    for (node = discovery_index_bucket(&configuration->device_filters, id->device.hash); node; node = next) {
+        next = node->next;
+        filter = (hpd_filter_t *) node;
+        if (discovery_did_equal(filter->device, &id->device))
+            event_deliver_change(filter->listener, change, id, value, &service);
+    }
+    TAILQ_FOREACH_SAFE(filter, &configuration->prefix_filters, prefix_field, filter_tmp) {
+        if (strncmp(id->device.adapter.aid, filter->prefix, filter->prefix_len) == 0)
+            event_deliver_change(filter->listener, change, id, value, &service);
+    }
+}
+
+/**
+ * Calls each listener that has changes in a batch, in the order the batches were started.
+ */
+static void event_deliver_batches(hpd_t *hpd)
+{
+    hpd_listener_t *listener;
+    size_t count;
+
+    // Callbacks may free other listeners, which removes them from the list, so always take the first
+    while ((listener = TAILQ_FIRST(&hpd->configuration->batched))) {
+        TAILQ_REMOVE(&hpd->configuration->batched, listener, batch_field);
+        count = listener->batch_count;
+        listener->batch_count = 0;
+        listener->on_change_batch(listener->data, listener->batch, count);
     }
 }
 
+void event_on_changed_queue(hpd_ev_loop_t *loop, ev_async *w, int revents)
+{
+    hpd_error_t rc;
+    hpd_t *hpd = w->data;
+    hpd_ev_asyncs_t items;
+    hpd_ev_async_t *async, *async_tmp;
+
+    daemon_queue_take(&hpd->changed_queue, &items);
+    TAILQ_FOREACH(async, &items, HPD_TAILQ_FIELD) {
+        event_on_changed(hpd, async->service, async->value);
+    }
+
+    // Batches point to the ids and values of the changes, so these are kept until all batches are delivered
+    event_deliver_batches(hpd);
+
+    TAILQ_FOREACH_SAFE(async, &items, HPD_TAILQ_FIELD, async_tmp) {
+        TAILQ_REMOVE(&items, async, HPD_TAILQ_FIELD);
+        if ((rc = value_free(async->value))) {
+            LOG_ERROR(hpd, "free function failed [code: %i].", rc);
+        }
+        pool_free(async);
+    }
+}
+
+hpd_error_t event_changed(const hpd_service_id_t *id, hpd_value_t *val)
+{
+    hpd_error_t rc;
+    event_change_t *change;
+    hpd_t *hpd = id->device.adapter.context->hpd;
+    change = pool_alloc(&hpd->pool, HPD_P_CHANGE, offsetof(event_change_t, service) + discovery_sid_size(id));
+    if (!change) LOG_RETURN_E_ALLOC(hpd);
+    discovery_copy_sid_to(&change->service, id);
+    change->async.hpd = hpd;
+    change->async.service = &change->service;
+    change->async.value = val;
+    // The value stays with the caller if the change is refused
+    if ((rc = daemon_queue_push(hpd, &hpd->changed_queue, &change->async))) pool_free(change);
+    return rc;
+}
+
 hpd_error_t event_inform_adp_attached(hpd_adapter_t *adapter)
 {
     hpd_error_t rc;
@@ -195,6 +613,7 @@ hpd_error_t event_inform_adp_attached(hpd_adapter_t *adapter)
 
     hpd_adapter_id_t *aid;
     if ((rc = discovery_alloc_aid(&aid, context, adapter->id))) return rc;
+    discovery_cache_aid(aid, adapter);
     
     hpd_listener_t *listener;
     TAILQ_FOREACH(listener, &hpd->configuration->listeners, HPD_TAILQ_FIELD) {
@@ -213,6 +632,7 @@ hpd_error_t event_inform_adp_detached(hpd_adapter_t *adapter)
 
     hpd_adapter_id_t *aid;
     if ((rc = discovery_alloc_aid(&aid, context, adapter->id))) return rc;
+    discovery_cache_aid(aid, adapter);
 
     hpd_listener_t *listener;
     TAILQ_FOREACH(listener, &hpd->configuration->listeners, HPD_TAILQ_FIELD) {
@@ -231,6 +651,7 @@ hpd_error_t event_inform_adp_changed(hpd_adapter_t *adapter)
 
     hpd_adapter_id_t *aid;
     if ((rc = discovery_alloc_aid(&aid, context, adapter->id))) return rc;
+    discovery_cache_aid(aid, adapter);
 
     hpd_listener_t *listener;
     TAILQ_FOREACH(listener, &hpd->configuration->listeners, HPD_TAILQ_FIELD) {
@@ -250,6 +671,7 @@ hpd_error_t event_inform_dev_attached(hpd_device_t *device)
 
     hpd_device_id_t *did;
     if ((rc = discovery_alloc_did(&did, context, adapter->id, device->id))) return rc;
+    discovery_cache_did(did, device);
 
     hpd_listener_t *listener;
     TAILQ_FOREACH(listener, &hpd->configuration->listeners, HPD_TAILQ_FIELD) {
@@ -269,6 +691,7 @@ hpd_error_t event_inform_dev_detached(hpd_device_t *device)
 
     hpd_device_id_t *did;
     if ((rc = discovery_alloc_did(&did, context, adapter->id, device->id))) return rc;
+    discovery_cache_did(did, device);
 
     hpd_listener_t *listener;
     TAILQ_FOREACH(listener, &hpd->configuration->listeners, HPD_TAILQ_FIELD) {
@@ -288,6 +711,7 @@ hpd_error_t event_inform_dev_changed(hpd_device_t *device)
 
     hpd_device_id_t *did;
     if ((rc = discovery_alloc_did(&did, context, adapter->id, device->id))) return rc;
+    discovery_cache_did(did, device);
 
     hpd_listener_t *listener;
     TAILQ_FOREACH(listener, &hpd->configuration->listeners, HPD_TAILQ_FIELD) {
@@ -308,6 +732,7 @@ hpd_error_t event_inform_srv_attached(hpd_service_t *service)
 
     hpd_service_id_t *sid;
     if ((rc = discovery_alloc_sid(&sid, context, adapter->id, device->id, service->id))) return rc;
+    discovery_cache_sid(sid, service);
 
     hpd_listener_t *listener;
     TAILQ_FOREACH(listener, &hpd->configuration->listeners, HPD_TAILQ_FIELD) {
@@ -328,6 +753,7 @@ hpd_error_t event_inform_srv_detached(hpd_service_t *service)
 
     hpd_service_id_t *sid;
     if ((rc = discovery_alloc_sid(&sid, context, adapter->id, device->id, service->id))) return rc;
+    discovery_cache_sid(sid, service);
 
     hpd_listener_t *listener;
     TAILQ_FOREACH(listener, &hpd->configuration->listeners, HPD_TAILQ_FIELD) {
@@ -348,6 +774,7 @@ hpd_error_t event_inform_srv_changed(hpd_service_t *service)
 
     hpd_service_id_t *sid;
     if ((rc = discovery_alloc_sid(&sid, context, adapter->id, device->id, service->id))) return rc;
+    discovery_cache_sid(sid, service);
 
     hpd_listener_t *listener;
     TAILQ_FOREACH(listener, &hpd->configuration->listeners, HPD_TAILQ_FIELD) {
@@ -359,11 +786,22 @@ hpd_error_t event_inform_srv_changed(hpd_service_t *service)
 
 hpd_error_t event_log(hpd_t *hpd, const char *msg)
 {
-    hpd_listener_t *listener;
+    hpd_listener_t *listener, *tmp;
     if (hpd->configuration) {
-        TAILQ_FOREACH(listener, &hpd->configuration->listeners, HPD_TAILQ_FIELD) {
+        TAILQ_FOREACH_SAFE(listener, &hpd->configuration->listeners, HPD_TAILQ_FIELD, tmp) {
             if (listener->on_log) listener->on_log(listener->data, msg);
         }
     }
     return HPD_E_SUCCESS;
 }
+
+hpd_error_t event_log_record(hpd_t *hpd, const hpd_log_record_t *record)
+{
+    hpd_listener_t *listener, *tmp;
+    if (hpd->configuration) {
+        TAILQ_FOREACH_SAFE(listener, &hpd->configuration->listeners, HPD_TAILQ_FIELD, tmp) {
+            if (listener->on_log_record) listener->on_log_record(listener->data, record);
+        }
+    }
+    return HPD_E_SUCCESS;
+}
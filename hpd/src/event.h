@@ -33,16 +33,26 @@ extern "C" {
 #endif
 
 #include "hpd-0.6/hpd_types.h"
+#include <ev.h>
+#include <stdarg.h>
 
 hpd_error_t event_alloc_listener(hpd_listener_t **listener, const hpd_module_t *context);
 hpd_error_t event_free_listener(hpd_listener_t *listener);
 
 hpd_error_t event_set_listener_data(hpd_listener_t *listener, void *data, hpd_free_f on_free);
 hpd_error_t event_set_value_callback(hpd_listener_t *listener, hpd_value_f on_change);
+hpd_error_t event_set_value_batch_callback(hpd_listener_t *listener, hpd_changes_f on_change_batch);
 hpd_error_t event_set_adapter_callback(hpd_listener_t *listener, hpd_adapter_f on_attach, hpd_adapter_f on_detach, hpd_adapter_f on_change);
 hpd_error_t event_set_device_callback(hpd_listener_t *listener, hpd_device_f on_attach, hpd_device_f on_detach, hpd_device_f on_change);
 hpd_error_t event_set_service_callback(hpd_listener_t *listener, hpd_service_f on_attach, hpd_service_f on_detach, hpd_service_f on_change);
 hpd_error_t event_set_log_callback(hpd_listener_t *listener, hpd_log_f on_log);
+hpd_error_t event_set_log_record_callback(hpd_listener_t *listener, hpd_log_record_f on_log_record);
+hpd_error_t event_add_service_filter(hpd_listener_t *listener, const hpd_service_id_t *id);
+hpd_error_t event_add_device_filter(hpd_listener_t *listener, const hpd_device_id_t *id);
+hpd_error_t event_add_adapter_filter(hpd_listener_t *listener, const char *prefix);
+hpd_error_t event_set_attr_filter_v(hpd_listener_t *listener, va_list vp);
+hpd_error_t event_set_coalescing(hpd_listener_t *listener, double window, hpd_changes_f on_changes);
+hpd_error_t event_get_coalesce_stats(const hpd_listener_t *listener, unsigned long *received, unsigned long *absorbed);
 
 hpd_error_t event_subscribe(hpd_listener_t *listener);
 hpd_error_t event_unsubscribe(hpd_listener_t *listener);
@@ -52,6 +62,7 @@ hpd_error_t event_get_listener_data(const hpd_listener_t *listener, void **data)
 hpd_error_t event_foreach_attached(const hpd_listener_t *listener);
 
 hpd_error_t event_changed(const hpd_service_id_t *id, hpd_value_t *val);
+void event_on_changed_queue(hpd_ev_loop_t *loop, ev_async *w, int revents);
 
 hpd_error_t event_inform_adp_attached(hpd_adapter_t *adapter);
 hpd_error_t event_inform_adp_detached(hpd_adapter_t *adapter);
@@ -64,6 +75,7 @@ hpd_error_t event_inform_srv_detached(hpd_service_t *service);
 hpd_error_t event_inform_srv_changed(hpd_service_t *service);
 
 hpd_error_t event_log(hpd_t *hpd, const char *msg);
+hpd_error_t event_log_record(hpd_t *hpd, const hpd_log_record_t *record);
 
 #ifdef __cplusplus
 }
@@ -38,7 +38,6 @@ hpd_error_t hpd_id_changed(const hpd_service_id_t *id, hpd_value_t *val)
     if (!id) return HPD_E_NULL;
     hpd_t *hpd = id->device.adapter.context->hpd;
     if (!val) LOG_RETURN_E_NULL(hpd);
-    if (!hpd->loop) LOG_RETURN_HPD_STOPPED(hpd);
     return event_changed(id, val);
 }
 
@@ -58,6 +57,7 @@ hpd_error_t hpd_changed(const hpd_service_t *service, hpd_value_t *val)
     if ((rc = discovery_alloc_sid(&sid, context,
                                   service->device->adapter->id, service->device->id, service->id)))
         return rc;
+    discovery_cache_sid(sid, (hpd_service_t *) service);
 
     rc = event_changed(sid, val);
 
@@ -88,6 +88,12 @@ hpd_error_t hpd_listener_set_value_callback(hpd_listener_t *listener, hpd_value_
     return event_set_value_callback(listener, on_change);
 }
 
+hpd_error_t hpd_listener_set_value_batch_callback(hpd_listener_t *listener, hpd_changes_f on_change_batch)
+{
+    if (!listener) return HPD_E_NULL;
+    return event_set_value_batch_callback(listener, on_change_batch);
+}
+
 hpd_error_t hpd_listener_set_adapter_callback(hpd_listener_t *listener, hpd_adapter_f on_attach, hpd_adapter_f on_detach, hpd_adapter_f on_change)
 {
     if (!listener) return HPD_E_NULL;
@@ -112,13 +118,71 @@ hpd_error_t hpd_listener_set_log_callback(hpd_listener_t *listener, hpd_log_f on
     return event_set_log_callback(listener, on_log);
 }
 
+hpd_error_t hpd_listener_set_log_record_callback(hpd_listener_t *listener, hpd_log_record_f on_log_record)
+{
+    if (!listener) return HPD_E_NULL;
+    return event_set_log_record_callback(listener, on_log_record);
+}
+
+hpd_error_t hpd_listener_add_service_filter(hpd_listener_t *listener, const hpd_service_id_t *id)
+{
+    if (!listener) return HPD_E_NULL;
+    if (!id) LOG_RETURN_E_NULL(listener->context->hpd);
+    return event_add_service_filter(listener, id);
+}
+
+hpd_error_t hpd_listener_add_device_filter(hpd_listener_t *listener, const hpd_device_id_t *id)
+{
+    if (!listener) return HPD_E_NULL;
+    if (!id) LOG_RETURN_E_NULL(listener->context->hpd);
+    return event_add_device_filter(listener, id);
+}
+
+hpd_error_t hpd_listener_add_adapter_filter(hpd_listener_t *listener, const char *prefix)
+{
+    if (!listener) return HPD_E_NULL;
+    if (!prefix) LOG_RETURN_E_NULL(listener->context->hpd);
+    return event_add_adapter_filter(listener, prefix);
+}
+
+hpd_error_t hpd_listener_set_attr_filter(hpd_listener_t *listener, ...)
+{
+    if (!listener) return HPD_E_NULL;
+
+    va_list vp;
+    va_start(vp, listener);
+    hpd_error_t rc = event_set_attr_filter_v(listener, vp);
+    va_end(vp);
+
+    return rc;
+}
+
+hpd_error_t hpd_listener_set_coalescing(hpd_listener_t *listener, double window, hpd_changes_f on_changes)
+{
+    if (!listener) return HPD_E_NULL;
+    hpd_t *hpd = listener->context->hpd;
+    if (window < 0) LOG_RETURN(hpd, HPD_E_ARGUMENT, "Window cannot be negative.");
+    if (listener->subscribed) LOG_RETURN(hpd, HPD_E_STATE, "Coalescing must be set before subscribing.");
+    return event_set_coalescing(listener, window, on_changes);
+}
+
+hpd_error_t hpd_listener_get_coalesce_stats(const hpd_listener_t *listener, unsigned long *received,
+                                            unsigned long *absorbed)
+{
+    if (!listener) return HPD_E_NULL;
+    if (!received && !absorbed) LOG_RETURN_E_NULL(listener->context->hpd);
+    return event_get_coalesce_stats(listener, received, absorbed);
+}
+
 hpd_error_t hpd_subscribe(hpd_listener_t *listener)
 {
     if (!listener) return HPD_E_NULL;
     hpd_t *hpd = listener->context->hpd;
-    if (!listener->on_change && !listener->on_dev_attach && !listener->on_dev_detach && !listener->on_log)
+    if (!listener->on_change && !listener->on_changes && !listener->on_change_batch && !listener->on_dev_attach && !listener->on_dev_detach && !listener->on_log &&
+        !listener->on_log_record)
         LOG_RETURN(hpd, HPD_E_ARGUMENT, "Listener do not contain any callbacks.");
     if (!hpd->configuration) LOG_RETURN_HPD_STOPPED(hpd);
+    if (listener->subscribed) LOG_RETURN(hpd, HPD_E_STATE, "Listener is already subscribed.");
     return event_subscribe(listener);
 }
 
@@ -29,12 +29,11 @@
 #include "daemon.h"
 #include "event.h"
 
-#ifdef THREAD_SAFE
-#include <pthread.h>
-#endif
+#include <errno.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
-#include <time.h>
+#include <unistd.h>
 
 #define COLOR_BLACK    "\x1b[30m"
 #define COLOR_RED      "\x1b[31m"
@@ -54,8 +53,347 @@
 #define COLOR_BWHITE   "\x1b[97m"
 #define COLOR_RESET    "\x1b[0m"
 
+#define LOG_TRUNCATED "[...]"
+
+static const char *log_type(hpd_log_level_t level)
+{
+    switch (level) {
+        case HPD_L_ERROR: return "ERROR";
+        case HPD_L_WARN: return "WARNING";
+        case HPD_L_INFO: return "INFO";
+        case HPD_L_DEBUG: return "DEBUG";
+        case HPD_L_VERBOSE: return "VERBOSE";
+        default: return NULL;
+    }
+}
+
+static const char *log_color(hpd_log_level_t level)
+{
+    switch (level) {
+        case HPD_L_ERROR: return COLOR_RED;
+        case HPD_L_WARN: return COLOR_YELLOW;
+        case HPD_L_INFO: return COLOR_BLACK;
+        case HPD_L_DEBUG: return COLOR_WHITE;
+        case HPD_L_VERBOSE: return COLOR_BBLACK;
+        default: return COLOR_RESET;
+    }
+}
+
+static void log_write(hpd_t *hpd)
+{
+    log_sink_t *sink = &hpd->log_sink;
+    struct iovec *iov = sink->iov;
+    int iovcnt = sink->iovcnt;
+
+    if (!sink->iovcnt) return;
+
+    while (iovcnt > 0) {
+        ssize_t n = writev(STDERR_FILENO, iov, iovcnt);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        for (; iovcnt > 0 && (size_t) n >= iov->iov_len; iov++, iovcnt--) n -= iov->iov_len;
+        if (iovcnt > 0) {
+            iov->iov_base = (char *) iov->iov_base + n;
+            iov->iov_len -= n;
+        }
+    }
+
+    sink->len = 0;
+    sink->iovcnt = 0;
+}
+
+static int log_print_line(char *dst, size_t size, const char *time_str, const char *module, const char *type,
+                          const char *mline, int mlen, const char *file, int line)
+{
+    int mpad = 12 - (int) strlen(module);
+    int lpad = 128 - mlen;
+    return snprintf(dst, size, "%s [%s]%*s %8s: %.*s%*s  %s:%d\n",
+                    time_str, module, mpad > 0 ? mpad : 0, "", type, mlen, mline, lpad > 0 ? lpad : 0, "",
+                    file, line);
+}
+
+static void log_add_text(hpd_t *hpd, hpd_log_level_t level, char *text, size_t len)
+{
+    log_sink_t *sink = &hpd->log_sink;
+
+    if (hpd->log_colored) {
+        sink->iov[sink->iovcnt].iov_base = (void *) log_color(level);
+        sink->iov[sink->iovcnt++].iov_len = strlen(log_color(level));
+        sink->iov[sink->iovcnt].iov_base = text;
+        sink->iov[sink->iovcnt++].iov_len = len;
+        sink->iov[sink->iovcnt].iov_base = COLOR_RESET;
+        sink->iov[sink->iovcnt++].iov_len = strlen(COLOR_RESET);
+    } else if (sink->iovcnt > 0 && (char *) sink->iov[sink->iovcnt-1].iov_base + sink->iov[sink->iovcnt-1].iov_len == text) {
+        sink->iov[sink->iovcnt-1].iov_len += len;
+    } else {
+        sink->iov[sink->iovcnt].iov_base = text;
+        sink->iov[sink->iovcnt++].iov_len = len;
+    }
+
+    // Listeners get one call per line, as the text is still terminated here
+    log_lock(hpd);
+    event_log(hpd, text);
+    log_unlock(hpd);
+}
+
+static void log_append_line(hpd_t *hpd, const log_record_t *record, const char *mline, int mlen)
+{
+    log_sink_t *sink = &hpd->log_sink;
+    const char *type = log_type(record->level);
+    const char *fn = strrchr(record->file, '/');
+    const char *file = fn ? &fn[1] : record->file;
+
+    if (sink->iovcnt + 3 > LOG_IOV_MAX) log_write(hpd);
+
+    size_t size = LOG_BUFFER_SIZE - sink->len;
+    int len = log_print_line(&sink->buffer[sink->len], size, sink->time_str, record->module, type, mline, mlen, file,
+                             record->line);
+    if (len < 0) return;
+    if ((size_t) len >= size && sink->len) {
+        log_write(hpd);
+        size = LOG_BUFFER_SIZE;
+        len = log_print_line(sink->buffer, size, sink->time_str, record->module, type, mline, mlen, file,
+                             record->line);
+        if (len < 0) return;
+    }
+
+    if ((size_t) len >= size) {
+        // Does not fit in an empty buffer either, written on its own
+        char *text = malloc((size_t) len + 1);
+        if (!text) return;
+        if (log_print_line(text, (size_t) len + 1, sink->time_str, record->module, type, mline, mlen, file,
+                           record->line) == len) {
+            log_add_text(hpd, record->level, text, (size_t) len);
+            log_write(hpd);
+        }
+        free(text);
+        return;
+    }
+
+    log_add_text(hpd, record->level, &sink->buffer[sink->len], (size_t) len);
+    sink->len += (size_t) len;
+}
+
+static void log_append(hpd_t *hpd, const log_record_t *record)
+{
+    log_sink_t *sink = &hpd->log_sink;
+
+    // Consecutive records mostly share the same second
+    if (record->time.tv_sec != sink->time || !sink->time_str[0]) {
+        struct tm tm_info;
+        localtime_r(&record->time.tv_sec, &tm_info);
+        strftime(sink->time_str, sizeof(sink->time_str), "%Y/%m/%d %H:%M:%S", &tm_info);
+        sink->time = record->time.tv_sec;
+    }
+
+    // Split into lines on newline character, skipping empty lines
+    const char *mline = record->text;
+    while (*mline) {
+        const char *end = strchr(mline, '\n');
+        if (!end) end = &mline[strlen(mline)];
+        if (end != mline) log_append_line(hpd, record, mline, (int) (end - mline));
+        mline = *end ? &end[1] : end;
+    }
+}
+
+static void log_dispatch(hpd_t *hpd, const log_record_t *record)
+{
+    hpd_log_record_t log_record = {
+            .time = (unsigned long long) record->time.tv_sec * 1000000 + record->time.tv_nsec / 1000,
+            .level = record->level,
+            .module = record->module,
+            .file = record->file,
+            .line = record->line,
+            .msg = record->text,
+            .len = strlen(record->text),
+    };
+    log_lock(hpd);
+    event_log_record(hpd, &log_record);
+    log_unlock(hpd);
+}
+
+static void log_append_dropped(hpd_t *hpd, unsigned long dropped)
+{
+    log_record_t record = {
+            .level = HPD_L_WARN,
+            .line = __LINE__,
+            .file = __FILE__,
+            .module = HPD_LOG_MODULE,
+    };
+    record.text = record.msg;
+    clock_gettime(CLOCK_REALTIME, &record.time);
+    snprintf(record.msg, LOG_MSG_MAX, "Log ring full, %lu messages were dropped.", dropped);
+    log_append(hpd, &record);
+    log_dispatch(hpd, &record);
+}
+
+/**
+ * Write every record that is ready. Only called by the writer, or with THREAD_SAFE undefined by the thread that added
+ * the record.
+ */
+static void log_drain(hpd_t *hpd)
+{
+    log_sink_t *sink = &hpd->log_sink;
+
+    for (;;) {
+        unsigned long dropped = __atomic_exchange_n(&sink->dropped, 0, __ATOMIC_RELAXED);
+        if (dropped) log_append_dropped(hpd, dropped);
+
+        log_record_t *record = &sink->records[sink->head & (LOG_RING_SIZE-1)];
+        if (__atomic_load_n(&record->seq, __ATOMIC_SEQ_CST) != sink->head+1) break;
+        log_append(hpd, record);
+        log_dispatch(hpd, record);
+        if (record->text != record->msg) free(record->text);
+        // The text has been copied out, hand the record back to the producers
+        __atomic_store_n(&record->seq, sink->head + LOG_RING_SIZE, __ATOMIC_RELEASE);
+        sink->head++;
+    }
+
+    log_write(hpd);
+    __atomic_store_n(&sink->written, sink->head, __ATOMIC_RELEASE);
+}
+
+#ifdef THREAD_SAFE
+static hpd_bool_t log_ready(log_sink_t *sink)
+{
+    log_record_t *record = &sink->records[sink->head & (LOG_RING_SIZE-1)];
+    return __atomic_load_n(&record->seq, __ATOMIC_SEQ_CST) == sink->head+1 ||
+           __atomic_load_n(&sink->dropped, __ATOMIC_RELAXED);
+}
+
+static void *log_writer(void *data)
+{
+    hpd_t *hpd = data;
+    log_sink_t *sink = &hpd->log_sink;
+
+    pthread_mutex_lock(&sink->mutex);
+    while (sink->running) {
+        pthread_mutex_unlock(&sink->mutex);
+        log_drain(hpd);
+        pthread_mutex_lock(&sink->mutex);
+        pthread_cond_broadcast(&sink->flushed);
+
+        // Producers check waiting after adding a record, so nothing is missed between the check and the wait
+        __atomic_store_n(&sink->waiting, HPD_TRUE, __ATOMIC_SEQ_CST);
+        while (sink->running && !log_ready(sink))
+            pthread_cond_wait(&sink->wake, &sink->mutex);
+        __atomic_store_n(&sink->waiting, HPD_FALSE, __ATOMIC_SEQ_CST);
+    }
+    pthread_mutex_unlock(&sink->mutex);
+
+    log_drain(hpd);
+    return NULL;
+}
+#endif
+
+hpd_error_t log_init(hpd_t *hpd)
+{
+    log_sink_t *sink = &hpd->log_sink;
+
+    sink->records = calloc(LOG_RING_SIZE, sizeof(log_record_t));
+    if (!sink->records) return HPD_E_ALLOC;
+    for (unsigned long i = 0; i < LOG_RING_SIZE; i++) sink->records[i].seq = i;
+
+#ifdef THREAD_SAFE
+    pthread_mutexattr_t attr;
+    // Listeners may unsubscribe from within their own on_log callback
+    if (pthread_mutexattr_init(&attr)) goto mutexattr_error;
+    if (pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE)) goto log_mutex_error;
+    if (pthread_mutex_init(&hpd->log_mutex, &attr)) goto log_mutex_error;
+    if (pthread_mutex_init(&sink->mutex, NULL)) goto mutex_error;
+    if (pthread_cond_init(&sink->wake, NULL)) goto wake_error;
+    if (pthread_cond_init(&sink->flushed, NULL)) goto flushed_error;
+    sink->running = HPD_TRUE;
+    if (pthread_create(&sink->writer, NULL, log_writer, hpd)) goto thread_error;
+    pthread_mutexattr_destroy(&attr);
+#endif
+
+    return HPD_E_SUCCESS;
+
+#ifdef THREAD_SAFE
+    thread_error:
+    pthread_cond_destroy(&sink->flushed);
+    flushed_error:
+    pthread_cond_destroy(&sink->wake);
+    wake_error:
+    pthread_mutex_destroy(&sink->mutex);
+    mutex_error:
+    pthread_mutex_destroy(&hpd->log_mutex);
+    log_mutex_error:
+    pthread_mutexattr_destroy(&attr);
+    mutexattr_error:
+    free(sink->records);
+    sink->records = NULL;
+    return HPD_E_UNKNOWN;
+#endif
+}
+
+void log_destroy(hpd_t *hpd)
+{
+    log_sink_t *sink = &hpd->log_sink;
+
+#ifdef THREAD_SAFE
+    // The writer drains the ring once more before it exits
+    pthread_mutex_lock(&sink->mutex);
+    sink->running = HPD_FALSE;
+    pthread_cond_signal(&sink->wake);
+    pthread_mutex_unlock(&sink->mutex);
+    pthread_join(sink->writer, NULL);
+    pthread_cond_destroy(&sink->flushed);
+    pthread_cond_destroy(&sink->wake);
+    pthread_mutex_destroy(&sink->mutex);
+    pthread_mutex_destroy(&hpd->log_mutex);
+#endif
+
+    free(sink->records);
+    sink->records = NULL;
+}
+
+/**
+ * Wait until everything logged so far has been written and handed to the listeners.
+ */
+void log_flush(hpd_t *hpd)
+{
+    log_sink_t *sink = &hpd->log_sink;
+
+#ifdef THREAD_SAFE
+    if (pthread_equal(pthread_self(), sink->writer)) return;
+    unsigned long tail = __atomic_load_n(&sink->tail, __ATOMIC_ACQUIRE);
+    pthread_mutex_lock(&sink->mutex);
+    while (sink->running && __atomic_load_n(&sink->written, __ATOMIC_ACQUIRE) < tail) {
+        pthread_cond_signal(&sink->wake);
+        pthread_cond_wait(&sink->flushed, &sink->mutex);
+    }
+    pthread_mutex_unlock(&sink->mutex);
+#else
+    if (!sink->draining) {
+        sink->draining = HPD_TRUE;
+        log_drain(hpd);
+        sink->draining = HPD_FALSE;
+    }
+#endif
+}
+
+void log_lock(hpd_t *hpd)
+{
+#ifdef THREAD_SAFE
+    pthread_mutex_lock(&hpd->log_mutex);
+#endif
+}
+
+void log_unlock(hpd_t *hpd)
+{
+#ifdef THREAD_SAFE
+    pthread_mutex_unlock(&hpd->log_mutex);
+#endif
+}
+
 hpd_error_t log_logf(hpd_t *hpd, const char *module, hpd_log_level_t level, const char *file, int line, const char *fmt, ...)
 {
+    if (level > hpd->hpd_log_level) return HPD_E_SUCCESS;
+
     hpd_error_t rc;
     va_list vp;
     va_start(vp, fmt);
@@ -66,98 +404,63 @@ hpd_error_t log_logf(hpd_t *hpd, const char *module, hpd_log_level_t level, cons
 
 hpd_error_t log_vlogf(hpd_t *hpd, const char *module, hpd_log_level_t level, const char *file, int line, const char *fmt, va_list vp)
 {
-    if (strcmp(module, HPD_LOG_MODULE) == 0 && level > hpd->hpd_log_level) return HPD_E_SUCCESS;
+    log_sink_t *sink = &hpd->log_sink;
 
-    // Set type string and color based on type
-    char *type = NULL;
-    char *color = "";
-    if (hpd->log_colored) color = COLOR_RESET;
-    switch (level) {
-        case HPD_L_NONE:
-            break;
-        case HPD_L_ERROR:
-            type = "ERROR";
-            if (hpd->log_colored) color = COLOR_RED;
-            break;
-        case HPD_L_WARN:
-            type = "WARNING";
-            if (hpd->log_colored) color = COLOR_YELLOW;
-            break;
-        case HPD_L_INFO:
-            type = "INFO";
-            if (hpd->log_colored) color = COLOR_BLACK;
-            break;
-        case HPD_L_DEBUG:
-            type = "DEBUG";
-            if (hpd->log_colored) color = COLOR_WHITE;
-            break;
-        case HPD_L_VERBOSE:
-            type = "VERBOSE";
-            if (hpd->log_colored) color = COLOR_BBLACK;
-            break;
+    if (!log_type(level)) LOG_RETURN(hpd, HPD_E_ARGUMENT, "Unknown log level.");
+    if (!sink->records) return HPD_E_STATE;
+
+    // Reserve a record, or drop the message if the writer is too far behind
+    log_record_t *record;
+    unsigned long pos = __atomic_load_n(&sink->tail, __ATOMIC_RELAXED);
+    for (;;) {
+        record = &sink->records[pos & (LOG_RING_SIZE-1)];
+        long diff = (long) (__atomic_load_n(&record->seq, __ATOMIC_ACQUIRE) - pos);
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&sink->tail, &pos, pos+1, HPD_TRUE, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                break;
+        } else if (diff < 0) {
+            __atomic_add_fetch(&sink->dropped, 1, __ATOMIC_RELAXED);
+            return HPD_E_SUCCESS;
+        } else {
+            pos = __atomic_load_n(&sink->tail, __ATOMIC_RELAXED);
+        }
     }
-    if (!type) LOG_RETURN(hpd, HPD_E_ARGUMENT, "Unknown log level.");
-
-    // Build time string
-    time_t timer;
-    char time_buffer[26];
-    struct tm* tm_info;
-    time(&timer);
-    tm_info = localtime(&timer);
-    strftime(time_buffer, 26, "%Y/%m/%d %H:%M:%S", tm_info);
-
-    // Build filename
-    const char *fn = &strrchr(file, '/')[1];
-    file = fn ? fn : file;
-
-    // Length of actual message
-    va_list  vp_copy;
+
+    // Arguments may not outlive this call, so the message itself is printed here
+    clock_gettime(CLOCK_REALTIME, &record->time);
+    record->level = level;
+    record->file = file;
+    record->line = line;
+    strncpy(record->module, module, LOG_MODULE_MAX-1);
+    record->module[LOG_MODULE_MAX-1] = '\0';
+    record->text = record->msg;
+    va_list vp_copy;
     va_copy(vp_copy, vp);
-    int mlen = vsnprintf(NULL, 0, fmt, vp_copy);
+    int len = vsnprintf(record->msg, LOG_MSG_MAX, fmt, vp_copy);
     va_end(vp_copy);
-    if (mlen < 0) return HPD_E_UNKNOWN;
-    size_t umlen = (unsigned int) mlen+1;
-
-    // Allocate actual message
-    char *msg = calloc(umlen, sizeof(char));
-    if (!msg) return HPD_E_ALLOC;
-    mlen = vsnprintf(msg, umlen, fmt, vp);
-    if (mlen < 0) return HPD_E_UNKNOWN;
-    
-    // Split into lines on newline character
-    for (char *mline = strtok(msg, "\n"); mline; mline = strtok(NULL, "\n")) {
-
-        // Length of full string
-        int slen = snprintf(NULL, 0, "%s [%s]%*s %8s: %s%*s  %s:%d\n",
-                            time_buffer, module, (int) (12 - strlen(module)), "", type, mline, (int) (128 - strlen(mline)), "", file, line);
-        if (slen < 0) return HPD_E_UNKNOWN;
-        size_t uslen = (unsigned int) slen+1;
-
-        // Allocate full message
-        char *fmsg = calloc(uslen, sizeof(char));
-        if (!fmsg) return HPD_E_ALLOC;
-        slen = snprintf(fmsg, uslen, "%s [%s]%*s %8s: %s%*s  %s:%d\n",
-                        time_buffer, module, (int) (12 - strlen(module)), "", type, mline, (int) (128 - strlen(mline)), "", file, line);
-        if (slen < 0) return HPD_E_UNKNOWN;
-
-#ifdef THREAD_SAFE
-        // TODO Better thing to do?
-        if (pthread_mutex_lock(&hpd->log_mutex)) return HPD_E_UNKNOWN;
-#endif
-
-        fprintf(stderr, "%s%s%s", color, fmsg, hpd->log_colored ? COLOR_RESET : "");
-        // TODO Using log methods inside on_log callbacks causes everything to freeze (above mutex lock)
-        event_log(hpd, fmsg);
+    if (len < 0) {
+        record->msg[0] = '\0';
+    } else if (len >= LOG_MSG_MAX) {
+        // Only long messages pay for an allocation, if that fails they are cut and marked as such
+        char *text = malloc((size_t) len + 1);
+        if (text && vsnprintf(text, (size_t) len + 1, fmt, vp) == len) {
+            record->text = text;
+        } else {
+            free(text);
+            strcpy(&record->msg[LOG_MSG_MAX - sizeof(LOG_TRUNCATED)], LOG_TRUNCATED);
+        }
+    }
+    __atomic_store_n(&record->seq, pos+1, __ATOMIC_SEQ_CST);
 
 #ifdef THREAD_SAFE
-        // TODO Better thing to do?
-        if (pthread_mutex_unlock(&hpd->log_mutex)) return HPD_E_UNKNOWN;
-#endif
-
-        free(fmsg);
-
+    if (__atomic_load_n(&sink->waiting, __ATOMIC_SEQ_CST)) {
+        pthread_mutex_lock(&sink->mutex);
+        pthread_cond_signal(&sink->wake);
+        pthread_mutex_unlock(&sink->mutex);
     }
+#else
+    log_flush(hpd);
+#endif
 
-    free(msg);
     return HPD_E_SUCCESS;
 }
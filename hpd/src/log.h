@@ -30,6 +30,11 @@
 
 #include "hpd-0.6/hpd_types.h"
 #include <stdarg.h>
+#include <time.h>
+#include <sys/uio.h>
+#ifdef THREAD_SAFE
+#include <pthread.h>
+#endif
 
 #ifdef __cplusplus
 extern "C" {
@@ -37,6 +42,62 @@ extern "C" {
 
 #define HPD_LOG_MODULE "hpd"
 
+#define LOG_RING_SIZE 256       ///< Records in the ring, must be a power of two
+#define LOG_MSG_MAX 512         ///< Longer messages are allocated
+#define LOG_MODULE_MAX 32
+#define LOG_BUFFER_SIZE 16384   ///< Text written per batch
+#define LOG_IOV_MAX 192
+
+typedef struct log_record log_record_t;
+typedef struct log_sink log_sink_t;
+
+struct log_record {
+    unsigned long seq;
+    struct timespec time;
+    hpd_log_level_t level;
+    int line;
+    const char *file;
+    char module[LOG_MODULE_MAX];
+    char *text;                 ///< Either msg, or an allocation for a message that does not fit in it
+    char msg[LOG_MSG_MAX];
+};
+
+/**
+ * Bounded multi-producer, single-consumer ring of log records. Any thread may log: the message is printed into a free
+ * record, and everything else (time, padding, colors) is left to a single writer, which turns a batch of records into
+ * text, writes it to stderr with one writev() and hands it to the log listeners. When the ring is full, records are
+ * dropped and counted instead of blocking the caller.
+ *
+ * Without THREAD_SAFE there is no writer thread, and the ring is drained right after each record is added.
+ */
+struct log_sink {
+    log_record_t *records;
+    unsigned long tail;     ///< Next record to reserve, shared by all producers
+    unsigned long head;     ///< Next record to write, owned by the writer
+    unsigned long written;  ///< Records written so far
+    unsigned long dropped;  ///< Records dropped since last reported
+    hpd_bool_t draining;
+    time_t time;
+    char time_str[26];
+    size_t len;
+    int iovcnt;
+    struct iovec iov[LOG_IOV_MAX];
+    char buffer[LOG_BUFFER_SIZE];
+#ifdef THREAD_SAFE
+    pthread_t writer;
+    pthread_mutex_t mutex;
+    pthread_cond_t wake;        ///< Signalled when a record is added while the writer is waiting
+    pthread_cond_t flushed;     ///< Broadcast when the writer has caught up
+    hpd_bool_t waiting;
+    hpd_bool_t running;
+#endif
+};
+
+hpd_error_t log_init(hpd_t *hpd);
+void log_destroy(hpd_t *hpd);
+void log_flush(hpd_t *hpd);
+void log_lock(hpd_t *hpd);
+void log_unlock(hpd_t *hpd);
 hpd_error_t log_logf(hpd_t *hpd, const char *module, hpd_log_level_t level, const char *file, int line, const char *fmt, ...);
 hpd_error_t log_vlogf(hpd_t *hpd, const char *module, hpd_log_level_t level, const char *file, int line, const char *fmt, va_list vp);
 
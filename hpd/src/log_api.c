@@ -27,6 +27,10 @@
 
 #include "log.h"
 #include "daemon.h"
+#include <stddef.h>
+
+_Static_assert(offsetof(hpd_module_t, log_level) == offsetof(hpd_module_head_t, log_level),
+               "The HPD_LOG_* macros read log_level through hpd_module_head_t");
 
 #ifdef THREAD_SAFE
 const int HPD_THREAD_SAFE = 1;
@@ -39,7 +43,7 @@ hpd_error_t hpd_logf(const hpd_module_t *context, hpd_log_level_t level, const c
     if (!context) return HPD_E_NULL;
     if (!fmt) LOG_RETURN_E_NULL(context->hpd);
 
-    if (level > context->log_level) return HPD_E_SUCCESS;
+    if (level > __atomic_load_n(&context->log_level, __ATOMIC_RELAXED)) return HPD_E_SUCCESS;
 
     hpd_error_t rc;
     va_list vp;
@@ -53,5 +57,24 @@ hpd_error_t hpd_vlogf(const hpd_module_t *context, hpd_log_level_t level, const
 {
     if (!context) return HPD_E_NULL;
     if (!fmt) LOG_RETURN_E_NULL(context->hpd);
+    if (level > __atomic_load_n(&context->log_level, __ATOMIC_RELAXED)) return HPD_E_SUCCESS;
     return log_vlogf(context->hpd, context->id, level, file, line, fmt, vp);
 }
+
+hpd_error_t hpd_module_set_log_level(const hpd_module_t *context, hpd_log_level_t level)
+{
+    if (!context) return HPD_E_NULL;
+    if (level < HPD_L_NONE || level > HPD_L_VERBOSE)
+        LOG_RETURN(context->hpd, HPD_E_ARGUMENT, "Unknown log level.");
+    // May be called from any thread, the HPD_LOG_* macros pick it up on their next check
+    __atomic_store_n(&((hpd_module_t *) context)->log_level, level, __ATOMIC_RELAXED);
+    return HPD_E_SUCCESS;
+}
+
+hpd_error_t hpd_module_get_log_level(const hpd_module_t *context, hpd_log_level_t *level)
+{
+    if (!context) return HPD_E_NULL;
+    if (!level) LOG_RETURN_E_NULL(context->hpd);
+    (*level) = __atomic_load_n(&context->log_level, __ATOMIC_RELAXED);
+    return HPD_E_SUCCESS;
+}
@@ -32,6 +32,8 @@
 #include "hpd-0.6/common/hpd_queue.h"
 #include "hpd-0.6/common/hpd_map.h"
 #include "comm.h"
+#include <stddef.h>
+#include <stdint.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -42,12 +44,54 @@ typedef struct hpd_adapters hpd_adapters_t;
 typedef struct hpd_devices hpd_devices_t;
 typedef struct hpd_services hpd_services_t;
 typedef struct hpd_parameters hpd_parameters_t;
+typedef struct hpd_index hpd_index_t;
+typedef struct hpd_index_node hpd_index_node_t;
 
 TAILQ_HEAD(hpd_adapters, hpd_adapter);
 TAILQ_HEAD(hpd_devices, hpd_device);
 TAILQ_HEAD(hpd_services, hpd_service);
 TAILQ_HEAD(hpd_parameters, hpd_parameter);
 
+/**
+ * Intrusive hash index over attached model objects, keyed by the hash of their full id tuple, e.g. (aid, did, sid)
+ * for services. Buckets are chained through the hpd_index_node embedded in each object.
+ */
+struct hpd_index {
+    hpd_index_node_t **buckets;
+    size_t size;  //< Number of buckets, zero or a power of two
+    size_t count; //< Number of nodes in the index
+};
+
+struct hpd_index_node {
+    hpd_index_node_t *next;
+    uint32_t hash;
+    hpd_bool_t indexed;
+};
+
+typedef enum hpd_filter_type {
+    HPD_F_SERVICE,          //< Changes to a single service
+    HPD_F_DEVICE,           //< Changes to any service on a device
+    HPD_F_ADAPTER_PREFIX,   //< Changes to any service on adapters with an id starting with a prefix
+} hpd_filter_type_t;
+
+/**
+ * A subscription filter of a listener. Service and device filters are indexed on the hash of their id, in
+ * service_filters and device_filters of the configuration, adapter prefixes are kept in a list.
+ */
+struct hpd_filter {
+    hpd_index_node_t index;     //< Must be first, nodes in the filter indices are cast to filters
+    TAILQ_ENTRY(hpd_filter) HPD_TAILQ_FIELD;
+    TAILQ_ENTRY(hpd_filter) prefix_field;
+    hpd_listener_t *listener;
+    hpd_filter_type_t type;
+    union {
+        hpd_service_id_t *service;
+        hpd_device_id_t *device;
+        char *prefix;
+    };
+    size_t prefix_len;
+};
+
 struct hpd_action {
     hpd_service_t *service;
     hpd_method_t method;           //< Method
@@ -59,6 +103,18 @@ struct hpd_configuration {
     hpd_adapters_t  adapters;
     hpd_listeners_t listeners;
     hpd_t *hpd;
+    // Lookup indices for attached objects
+    hpd_index_t adapter_index;
+    hpd_index_t device_index;
+    hpd_index_t service_index;
+    hpd_index_t parameter_index;
+    // Subscription filters of subscribed listeners
+    hpd_listeners_t unfiltered;     //< Listeners without id filters, these receive all changes
+    hpd_listeners_t batched;        //< Listeners with a batch waiting to be delivered
+    hpd_index_t service_filters;
+    hpd_index_t device_filters;
+    hpd_filters_t prefix_filters;
+    unsigned long changes;          //< Number of changes dispatched, used to call each listener once per change
 };
 
 struct hpd_adapter {
@@ -66,6 +122,7 @@ struct hpd_adapter {
     // Navigational members
     hpd_configuration_t *configuration;
     TAILQ_ENTRY(hpd_adapter) HPD_TAILQ_FIELD;
+    hpd_index_node_t index;
     hpd_devices_t *devices;
     // Data members
     char *id;
@@ -80,6 +137,7 @@ struct hpd_device {
     // Navigational members
     hpd_adapter_t *adapter;
     TAILQ_ENTRY(hpd_device) HPD_TAILQ_FIELD;
+    hpd_index_node_t index;
     hpd_services_t *services;
     // Data members
     char *id;
@@ -94,6 +152,7 @@ struct hpd_service {
     // Navigational members
     hpd_device_t *device;
     TAILQ_ENTRY(hpd_service) HPD_TAILQ_FIELD;
+    hpd_index_node_t index;
     hpd_parameters_t *parameters;
     // Data members
     char *id;
@@ -108,10 +167,13 @@ struct hpd_parameter {
     const hpd_module_t *context;
     hpd_service_t *service;
     TAILQ_ENTRY(hpd_parameter) HPD_TAILQ_FIELD;
+    hpd_index_node_t index;
     char *id;
     hpd_map_t *attributes;
 };
 
+#define HPD_INDEX_ENTRY(NODE, TYPE) ((TYPE *) ((char *) (NODE) - offsetof(TYPE, index)))
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,213 @@
+/*
+ * Copyright 2011 Aalborg University. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are
+ * permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of
+ * conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list
+ * of conditions and the following disclaimer in the documentation and/or other materials
+ * provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY Aalborg University ''AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL Aalborg University OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are those of the
+ * authors and should not be interpreted as representing official policies, either expressed
+ */
+
+
+#include "pool.h"
+#include "daemon.h"
+#include "log.h"
+#include <stdlib.h>
+#include <string.h>
+
+// gcc defines __SANITIZE_ADDRESS__, clang only reports it through __has_feature()
+#if defined(__has_feature)
+#if __has_feature(address_sanitizer)
+#define POOL_ASAN
+#endif
+#endif
+
+#if defined(__SANITIZE_ADDRESS__) || defined(POOL_ASAN)
+// Recycled objects would hide use after free from the sanitizer
+#undef POOL_CACHE_MAX
+#define POOL_CACHE_MAX 0
+#endif
+
+#define POOL_CLASS_SIZE(C) ((size_t) 64 << (C))
+
+/**
+ * Header in front of every object. It takes 16 bytes on 64 bit, so objects keep the alignment malloc() gives.
+ */
+struct pool_object {
+    union {
+        hpd_pool_t *pool;       ///< While in use
+        pool_object_t *next;    ///< While cached or returned
+    };
+    unsigned short size_class;  ///< POOL_CLASSES if the object is too large to be cached
+    unsigned short type;
+};
+
+static unsigned short pool_size_class(size_t size)
+{
+    unsigned short c;
+    for (c = 0; c < POOL_CLASSES; c++)
+        if (size <= POOL_CLASS_SIZE(c)) break;
+    return c;
+}
+
+static hpd_bool_t pool_is_owner(const hpd_pool_t *pool)
+{
+#ifdef THREAD_SAFE
+    return (hpd_bool_t) pthread_equal(pthread_self(), pool->owner);
+#else
+    return HPD_TRUE;
+#endif
+}
+
+static void pool_cache(hpd_pool_t *pool, pool_object_t *obj)
+{
+    unsigned short c = obj->size_class;
+    if (pool->cached_count[c] >= POOL_CACHE_MAX) {
+        free(obj);
+        return;
+    }
+    obj->next = pool->cached[c];
+    pool->cached[c] = obj;
+    pool->cached_count[c]++;
+}
+
+static void pool_take_returned(hpd_pool_t *pool)
+{
+#ifdef THREAD_SAFE
+    pool_object_t *obj, *next;
+    if (!__atomic_load_n(&pool->returned, __ATOMIC_RELAXED)) return;
+    for (obj = __atomic_exchange_n(&pool->returned, NULL, __ATOMIC_ACQUIRE); obj; obj = next) {
+        next = obj->next;
+        pool_cache(pool, obj);
+    }
+#endif
+}
+
+void pool_init(hpd_pool_t *pool)
+{
+    memset(pool, 0, sizeof(hpd_pool_t));
+    pool_set_owner(pool);
+}
+
+void pool_destroy(hpd_t *hpd, hpd_pool_t *pool)
+{
+    pool_object_t *obj, *next;
+    int type;
+    unsigned short c;
+
+    pool_take_returned(pool);
+    for (c = 0; c < POOL_CLASSES; c++) {
+        for (obj = pool->cached[c]; obj; obj = next) {
+            next = obj->next;
+            free(obj);
+        }
+        pool->cached[c] = NULL;
+        pool->cached_count[c] = 0;
+    }
+
+    for (type = 0; type < HPD_P_COUNT; type++)
+        if (pool->stats[type].live)
+            LOG_WARN(hpd, "%zu objects of pool type %i were never freed.", pool->stats[type].live, type);
+}
+
+/**
+ * Makes the calling thread the owner of the pool, hpd does this when it starts the event loop.
+ */
+void pool_set_owner(hpd_pool_t *pool)
+{
+#ifdef THREAD_SAFE
+    pool->owner = pthread_self();
+#endif
+}
+
+/**
+ * Allocates size bytes, to be freed with pool_free(). May be called on any thread, but only the owner reuses cached
+ * objects.
+ */
+void *pool_alloc(hpd_pool_t *pool, hpd_pool_type_t type, size_t size)
+{
+    size_t total = sizeof(pool_object_t) + size;
+    unsigned short c = pool_size_class(total);
+    pool_object_t *obj = NULL;
+
+    if (c < POOL_CLASSES && pool_is_owner(pool)) {
+        if (!pool->cached[c]) pool_take_returned(pool);
+        if ((obj = pool->cached[c])) {
+            pool->cached[c] = obj->next;
+            pool->cached_count[c]--;
+        }
+    }
+    // Allocate the full class size, so it can be cached when freed
+    if (!obj && !(obj = malloc(c < POOL_CLASSES ? POOL_CLASS_SIZE(c) : total))) return NULL;
+
+    obj->pool = pool;
+    obj->size_class = c;
+    obj->type = (unsigned short) type;
+
+    pool_stats_t *stats = &pool->stats[type];
+    size_t live = __atomic_add_fetch(&stats->live, 1, __ATOMIC_RELAXED);
+    size_t high_water = __atomic_load_n(&stats->high_water, __ATOMIC_RELAXED);
+    while (live > high_water &&
+           !__atomic_compare_exchange_n(&stats->high_water, &high_water, live, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+    return obj + 1;
+}
+
+/**
+ * Like pool_alloc(), but the memory is zeroed.
+ */
+void *pool_calloc(hpd_pool_t *pool, hpd_pool_type_t type, size_t size)
+{
+    void *ptr = pool_alloc(pool, type, size);
+    if (ptr) memset(ptr, 0, size);
+    return ptr;
+}
+
+/**
+ * Frees an object from pool_alloc() or pool_calloc(), on any thread. Objects freed on other threads than the owner are pushed onto the
+ * returned stack without locking.
+ */
+void pool_free(void *ptr)
+{
+    if (!ptr) return;
+
+    pool_object_t *obj = (pool_object_t *) ptr - 1;
+    hpd_pool_t *pool = obj->pool;
+
+    __atomic_sub_fetch(&pool->stats[obj->type].live, 1, __ATOMIC_RELAXED);
+
+    if (obj->size_class >= POOL_CLASSES) {
+        free(obj);
+    } else if (pool_is_owner(pool)) {
+        pool_cache(pool, obj);
+    } else {
+#ifdef THREAD_SAFE
+        obj->next = __atomic_load_n(&pool->returned, __ATOMIC_RELAXED);
+        while (!__atomic_compare_exchange_n(&pool->returned, &obj->next, obj, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+#endif
+    }
+}
+
+hpd_error_t pool_get_stats(hpd_pool_t *pool, hpd_pool_type_t type, size_t *live, size_t *high_water)
+{
+    if (live) (*live) = __atomic_load_n(&pool->stats[type].live, __ATOMIC_RELAXED);
+    if (high_water) (*high_water) = __atomic_load_n(&pool->stats[type].high_water, __ATOMIC_RELAXED);
+    return HPD_E_SUCCESS;
+}
@@ -0,0 +1,79 @@
+/*
+ * Copyright 2011 Aalborg University. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are
+ * permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of
+ * conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list
+ * of conditions and the following disclaimer in the documentation and/or other materials
+ * provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY Aalborg University ''AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL Aalborg University OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are those of the
+ * authors and should not be interpreted as representing official policies, either expressed
+ */
+
+#ifndef HOMEPORT_POOL_H
+#define HOMEPORT_POOL_H
+
+#include "hpd-0.6/hpd_types.h"
+#include <stddef.h>
+#ifdef THREAD_SAFE
+#include <pthread.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define POOL_CLASSES 5          ///< Size classes of 64, 128, 256, 512 and 1024 bytes, larger objects are not cached
+#define POOL_CACHE_MAX 1024     ///< Objects cached per size class, more are given back to malloc()
+
+typedef struct hpd_pool hpd_pool_t;
+typedef struct pool_object pool_object_t;
+typedef struct pool_stats pool_stats_t;
+
+struct pool_stats {
+    size_t live;
+    size_t high_water;
+};
+
+/**
+ * Free lists of recently freed objects, one per size class. They are only touched by the owner, the thread running the
+ * event loop, so they need no locking. Other threads allocate with malloc() and give objects back through returned.
+ */
+struct hpd_pool {
+    pool_object_t *cached[POOL_CLASSES];
+    size_t cached_count[POOL_CLASSES];
+    pool_stats_t stats[HPD_P_COUNT];
+#ifdef THREAD_SAFE
+    pthread_t owner;
+    pool_object_t *returned;    ///< Lock-free stack of objects freed on other threads, taken by the owner
+#endif
+};
+
+void pool_init(hpd_pool_t *pool);
+void pool_destroy(hpd_t *hpd, hpd_pool_t *pool);
+void pool_set_owner(hpd_pool_t *pool);
+void *pool_alloc(hpd_pool_t *pool, hpd_pool_type_t type, size_t size);
+void *pool_calloc(hpd_pool_t *pool, hpd_pool_type_t type, size_t size);
+void pool_free(void *ptr);
+hpd_error_t pool_get_stats(hpd_pool_t *pool, hpd_pool_type_t type, size_t *live, size_t *high_water);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //HOMEPORT_POOL_H
@@ -35,50 +35,48 @@
 #include "comm.h"
 #include "model.h"
 
+/**
+ * A request, its response, the queue node and the service id are carved from a single pool object, allocated in
+ * request_alloc_request(). Ownership moves by pointer from then on: the response and the node are used in place, and
+ * the block is freed along with the request, or with the response once that has been allocated.
+ */
+typedef struct request_block {
+    hpd_request_t request;      ///< Must be first, requests are cast to blocks
+    hpd_response_t response;
+    hpd_ev_async_t async;       ///< Queue node, used by the request and then by its response
+    hpd_service_id_t service;   ///< Must be last, followed by its strings
+} request_block_t;
+
 hpd_error_t request_alloc_request(hpd_request_t **request, const hpd_service_id_t *id, hpd_method_t method,
                                   hpd_response_f on_response)
 {
-    hpd_error_t rc = HPD_E_ALLOC;
-    HPD_CALLOC(*request, 1, hpd_request_t);
-    if ((rc = discovery_copy_sid(&(*request)->service, id))) goto alloc_error;
+    hpd_t *hpd = id->device.adapter.context->hpd;
+    request_block_t *block;
+    block = pool_calloc(&hpd->pool, HPD_P_REQUEST, offsetof(request_block_t, service) + discovery_sid_size(id));
+    if (!block) LOG_RETURN_E_ALLOC(hpd);
+    discovery_copy_sid_to(&block->service, id);
+    (*request) = &block->request;
+    (*request)->service = &block->service;
     (*request)->method = method;
     (*request)->on_response = on_response;
     return HPD_E_SUCCESS;
-
-    alloc_error:
-        request_free_request(*request);
-    switch (rc) {
-        case HPD_E_ALLOC:
-            LOG_RETURN_E_ALLOC(id->device.adapter.context->hpd);
-        default:
-            return rc;
-    }
 }
 
 hpd_error_t request_free_request(hpd_request_t *request)
 {
     if (request) {
         if (request->on_free) request->on_free(request->data);
-        if (request->service) discovery_free_sid(request->service);
         if (request->value) value_free(request->value);
-        free(request);
+        pool_free(request);
     }
     return HPD_E_SUCCESS;
 }
 
 hpd_error_t request_set_request_value(hpd_request_t *request, hpd_value_t *value)
 {
-    if (value) {
-        HPD_CPY_ALLOC(request->value, value, hpd_value_t);
-        free(value);
-    } else {
-        value_free(request->value);
-        request->value = NULL;
-    }
+    if (request->value && request->value != value) value_free(request->value);
+    request->value = value;
     return HPD_E_SUCCESS;
-
-    alloc_error:
-        LOG_RETURN_E_ALLOC(request->service->device.adapter.context->hpd);
 }
 
 hpd_error_t request_set_request_data(hpd_request_t *request, void *data, hpd_free_f on_free)
@@ -108,40 +106,28 @@ hpd_error_t request_get_request_value(const hpd_request_t *req, const hpd_value_
 
 hpd_error_t request_alloc_response(hpd_response_t **response, hpd_request_t *request, hpd_status_t status)
 {
-    HPD_CALLOC(*response, 1, hpd_response_t);
-    HPD_CPY_ALLOC((*response)->request, request, hpd_request_t);
-    free(request);
+    request_block_t *block = (request_block_t *) request;
+    (*response) = &block->response;
+    (*response)->request = request;
     (*response)->status = status;
+    (*response)->value = NULL;
     return HPD_E_SUCCESS;
-
-    alloc_error:
-    request_free_response(*response);
-        LOG_RETURN_E_ALLOC(request->service->device.adapter.context->hpd);
 }
 
 hpd_error_t request_free_response(hpd_response_t *response)
 {
     if (response) {
-        if (response->request) request_free_request(response->request);
         if (response->value) value_free(response->value);
-        free(response);
+        request_free_request(response->request);
     }
     return HPD_E_SUCCESS;
 }
 
 hpd_error_t request_set_response_value(hpd_response_t *response, hpd_value_t *value)
 {
-    if (value) {
-        HPD_CPY_ALLOC(response->value, value, hpd_value_t);
-        free(value);
-    } else {
-        value_free(response->value);
-        response->value = NULL;
-    }
+    if (response->value && response->value != value) value_free(response->value);
+    response->value = value;
     return HPD_E_SUCCESS;
-
-    alloc_error:
-    LOG_RETURN_E_ALLOC(response->request->service->device.adapter.context->hpd);
 }
 
 hpd_error_t request_get_response_status(const hpd_response_t *response, hpd_status_t *status)
@@ -180,21 +166,14 @@ hpd_error_t request_get_response_request_value(const hpd_response_t *response, c
     return HPD_E_SUCCESS;
 }
 
-static void request_on_request(hpd_ev_loop_t *loop, ev_async *w, int revents)
+static void request_on_request(hpd_t *hpd, hpd_request_t *request)
 {
     hpd_error_t rc;
-    hpd_ev_async_t *async = w->data;
-    hpd_request_t *request = async->request;
     hpd_service_id_t *service_id = request->service;
 
-    hpd_t *hpd = service_id->device.adapter.context->hpd;
     char *sid = service_id->sid;
     char *did = service_id->device.did;
     char *aid = service_id->device.adapter.aid;
-    
-    TAILQ_REMOVE(&hpd->request_watchers, async, HPD_TAILQ_FIELD);
-    ev_async_stop(loop, w);
-    free(async);
 
     hpd_service_t *service;
     hpd_response_t *response;
@@ -228,25 +207,20 @@ static void request_on_request(hpd_ev_loop_t *loop, ev_async *w, int revents)
     return;
 
     error_free_response:
+        // Also frees the request
         request_free_response(response);
+        LOG_ERROR(hpd, "on_request() failed [code: %i].", rc);
+        return;
     error_free_request:
         request_free_request(request);
         LOG_ERROR(hpd, "on_request() failed [code: %i].", rc);
         return;
 }
 
-static void request_on_respond(hpd_ev_loop_t *loop, ev_async *w, int revents)
+static void request_on_respond(hpd_t *hpd, hpd_response_t *response)
 {
     hpd_error_t rc;
-    hpd_ev_async_t *async = w->data;
-    hpd_response_t *response = async->response;
     hpd_request_t *request = response->request;
-    hpd_service_id_t *service_id = request->service;
-    hpd_t *hpd = service_id->device.adapter.context->hpd;
-
-    TAILQ_REMOVE(&hpd->respond_watchers, async, HPD_TAILQ_FIELD);
-    ev_async_stop(loop, w);
-    free(async);
 
     if (request->on_response) request->on_response(request->data, response);
 
@@ -255,40 +229,58 @@ static void request_on_respond(hpd_ev_loop_t *loop, ev_async *w, int revents)
     }
 }
 
+void request_on_request_queue(hpd_ev_loop_t *loop, ev_async *w, int revents)
+{
+    hpd_t *hpd = w->data;
+    hpd_ev_asyncs_t items;
+    hpd_ev_async_t *async, *async_tmp;
+
+    daemon_queue_take(&hpd->request_queue, &items);
+    TAILQ_FOREACH_SAFE(async, &items, HPD_TAILQ_FIELD, async_tmp) {
+        TAILQ_REMOVE(&items, async, HPD_TAILQ_FIELD);
+        request_on_request(hpd, async->request);
+    }
+}
+
+void request_on_respond_queue(hpd_ev_loop_t *loop, ev_async *w, int revents)
+{
+    hpd_t *hpd = w->data;
+    hpd_ev_asyncs_t items;
+    hpd_ev_async_t *async, *async_tmp;
+
+    daemon_queue_take(&hpd->respond_queue, &items);
+    TAILQ_FOREACH_SAFE(async, &items, HPD_TAILQ_FIELD, async_tmp) {
+        TAILQ_REMOVE(&items, async, HPD_TAILQ_FIELD);
+        request_on_respond(hpd, async->response);
+    }
+}
+
 hpd_error_t request_request(hpd_request_t *request)
 {
-    hpd_ev_async_t *async;
+    hpd_ev_async_t *async = &((request_block_t *) request)->async;
     hpd_t *hpd = request->service->device.adapter.context->hpd;
-    HPD_CALLOC(async, 1, hpd_ev_async_t);
-    HPD_CPY_ALLOC(async->request, request, hpd_request_t);
-    ev_async_init(&async->watcher, request_on_request);
-    async->watcher.data = async;
-    ev_async_start(hpd->loop, &async->watcher);
-    ev_async_send(hpd->loop, &async->watcher);
-    TAILQ_INSERT_TAIL(&hpd->request_watchers, async, HPD_TAILQ_FIELD);
-    free(request);
-    return HPD_E_SUCCESS;
+    async->request = request;
+    return daemon_queue_push(hpd, &hpd->request_queue, async);
+}
 
-    alloc_error:
-    free(async);
-    LOG_RETURN_E_ALLOC(hpd);
+hpd_error_t request_requests(hpd_request_t **requests, size_t n)
+{
+    hpd_ev_asyncs_t items;
+    hpd_t *hpd = requests[0]->service->device.adapter.context->hpd;
+
+    TAILQ_INIT(&items);
+    for (size_t i = 0; i < n; i++) {
+        hpd_ev_async_t *async = &((request_block_t *) requests[i])->async;
+        async->request = requests[i];
+        TAILQ_INSERT_TAIL(&items, async, HPD_TAILQ_FIELD);
+    }
+    return daemon_queue_push_all(hpd, &hpd->request_queue, &items);
 }
 
 hpd_error_t request_respond(hpd_response_t *response)
 {
-    hpd_ev_async_t *async;
+    hpd_ev_async_t *async = &((request_block_t *) response->request)->async;
     hpd_t *hpd = response->request->service->device.adapter.context->hpd;
-    HPD_CALLOC(async, 1, hpd_ev_async_t);
-    HPD_CPY_ALLOC(async->response, response, hpd_response_t);
-    ev_async_init(&async->watcher, request_on_respond);
-    async->watcher.data = async;
-    ev_async_start(hpd->loop, &async->watcher);
-    ev_async_send(hpd->loop, &async->watcher);
-    TAILQ_INSERT_TAIL(&hpd->respond_watchers, async, HPD_TAILQ_FIELD);
-    free(response);
-    return HPD_E_SUCCESS;
-
-    alloc_error:
-    free(async);
-    LOG_RETURN_E_ALLOC(hpd);
+    async->response = response;
+    return daemon_queue_push(hpd, &hpd->respond_queue, async);
 }
@@ -29,6 +29,7 @@
 #define HOMEPORT_REQUEST_H
 
 #include "hpd-0.6/hpd_types.h"
+#include <ev.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -39,6 +40,7 @@ hpd_error_t request_free_request(hpd_request_t *request);
 hpd_error_t request_set_request_value(hpd_request_t *request, hpd_value_t *value);
 hpd_error_t request_set_request_data(hpd_request_t *request, void *data, hpd_free_f on_free);
 hpd_error_t request_request(hpd_request_t *request);
+hpd_error_t request_requests(hpd_request_t **requests, size_t n);
 hpd_error_t request_get_request_service(const hpd_request_t *req, const hpd_service_id_t **id);
 hpd_error_t request_get_request_method(const hpd_request_t *req, hpd_method_t *method);
 hpd_error_t request_get_request_value(const hpd_request_t *req, const hpd_value_t **value);
@@ -53,6 +55,9 @@ hpd_error_t request_get_response_request_service(const hpd_response_t *response,
 hpd_error_t request_get_response_request_method(const hpd_response_t *response, hpd_method_t *method);
 hpd_error_t request_get_response_request_value(const hpd_response_t *response, const hpd_value_t **value);
 
+void request_on_request_queue(hpd_ev_loop_t *loop, ev_async *w, int revents);
+void request_on_respond_queue(hpd_ev_loop_t *loop, ev_async *w, int revents);
+
 #ifdef __cplusplus
 }
 #endif
@@ -64,11 +64,23 @@ hpd_error_t hpd_request_set_data(hpd_request_t *request, void *data, hpd_free_f
 hpd_error_t hpd_request(hpd_request_t *request)
 {
     if (!request) return HPD_E_NULL;
-    hpd_t *hpd = request->service->device.adapter.context->hpd;
-    if (!hpd->loop) LOG_RETURN_HPD_STOPPED(hpd);
     return request_request(request);
 }
 
+hpd_error_t hpd_requests(hpd_request_t **requests, size_t n)
+{
+    if (!requests) return HPD_E_NULL;
+    if (n == 0) return HPD_E_SUCCESS;
+    if (!requests[0]) return HPD_E_NULL;
+    hpd_t *hpd = requests[0]->service->device.adapter.context->hpd;
+    for (size_t i = 1; i < n; i++) {
+        if (!requests[i]) LOG_RETURN_E_NULL(hpd);
+        if (requests[i]->service->device.adapter.context->hpd != hpd)
+            LOG_RETURN(hpd, HPD_E_ARGUMENT, "Requests must belong to the same hpd instance.");
+    }
+    return request_requests(requests, n);
+}
+
 hpd_error_t hpd_request_get_service(const hpd_request_t *req, const hpd_service_id_t **id)
 {
     if (!req) return HPD_E_NULL;
@@ -171,8 +183,6 @@ hpd_error_t hpd_response_set_value(hpd_response_t *response, hpd_value_t *value)
 hpd_error_t hpd_respond(hpd_response_t *response)
 {
     if (!response) return HPD_E_NULL;
-    hpd_t *hpd = response->request->service->device.adapter.context->hpd;
-    if (!hpd->loop) LOG_RETURN_HPD_STOPPED(hpd);
     return request_respond(response);
 }
 
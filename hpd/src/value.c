@@ -32,87 +32,161 @@
 #include "log.h"
 #include "daemon.h"
 
-hpd_error_t value_alloc(hpd_value_t **value, const hpd_module_t *context, const char *body, int len)
+/**
+ * Values are reference counted at two levels.
+ *
+ *  A hpd_value_t is a handle, which can be held by several owners at once
+ *  through value_ref(), and is freed when the last of them calls
+ *  value_free(). The body and headers are kept in a hpd_value_data_t, which
+ *  value_copy() shares between handles. Before a handle modifies the data,
+ *  value_own_data() gives it a private copy, if it is shared. So passing a
+ *  value on to many holders neither copies the body nor the headers.
+ */
+
+static hpd_value_data_t *value_data_alloc(hpd_t *hpd, hpd_bool_t has_body, size_t len)
 {
-    hpd_error_t rc;
-    HPD_CALLOC((*value), 1, hpd_value_t);
+    hpd_value_data_t *data = pool_alloc(&hpd->pool, HPD_P_VALUE_DATA, sizeof(hpd_value_data_t) + (has_body ? len + 1 : 0));
+    if (!data) return NULL;
+    data->refs = 1;
+    data->headers = NULL;
+    data->body = has_body ? data->buf : NULL;
+    data->len = has_body ? len : 0;
+    if (has_body) data->body[len] = '\0';
+    return data;
+}
+
+static hpd_error_t value_data_unref(hpd_value_data_t *data)
+{
+    hpd_error_t rc = HPD_E_SUCCESS;
+    if (__atomic_sub_fetch(&data->refs, 1, __ATOMIC_ACQ_REL) > 0) return HPD_E_SUCCESS;
+    if (data->headers) rc = hpd_map_free(data->headers);
+    pool_free(data);
+    return rc;
+}
+
+static hpd_error_t value_handle_alloc(hpd_value_t **value, const hpd_module_t *context, hpd_value_data_t *data)
+{
+    if (!((*value) = pool_calloc(&context->hpd->pool, HPD_P_VALUE, sizeof(hpd_value_t)))) goto alloc_error;
     (*value)->context = context;
-    if ((rc = hpd_map_alloc(&(*value)->headers))) {
-        free(*value);
-        return rc;
-    }
-    if (body) {
-        HPD_STR_CPY((*value)->body, body);
-        if (len == HPD_NULL_TERMINATED) (*value)->len = strlen(body);
-        else (*value)->len = (size_t) len;
-    }
+    (*value)->refs = 1;
+    (*value)->data = data;
     return HPD_E_SUCCESS;
 
     alloc_error:
-        value_free(*value);
-        (*value) = NULL;
         LOG_RETURN_E_ALLOC(context->hpd);
 }
 
-hpd_error_t value_vallocf(hpd_value_t **value, const hpd_module_t *context, const char *fmt, va_list vp)
+/// Make sure the data of value is not shared with other values, before modifying it
+static hpd_error_t value_own_data(hpd_value_t *value)
 {
     hpd_error_t rc;
-    HPD_CALLOC((*value), 1, hpd_value_t);
-    (*value)->context = context;
-    if ((rc = hpd_map_alloc(&(*value)->headers))) {
-        free(*value);
-        return rc;
+    hpd_value_data_t *src = value->data;
+
+    if (__atomic_load_n(&src->refs, __ATOMIC_ACQUIRE) == 1) return HPD_E_SUCCESS;
+
+    hpd_value_data_t *dst;
+    if (!(dst = value_data_alloc(value->context->hpd, src->body != NULL, src->len))) LOG_RETURN_E_ALLOC(value->context->hpd);
+    if (src->body) memcpy(dst->body, src->body, src->len);
+
+    if (src->headers) {
+        if ((rc = hpd_map_alloc(&dst->headers))) goto error;
+        const hpd_pair_t *pair;
+        hpd_map_foreach(rc, pair, src->headers) {
+            const char *k, *v;
+            if ((rc = hpd_pair_get(pair, &k, &v))) goto error;
+            if ((rc = hpd_map_set(dst->headers, k, v))) goto error;
+        }
+        if (rc) goto error;
     }
-    if (fmt) {
-        HPD_VSPRINTF_ALLOC((*value)->body, fmt, vp);
-        (*value)->len = strlen((*value)->body);
+
+    value->data = dst;
+    return value_data_unref(src);
+
+    error:
+        value_data_unref(dst);
+        return rc;
+}
+
+hpd_error_t value_alloc(hpd_value_t **value, const hpd_module_t *context, const char *body, int len)
+{
+    hpd_error_t rc;
+    size_t body_len = 0;
+    if (body) body_len = len == HPD_NULL_TERMINATED ? strlen(body) : (size_t) len;
+
+    hpd_value_data_t *data;
+    if (!(data = value_data_alloc(context->hpd, body != NULL, body_len))) LOG_RETURN_E_ALLOC(context->hpd);
+    if (body) memcpy(data->body, body, body_len);
+
+    if ((rc = value_handle_alloc(value, context, data))) {
+        value_data_unref(data);
+        return rc;
     }
     return HPD_E_SUCCESS;
+}
 
-    alloc_error:
-    value_free(*value);
-    (*value) = NULL;
-    LOG_RETURN_E_ALLOC(context->hpd);
+hpd_error_t value_vallocf(hpd_value_t **value, const hpd_module_t *context, const char *fmt, va_list vp)
+{
+    hpd_error_t rc;
+    hpd_value_data_t *data;
+
+    if (fmt) {
+        va_list vp2;
+        va_copy(vp2, vp);
+        int len = vsnprintf(NULL, 0, fmt, vp2);
+        va_end(vp2);
+        if (len < 0) LOG_RETURN(context->hpd, HPD_E_UNKNOWN, "vsnprintf error.");
+        if (!(data = value_data_alloc(context->hpd, HPD_TRUE, (size_t) len))) LOG_RETURN_E_ALLOC(context->hpd);
+        if (vsnprintf(data->body, (size_t) len + 1, fmt, vp) < 0) {
+            value_data_unref(data);
+            LOG_RETURN(context->hpd, HPD_E_UNKNOWN, "vsnprintf error.");
+        }
+    } else {
+        if (!(data = value_data_alloc(context->hpd, HPD_FALSE, 0))) LOG_RETURN_E_ALLOC(context->hpd);
+    }
 
-    vsnprintf_error:
-    value_free(*value);
-    free((*value)->body);
-    LOG_RETURN(context->hpd, HPD_E_UNKNOWN, "vsnprintf error.");
+    if ((rc = value_handle_alloc(value, context, data))) {
+        value_data_unref(data);
+        return rc;
+    }
+    return HPD_E_SUCCESS;
 }
 
 hpd_error_t value_copy(hpd_value_t **dst, const hpd_value_t *src)
 {
     hpd_error_t rc;
-    if ((rc = value_alloc(dst, src->context, src->body, (int) src->len))) return rc;
-    const hpd_pair_t *pair;
-    hpd_map_foreach(rc, pair, src->headers) {
-        const char *k, *v;
-        if ((rc = hpd_pair_get(pair, &k, &v))) {
-            value_free(*dst);
-            return rc;
-        }
-        if ((rc = value_set_header(*dst, k, v))) {
-            value_free(*dst);
-            return rc;
-        }
-    }
-    return rc;
+    if ((rc = value_handle_alloc(dst, src->context, src->data))) return rc;
+    __atomic_add_fetch(&src->data->refs, 1, __ATOMIC_RELAXED);
+    return HPD_E_SUCCESS;
+}
+
+hpd_value_t *value_ref(const hpd_value_t *value)
+{
+    hpd_value_t *ref = (hpd_value_t *) value;
+    __atomic_add_fetch(&ref->refs, 1, __ATOMIC_RELAXED);
+    return ref;
+}
+
+hpd_bool_t value_is_shared(const hpd_value_t *value)
+{
+    return __atomic_load_n(&value->refs, __ATOMIC_ACQUIRE) > 1;
 }
 
 hpd_error_t value_free(hpd_value_t *value)
 {
     hpd_error_t rc = HPD_E_SUCCESS;
-    if (value) {
-        rc = hpd_map_free(value->headers);
-        free(value->body);
-    }
-    free(value);
+    if (!value) return HPD_E_SUCCESS;
+    if (__atomic_sub_fetch(&value->refs, 1, __ATOMIC_ACQ_REL) > 0) return HPD_E_SUCCESS;
+    rc = value_data_unref(value->data);
+    pool_free(value);
     return rc;
 }
 
 hpd_error_t value_set_header(hpd_value_t *value, const char *key, const char *val)
 {
-    return hpd_map_set(value->headers, key, val);
+    hpd_error_t rc;
+    if ((rc = value_own_data(value))) return rc;
+    if (!value->data->headers && (rc = hpd_map_alloc(&value->data->headers))) return rc;
+    return hpd_map_set(value->data->headers, key, val);
 }
 
 hpd_error_t value_set_headers_v(hpd_value_t *value, va_list vp)
@@ -130,14 +204,18 @@ hpd_error_t value_set_headers_v(hpd_value_t *value, va_list vp)
 
 hpd_error_t value_get_body(const hpd_value_t *value, const char **body, size_t *len)
 {
-    if (body) (*body) = value->body;
-    if (len) (*len) = value->len;
+    if (body) (*body) = value->data->body;
+    if (len) (*len) = value->data->len;
     return HPD_E_SUCCESS;
 }
 
 hpd_error_t value_get_header(const hpd_value_t *value, const char *key, const char **val)
 {
-    return hpd_map_get(value->headers, key, val);
+    if (!value->data->headers) {
+        (*val) = NULL;
+        return HPD_E_NOT_FOUND;
+    }
+    return hpd_map_get(value->data->headers, key, val);
 }
 
 hpd_error_t value_get_headers_v(const hpd_value_t *value, va_list vp)
@@ -155,7 +233,11 @@ hpd_error_t value_get_headers_v(const hpd_value_t *value, va_list vp)
 
 hpd_error_t value_first_header(const hpd_value_t *value, const hpd_pair_t **pair)
 {
-    return hpd_map_first(value->headers, pair);
+    if (!value->data->headers) {
+        (*pair) = NULL;
+        return HPD_E_SUCCESS;
+    }
+    return hpd_map_first(value->data->headers, pair);
 }
 
 hpd_error_t value_next_header(const hpd_pair_t **pair)
@@ -39,6 +39,8 @@ extern "C" {
 hpd_error_t value_alloc(hpd_value_t **value, const hpd_module_t *context, const char *body, int len);
 hpd_error_t value_vallocf(hpd_value_t **value, const hpd_module_t *context, const char *fmt, va_list vp);
 hpd_error_t value_copy(hpd_value_t **dst, const hpd_value_t *src);
+hpd_value_t *value_ref(const hpd_value_t *value);
+hpd_bool_t value_is_shared(const hpd_value_t *value);
 hpd_error_t value_free(hpd_value_t *value);
 hpd_error_t value_set_header(hpd_value_t *value, const char *key, const char *val);
 hpd_error_t value_set_headers_v(hpd_value_t *value, va_list vp);
@@ -64,6 +64,20 @@ hpd_error_t hpd_value_copy(const hpd_module_t *context, hpd_value_t **dst, const
     return value_copy(dst, src);
 }
 
+hpd_error_t hpd_value_ref(const hpd_value_t *value, hpd_value_t **ref)
+{
+    if (!value) return HPD_E_NULL;
+    if (!ref) LOG_RETURN_E_NULL(value->context->hpd);
+    (*ref) = value_ref(value);
+    return HPD_E_SUCCESS;
+}
+
+hpd_error_t hpd_value_unref(hpd_value_t *value)
+{
+    if (!value) return HPD_E_NULL;
+    return value_free(value);
+}
+
 hpd_error_t hpd_value_free(hpd_value_t *value)
 {
     if (!value) return HPD_E_NULL;
@@ -76,12 +90,15 @@ hpd_error_t hpd_value_set_header(hpd_value_t *value, const char *key, const char
     hpd_t *hpd = value->context->hpd;
     if (!key) LOG_RETURN_E_NULL(hpd);
     if (key[0] == '_') LOG_RETURN(hpd, HPD_E_ARGUMENT, "Keys starting with '_' is reserved for generated headers");
+    if (value_is_shared(value)) LOG_RETURN(hpd, HPD_E_STATE, "Value is referenced elsewhere, modify a copy instead.");
     return value_set_header(value, key, val);
 }
 
 hpd_error_t hpd_value_set_headers(hpd_value_t *value, ...)
 {
     if (!value) return HPD_E_NULL;
+    if (value_is_shared(value))
+        LOG_RETURN(value->context->hpd, HPD_E_STATE, "Value is referenced elsewhere, modify a copy instead.");
 
     va_list vp;
     va_start(vp, value);
@@ -0,0 +1,143 @@
+/*
+ * Copyright 2011 Aalborg University. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are
+ * permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of
+ * conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list
+ * of conditions and the following disclaimer in the documentation and/or other materials
+ * provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY Aalborg University ''AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL Aalborg University OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are those of the
+ * authors and should not be interpreted as representing official policies, either expressed
+ */
+
+/*
+ * Looks up attached objects through the index on their id tuple, and through the object cached in the id. The tests
+ * run inside the loop, as attaching and detaching must happen on the loop thread.
+ */
+
+#include "hpd_test.h"
+#include "discovery.h"
+
+#define CASE hpd_discovery
+
+class CASE : public hpd_loop_test {
+};
+
+static void attach_service(const hpd_module_t *context, hpd_device_t *device, const char *id, hpd_service_t **service)
+{
+    ASSERT_EQ(hpd_service_alloc(service, context, id), HPD_E_SUCCESS);
+    ASSERT_EQ(hpd_service_attach(device, *service), HPD_E_SUCCESS);
+}
+
+static void on_index(const hpd_module_t *context)
+{
+    // (adapter, device, s8798) and (adapter, device, s654876) have the same FNV-1a hash
+    const char *ids[] = { "s8798", "s654876" };
+    hpd_adapter_t *adapter;
+    hpd_device_t *device, *found_device;
+    hpd_service_t *services[2], *found;
+    hpd_device_id_t *did;
+    hpd_service_id_t *sids[2];
+
+    ASSERT_EQ(hpd_adapter_alloc(&adapter, context, "adapter"), HPD_E_SUCCESS);
+    ASSERT_EQ(hpd_adapter_attach(adapter), HPD_E_SUCCESS);
+    ASSERT_EQ(hpd_device_alloc(&device, context, "device"), HPD_E_SUCCESS);
+    ASSERT_EQ(hpd_device_attach(adapter, device), HPD_E_SUCCESS);
+    ASSERT_EQ(hpd_device_id_alloc(&did, context, "adapter", "device"), HPD_E_SUCCESS);
+    for (int i = 0; i < 2; i++) {
+        attach_service(context, device, ids[i], &services[i]);
+        ASSERT_EQ(hpd_service_id_alloc(&sids[i], context, "adapter", "device", ids[i]), HPD_E_SUCCESS);
+    }
+    ASSERT_EQ(sids[0]->hash, sids[1]->hash);
+
+    // Lookup after attach, the collision is told apart on the id strings
+    ASSERT_EQ(discovery_find_device(did, &found_device), HPD_E_SUCCESS);
+    ASSERT_EQ(found_device, device);
+    for (int i = 0; i < 2; i++) {
+        ASSERT_EQ(discovery_find_service(sids[i], &found), HPD_E_SUCCESS);
+        ASSERT_EQ(found, services[i]);
+    }
+
+    // Miss after detach, the other service in the same bucket is still found
+    ASSERT_EQ(hpd_service_detach(services[0]), HPD_E_SUCCESS);
+    ASSERT_EQ(discovery_find_service(sids[0], &found), HPD_E_NOT_FOUND);
+    ASSERT_EQ(discovery_find_service(sids[1], &found), HPD_E_SUCCESS);
+    ASSERT_EQ(found, services[1]);
+    ASSERT_EQ(hpd_service_free(services[0]), HPD_E_SUCCESS);
+
+    // Detaching the adapter removes everything below it from the index
+    ASSERT_EQ(hpd_adapter_detach(adapter), HPD_E_SUCCESS);
+    ASSERT_EQ(discovery_find_device(did, &found_device), HPD_E_NOT_FOUND);
+    ASSERT_EQ(discovery_find_service(sids[1], &found), HPD_E_NOT_FOUND);
+
+    ASSERT_EQ(hpd_adapter_free(adapter), HPD_E_SUCCESS);
+    ASSERT_EQ(hpd_device_id_free(did), HPD_E_SUCCESS);
+    for (int i = 0; i < 2; i++) ASSERT_EQ(hpd_service_id_free(sids[i]), HPD_E_SUCCESS);
+}
+
+TEST_F(CASE, index)
+{
+    run(on_index);
+}
+
+static void on_cache(const hpd_module_t *context)
+{
+    hpd_adapter_t *adapter;
+    hpd_device_t *device;
+    hpd_service_t *service, *other, *replacement, *found;
+    hpd_service_id_t *sid;
+
+    ASSERT_EQ(hpd_adapter_alloc(&adapter, context, "adapter"), HPD_E_SUCCESS);
+    ASSERT_EQ(hpd_adapter_attach(adapter), HPD_E_SUCCESS);
+    ASSERT_EQ(hpd_device_alloc(&device, context, "device"), HPD_E_SUCCESS);
+    ASSERT_EQ(hpd_device_attach(adapter, device), HPD_E_SUCCESS);
+    attach_service(context, device, "s1", &service);
+    attach_service(context, device, "s2", &other);
+    ASSERT_EQ(hpd_service_id_alloc(&sid, context, "adapter", "device", "s1"), HPD_E_SUCCESS);
+
+    ASSERT_EQ(discovery_find_service(sid, &found), HPD_E_SUCCESS);
+    ASSERT_EQ(found, service);
+    ASSERT_EQ(sid->node, service);
+
+    // Any detach invalidates the cache, an object that is still attached is found again
+    ASSERT_EQ(hpd_service_detach(other), HPD_E_SUCCESS);
+    ASSERT_EQ(hpd_service_free(other), HPD_E_SUCCESS);
+    ASSERT_EQ(discovery_find_service(sid, &found), HPD_E_SUCCESS);
+    ASSERT_EQ(found, service);
+
+    // The cached service is detached but not yet freed, so a stale cache would still hand it out
+    ASSERT_EQ(hpd_service_detach(service), HPD_E_SUCCESS);
+    ASSERT_EQ(discovery_find_service(sid, &found), HPD_E_NOT_FOUND);
+    attach_service(context, device, "s1", &replacement);
+    ASSERT_EQ(discovery_find_service(sid, &found), HPD_E_SUCCESS);
+    ASSERT_EQ(found, replacement);
+    ASSERT_EQ(sid->node, replacement);
+    ASSERT_EQ(hpd_service_free(service), HPD_E_SUCCESS);
+
+    // Same for the object's ancestors, and for freeing them
+    ASSERT_EQ(hpd_adapter_detach(adapter), HPD_E_SUCCESS);
+    ASSERT_EQ(hpd_adapter_free(adapter), HPD_E_SUCCESS);
+    ASSERT_EQ(discovery_find_service(sid, &found), HPD_E_NOT_FOUND);
+
+    ASSERT_EQ(hpd_service_id_free(sid), HPD_E_SUCCESS);
+}
+
+TEST_F(CASE, id_cache)
+{
+    run(on_cache);
+}
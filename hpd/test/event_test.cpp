@@ -0,0 +1,241 @@
+/*
+ * Copyright 2011 Aalborg University. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are
+ * permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of
+ * conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list
+ * of conditions and the following disclaimer in the documentation and/or other materials
+ * provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY Aalborg University ''AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL Aalborg University OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are those of the
+ * authors and should not be interpreted as representing official policies, either expressed
+ */
+
+#include "hpd_test.h"
+
+#define CASE hpd_listener
+
+typedef enum {
+    LISTENER_ALL,           ///< No filters
+    LISTENER_SERVICE,       ///< zwave0/d1/s1
+    LISTENER_DEVICE,        ///< zwave0/d1 and zwave0/d1/s1, called once per change
+    LISTENER_PREFIX,        ///< zw*
+    LISTENER_ATTRS,         ///< type=switch
+    LISTENER_LATE,          ///< knx/d2/s3, added after subscribing
+    LISTENER_COALESCE,      ///< No filters, coalescing until the next loop iteration
+    LISTENER_BATCH,         ///< No filters, batch callback
+    LISTENER_COUNT,
+} listener_type_t;
+
+typedef struct {
+    hpd_t *hpd;
+    const hpd_module_t *context;
+    hpd_adapter_t *adapters[2];
+    hpd_service_id_t *sids[3];
+    hpd_listener_t *listeners[LISTENER_COUNT];
+    int received[LISTENER_COUNT];
+    int batches;
+    size_t batch_size;
+    char last_s1[8];
+    unsigned long coalesce_received;
+    unsigned long coalesce_absorbed;
+    int batch_calls;
+    char batch[32];
+    hpd_error_t rc;
+} module_data_t;
+
+static module_data_t *module_data;
+
+static void on_change(void *data, const hpd_service_id_t *service, const hpd_value_t *val)
+{
+    module_data->received[*(int *) data]++;
+}
+
+static void on_changes(void *data, const hpd_change_t *changes, size_t n)
+{
+    const char *sid, *body;
+    size_t len;
+
+    module_data->batches++;
+    module_data->batch_size = n;
+    for (size_t i = 0; i < n; i++) {
+        if ((module_data->rc = hpd_service_id_get_service_id_str(changes[i].service, &sid))) break;
+        if ((module_data->rc = hpd_value_get_body(changes[i].value, &body, &len))) break;
+        if (strcmp(sid, "s1") == 0) snprintf(module_data->last_s1, sizeof(module_data->last_s1), "%.*s", (int) len, body);
+    }
+    hpd_listener_get_coalesce_stats(module_data->listeners[LISTENER_COALESCE], &module_data->coalesce_received,
+                                    &module_data->coalesce_absorbed);
+    // Delivered on the loop iteration after all changes were dispatched
+    hpd_stop(module_data->hpd);
+}
+
+static void on_change_batch(void *data, const hpd_change_t *changes, size_t n)
+{
+    const char *sid, *body;
+    size_t len;
+
+    module_data->batch_calls++;
+    for (size_t i = 0; i < n; i++) {
+        if ((module_data->rc = hpd_service_id_get_service_id_str(changes[i].service, &sid))) break;
+        if ((module_data->rc = hpd_value_get_body(changes[i].value, &body, &len))) break;
+        size_t used = strlen(module_data->batch);
+        snprintf(module_data->batch + used, sizeof(module_data->batch) - used, "%s=%.*s ", sid, (int) len, body);
+    }
+}
+
+static void send_changes(module_data_t *data)
+{
+    hpd_value_t *value;
+    int sids[] = { 0, 1, 2, 0 };
+
+    for (int i = 0; i < 4; i++) {
+        if ((data->rc = hpd_value_allocf(&value, data->context, "%d", i))) goto error;
+        if ((data->rc = hpd_id_changed(data->sids[sids[i]], value))) goto error;
+    }
+    return;
+
+    error:
+    hpd_stop(data->hpd);
+}
+
+static hpd_error_t attach(module_data_t *data, int i, const char *aid, const char *did, const char *sid)
+{
+    hpd_error_t rc;
+    hpd_device_t *device;
+    hpd_service_t *service;
+
+    if (!data->adapters[i / 2]) {
+        if ((rc = hpd_adapter_alloc(&data->adapters[i / 2], data->context, aid))) return rc;
+        if ((rc = hpd_adapter_attach(data->adapters[i / 2]))) return rc;
+    }
+    if ((rc = hpd_device_alloc(&device, data->context, did))) return rc;
+    if ((rc = hpd_device_attach(data->adapters[i / 2], device))) return rc;
+    if ((rc = hpd_service_alloc(&service, data->context, sid))) return rc;
+    if (i == 0 && (rc = hpd_service_set_attrs(service, "type", "switch", NULL))) return rc;
+    if ((rc = hpd_service_attach(device, service))) return rc;
+    return hpd_service_id_alloc(&data->sids[i], data->context, aid, did, sid);
+}
+
+static hpd_error_t start(module_data_t *module_data)
+{
+    hpd_error_t rc;
+    const hpd_module_t *context = module_data->context;
+    hpd_device_id_t *did;
+
+    if ((rc = attach(module_data, 0, "zwave0", "d1", "s1"))) return rc;
+    if ((rc = attach(module_data, 1, "zwave0", "d0", "s2"))) return rc;
+    if ((rc = attach(module_data, 2, "knx", "d2", "s3"))) return rc;
+
+    for (int i = 0; i < LISTENER_COUNT; i++) {
+        int *type = (int *) malloc(sizeof(int));
+        if (!type) return HPD_E_ALLOC;
+        *type = i;
+        if ((rc = hpd_listener_alloc(&module_data->listeners[i], context))) return rc;
+        if ((rc = hpd_listener_set_data(module_data->listeners[i], type, free))) return rc;
+        if ((rc = hpd_listener_set_value_callback(module_data->listeners[i], on_change))) return rc;
+    }
+
+    if ((rc = hpd_device_id_alloc(&did, context, "zwave0", "d1"))) return rc;
+    if ((rc = hpd_listener_add_service_filter(module_data->listeners[LISTENER_SERVICE], module_data->sids[0]))) return rc;
+    if ((rc = hpd_listener_add_device_filter(module_data->listeners[LISTENER_DEVICE], did))) return rc;
+    if ((rc = hpd_listener_add_service_filter(module_data->listeners[LISTENER_DEVICE], module_data->sids[0]))) return rc;
+    if ((rc = hpd_listener_add_adapter_filter(module_data->listeners[LISTENER_PREFIX], "zw"))) return rc;
+    if ((rc = hpd_listener_set_attr_filter(module_data->listeners[LISTENER_ATTRS], "type", "switch", NULL))) return rc;
+    if ((rc = hpd_listener_set_coalescing(module_data->listeners[LISTENER_COALESCE], 0, on_changes))) return rc;
+    if ((rc = hpd_listener_set_value_batch_callback(module_data->listeners[LISTENER_BATCH], on_change_batch))) return rc;
+    if ((rc = hpd_device_id_free(did))) return rc;
+
+    for (int i = 0; i < LISTENER_COUNT; i++)
+        if ((rc = hpd_subscribe(module_data->listeners[i]))) return rc;
+    return hpd_listener_add_service_filter(module_data->listeners[LISTENER_LATE], module_data->sids[2]);
+}
+
+static hpd_error_t stop(module_data_t *module_data)
+{
+    hpd_error_t rc;
+
+    for (int i = 0; i < LISTENER_COUNT; i++) {
+        if (module_data->listeners[i] && (rc = hpd_listener_free(module_data->listeners[i]))) return rc;
+        module_data->listeners[i] = NULL;
+    }
+    for (int i = 0; i < 3; i++) {
+        if (module_data->sids[i] && (rc = hpd_service_id_free(module_data->sids[i]))) return rc;
+        module_data->sids[i] = NULL;
+    }
+    for (int i = 0; i < 2; i++) {
+        if (module_data->adapters[i] && (rc = hpd_adapter_free(module_data->adapters[i]))) return rc;
+        module_data->adapters[i] = NULL;
+    }
+    return HPD_E_SUCCESS;
+}
+
+class CASE : public hpd_loop_test {
+protected:
+    virtual void SetUp() {
+        module_data = (module_data_t *) calloc(1, sizeof(module_data_t));
+        ASSERT_NE(module_data, nullptr);
+    }
+
+    virtual void TearDown() {
+        EXPECT_EQ(module_data->rc, HPD_E_SUCCESS);
+        free(module_data);
+    }
+
+    virtual hpd_error_t on_start() {
+        module_data->hpd = hpd;
+        module_data->context = context;
+        return start(module_data);
+    }
+
+    virtual hpd_error_t on_stop() {
+        return stop(module_data);
+    }
+
+    virtual void on_loop() {
+        send_changes(module_data);
+    }
+};
+
+TEST_F(CASE, filters)
+{
+    run();
+    ASSERT_EQ(module_data->received[LISTENER_ALL], 4);
+    ASSERT_EQ(module_data->received[LISTENER_SERVICE], 2);
+    ASSERT_EQ(module_data->received[LISTENER_DEVICE], 2);
+    ASSERT_EQ(module_data->received[LISTENER_PREFIX], 3);
+    ASSERT_EQ(module_data->received[LISTENER_ATTRS], 2);
+    ASSERT_EQ(module_data->received[LISTENER_LATE], 1);
+}
+
+TEST_F(CASE, coalesce)
+{
+    run();
+    ASSERT_EQ(module_data->received[LISTENER_COALESCE], 0);
+    ASSERT_EQ(module_data->batches, 1);
+    ASSERT_EQ(module_data->batch_size, 3u);
+    ASSERT_STREQ(module_data->last_s1, "3");
+    ASSERT_EQ(module_data->coalesce_received, 4ul);
+    ASSERT_EQ(module_data->coalesce_absorbed, 1ul);
+}
+
+TEST_F(CASE, batch)
+{
+    run();
+    ASSERT_EQ(module_data->received[LISTENER_BATCH], 0);
+    ASSERT_EQ(module_data->batch_calls, 1);
+    ASSERT_STREQ(module_data->batch, "s1=0 s2=1 s3=2 s1=3 ");
+}
@@ -0,0 +1,145 @@
+/*
+ * Copyright 2011 Aalborg University. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are
+ * permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of
+ * conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list
+ * of conditions and the following disclaimer in the documentation and/or other materials
+ * provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY Aalborg University ''AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL Aalborg University OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are those of the
+ * authors and should not be interpreted as representing official policies, either expressed
+ */
+
+/*
+ * Fixtures shared by the tests of hpd. hpd_context_test calls the API without running hpd, through a context like the
+ * one handed to a module, and hpd_loop_test runs the test inside a module named "test", on the loop of hpd.
+ */
+
+#ifndef HOMEPORT_HPD_TEST_H
+#define HOMEPORT_HPD_TEST_H
+
+#include <gtest/gtest.h>
+#include <string.h>
+#include "hpd-0.6/hpd_api.h"
+#include "daemon.h"
+#include <ev.h>
+
+class hpd_context_test : public ::testing::Test {
+protected:
+    hpd_t *hpd;
+    hpd_module_t context;
+
+    virtual void SetUp() {
+        ASSERT_EQ(hpd_alloc(&hpd), HPD_E_SUCCESS);
+        memset(&context, 0, sizeof(context));
+        context.hpd = hpd;
+    }
+
+    virtual void TearDown() {
+        ASSERT_EQ(hpd_free(hpd), HPD_E_SUCCESS);
+    }
+};
+
+typedef void (*hpd_test_f)(const hpd_module_t *context);
+
+/**
+ * on_start() and on_stop() are called when the module is started and stopped, and on_loop() once the loop runs, as
+ * requests and changes cannot stop the loop before that. Unless overridden, on_loop() calls the function given to run()
+ * and stops hpd.
+ */
+class hpd_loop_test : public ::testing::Test {
+protected:
+    hpd_t *hpd;
+    const hpd_module_t *context;
+    hpd_ev_loop_t *loop;
+    ev_timer timer;
+    hpd_test_f test;
+
+    virtual hpd_error_t on_start() {
+        return HPD_E_SUCCESS;
+    }
+
+    virtual hpd_error_t on_stop() {
+        return HPD_E_SUCCESS;
+    }
+
+    virtual void on_loop() {
+        if (test) test(context);
+        hpd_stop(hpd);
+    }
+
+    void run(hpd_test_f f = nullptr) {
+        char *argv[] = { (char *) "test" };
+        hpd_module_def_t module_def = { on_create, on_destroy, on_module_start, on_module_stop, on_parse_opt };
+
+        test = f;
+        running() = this;
+        ASSERT_EQ(hpd_alloc(&hpd), HPD_E_SUCCESS);
+        ASSERT_EQ(hpd_module(hpd, "test", &module_def), HPD_E_SUCCESS);
+        ASSERT_EQ(hpd_start(hpd, 1, argv), HPD_E_SUCCESS);
+        ASSERT_EQ(hpd_free(hpd), HPD_E_SUCCESS);
+    }
+
+public:
+    /// Calls on_loop() again on the next loop iteration
+    void loop_again() {
+        ev_timer_start(loop, &timer);
+    }
+
+private:
+    static hpd_loop_test *&running() {
+        static hpd_loop_test *test = nullptr;
+        return test;
+    }
+
+    static void on_timeout(hpd_ev_loop_t *loop, ev_timer *w, int revents) {
+        ((hpd_loop_test *) w->data)->on_loop();
+    }
+
+    static hpd_error_t on_create(void **data, const hpd_module_t *context) {
+        running()->context = context;
+        *data = running();
+        return HPD_E_SUCCESS;
+    }
+
+    static hpd_error_t on_destroy(void *data) {
+        return HPD_E_SUCCESS;
+    }
+
+    static hpd_error_t on_module_start(void *data) {
+        hpd_loop_test *test = (hpd_loop_test *) data;
+        hpd_error_t rc;
+
+        if ((rc = test->on_start())) return rc;
+        if ((rc = hpd_get_loop(test->context, &test->loop))) return rc;
+        ev_timer_init(&test->timer, on_timeout, 0, 0);
+        test->timer.data = test;
+        ev_timer_start(test->loop, &test->timer);
+        return HPD_E_SUCCESS;
+    }
+
+    static hpd_error_t on_module_stop(void *data) {
+        return ((hpd_loop_test *) data)->on_stop();
+    }
+
+    static hpd_error_t on_parse_opt(void *data, const char *name, const char *arg) {
+        return HPD_E_ARGUMENT;
+    }
+};
+
+#endif //HOMEPORT_HPD_TEST_H
@@ -0,0 +1,93 @@
+/*
+ * Copyright 2011 Aalborg University. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are
+ * permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of
+ * conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list
+ * of conditions and the following disclaimer in the documentation and/or other materials
+ * provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY Aalborg University ''AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL Aalborg University OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are those of the
+ * authors and should not be interpreted as representing official policies, either expressed
+ */
+
+#include "hpd_test.h"
+#include "discovery.h"
+
+#define CASE hpd_id_api
+
+class CASE : public hpd_context_test {
+};
+
+TEST_F(CASE, service_id_copy) {
+    hpd_service_id_t *id, *copy;
+    const hpd_device_id_t *did;
+    const char *str;
+
+    ASSERT_EQ(hpd_service_id_alloc(&id, &context, "adapter", "device", "service"), HPD_E_SUCCESS);
+    ASSERT_EQ(hpd_service_id_copy(&copy, id), HPD_E_SUCCESS);
+    ASSERT_EQ(hpd_service_id_free(id), HPD_E_SUCCESS);
+
+    ASSERT_EQ(hpd_service_id_get_adapter_id_str(copy, &str), HPD_E_SUCCESS);
+    ASSERT_STREQ(str, "adapter");
+    ASSERT_EQ(hpd_service_id_get_device_id_str(copy, &str), HPD_E_SUCCESS);
+    ASSERT_STREQ(str, "device");
+    ASSERT_EQ(hpd_service_id_get_service_id_str(copy, &str), HPD_E_SUCCESS);
+    ASSERT_STREQ(str, "service");
+
+    ASSERT_EQ(hpd_service_id_get_device_id(copy, &did), HPD_E_SUCCESS);
+    ASSERT_EQ(hpd_device_id_get_adapter_id_str(did, &str), HPD_E_SUCCESS);
+    ASSERT_STREQ(str, "adapter");
+
+    ASSERT_EQ(hpd_service_id_free(copy), HPD_E_SUCCESS);
+}
+
+TEST_F(CASE, parameter_id_copy) {
+    hpd_parameter_id_t *id, *copy;
+    const char *str;
+
+    ASSERT_EQ(hpd_parameter_id_alloc(&id, &context, "a", "d", "s", "parameter"), HPD_E_SUCCESS);
+    ASSERT_EQ(hpd_parameter_id_copy(&copy, id), HPD_E_SUCCESS);
+    ASSERT_EQ(hpd_parameter_id_free(id), HPD_E_SUCCESS);
+
+    ASSERT_EQ(hpd_parameter_id_get_adapter_id_str(copy, &str), HPD_E_SUCCESS);
+    ASSERT_STREQ(str, "a");
+    ASSERT_EQ(hpd_parameter_id_get_service_id_str(copy, &str), HPD_E_SUCCESS);
+    ASSERT_STREQ(str, "s");
+    ASSERT_EQ(hpd_parameter_id_get_parameter_id_str(copy, &str), HPD_E_SUCCESS);
+    ASSERT_STREQ(str, "parameter");
+
+    ASSERT_EQ(hpd_parameter_id_free(copy), HPD_E_SUCCESS);
+}
+
+TEST_F(CASE, service_id_equal) {
+    hpd_service_id_t *id, *copy, *other, *shifted;
+
+    ASSERT_EQ(hpd_service_id_alloc(&id, &context, "adapter", "device", "service"), HPD_E_SUCCESS);
+    ASSERT_EQ(hpd_service_id_copy(&copy, id), HPD_E_SUCCESS);
+    ASSERT_EQ(hpd_service_id_alloc(&other, &context, "adapter", "device", "other"), HPD_E_SUCCESS);
+    ASSERT_EQ(hpd_service_id_alloc(&shifted, &context, "adapterd", "evice", "service"), HPD_E_SUCCESS);
+
+    ASSERT_TRUE(discovery_sid_equal(id, copy));
+    ASSERT_FALSE(discovery_sid_equal(id, other));
+    ASSERT_FALSE(discovery_sid_equal(id, shifted));
+
+    ASSERT_EQ(hpd_service_id_free(id), HPD_E_SUCCESS);
+    ASSERT_EQ(hpd_service_id_free(copy), HPD_E_SUCCESS);
+    ASSERT_EQ(hpd_service_id_free(other), HPD_E_SUCCESS);
+    ASSERT_EQ(hpd_service_id_free(shifted), HPD_E_SUCCESS);
+}
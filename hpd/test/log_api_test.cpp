@@ -0,0 +1,75 @@
+/*
+ * Copyright 2011 Aalborg University. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are
+ * permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of
+ * conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list
+ * of conditions and the following disclaimer in the documentation and/or other materials
+ * provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY Aalborg University ''AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL Aalborg University OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are those of the
+ * authors and should not be interpreted as representing official policies, either expressed
+ */
+
+#include "hpd_test.h"
+
+#define CASE hpd_log_api
+
+class CASE : public hpd_context_test {
+protected:
+    char id[5] = "test";
+
+    virtual void SetUp() {
+        hpd_context_test::SetUp();
+        context.id = id;
+        context.log_level = HPD_L_INFO;
+    }
+};
+
+TEST_F(CASE, log_level) {
+    hpd_log_level_t level;
+
+    ASSERT_EQ(hpd_module_get_log_level(NULL, &level), HPD_E_NULL);
+    ASSERT_EQ(hpd_module_get_log_level(&context, NULL), HPD_E_NULL);
+    ASSERT_EQ(hpd_module_set_log_level(NULL, HPD_L_DEBUG), HPD_E_NULL);
+    ASSERT_EQ(hpd_module_set_log_level(&context, (hpd_log_level_t) (HPD_L_VERBOSE + 1)), HPD_E_ARGUMENT);
+
+    ASSERT_EQ(hpd_module_get_log_level(&context, &level), HPD_E_SUCCESS);
+    ASSERT_EQ(level, HPD_L_INFO);
+    ASSERT_EQ(hpd_module_set_log_level(&context, HPD_L_VERBOSE), HPD_E_SUCCESS);
+    ASSERT_EQ(hpd_module_get_log_level(&context, &level), HPD_E_SUCCESS);
+    ASSERT_EQ(level, HPD_L_VERBOSE);
+}
+
+TEST_F(CASE, arguments_not_evaluated) {
+    int evaluated = 0;
+
+    HPD_LOG_DEBUG(&context, "%d", ++evaluated);
+    HPD_LOG_VERBOSE(&context, "%d", ++evaluated);
+    ASSERT_EQ(evaluated, 0);
+
+    ASSERT_EQ(HPD_LOG_INFO(&context, "%d", ++evaluated), HPD_E_SUCCESS);
+    ASSERT_EQ(evaluated, 1);
+
+    ASSERT_EQ(hpd_module_set_log_level(&context, HPD_L_NONE), HPD_E_SUCCESS);
+    HPD_LOG_ERROR(&context, "%d", ++evaluated);
+    ASSERT_EQ(evaluated, 1);
+
+    ASSERT_EQ(hpd_module_set_log_level(&context, HPD_L_DEBUG), HPD_E_SUCCESS);
+    HPD_LOG_DEBUG(&context, "%d", ++evaluated);
+    ASSERT_EQ(evaluated, 2);
+}
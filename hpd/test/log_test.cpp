@@ -0,0 +1,242 @@
+/*
+ * Copyright 2011 Aalborg University. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are
+ * permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of
+ * conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list
+ * of conditions and the following disclaimer in the documentation and/or other materials
+ * provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY Aalborg University ''AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL Aalborg University OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are those of the
+ * authors and should not be interpreted as representing official policies, either expressed
+ */
+
+/*
+ * Logs through the ring of the log writer while a module is running, and checks what listeners receive: every message
+ * from several threads, in order after a flush, a count of the messages dropped when the ring is full, and a listener
+ * that unsubscribes from its own callback.
+ */
+
+#include "hpd_test.h"
+#include "log.h"
+#include <pthread.h>
+#include <semaphore.h>
+#include <string>
+#include <vector>
+
+#define CASE hpd_log
+
+#define THREADS 4
+#define THREAD_MESSAGES 500
+
+/// Messages each thread logs before it waits for the writer, so the ring is never overrun
+#define FLUSH_EVERY 32
+
+static const hpd_module_t *thread_context;
+static hpd_listener_t *listener;
+static hpd_listener_t *unsubscribing;
+static std::vector<std::string> lines;
+static std::vector<std::string> records;
+static std::vector<std::string> unsubscribing_lines;
+static sem_t release;
+
+static bool is_test_line(const char *msg)
+{
+    return strstr(msg, "[test]") != nullptr;
+}
+
+static void on_log(void *data, const char *msg)
+{
+    if (is_test_line(msg)) lines.push_back(msg);
+}
+
+static void on_log_record(void *data, const hpd_log_record_t *record)
+{
+    std::string msg(record->msg, record->len);
+    if (strcmp(record->module, "test") == 0) records.push_back(msg);
+    if (strcmp(record->module, HPD_LOG_MODULE) == 0 && msg.find("Log ring full") == 0) records.push_back(msg);
+    // Holds the writer, so the ring fills up behind it
+    if (msg == "block") sem_wait(&release);
+}
+
+static void on_log_unsubscribe(void *data, const char *msg)
+{
+    if (!is_test_line(msg)) return;
+    unsubscribing_lines.push_back(msg);
+    if (strstr(msg, "unsubscribe me")) {
+        hpd_listener_free(unsubscribing);
+        unsubscribing = nullptr;
+    }
+}
+
+class CASE : public hpd_loop_test {
+protected:
+    virtual void SetUp() {
+        lines.clear();
+        records.clear();
+        unsubscribing_lines.clear();
+    }
+
+    virtual hpd_error_t on_start() {
+        hpd_error_t rc;
+
+        if ((rc = hpd_listener_alloc(&listener, context))) return rc;
+        if ((rc = hpd_listener_set_log_callback(listener, on_log))) return rc;
+        if ((rc = hpd_listener_set_log_record_callback(listener, on_log_record))) return rc;
+        if ((rc = hpd_subscribe(listener))) return rc;
+        if ((rc = hpd_listener_alloc(&unsubscribing, context))) return rc;
+        if ((rc = hpd_listener_set_log_callback(unsubscribing, on_log_unsubscribe))) return rc;
+        return hpd_subscribe(unsubscribing);
+    }
+
+    virtual hpd_error_t on_stop() {
+        hpd_error_t rc;
+
+        if ((rc = hpd_listener_free(listener))) return rc;
+        if (unsubscribing && (rc = hpd_listener_free(unsubscribing))) return rc;
+        unsubscribing = nullptr;
+        return HPD_E_SUCCESS;
+    }
+
+    virtual void on_loop() {
+        // Nothing logged before the test is of interest
+        log_flush(hpd);
+        lines.clear();
+        records.clear();
+        hpd_loop_test::on_loop();
+    }
+};
+
+static void *on_thread(void *data)
+{
+    long thread = (long) data;
+
+    for (int i = 0; i < THREAD_MESSAGES; i++) {
+        HPD_LOG_INFO(thread_context, "thread %ld message %d", thread, i);
+        if (i % FLUSH_EVERY == FLUSH_EVERY - 1) log_flush(thread_context->hpd);
+    }
+    return nullptr;
+}
+
+static void log_from_threads(const hpd_module_t *context)
+{
+    pthread_t threads[THREADS];
+
+    thread_context = context;
+    for (long i = 0; i < THREADS; i++) pthread_create(&threads[i], nullptr, on_thread, (void *) i);
+    for (auto &thread : threads) pthread_join(thread, nullptr);
+    log_flush(context->hpd);
+}
+
+TEST_F(CASE, threads) {
+    run(log_from_threads);
+
+    // Every message arrives once, and the messages of one thread in the order they were logged
+    int next[THREADS] = {};
+    ASSERT_EQ(records.size(), (size_t) THREADS * THREAD_MESSAGES);
+    for (auto &record : records) {
+        long thread;
+        int i;
+        ASSERT_EQ(sscanf(record.c_str(), "thread %ld message %d", &thread, &i), 2);
+        ASSERT_LT(thread, THREADS);
+        ASSERT_EQ(i, next[thread]++);
+    }
+    ASSERT_EQ(lines.size(), records.size());
+}
+
+static void log_in_order(const hpd_module_t *context)
+{
+    HPD_LOG_INFO(context, "first");
+    HPD_LOG_WARN(context, "second\nthird");
+    HPD_LOG_ERROR(context, "fourth");
+    // Delivered to the listeners by the time the flush returns
+    log_flush(context->hpd);
+    HPD_LOG_INFO(context, "after flush");
+}
+
+TEST_F(CASE, flush_order) {
+    run(log_in_order);
+
+    // One call of on_log per line, in order
+    const char *expected[] = { "first", "second", "third", "fourth", "after flush" };
+    ASSERT_EQ(lines.size(), 5u);
+    for (size_t i = 0; i < lines.size(); i++) {
+        ASSERT_NE(lines[i].find(std::string(": ") + expected[i] + " "), std::string::npos) << lines[i];
+        ASSERT_EQ(lines[i].find('\n'), lines[i].size() - 1);
+    }
+    ASSERT_EQ(records.size(), 4u);
+    ASSERT_EQ(records[1], "second\nthird");
+}
+
+static void log_until_full(const hpd_module_t *context)
+{
+    HPD_LOG_INFO(context, "block");
+    for (int i = 0; i < LOG_RING_SIZE + 10; i++) HPD_LOG_INFO(context, "message %d", i);
+    sem_post(&release);
+    log_flush(context->hpd);
+}
+
+TEST_F(CASE, dropped) {
+    ASSERT_EQ(sem_init(&release, 0, 0), 0);
+    run(log_until_full);
+    sem_destroy(&release);
+
+    // The record of the blocked message is only handed back once the writer is released, so one less fits
+    int kept = LOG_RING_SIZE - 1, dropped = 11;
+    ASSERT_EQ(records.size(), (size_t) 1 + kept + 1);
+    ASSERT_EQ(records[0], "block");
+    ASSERT_EQ(records[1], "Log ring full, " + std::to_string(dropped) + " messages were dropped.");
+    for (int i = 0; i < kept; i++) ASSERT_EQ(records[2 + i], "message " + std::to_string(i));
+}
+
+static void log_unsubscribe(const hpd_module_t *context)
+{
+    HPD_LOG_INFO(context, "before");
+    HPD_LOG_INFO(context, "unsubscribe me");
+    HPD_LOG_INFO(context, "after");
+    log_flush(context->hpd);
+}
+
+TEST_F(CASE, unsubscribe_in_on_log) {
+    run(log_unsubscribe);
+
+    ASSERT_EQ(unsubscribing, nullptr);
+    ASSERT_EQ(unsubscribing_lines.size(), 2u);
+    ASSERT_NE(unsubscribing_lines[1].find("unsubscribe me"), std::string::npos);
+    // The other listener still gets everything
+    ASSERT_EQ(lines.size(), 3u);
+    ASSERT_NE(lines[2].find("after"), std::string::npos);
+}
+
+static void log_long(const hpd_module_t *context)
+{
+    HPD_LOG_INFO(context, "%s", std::string(2000, 'x').c_str());
+    HPD_LOG_INFO(context, "%s", std::string(LOG_BUFFER_SIZE + 100, 'y').c_str());
+    log_flush(context->hpd);
+}
+
+TEST_F(CASE, long_messages) {
+    run(log_long);
+
+    // Neither the record nor the line it is written as cuts the message
+    ASSERT_EQ(records.size(), 2u);
+    ASSERT_EQ(records[0], std::string(2000, 'x'));
+    ASSERT_EQ(records[1], std::string(LOG_BUFFER_SIZE + 100, 'y'));
+    ASSERT_EQ(lines.size(), 2u);
+    ASSERT_NE(lines[0].find(std::string(2000, 'x') + " "), std::string::npos);
+    ASSERT_NE(lines[1].find(std::string(LOG_BUFFER_SIZE + 100, 'y') + " "), std::string::npos);
+}
@@ -0,0 +1,113 @@
+/*
+ * Copyright 2011 Aalborg University. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are
+ * permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of
+ * conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list
+ * of conditions and the following disclaimer in the documentation and/or other materials
+ * provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY Aalborg University ''AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL Aalborg University OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are those of the
+ * authors and should not be interpreted as representing official policies, either expressed
+ */
+
+#include "hpd_test.h"
+#include <pthread.h>
+#include <string>
+
+#define CASE hpd_pool_api
+
+class CASE : public hpd_context_test {
+protected:
+    size_t live(hpd_pool_type_t type) {
+        size_t live = 0;
+        EXPECT_EQ(hpd_get_pool_stats(&context, type, &live, NULL), HPD_E_SUCCESS);
+        return live;
+    }
+
+    size_t high_water(hpd_pool_type_t type) {
+        size_t high_water = 0;
+        EXPECT_EQ(hpd_get_pool_stats(&context, type, NULL, &high_water), HPD_E_SUCCESS);
+        return high_water;
+    }
+};
+
+static void *free_value(void *value)
+{
+    hpd_value_free((hpd_value_t *) value);
+    return NULL;
+}
+
+TEST_F(CASE, errors) {
+    size_t live, high_water;
+
+    ASSERT_EQ(hpd_get_pool_stats(NULL, HPD_P_VALUE, &live, &high_water), HPD_E_NULL);
+    ASSERT_EQ(hpd_get_pool_stats(&context, HPD_P_VALUE, NULL, NULL), HPD_E_NULL);
+    ASSERT_EQ(hpd_get_pool_stats(&context, HPD_P_COUNT, &live, &high_water), HPD_E_ARGUMENT);
+    ASSERT_EQ(hpd_get_pool_stats(&context, (hpd_pool_type_t) -1, &live, &high_water), HPD_E_ARGUMENT);
+}
+
+TEST_F(CASE, values) {
+    hpd_value_t *value1, *value2, *copy;
+    std::string large(4096, 'x');
+
+    ASSERT_EQ(live(HPD_P_VALUE), 0u);
+    ASSERT_EQ(live(HPD_P_VALUE_DATA), 0u);
+
+    ASSERT_EQ(hpd_value_alloc(&value1, &context, "small", HPD_NULL_TERMINATED), HPD_E_SUCCESS);
+    ASSERT_EQ(hpd_value_alloc(&value2, &context, large.c_str(), HPD_NULL_TERMINATED), HPD_E_SUCCESS);
+    ASSERT_EQ(hpd_value_copy(&context, &copy, value1), HPD_E_SUCCESS);
+    ASSERT_EQ(live(HPD_P_VALUE), 3);
+    ASSERT_EQ(live(HPD_P_VALUE_DATA), 2);
+
+    ASSERT_EQ(hpd_value_free(value1), HPD_E_SUCCESS);
+    ASSERT_EQ(hpd_value_free(value2), HPD_E_SUCCESS);
+    ASSERT_EQ(live(HPD_P_VALUE), 1);
+    ASSERT_EQ(live(HPD_P_VALUE_DATA), 1);
+
+    ASSERT_EQ(hpd_value_free(copy), HPD_E_SUCCESS);
+    ASSERT_EQ(live(HPD_P_VALUE), 0u);
+    ASSERT_EQ(live(HPD_P_VALUE_DATA), 0u);
+    ASSERT_EQ(high_water(HPD_P_VALUE), 3);
+    ASSERT_EQ(high_water(HPD_P_VALUE_DATA), 2);
+}
+
+TEST_F(CASE, service_ids) {
+    hpd_service_id_t *id, *copy;
+
+    ASSERT_EQ(hpd_service_id_alloc(&id, &context, "adapter", "device", "service"), HPD_E_SUCCESS);
+    ASSERT_EQ(hpd_service_id_copy(&copy, id), HPD_E_SUCCESS);
+    ASSERT_EQ(live(HPD_P_SERVICE_ID), 2);
+    ASSERT_EQ(hpd_service_id_free(id), HPD_E_SUCCESS);
+    ASSERT_EQ(hpd_service_id_free(copy), HPD_E_SUCCESS);
+    ASSERT_EQ(live(HPD_P_SERVICE_ID), 0u);
+    ASSERT_EQ(high_water(HPD_P_SERVICE_ID), 2);
+}
+
+TEST_F(CASE, free_on_other_thread) {
+    hpd_value_t *value;
+    pthread_t thread;
+
+    for (int i = 0; i < 100; i++) {
+        ASSERT_EQ(hpd_value_alloc(&value, &context, "value", HPD_NULL_TERMINATED), HPD_E_SUCCESS);
+        ASSERT_EQ(pthread_create(&thread, NULL, free_value, value), 0);
+        ASSERT_EQ(pthread_join(thread, NULL), 0);
+    }
+    ASSERT_EQ(live(HPD_P_VALUE), 0u);
+    ASSERT_EQ(live(HPD_P_VALUE_DATA), 0u);
+    ASSERT_EQ(high_water(HPD_P_VALUE), 1);
+}
@@ -0,0 +1,227 @@
+/*
+ * Copyright 2011 Aalborg University. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are
+ * permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of
+ * conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list
+ * of conditions and the following disclaimer in the documentation and/or other materials
+ * provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY Aalborg University ''AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL Aalborg University OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are those of the
+ * authors and should not be interpreted as representing official policies, either expressed
+ */
+
+/*
+ * Counts the allocations made between handing a request or change to hpd and receiving it back on the other end. Once
+ * the pool holds the objects a round trip needs, there should be none. malloc(), calloc() and realloc() are replaced
+ * for the whole process, so this lives in its own executable.
+ */
+
+#include "hpd_test.h"
+
+#define CASE hpd_request_alloc
+
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t nmemb, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+
+static int counting = 0;
+static int allocations = 0;
+
+void *malloc(size_t size)
+{
+    if (counting) allocations++;
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+    if (counting) allocations++;
+    return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    if (counting) allocations++;
+    return __libc_realloc(ptr, size);
+}
+}
+
+typedef enum {
+    ROUND_TRIP_GET,
+    ROUND_TRIP_PUT,
+    ROUND_TRIP_CHANGED,
+} round_trip_t;
+
+typedef struct {
+    hpd_loop_test *test;
+    hpd_t *hpd;
+    const hpd_module_t *context;
+    round_trip_t round_trip;
+    hpd_adapter_t *adapter;
+    hpd_service_id_t *sid;
+    hpd_listener_t *listener;
+    hpd_value_t *value;
+    hpd_error_t rc;
+    int allocations;
+    int received;       ///< The first round trip is not counted, it fills the pool and libev's pending array
+} module_data_t;
+
+static module_data_t *module_data;
+
+static void on_received(module_data_t *data)
+{
+    counting = 0;
+    data->allocations = allocations;
+    // Send the next one after the current request has been freed
+    if (++data->received == 1) data->test->loop_again();
+    else hpd_stop(data->hpd);
+}
+
+static hpd_status_t on_action(void *data, hpd_request_t *req)
+{
+    return HPD_S_200;
+}
+
+static void on_response(void *data, const hpd_response_t *res)
+{
+    on_received(module_data);
+}
+
+static void on_change(void *data, const hpd_service_id_t *service, const hpd_value_t *val)
+{
+    on_received(module_data);
+}
+
+static void send(module_data_t *data)
+{
+    hpd_request_t *req;
+
+    // Only the value is allocated up front, what happens to it after it is handed over is counted
+    if ((data->rc = hpd_value_alloc(&data->value, data->context, "value", HPD_NULL_TERMINATED))) goto error;
+
+    allocations = 0;
+    counting = 1;
+    switch (data->round_trip) {
+        case ROUND_TRIP_GET:
+            if ((data->rc = hpd_request_alloc(&req, data->sid, HPD_M_GET, on_response))) goto error;
+            if ((data->rc = hpd_request(req))) goto error;
+            hpd_value_free(data->value);
+            break;
+        case ROUND_TRIP_PUT:
+            if ((data->rc = hpd_request_alloc(&req, data->sid, HPD_M_PUT, on_response))) goto error;
+            if ((data->rc = hpd_request_set_value(req, data->value))) goto error;
+            if ((data->rc = hpd_request(req))) goto error;
+            break;
+        case ROUND_TRIP_CHANGED:
+            if ((data->rc = hpd_id_changed(data->sid, data->value))) goto error;
+            break;
+    }
+    return;
+
+    error:
+    counting = 0;
+    hpd_stop(data->hpd);
+}
+
+static hpd_error_t start(module_data_t *module_data)
+{
+    hpd_error_t rc;
+    const hpd_module_t *context = module_data->context;
+    hpd_device_t *device;
+    hpd_service_t *service;
+
+    if ((rc = hpd_adapter_alloc(&module_data->adapter, context, "adapter"))) return rc;
+    if ((rc = hpd_adapter_attach(module_data->adapter))) return rc;
+    if ((rc = hpd_device_alloc(&device, context, "device"))) return rc;
+    if ((rc = hpd_device_attach(module_data->adapter, device))) return rc;
+    if ((rc = hpd_service_alloc(&service, context, "service"))) return rc;
+    if ((rc = hpd_service_set_action(service, HPD_M_GET, on_action))) return rc;
+    if ((rc = hpd_service_set_action(service, HPD_M_PUT, on_action))) return rc;
+    if ((rc = hpd_service_attach(device, service))) return rc;
+    if ((rc = hpd_service_id_alloc(&module_data->sid, context, "adapter", "device", "service"))) return rc;
+
+    if ((rc = hpd_listener_alloc(&module_data->listener, context))) return rc;
+    if ((rc = hpd_listener_set_value_callback(module_data->listener, on_change))) return rc;
+    return hpd_subscribe(module_data->listener);
+}
+
+static hpd_error_t stop(module_data_t *module_data)
+{
+    hpd_error_t rc;
+
+    if (module_data->listener && (rc = hpd_listener_free(module_data->listener))) return rc;
+    module_data->listener = NULL;
+    if (module_data->sid && (rc = hpd_service_id_free(module_data->sid))) return rc;
+    module_data->sid = NULL;
+    if (module_data->adapter && (rc = hpd_adapter_free(module_data->adapter))) return rc;
+    module_data->adapter = NULL;
+    return HPD_E_SUCCESS;
+}
+
+class CASE : public hpd_loop_test {
+protected:
+    virtual void SetUp() {
+        module_data = (module_data_t *) calloc(1, sizeof(module_data_t));
+        ASSERT_NE(module_data, nullptr);
+    }
+
+    virtual void TearDown() {
+        free(module_data);
+    }
+
+    virtual hpd_error_t on_start() {
+        module_data->test = this;
+        module_data->hpd = hpd;
+        module_data->context = context;
+        return start(module_data);
+    }
+
+    virtual hpd_error_t on_stop() {
+        return stop(module_data);
+    }
+
+    virtual void on_loop() {
+        send(module_data);
+    }
+
+    void run_round_trip(round_trip_t type) {
+        module_data->round_trip = type;
+        run();
+        ASSERT_EQ(module_data->rc, HPD_E_SUCCESS);
+        ASSERT_EQ(module_data->received, 2);
+    }
+};
+
+TEST_F(CASE, get_allocations)
+{
+    run_round_trip(ROUND_TRIP_GET);
+    ASSERT_EQ(module_data->allocations, 0);
+}
+
+TEST_F(CASE, put_allocations)
+{
+    run_round_trip(ROUND_TRIP_PUT);
+    ASSERT_EQ(module_data->allocations, 0);
+}
+
+TEST_F(CASE, changed_allocations)
+{
+    run_round_trip(ROUND_TRIP_CHANGED);
+    ASSERT_EQ(module_data->allocations, 0);
+}
@@ -0,0 +1,209 @@
+/*
+ * Copyright 2011 Aalborg University. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are
+ * permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of
+ * conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list
+ * of conditions and the following disclaimer in the documentation and/or other materials
+ * provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY Aalborg University ''AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL Aalborg University OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are those of the
+ * authors and should not be interpreted as representing official policies, either expressed
+ */
+
+
+/*
+ * Request queue throughput benchmark.
+ *
+ * A single service answers GET requests immediately. For each queue depth, that many requests are kept in flight:
+ * all are submitted at once, and the next batch is submitted when the last response of the current batch arrives.
+ * Prints requests/sec per depth, which should stay roughly flat as depth grows.
+ *
+ * Usage: bench_request_queue [hpd options]. The module itself takes no options.
+ */
+
+#include "hpd-0.6/hpd_api.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define BENCH_REQUESTS 200000
+
+static const int depths[] = { 1, 10, 100, 1000, 10000, 0 };
+
+typedef struct {
+    const hpd_module_t *context;
+    hpd_adapter_t *adapter;
+    hpd_service_id_t *sid;
+    const int *depth;
+    int outstanding;
+    int sent;
+    struct timespec start;
+} bench_t;
+
+static hpd_t *hpd;
+
+static hpd_error_t bench_on_create(void **data, const hpd_module_t *context);
+static hpd_error_t bench_on_destroy(void *data);
+static hpd_error_t bench_on_start(void *data);
+static hpd_error_t bench_on_stop(void *data);
+static hpd_error_t bench_on_parse_opt(void *data, const char *name, const char *arg);
+
+static hpd_module_def_t bench_def = {
+        bench_on_create,
+        bench_on_destroy,
+        bench_on_start,
+        bench_on_stop,
+        bench_on_parse_opt,
+};
+
+static double bench_elapsed(const struct timespec *start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double) (now.tv_sec - start->tv_sec) + (double) (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static hpd_status_t bench_on_get(void *data, hpd_request_t *req)
+{
+    return HPD_S_200;
+}
+
+static void bench_on_response(void *data, const hpd_response_t *res);
+
+static hpd_error_t bench_send_batch(bench_t *bench)
+{
+    hpd_error_t rc;
+    for (int i = 0; i < *bench->depth; i++) {
+        hpd_request_t *req;
+        if ((rc = hpd_request_alloc(&req, bench->sid, HPD_M_GET, bench_on_response))) return rc;
+        if ((rc = hpd_request_set_data(req, bench, NULL))) goto error_free;
+        if ((rc = hpd_request(req))) goto error_free;
+        bench->outstanding++;
+        bench->sent++;
+        continue;
+
+        error_free:
+        hpd_request_free(req);
+        return rc;
+    }
+    return HPD_E_SUCCESS;
+}
+
+static hpd_error_t bench_next_depth(bench_t *bench)
+{
+    if (!*bench->depth) {
+        hpd_stop(hpd);
+        return HPD_E_SUCCESS;
+    }
+    bench->sent = 0;
+    clock_gettime(CLOCK_MONOTONIC, &bench->start);
+    return bench_send_batch(bench);
+}
+
+static void bench_on_response(void *data, const hpd_response_t *res)
+{
+    hpd_error_t rc;
+    bench_t *bench;
+
+    if ((rc = hpd_response_get_request_data(res, (void **) &bench))) goto error;
+    if (--bench->outstanding > 0) return;
+
+    if (bench->sent < BENCH_REQUESTS) {
+        if ((rc = bench_send_batch(bench))) goto error;
+        return;
+    }
+
+    double secs = bench_elapsed(&bench->start);
+    printf("depth %6i: %8i requests in %7.3f s, %10.0f requests/s\n",
+           *bench->depth, bench->sent, secs, bench->sent / secs);
+    fflush(stdout);
+
+    bench->depth++;
+    if ((rc = bench_next_depth(bench))) goto error;
+    return;
+
+    error:
+    HPD_LOG_ERROR(bench->context, "Benchmark failed [code: %i].", rc);
+    hpd_stop(hpd);
+}
+
+static hpd_error_t bench_on_create(void **data, const hpd_module_t *context)
+{
+    bench_t *bench = calloc(1, sizeof(bench_t));
+    if (!bench) return HPD_E_ALLOC;
+    bench->context = context;
+    bench->depth = depths;
+    *data = bench;
+    return HPD_E_SUCCESS;
+}
+
+static hpd_error_t bench_on_destroy(void *data)
+{
+    free(data);
+    return HPD_E_SUCCESS;
+}
+
+static hpd_error_t bench_on_start(void *data)
+{
+    hpd_error_t rc;
+    bench_t *bench = data;
+    hpd_device_t *device;
+    hpd_service_t *service;
+
+    if ((rc = hpd_adapter_alloc(&bench->adapter, bench->context, "bench"))) return rc;
+    if ((rc = hpd_adapter_attach(bench->adapter))) return rc;
+    if ((rc = hpd_device_alloc(&device, bench->context, "device"))) return rc;
+    if ((rc = hpd_device_attach(bench->adapter, device))) return rc;
+    if ((rc = hpd_service_alloc(&service, bench->context, "service"))) return rc;
+    if ((rc = hpd_service_set_action(service, HPD_M_GET, bench_on_get))) return rc;
+    if ((rc = hpd_service_attach(device, service))) return rc;
+    if ((rc = hpd_service_id_alloc(&bench->sid, bench->context, "bench", "device", "service"))) return rc;
+
+    return bench_next_depth(bench);
+}
+
+static hpd_error_t bench_on_stop(void *data)
+{
+    hpd_error_t rc;
+    bench_t *bench = data;
+
+    if (bench->sid && (rc = hpd_service_id_free(bench->sid))) return rc;
+    bench->sid = NULL;
+    if (bench->adapter && (rc = hpd_adapter_free(bench->adapter))) return rc;
+    bench->adapter = NULL;
+    return HPD_E_SUCCESS;
+}
+
+static hpd_error_t bench_on_parse_opt(void *data, const char *name, const char *arg)
+{
+    return HPD_E_ARGUMENT;
+}
+
+int main(int argc, char *argv[])
+{
+    hpd_error_t rc;
+
+    if ((rc = hpd_alloc(&hpd))) return rc;
+    if ((rc = hpd_module(hpd, "bench", &bench_def))) goto error_free;
+    if ((rc = hpd_start(hpd, argc, argv))) goto error_free;
+    return hpd_free(hpd);
+
+    error_free:
+    hpd_free(hpd);
+    return rc;
+}
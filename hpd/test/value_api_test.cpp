@@ -0,0 +1,149 @@
+/*
+ * Copyright 2011 Aalborg University. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are
+ * permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list of
+ * conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this list
+ * of conditions and the following disclaimer in the documentation and/or other materials
+ * provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY Aalborg University ''AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL Aalborg University OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are those of the
+ * authors and should not be interpreted as representing official policies, either expressed
+ */
+
+
+#include "hpd_test.h"
+
+#define CASE hpd_value_api
+
+class CASE : public hpd_context_test {
+};
+
+TEST_F(CASE, alloc_null_terminated) {
+    hpd_value_t *value;
+    const char *body;
+    size_t len;
+
+    ASSERT_EQ(hpd_value_alloc(&value, &context, "hello", HPD_NULL_TERMINATED), HPD_E_SUCCESS);
+    ASSERT_EQ(hpd_value_get_body(value, &body, &len), HPD_E_SUCCESS);
+    ASSERT_EQ(len, 5u);
+    ASSERT_STREQ(body, "hello");
+    ASSERT_EQ(hpd_value_free(value), HPD_E_SUCCESS);
+}
+
+TEST_F(CASE, alloc_binary) {
+    const char data[] = { 'a', '\0', 'b', (char) 0xff, '\0' };
+    hpd_value_t *value, *copy;
+    const char *body;
+    size_t len;
+
+    ASSERT_EQ(hpd_value_alloc(&value, &context, data, sizeof(data)), HPD_E_SUCCESS);
+    ASSERT_EQ(hpd_value_get_body(value, &body, &len), HPD_E_SUCCESS);
+    ASSERT_EQ(len, sizeof(data));
+    ASSERT_EQ(memcmp(body, data, sizeof(data)), 0);
+    ASSERT_EQ(body[len], '\0');
+
+    ASSERT_EQ(hpd_value_copy(&context, &copy, value), HPD_E_SUCCESS);
+    ASSERT_EQ(hpd_value_free(value), HPD_E_SUCCESS);
+    ASSERT_EQ(hpd_value_get_body(copy, &body, &len), HPD_E_SUCCESS);
+    ASSERT_EQ(len, sizeof(data));
+    ASSERT_EQ(memcmp(body, data, sizeof(data)), 0);
+    ASSERT_EQ(hpd_value_free(copy), HPD_E_SUCCESS);
+}
+
+TEST_F(CASE, alloc_prefix) {
+    hpd_value_t *value;
+    const char *body;
+    size_t len;
+
+    ASSERT_EQ(hpd_value_alloc(&value, &context, "hello world", 5), HPD_E_SUCCESS);
+    ASSERT_EQ(hpd_value_get_body(value, &body, &len), HPD_E_SUCCESS);
+    ASSERT_EQ(len, 5u);
+    ASSERT_STREQ(body, "hello");
+    ASSERT_EQ(hpd_value_free(value), HPD_E_SUCCESS);
+}
+
+TEST_F(CASE, allocf) {
+    hpd_value_t *value;
+    const char *body;
+    size_t len;
+
+    ASSERT_EQ(hpd_value_allocf(&value, &context, "%s=%i", "x", 42), HPD_E_SUCCESS);
+    ASSERT_EQ(hpd_value_get_body(value, &body, &len), HPD_E_SUCCESS);
+    ASSERT_EQ(len, 4);
+    ASSERT_STREQ(body, "x=42");
+    ASSERT_EQ(hpd_value_free(value), HPD_E_SUCCESS);
+}
+
+TEST_F(CASE, ref_unref) {
+    hpd_value_t *value, *ref;
+    const char *body;
+
+    ASSERT_EQ(hpd_value_alloc(&value, &context, "hello", HPD_NULL_TERMINATED), HPD_E_SUCCESS);
+    ASSERT_EQ(hpd_value_ref(value, &ref), HPD_E_SUCCESS);
+    ASSERT_EQ(ref, value);
+
+    // Shared values are read-only
+    ASSERT_EQ(hpd_value_set_header(ref, "key", "val"), HPD_E_STATE);
+
+    ASSERT_EQ(hpd_value_unref(value), HPD_E_SUCCESS);
+    ASSERT_EQ(hpd_value_get_body(ref, &body, NULL), HPD_E_SUCCESS);
+    ASSERT_STREQ(body, "hello");
+    ASSERT_EQ(hpd_value_set_header(ref, "key", "val"), HPD_E_SUCCESS);
+    ASSERT_EQ(hpd_value_unref(ref), HPD_E_SUCCESS);
+}
+
+TEST_F(CASE, copy_on_write) {
+    hpd_value_t *value, *copy;
+    const char *body, *copy_body, *val;
+
+    ASSERT_EQ(hpd_value_alloc(&value, &context, "hello", HPD_NULL_TERMINATED), HPD_E_SUCCESS);
+    ASSERT_EQ(hpd_value_set_header(value, "a", "1"), HPD_E_SUCCESS);
+    ASSERT_EQ(hpd_value_copy(&context, &copy, value), HPD_E_SUCCESS);
+
+    // Body is shared until modified
+    ASSERT_EQ(hpd_value_get_body(value, &body, NULL), HPD_E_SUCCESS);
+    ASSERT_EQ(hpd_value_get_body(copy, &copy_body, NULL), HPD_E_SUCCESS);
+    ASSERT_EQ(body, copy_body);
+
+    ASSERT_EQ(hpd_value_set_header(copy, "a", "2"), HPD_E_SUCCESS);
+    ASSERT_EQ(hpd_value_get_body(copy, &copy_body, NULL), HPD_E_SUCCESS);
+    ASSERT_NE(body, copy_body);
+    ASSERT_STREQ(copy_body, "hello");
+
+    ASSERT_EQ(hpd_value_get_header(value, "a", &val), HPD_E_SUCCESS);
+    ASSERT_STREQ(val, "1");
+    ASSERT_EQ(hpd_value_get_header(copy, "a", &val), HPD_E_SUCCESS);
+    ASSERT_STREQ(val, "2");
+
+    ASSERT_EQ(hpd_value_free(value), HPD_E_SUCCESS);
+    ASSERT_EQ(hpd_value_get_header(copy, "a", &val), HPD_E_SUCCESS);
+    ASSERT_STREQ(val, "2");
+    ASSERT_EQ(hpd_value_free(copy), HPD_E_SUCCESS);
+}
+
+TEST_F(CASE, no_headers) {
+    hpd_value_t *value;
+    const hpd_pair_t *pair;
+    const char *val;
+
+    ASSERT_EQ(hpd_value_alloc(&value, &context, NULL, 0), HPD_E_SUCCESS);
+    ASSERT_EQ(hpd_value_get_header(value, "a", &val), HPD_E_NOT_FOUND);
+    ASSERT_EQ(hpd_value_first_header(value, &pair), HPD_E_SUCCESS);
+    ASSERT_EQ(pair, nullptr);
+    ASSERT_EQ(hpd_value_free(value), HPD_E_SUCCESS);
+}